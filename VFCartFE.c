@@ -81,37 +81,69 @@ extern PetscErrorCode VFCartFEElement1DCreate(VFCartFEElement1D *e)
 }
 
 #undef __FUNCT__
-#define __FUNCT__ "VFCartFEElement1DInit"
+#define __FUNCT__ "VFCartFEElement1DInitQuadrature"
 /*
-  VFCartFEElement1DInit
-
-  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+  VFCartFEElement1DInitQuadrature: same as VFCartFEElement1DInit using ng integration points:
+    ng = 3: 5th order Gauss rule
+    ng = 2: 3rd order Gauss rule, exact for the stiffness of a P1 element but not for its mass matrix 
+            times a P1 coefficient
 */
-extern PetscErrorCode VFCartFEElement1DInit(VFCartFEElement1D *e,PetscReal lx)
+extern PetscErrorCode VFCartFEElement1DInitQuadrature(VFCartFEElement1D *e,PetscReal lx,PetscInt ng)
 {
   PetscErrorCode ierr;
+  PetscInt       g;
   
   PetscFunctionBegin;
   ierr = VFCartFEElement1DCreate(e);CHKERRQ(ierr);
+  e->ng        = ng;
   e->lx        = lx;
   e->ly        = 0.;
   e->lz        = 0.;
   
-  e->weight[0] = 5.*e->lx / 18.;
-  e->weight[1] = 8.*e->lx / 18.;
-  e->weight[2] = 5.*e->lx / 18.;
-  /* 
-    Value of the basis function at the integration points 
-  */
-  e->phi[0][0][0][0] = (1. + sqrt(3./5.)) * .5; e->phi[0][0][0][1] = .5; e->phi[0][0][0][2] = (1. - sqrt(3./5.)) * .5; 
-  e->phi[0][0][1][0] = (1. - sqrt(3./5.)) * .5; e->phi[0][0][1][1] = .5; e->phi[0][0][1][2] = (1. + sqrt(3./5.)) * .5; 
-  
+  switch (ng) {
+  case 2:
+    e->weight[0] = .5*e->lx;
+    e->weight[1] = .5*e->lx;
+    e->phi[0][0][0][0] = (1. + sqrt(1./3.)) * .5; e->phi[0][0][0][1] = (1. - sqrt(1./3.)) * .5; 
+    e->phi[0][0][1][0] = (1. - sqrt(1./3.)) * .5; e->phi[0][0][1][1] = (1. + sqrt(1./3.)) * .5; 
+    break;
+  case 3:
+    e->weight[0] = 5.*e->lx / 18.;
+    e->weight[1] = 8.*e->lx / 18.;
+    e->weight[2] = 5.*e->lx / 18.;
+    /* 
+      Value of the basis function at the integration points 
+    */
+    e->phi[0][0][0][0] = (1. + sqrt(3./5.)) * .5; e->phi[0][0][0][1] = .5; e->phi[0][0][0][2] = (1. - sqrt(3./5.)) * .5; 
+    e->phi[0][0][1][0] = (1. - sqrt(3./5.)) * .5; e->phi[0][0][1][1] = .5; e->phi[0][0][1][2] = (1. + sqrt(3./5.)) * .5; 
+    break;
+  default:
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_OUTOFRANGE,"ERROR: %i points quadrature is not implemented in %s\n",ng,__FUNCT__);
+  }
   /* 
     Value of the derivative of the basis functions at the integration points
   */
-  e->dphi[0][0][0][0] = -1. / e->lx; e->dphi[0][0][0][1] = -1. / e->lx; e->dphi[0][0][0][2] = -1. / e->lx; 
-  e->dphi[0][0][1][0] =  1. / e->lx; e->dphi[0][0][1][1] =  1. / e->lx; e->dphi[0][0][1][2] =  1. / e->lx;
-  ierr = PetscLogFlops(24);CHKERRQ(ierr);
+  for (g = 0; g < e->ng; g++) {
+    e->dphi[0][0][0][g] = -1. / e->lx;
+    e->dphi[0][0][1][g] =  1. / e->lx;
+  }
+  ierr = PetscLogFlops(8 * e->ng);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEElement1DInit"
+/*
+  VFCartFEElement1DInit
+
+  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+*/
+extern PetscErrorCode VFCartFEElement1DInit(VFCartFEElement1D *e,PetscReal lx)
+{
+  PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  ierr = VFCartFEElement1DInitQuadrature(e,lx,3);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -128,6 +160,7 @@ extern PetscErrorCode VFCartFEElement2DCreate(VFCartFEElement2D *e)
   PetscFunctionBegin;
   e->dim       = 2;
   e->ng        = 9;
+  e->ng1D      = 3;
   e->nphix     = 2;
   e->nphiy     = 2;
   e->nphiz     = 1;
@@ -135,13 +168,12 @@ extern PetscErrorCode VFCartFEElement2DCreate(VFCartFEElement2D *e)
 }
 
 #undef __FUNCT__
-#define __FUNCT__ "VFCartFEElement2DInit"
+#define __FUNCT__ "VFCartFEElement2DInitQuadrature"
 /*
-  VFCartFEElement2DInit
-
-  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+  VFCartFEElement2DInitQuadrature: same as VFCartFEElement2DInit using the tensor product of the 
+  ng1D points rules of VFCartFEElement1DInitQuadrature
 */
-extern PetscErrorCode VFCartFEElement2DInit(VFCartFEElement2D *e,PetscReal lx,PetscReal ly)
+extern PetscErrorCode VFCartFEElement2DInitQuadrature(VFCartFEElement2D *e,PetscReal lx,PetscReal ly,PetscInt ng1D)
 {
   PetscErrorCode     ierr;
   VFCartFEElement1D   ex,ey;
@@ -150,11 +182,13 @@ extern PetscErrorCode VFCartFEElement2DInit(VFCartFEElement2D *e,PetscReal lx,Pe
   
   PetscFunctionBegin;
   ierr = VFCartFEElement1DCreate(&ex);CHKERRQ(ierr);
-  ierr = VFCartFEElement1DInit(&ex,lx);CHKERRQ(ierr);
+  ierr = VFCartFEElement1DInitQuadrature(&ex,lx,ng1D);CHKERRQ(ierr);
   ierr = VFCartFEElement1DCreate(&ey);CHKERRQ(ierr);
-  ierr = VFCartFEElement1DInit(&ey,ly);CHKERRQ(ierr);
+  ierr = VFCartFEElement1DInitQuadrature(&ey,ly,ng1D);CHKERRQ(ierr);
   
   ierr = VFCartFEElement2DCreate(e);CHKERRQ(ierr);
+  e->ng1D  = ng1D;
+  e->ng    = ng1D * ng1D;
   e->lx    = lx; 
   e->ly    = ly;
   e->lz    = 0;
@@ -187,6 +221,22 @@ extern PetscErrorCode VFCartFEElement2DInit(VFCartFEElement2D *e,PetscReal lx,Pe
   PetscFunctionReturn(0);
 }
 
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEElement2DInit"
+/*
+  VFCartFEElement2DInit
+
+  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+*/
+extern PetscErrorCode VFCartFEElement2DInit(VFCartFEElement2D *e,PetscReal lx,PetscReal ly)
+{
+  PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  ierr = VFCartFEElement2DInitQuadrature(e,lx,ly,3);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
 #undef __FUNCT__
 #define __FUNCT__ "VFCartFEElement3DCreate"
 /*
@@ -200,6 +250,7 @@ extern PetscErrorCode VFCartFEElement3DCreate(VFCartFEElement3D *e)
   PetscFunctionBegin;
   e->dim       = 3;
   e->ng        = 27;
+  e->ng1D      = 3;
   e->nphix     = 2;
   e->nphiy     = 2;
   e->nphiz     = 2;
@@ -207,13 +258,12 @@ extern PetscErrorCode VFCartFEElement3DCreate(VFCartFEElement3D *e)
 }
 
 #undef __FUNCT__
-#define __FUNCT__ "VFCartFEElement3DInit"
+#define __FUNCT__ "VFCartFEElement3DInitQuadrature"
 /*
-  VFCartFEElement3DInit
-
-  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+  VFCartFEElement3DInitQuadrature: same as VFCartFEElement3DInit using the tensor product of the 
+  ng1D points rules of VFCartFEElement1DInitQuadrature
 */
-extern PetscErrorCode VFCartFEElement3DInit(VFCartFEElement3D *e,PetscReal lx,PetscReal ly,PetscReal lz)
+extern PetscErrorCode VFCartFEElement3DInitQuadrature(VFCartFEElement3D *e,PetscReal lx,PetscReal ly,PetscReal lz,PetscInt ng1D)
 {
   PetscErrorCode     ierr;
   VFCartFEElement1D   ex,ey,ez;
@@ -222,13 +272,15 @@ extern PetscErrorCode VFCartFEElement3DInit(VFCartFEElement3D *e,PetscReal lx,Pe
   
   PetscFunctionBegin;
   ierr = VFCartFEElement1DCreate(&ex);CHKERRQ(ierr);
-  ierr = VFCartFEElement1DInit(&ex,lx);CHKERRQ(ierr);
+  ierr = VFCartFEElement1DInitQuadrature(&ex,lx,ng1D);CHKERRQ(ierr);
   ierr = VFCartFEElement1DCreate(&ey);CHKERRQ(ierr);
-  ierr = VFCartFEElement1DInit(&ey,ly);CHKERRQ(ierr);
+  ierr = VFCartFEElement1DInitQuadrature(&ey,ly,ng1D);CHKERRQ(ierr);
   ierr = VFCartFEElement1DCreate(&ez);CHKERRQ(ierr);
-  ierr = VFCartFEElement1DInit(&ez,lz);CHKERRQ(ierr);
+  ierr = VFCartFEElement1DInitQuadrature(&ez,lz,ng1D);CHKERRQ(ierr);
   
   ierr = VFCartFEElement3DCreate(e);CHKERRQ(ierr);
+  e->ng1D  = ng1D;
+  e->ng    = ng1D * ng1D * ng1D;
   e->lx    = lx; 
   e->ly    = ly;
   e->lz    = lz;
@@ -240,6 +292,16 @@ extern PetscErrorCode VFCartFEElement3DInit(VFCartFEElement3D *e,PetscReal lx,Pe
       }
     }
   }
+  for (g = 0; g < ex.ng; g++) {
+    for (i = 0; i < e->nphix; i++) {
+      e->phi1D[0][i][g]  = ex.phi[0][0][i][g];
+      e->dphi1D[0][i][g] = ex.dphi[0][0][i][g];
+      e->phi1D[1][i][g]  = ey.phi[0][0][i][g];
+      e->dphi1D[1][i][g] = ey.dphi[0][0][i][g];
+      e->phi1D[2][i][g]  = ez.phi[0][0][i][g];
+      e->dphi1D[2][i][g] = ez.dphi[0][0][i][g];
+    }
+  }
   for (g = 0,gk = 0; gk < ez.ng; gk++) {
     for (gj = 0; gj < ey.ng; gj++) {
       for (gi = 0; gi < ex.ng; gi++,g++) {
@@ -269,677 +331,1161 @@ extern PetscErrorCode VFCartFEElement3DInit(VFCartFEElement3D *e,PetscReal lx,Pe
 }
 
 #undef __FUNCT__
-#define __FUNCT__ "VecSetFromBC"
+#define __FUNCT__ "VFCartFEElement3DInit"
 /*
-  
-  VecSetFromBC:
-  
-  (c) 2014 Blaise Bourdin bourdin@lsu.edu
+  VFCartFEElement3DInit
+
+  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
 */
-extern PetscErrorCode VecSetFromBC(Vec BCVec,VFBC *BC)
+extern PetscErrorCode VFCartFEElement3DInit(VFCartFEElement3D *e,PetscReal lx,PetscReal ly,PetscReal lz)
 {
   PetscErrorCode ierr;
-  PetscInt       xs,xm,nx;
-  PetscInt       ys,ym,ny;
-  PetscInt       zs,zm,nz;
-  PetscInt       i,j,k,c;
-  PetscReal  ****BC_array,BCValue = 0.;
-  PetscInt       dof;
-  DM             da;
   
   PetscFunctionBegin;
-  ierr = VecGetDM(BCVec,&da);CHKERRQ(ierr);
-  ierr = DMDAGetInfo(da,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
-                    &dof,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
-  ierr = DMDAGetCorners(da,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  
-  ierr = DMDAVecGetArrayDOF(da,BCVec,&BC_array);CHKERRQ(ierr);
+  ierr = VFCartFEElement3DInitQuadrature(e,lx,ly,lz,3);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/*
+  VFCARTFE_SUMFACT_KERNELS(NG) instantiates the sum factorization kernels of the Q1 element (2 basis functions 
+  along each axis) with NG integration points along each axis. All loop bounds and scratch arrays are compile 
+  time constants so that the loops can be unrolled and vectorized. 
+  They perform the same operations in the same order as the generic kernels, so that the results are identical.
+*/
+#define VFCARTFE_SUMFACT_KERNELS(NG) \
+static void VFCartFEElement3DInterpolate_##NG(const VFCartFEElement3D *e,const PetscReal *f_local,PetscReal *f_elem,PetscReal *df_elem) \
+{ \
+  PetscInt  j,k,gi,gj,gk,g; \
+  PetscReal A[2][2][NG],Ax[2][2][NG]; \
+  PetscReal B[2][NG][NG],Bx[2][NG][NG],By[2][NG][NG]; \
+  \
+  for (k = 0; k < 2; k++) { \
+    for (j = 0; j < 2; j++) { \
+      for (gi = 0; gi < NG; gi++) { \
+        A[k][j][gi]  = 0. + f_local[(k*2+j)*2] * e->phi1D[0][0][gi]  + f_local[(k*2+j)*2+1] * e->phi1D[0][1][gi]; \
+        Ax[k][j][gi] = 0. + f_local[(k*2+j)*2] * e->dphi1D[0][0][gi] + f_local[(k*2+j)*2+1] * e->dphi1D[0][1][gi]; \
+      } \
+    } \
+  } \
+  for (k = 0; k < 2; k++) { \
+    for (gj = 0; gj < NG; gj++) { \
+      for (gi = 0; gi < NG; gi++) { \
+        B[k][gj][gi]  = 0. + A[k][0][gi]  * e->phi1D[1][0][gj]  + A[k][1][gi]  * e->phi1D[1][1][gj]; \
+        Bx[k][gj][gi] = 0. + Ax[k][0][gi] * e->phi1D[1][0][gj]  + Ax[k][1][gi] * e->phi1D[1][1][gj]; \
+        By[k][gj][gi] = 0. + A[k][0][gi]  * e->dphi1D[1][0][gj] + A[k][1][gi]  * e->dphi1D[1][1][gj]; \
+      } \
+    } \
+  } \
+  if (f_elem) { \
+    for (g = 0,gk = 0; gk < NG; gk++) { \
+      for (gj = 0; gj < NG; gj++) { \
+        for (gi = 0; gi < NG; gi++,g++) { \
+          f_elem[g] = 0. + B[0][gj][gi] * e->phi1D[2][0][gk] + B[1][gj][gi] * e->phi1D[2][1][gk]; \
+        } \
+      } \
+    } \
+  } \
+  if (df_elem) { \
+    for (g = 0,gk = 0; gk < NG; gk++) { \
+      for (gj = 0; gj < NG; gj++) { \
+        for (gi = 0; gi < NG; gi++,g++) { \
+          df_elem[g]            = 0. + Bx[0][gj][gi] * e->phi1D[2][0][gk]  + Bx[1][gj][gi] * e->phi1D[2][1][gk]; \
+          df_elem[NG*NG*NG+g]   = 0. + By[0][gj][gi] * e->phi1D[2][0][gk]  + By[1][gj][gi] * e->phi1D[2][1][gk]; \
+          df_elem[2*NG*NG*NG+g] = 0. + B[0][gj][gi]  * e->dphi1D[2][0][gk] + B[1][gj][gi]  * e->dphi1D[2][1][gk]; \
+        } \
+      } \
+    } \
+  } \
+} \
+\
+static void VFCartFEElement3DIntegrate_##NG(const VFCartFEElement3D *e,const PetscReal *f_elem,const PetscReal *df_elem,PetscReal *residual_local) \
+{ \
+  PetscInt  i,j,k,gi,gj,gk,g; \
+  PetscReal F,Fx,Fy,Fz; \
+  PetscReal C[2][NG][NG],Cx[2][NG][NG],Cy[2][NG][NG]; \
+  PetscReal D[2][2][NG],Dx[2][2][NG]; \
+  \
+  for (k = 0; k < 2; k++) { \
+    for (gj = 0; gj < NG; gj++) { \
+      for (gi = 0; gi < NG; gi++) { \
+        C[k][gj][gi]  = 0.; \
+        Cx[k][gj][gi] = 0.; \
+        Cy[k][gj][gi] = 0.; \
+      } \
+    } \
+  } \
+  for (g = 0,gk = 0; gk < NG; gk++) { \
+    for (gj = 0; gj < NG; gj++) { \
+      for (gi = 0; gi < NG; gi++,g++) { \
+        F  = f_elem  ? e->weight[g] * f_elem[g] : 0.; \
+        Fx = df_elem ? e->weight[g] * df_elem[g] : 0.; \
+        Fy = df_elem ? e->weight[g] * df_elem[NG*NG*NG+g] : 0.; \
+        Fz = df_elem ? e->weight[g] * df_elem[2*NG*NG*NG+g] : 0.; \
+        for (k = 0; k < 2; k++) { \
+          C[k][gj][gi]  += F * e->phi1D[2][k][gk] + Fz * e->dphi1D[2][k][gk]; \
+          Cx[k][gj][gi] += Fx * e->phi1D[2][k][gk]; \
+          Cy[k][gj][gi] += Fy * e->phi1D[2][k][gk]; \
+        } \
+      } \
+    } \
+  } \
+  for (k = 0; k < 2; k++) { \
+    for (j = 0; j < 2; j++) { \
+      for (gi = 0; gi < NG; gi++) { \
+        D[k][j][gi]  = 0.; \
+        Dx[k][j][gi] = 0.; \
+        for (gj = 0; gj < NG; gj++) { \
+          D[k][j][gi]  += C[k][gj][gi] * e->phi1D[1][j][gj] + Cy[k][gj][gi] * e->dphi1D[1][j][gj]; \
+          Dx[k][j][gi] += Cx[k][gj][gi] * e->phi1D[1][j][gj]; \
+        } \
+      } \
+    } \
+  } \
+  for (k = 0; k < 2; k++) { \
+    for (j = 0; j < 2; j++) { \
+      for (i = 0; i < 2; i++) { \
+        for (gi = 0; gi < NG; gi++) { \
+          residual_local[(k*2+j)*2+i] += D[k][j][gi] * e->phi1D[0][i][gi] + Dx[k][j][gi] * e->dphi1D[0][i][gi]; \
+        } \
+      } \
+    } \
+  } \
+}
+
+VFCARTFE_SUMFACT_KERNELS(2)
+VFCARTFE_SUMFACT_KERNELS(3)
+
+/*
+  Generic sum factorization kernels, for any number of basis functions and integration points
+*/
+static void VFCartFEElement3DInterpolate_Generic(const VFCartFEElement3D *e,const PetscReal *f_local,PetscReal *f_elem,PetscReal *df_elem)
+{
+  PetscInt       i,j,k,gi,gj,gk,g;
+  PetscReal      A[2][2][VFCARTFE_MAXNG1D],Ax[2][2][VFCARTFE_MAXNG1D];
+  PetscReal      B[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D],Bx[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D],By[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D];
   
-  for (c = 0;c < dof;c++) {
-    /* 
-      Faces
-    */
-    if (xs == 0 && BC[c].face[X0] != NONE) {
-      /*
-        x == 0
-      */
-      switch(BC[c].face[X0]) {
-        case ZERO:
-          BCValue = 0.;
-          break;
-        case ONE:
-          BCValue = 1.;
-          break;
-        case FIXED:
-          BCValue = BC[c].faceValue[X0];
-          break;
-        case NONE:
-          break;
-      }      
-      for (k = zs; k < zs + zm; k++) {
-        for (j = ys; j < ys + ym; j++) {
-          BC_array[k][j][0][c] = BCValue;
+  /*
+    Contraction along x
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (j = 0; j < e->nphiy; j++) {
+      for (gi = 0; gi < e->ng1D; gi++) {
+        A[k][j][gi]  = 0.;
+        Ax[k][j][gi] = 0.;
+        for (i = 0; i < e->nphix; i++) {
+          A[k][j][gi]  += f_local[(k*e->nphiy+j)*e->nphix+i] * e->phi1D[0][i][gi];
+          Ax[k][j][gi] += f_local[(k*e->nphiy+j)*e->nphix+i] * e->dphi1D[0][i][gi];
         }
       }
     }
-
-    if (xs + xm == nx && BC[c].face[X1] != NONE) {
-      /*
-        x == nx-1
-      */
-      switch(BC[c].face[X1]) {
-        case ZERO:
-          BCValue = 0.;
-          break;
-        case ONE:
-          BCValue = 1.;
-          break;
-        case FIXED:
-          BCValue = BC[c].faceValue[X1];
-          break;
-        case NONE:
-          break;
-      }      
-      for (k = zs; k < zs + zm; k++) {
-        for (j = ys; j < ys + ym; j++) {
-          BC_array[k][j][nx-1][c] = BCValue;
+  }
+  /*
+    Contraction along y
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (gj = 0; gj < e->ng1D; gj++) {
+      for (gi = 0; gi < e->ng1D; gi++) {
+        B[k][gj][gi]  = 0.;
+        Bx[k][gj][gi] = 0.;
+        By[k][gj][gi] = 0.;
+        for (j = 0; j < e->nphiy; j++) {
+          B[k][gj][gi]  += A[k][j][gi]  * e->phi1D[1][j][gj];
+          Bx[k][gj][gi] += Ax[k][j][gi] * e->phi1D[1][j][gj];
+          By[k][gj][gi] += A[k][j][gi]  * e->dphi1D[1][j][gj];
         }
       }
     }
-
-    if (ys == 0 && BC[c].face[Y0] != NONE) {
-      /*
-        y == 0
-      */
-      switch(BC[c].face[Y0]) {
-        case ZERO:
-          BCValue = 0.;
-          break;
-        case ONE:
-          BCValue = 1.;
-          break;
-        case FIXED:
-          BCValue = BC[c].faceValue[Y0];
-          break;
-        case NONE:
-          break;
-      }      
-      for (k = zs; k < zs + zm; k++) {
-        for (i = xs; i < xs + xm; i++) {
-          BC_array[k][0][i][c] = BCValue;
+  }
+  /*
+    Contraction along z
+  */
+  for (g = 0,gk = 0; gk < e->ng1D; gk++) {
+    for (gj = 0; gj < e->ng1D; gj++) {
+      for (gi = 0; gi < e->ng1D; gi++,g++) {
+        if (f_elem) {
+          f_elem[g] = 0.;
+          for (k = 0; k < e->nphiz; k++) f_elem[g] += B[k][gj][gi] * e->phi1D[2][k][gk];
+        }
+        if (df_elem) {
+          df_elem[g] = 0.; df_elem[e->ng+g] = 0.; df_elem[2*e->ng+g] = 0.;
+          for (k = 0; k < e->nphiz; k++) {
+            df_elem[g]           += Bx[k][gj][gi] * e->phi1D[2][k][gk];
+            df_elem[e->ng+g]     += By[k][gj][gi] * e->phi1D[2][k][gk];
+            df_elem[2*e->ng+g]   += B[k][gj][gi]  * e->dphi1D[2][k][gk];
+          }
         }
       }
     }
-    if (ys + ym == ny && BC[c].face[Y1] != NONE) {
-      /*
-        y == ny-1
-      */
-      switch(BC[c].face[Y1]) {
-        case ZERO:
-          BCValue = 0.;
-          break;
-        case ONE:
-          BCValue = 1.;
-          break;
-        case FIXED:
-          BCValue = BC[c].faceValue[Y1];
-          break;
-        case NONE:
-          break;
-      }      
-      for (k = zs; k < zs + zm; k++) {
-        for (i = xs; i < xs + xm; i++) {
-          BC_array[k][ny-1][i][c] = BCValue;
+  }
+}
+
+static void VFCartFEElement3DIntegrate_Generic(const VFCartFEElement3D *e,const PetscReal *f_elem,const PetscReal *df_elem,PetscReal *residual_local)
+{
+  PetscInt       i,j,k,gi,gj,gk,g;
+  PetscReal      F,Fx,Fy,Fz;
+  PetscReal      C[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D],Cx[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D],Cy[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D];
+  PetscReal      D[2][2][VFCARTFE_MAXNG1D],Dx[2][2][VFCARTFE_MAXNG1D];
+  
+  /*
+    Contraction along z
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (gj = 0; gj < e->ng1D; gj++) {
+      for (gi = 0; gi < e->ng1D; gi++) {
+        C[k][gj][gi]  = 0.;
+        Cx[k][gj][gi] = 0.;
+        Cy[k][gj][gi] = 0.;
+      }
+    }
+  }
+  for (g = 0,gk = 0; gk < e->ng1D; gk++) {
+    for (gj = 0; gj < e->ng1D; gj++) {
+      for (gi = 0; gi < e->ng1D; gi++,g++) {
+        F  = f_elem  ? e->weight[g] * f_elem[g] : 0.;
+        Fx = df_elem ? e->weight[g] * df_elem[g] : 0.;
+        Fy = df_elem ? e->weight[g] * df_elem[e->ng+g] : 0.;
+        Fz = df_elem ? e->weight[g] * df_elem[2*e->ng+g] : 0.;
+        for (k = 0; k < e->nphiz; k++) {
+          C[k][gj][gi]  += F * e->phi1D[2][k][gk] + Fz * e->dphi1D[2][k][gk];
+          Cx[k][gj][gi] += Fx * e->phi1D[2][k][gk];
+          Cy[k][gj][gi] += Fy * e->phi1D[2][k][gk];
         }
       }
     }
-    if (zs == 0 && BC[c].face[Z0] != NONE) {
-        /*
-          z == 0
-        */
-      switch(BC[c].face[Z0]) {
-        case ZERO:
-          BCValue = 0.;
-          break;
-        case ONE:
-          BCValue = 1.;
-          break;
-        case FIXED:
-          BCValue = BC[c].faceValue[Z0];
-          break;
-        case NONE:
-          break;
-      }      
-      for (j = ys; j < ys + ym; j++) {
-        for (i = xs; i < xs + xm; i++) {
-          BC_array[0][j][i][c] = BCValue;
+  }
+  /*
+    Contraction along y
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (j = 0; j < e->nphiy; j++) {
+      for (gi = 0; gi < e->ng1D; gi++) {
+        D[k][j][gi]  = 0.;
+        Dx[k][j][gi] = 0.;
+        for (gj = 0; gj < e->ng1D; gj++) {
+          D[k][j][gi]  += C[k][gj][gi] * e->phi1D[1][j][gj] + Cy[k][gj][gi] * e->dphi1D[1][j][gj];
+          Dx[k][j][gi] += Cx[k][gj][gi] * e->phi1D[1][j][gj];
         }
       }
     }
-    if (zs + zm == nz && BC[c].face[Z1] != NONE) {
-      /*
-        z == nz-1
-      */
-      switch(BC[c].face[Z1]) {
-        case ZERO:
-          BCValue = 0.;
-          break;
-        case ONE:
-          BCValue = 1.;
-          break;
-        case FIXED:
-          BCValue = BC[c].faceValue[Z1];
-          break;
-        case NONE:
-          break;
-      }      
-      for (j = ys; j < ys + ym; j++) {
-        for (i = xs; i < xs + xm; i++) {
-          BC_array[nz-1][j][i][c] = BCValue;
+  }
+  /*
+    Contraction along x
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (j = 0; j < e->nphiy; j++) {
+      for (i = 0; i < e->nphix; i++) {
+        for (gi = 0; gi < e->ng1D; gi++) {
+          residual_local[(k*e->nphiy+j)*e->nphix+i] += D[k][j][gi] * e->phi1D[0][i][gi] + Dx[k][j][gi] * e->dphi1D[0][i][gi];
         }
       }
     }
-    /*
-      edges
-    */
-    /* 
-      vertices
-    */
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == FIXED) BC_array[0][0][0][c]          = BC[c].vertexValue[X0Y0Z0];
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == ONE)   BC_array[0][0][0][c]          = 1.;
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == ZERO)  BC_array[0][0][0][c]          = 0.;
-
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == FIXED) BC_array[nz-1][0][0][c]       = BC[c].vertexValue[X0Y0Z1];
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == ONE)   BC_array[nz-1][0][0][c]       = 1.;
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == ZERO)  BC_array[nz-1][0][0][c]       = 0.;
-
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == FIXED) BC_array[0][ny-1][0][c]       = BC[c].vertexValue[X0Y1Z0];
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == ONE)   BC_array[0][ny-1][0][c]       = 1.;
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == ZERO)  BC_array[0][ny-1][0][c]       = 0.;
-
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == FIXED) BC_array[nz-1][ny-1][0][c]    = BC[c].vertexValue[X0Y1Z1];
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == ONE)   BC_array[nz-1][ny-1][0][c]    = 1.;
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == ZERO)  BC_array[nz-1][ny-1][0][c]    = 0.;
-
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == FIXED) BC_array[0][0][nx-1][c]       = BC[c].vertexValue[X1Y0Z0];
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == ONE)   BC_array[0][0][nx-1][c]       = 1.;
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == ZERO)  BC_array[0][0][nx-1][c]       = 0.;
-
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == FIXED) BC_array[nz-1][0][nx-1][c]    = BC[c].vertexValue[X1Y0Z1];
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == ONE)   BC_array[nz-1][0][nx-1][c]    = 1.;
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == ZERO)  BC_array[nz-1][0][nx-1][c]    = 0.;
-
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == FIXED) BC_array[0][ny-1][nx-1][c]    = BC[c].vertexValue[X1Y1Z0];
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == ONE)   BC_array[0][ny-1][nx-1][c]    = 1.;
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == ZERO)  BC_array[0][ny-1][nx-1][c]    = 0.;
-
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == FIXED) BC_array[nz-1][ny-1][nx-1][c] = BC[c].vertexValue[X1Y1Z1];
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == ONE)   BC_array[nz-1][ny-1][nx-1][c] = 1.;
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == ZERO)  BC_array[nz-1][ny-1][nx-1][c] = 0.;
   }
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEElement3DInterpolate"
+/*
+  VFCartFEElement3DInterpolate: computes the values f_elem[g] and the derivatives df_elem[l*ng+g] w.r.t. x_l 
+  at the integration points of the field whose nodal values are f_local[(k*nphiy+j)*nphix+i].
+  Either f_elem or df_elem can be NULL.
   
-  ierr = DMDAVecRestoreArrayDOF(da,BCVec,&BC_array);CHKERRQ(ierr);
+  The element is a tensor product, so the 1D tables are contracted one axis at a time (sum factorization) 
+  instead of looping over all basis functions at all integration points.
+*/
+extern PetscErrorCode VFCartFEElement3DInterpolate(VFCartFEElement3D *e,const PetscReal *f_local,PetscReal *f_elem,PetscReal *df_elem)
+{
+  PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  if (e->nphix == 2 && e->nphiy == 2 && e->nphiz == 2 && e->ng1D == 2) {
+    VFCartFEElement3DInterpolate_2(e,f_local,f_elem,df_elem);
+  } else if (e->nphix == 2 && e->nphiy == 2 && e->nphiz == 2 && e->ng1D == 3) {
+    VFCartFEElement3DInterpolate_3(e,f_local,f_elem,df_elem);
+  } else {
+    VFCartFEElement3DInterpolate_Generic(e,f_local,f_elem,df_elem);
+  }
+  ierr = PetscLogFlops(8 * 4 * e->ng1D + 12 * 2 * e->ng1D * e->ng1D + 8 * e->ng);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
-  
 
 #undef __FUNCT__
-#define __FUNCT__ "VecApplyDirichletBC"
+#define __FUNCT__ "VFCartFEElement3DIntegrate"
 /*
-  VecApplyDirichletBC
-
-  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+  VFCartFEElement3DIntegrate: accumulates in residual_local[(k*nphiy+j)*nphix+i] the integrals over the element of
+    f . phi[k][j][i] + \sum_l df_l . dphi[k][j][i][l]
+  where f and df_l are given by their values f_elem[g] and df_elem[l*ng+g] at the integration points. 
+  Either f_elem or df_elem can be NULL.
+  
+  This is the transpose of VFCartFEElement3DInterpolate, and is also evaluated by sum factorization.
 */
-extern PetscErrorCode VecApplyDirichletBC(Vec RHS,Vec BCU,VFBC *BC)
+extern PetscErrorCode VFCartFEElement3DIntegrate(VFCartFEElement3D *e,const PetscReal *f_elem,const PetscReal *df_elem,PetscReal *residual_local)
 {
   PetscErrorCode ierr;
-  PetscInt       xs,xm,nx;
-  PetscInt       ys,ym,ny;
-  PetscInt       zs,zm,nz;
-  PetscInt       i,j,k,c;
-  PetscReal  ****RHS_array;
-  PetscReal  ****BCU_array;
-  PetscInt       dim,dof;
-  DM             da;
   
   PetscFunctionBegin;
-  ierr = VecGetDM(RHS,&da);CHKERRQ(ierr);
-  ierr = DMDAGetInfo(da,&dim,&nx,&ny,&nz,NULL,NULL,NULL,
-                    &dof,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
-  ierr = DMDAGetCorners(da,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  
-  if (dim == 2) {
-    ierr = PetscMalloc(sizeof(PetscReal ***),&RHS_array);CHKERRQ(ierr);
-    ierr = PetscMalloc(sizeof(PetscReal ***),&BCU_array);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOF(da,RHS,&RHS_array[0]);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOF(da,BCU,&BCU_array[0]);CHKERRQ(ierr);
+  if (e->nphix == 2 && e->nphiy == 2 && e->nphiz == 2 && e->ng1D == 2) {
+    VFCartFEElement3DIntegrate_2(e,f_elem,df_elem,residual_local);
+  } else if (e->nphix == 2 && e->nphiy == 2 && e->nphiz == 2 && e->ng1D == 3) {
+    VFCartFEElement3DIntegrate_3(e,f_elem,df_elem,residual_local);
   } else {
-    ierr = DMDAVecGetArrayDOF(da,RHS,&RHS_array);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOF(da,BCU,&BCU_array);CHKERRQ(ierr);
+    VFCartFEElement3DIntegrate_Generic(e,f_elem,df_elem,residual_local);
   }
+  ierr = PetscLogFlops(4 * e->ng + 8 * e->ng * e->nphiz + 12 * 2 * e->ng1D * e->ng1D + 4 * 4 * e->ng1D);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/*
+  VFCartFEElement3DInterpolateBatch_Kernel: VFCartFEElement3DInterpolateBatch without PETSc calls, adds its flops to *flops
+*/
+extern void VFCartFEElement3DInterpolateBatch_Kernel(VFCartFEElement3D *e,const PetscReal *f_local,PetscReal *f_elem,PetscReal *df_elem,PetscLogDouble *flops)
+{
+  PetscInt       i,j,k,gi,gj,gk,g,b;
+  PetscReal      phi,dphi;
+  PetscReal      A[2][2][VFCARTFE_MAXNG1D][VFCARTFE_BATCH],Ax[2][2][VFCARTFE_MAXNG1D][VFCARTFE_BATCH];
+  PetscReal      B[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D][VFCARTFE_BATCH];
+  PetscReal      Bx[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D][VFCARTFE_BATCH];
+  PetscReal      By[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D][VFCARTFE_BATCH];
+  const PetscReal *f;
   
-  for (c = 0;c < dof;c++) {
-    /* 
-      Faces
-    */
-    if (xs == 0) {
-      /*
-        x == 0
-      */
-      i = 0;
-      if (BC[c].face[X0] == FIXED) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            RHS_array[k][j][i][c] = BCU_array[k][j][i][c];
-          }
-        }
-      }
-      if (BC[c].face[X0] == ONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            RHS_array[k][j][i][c] = 1.;
-          }
-        }
-      }
-      if (BC[c].face[X0] == ZERO) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            RHS_array[k][j][i][c] = 0.;
+  /*
+    Contraction along x
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (j = 0; j < e->nphiy; j++) {
+      for (gi = 0; gi < e->ng1D; gi++) {
+        for (b = 0; b < VFCARTFE_BATCH; b++) {
+          A[k][j][gi][b]  = 0.;
+          Ax[k][j][gi][b] = 0.;
+        }
+        for (i = 0; i < e->nphix; i++) {
+          f    = &f_local[((k*e->nphiy+j)*e->nphix+i)*VFCARTFE_BATCH];
+          phi  = e->phi1D[0][i][gi];
+          dphi = e->dphi1D[0][i][gi];
+          for (b = 0; b < VFCARTFE_BATCH; b++) {
+            A[k][j][gi][b]  += f[b] * phi;
+            Ax[k][j][gi][b] += f[b] * dphi;
           }
         }
       }
     }
-    if (xs + xm == nx) {
-      /*
-        x == nx-1
-      */
-      i = nx-1;
-      if (BC[c].face[X1] == FIXED) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            RHS_array[k][j][i][c] = BCU_array[k][j][i][c];
-          }
-        }
-      }
-      if (BC[c].face[X1] == ONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            RHS_array[k][j][i][c] = 1.;
-          }
-        }
-      }
-      if (BC[c].face[X1] == ZERO) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            RHS_array[k][j][i][c] = 0.;
+  }
+  /*
+    Contraction along y
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (gj = 0; gj < e->ng1D; gj++) {
+      for (gi = 0; gi < e->ng1D; gi++) {
+        for (b = 0; b < VFCARTFE_BATCH; b++) {
+          B[k][gj][gi][b]  = 0.;
+          Bx[k][gj][gi][b] = 0.;
+          By[k][gj][gi][b] = 0.;
+        }
+        for (j = 0; j < e->nphiy; j++) {
+          phi  = e->phi1D[1][j][gj];
+          dphi = e->dphi1D[1][j][gj];
+          for (b = 0; b < VFCARTFE_BATCH; b++) {
+            B[k][gj][gi][b]  += A[k][j][gi][b]  * phi;
+            Bx[k][gj][gi][b] += Ax[k][j][gi][b] * phi;
+            By[k][gj][gi][b] += A[k][j][gi][b]  * dphi;
           }
         }
       }
     }
-    if (ys == 0) {
-      /*
-        y == 0
-      */
-      j = 0;
-      if (BC[c].face[Y0] == FIXED) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            RHS_array[k][j][i][c] = BCU_array[k][j][i][c];
+  }
+  /*
+    Contraction along z
+  */
+  for (g = 0,gk = 0; gk < e->ng1D; gk++) {
+    for (gj = 0; gj < e->ng1D; gj++) {
+      for (gi = 0; gi < e->ng1D; gi++,g++) {
+        if (f_elem) {
+          for (b = 0; b < VFCARTFE_BATCH; b++) f_elem[g*VFCARTFE_BATCH+b] = 0.;
+          for (k = 0; k < e->nphiz; k++) {
+            phi = e->phi1D[2][k][gk];
+            for (b = 0; b < VFCARTFE_BATCH; b++) f_elem[g*VFCARTFE_BATCH+b] += B[k][gj][gi][b] * phi;
           }
         }
-      }
-      if (BC[c].face[Y0] == ONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            RHS_array[k][j][i][c] = 1.;
+        if (df_elem) {
+          for (b = 0; b < VFCARTFE_BATCH; b++) {
+            df_elem[g*VFCARTFE_BATCH+b]           = 0.;
+            df_elem[(e->ng+g)*VFCARTFE_BATCH+b]   = 0.;
+            df_elem[(2*e->ng+g)*VFCARTFE_BATCH+b] = 0.;
           }
-        }
-      }
-      if (BC[c].face[Y0] == ZERO) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            RHS_array[k][j][i][c] = 0.;
+          for (k = 0; k < e->nphiz; k++) {
+            phi  = e->phi1D[2][k][gk];
+            dphi = e->dphi1D[2][k][gk];
+            for (b = 0; b < VFCARTFE_BATCH; b++) {
+              df_elem[g*VFCARTFE_BATCH+b]           += Bx[k][gj][gi][b] * phi;
+              df_elem[(e->ng+g)*VFCARTFE_BATCH+b]   += By[k][gj][gi][b] * phi;
+              df_elem[(2*e->ng+g)*VFCARTFE_BATCH+b] += B[k][gj][gi][b]  * dphi;
+            }
           }
         }
       }
     }
-    if (ys + ym == ny) {
-      /*
-        y == ny-1
-      */
-      j = ny-1;
-      if (BC[c].face[Y1] == FIXED) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            RHS_array[k][j][i][c] = BCU_array[k][j][i][c];
-          }
+  }
+  *flops += VFCARTFE_BATCH * (8 * 4 * e->ng1D + 12 * 2 * e->ng1D * e->ng1D + 8 * e->ng);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEElement3DInterpolateBatch"
+/*
+  VFCartFEElement3DInterpolateBatch: VFCartFEElement3DInterpolate for VFCARTFE_BATCH cells sharing the same element.
+  The index b of the cell in the batch is the fastest index of all arrays:
+    f_local[l*VFCARTFE_BATCH+b], f_elem[g*VFCARTFE_BATCH+b], df_elem[(d*ng+g)*VFCARTFE_BATCH+b]
+  so that each operation of the sum factorization is applied to all the cells of the batch at once.
+*/
+extern PetscErrorCode VFCartFEElement3DInterpolateBatch(VFCartFEElement3D *e,const PetscReal *f_local,PetscReal *f_elem,PetscReal *df_elem)
+{
+  PetscErrorCode ierr;
+  PetscLogDouble flops = 0.;
+  
+  PetscFunctionBegin;
+  VFCartFEElement3DInterpolateBatch_Kernel(e,f_local,f_elem,df_elem,&flops);
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/*
+  VFCartFEElement3DIntegrateBatch_Kernel: VFCartFEElement3DIntegrateBatch without PETSc calls, adds its flops to *flops
+*/
+extern void VFCartFEElement3DIntegrateBatch_Kernel(VFCartFEElement3D *e,const PetscReal *f_elem,const PetscReal *df_elem,PetscReal *residual_local,PetscLogDouble *flops)
+{
+  PetscInt       i,j,k,gi,gj,gk,g,b;
+  PetscReal      phi,dphi;
+  PetscReal      F[VFCARTFE_BATCH],Fx[VFCARTFE_BATCH],Fy[VFCARTFE_BATCH],Fz[VFCARTFE_BATCH];
+  PetscReal      C[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D][VFCARTFE_BATCH];
+  PetscReal      Cx[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D][VFCARTFE_BATCH];
+  PetscReal      Cy[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D][VFCARTFE_BATCH];
+  PetscReal      D[2][2][VFCARTFE_MAXNG1D][VFCARTFE_BATCH],Dx[2][2][VFCARTFE_MAXNG1D][VFCARTFE_BATCH];
+  PetscReal      *r;
+  
+  /*
+    Contraction along z
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (gj = 0; gj < e->ng1D; gj++) {
+      for (gi = 0; gi < e->ng1D; gi++) {
+        for (b = 0; b < VFCARTFE_BATCH; b++) {
+          C[k][gj][gi][b]  = 0.;
+          Cx[k][gj][gi][b] = 0.;
+          Cy[k][gj][gi][b] = 0.;
         }
       }
-      if (BC[c].face[Y1] == ONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            RHS_array[k][j][i][c] = 1.;
-          }
+    }
+  }
+  for (g = 0,gk = 0; gk < e->ng1D; gk++) {
+    for (gj = 0; gj < e->ng1D; gj++) {
+      for (gi = 0; gi < e->ng1D; gi++,g++) {
+        for (b = 0; b < VFCARTFE_BATCH; b++) {
+          F[b]  = f_elem  ? e->weight[g] * f_elem[g*VFCARTFE_BATCH+b] : 0.;
+          Fx[b] = df_elem ? e->weight[g] * df_elem[g*VFCARTFE_BATCH+b] : 0.;
+          Fy[b] = df_elem ? e->weight[g] * df_elem[(e->ng+g)*VFCARTFE_BATCH+b] : 0.;
+          Fz[b] = df_elem ? e->weight[g] * df_elem[(2*e->ng+g)*VFCARTFE_BATCH+b] : 0.;
         }
-      }
-      if (BC[c].face[Y1] == ZERO) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            RHS_array[k][j][i][c] = 0.;
+        for (k = 0; k < e->nphiz; k++) {
+          phi  = e->phi1D[2][k][gk];
+          dphi = e->dphi1D[2][k][gk];
+          for (b = 0; b < VFCARTFE_BATCH; b++) {
+            C[k][gj][gi][b]  += F[b] * phi + Fz[b] * dphi;
+            Cx[k][gj][gi][b] += Fx[b] * phi;
+            Cy[k][gj][gi][b] += Fy[b] * phi;
           }
         }
       }
     }
-    if (dim == 3) {
-      if (zs == 0) {
-        /*
-          z == 0
-        */
-        k = 0;
-        if (BC[c].face[Z0] == FIXED) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              RHS_array[k][j][i][c] = BCU_array[k][j][i][c];
-            }
-          }
-        }
-        if (BC[c].face[Z0] == ONE) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              RHS_array[k][j][i][c] = 1.;
-            }
-          }
-        }
-        if (BC[c].face[Z0] == ZERO) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              RHS_array[k][j][i][c] = 0.;
-            }
+  }
+  /*
+    Contraction along y
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (j = 0; j < e->nphiy; j++) {
+      for (gi = 0; gi < e->ng1D; gi++) {
+        for (b = 0; b < VFCARTFE_BATCH; b++) {
+          D[k][j][gi][b]  = 0.;
+          Dx[k][j][gi][b] = 0.;
+        }
+        for (gj = 0; gj < e->ng1D; gj++) {
+          phi  = e->phi1D[1][j][gj];
+          dphi = e->dphi1D[1][j][gj];
+          for (b = 0; b < VFCARTFE_BATCH; b++) {
+            D[k][j][gi][b]  += C[k][gj][gi][b] * phi + Cy[k][gj][gi][b] * dphi;
+            Dx[k][j][gi][b] += Cx[k][gj][gi][b] * phi;
           }
         }
       }
-      if (zs + zm == nz) {
-        /*
-          z == nz-1
-        */
-        k = nz-1;
-        if (BC[c].face[Z1] == FIXED) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              RHS_array[k][j][i][c] = BCU_array[k][j][i][c];
-            }
-          }
-        }
-        if (BC[c].face[Z1] == ONE) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              RHS_array[k][j][i][c] = 1.;
-            }
-          }
-        }
-        if (BC[c].face[Z1] == ZERO) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              RHS_array[k][j][i][c] = 0.;
-            }
-          }
+    }
+  }
+  /*
+    Contraction along x
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (j = 0; j < e->nphiy; j++) {
+      for (i = 0; i < e->nphix; i++) {
+        r = &residual_local[((k*e->nphiy+j)*e->nphix+i)*VFCARTFE_BATCH];
+        for (gi = 0; gi < e->ng1D; gi++) {
+          phi  = e->phi1D[0][i][gi];
+          dphi = e->dphi1D[0][i][gi];
+          for (b = 0; b < VFCARTFE_BATCH; b++) r[b] += D[k][j][gi][b] * phi + Dx[k][j][gi][b] * dphi;
         }
       }
     }
-    /*
-      edges
-    */
-    /* 
-      vertices
-    */
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == FIXED) RHS_array[0][0][0][c]          = BCU_array[0][0][0][c];
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == ONE)   RHS_array[0][0][0][c]          = 1.;
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == ZERO)  RHS_array[0][0][0][c]          = 0.;
-
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == FIXED) RHS_array[nz-1][0][0][c]       = BCU_array[nz-1][0][0][c];
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == ONE)   RHS_array[nz-1][0][0][c]       = 1.;
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == ZERO)  RHS_array[nz-1][0][0][c]       = 0.;
-
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == FIXED) RHS_array[0][ny-1][0][c]       = BCU_array[0][ny-1][0][c];
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == ONE)   RHS_array[0][ny-1][0][c]       = 1.;
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == ZERO)  RHS_array[0][ny-1][0][c]       = 0.;
-
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == FIXED) RHS_array[nz-1][ny-1][0][c]    = BCU_array[nz-1][ny-1][0][c];
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == ONE)   RHS_array[nz-1][ny-1][0][c]    = 1.;
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == ZERO)  RHS_array[nz-1][ny-1][0][c]    = 0.;
-
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == FIXED) RHS_array[0][0][nx-1][c]       = BCU_array[0][0][nx-1][c];
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == ONE)   RHS_array[0][0][nx-1][c]       = 1.;
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == ZERO)  RHS_array[0][0][nx-1][c]       = 0.;
-
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == FIXED) RHS_array[nz-1][0][nx-1][c]    = BCU_array[nz-1][0][nx-1][c];
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == ONE)   RHS_array[nz-1][0][nx-1][c]    = 1.;
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == ZERO)  RHS_array[nz-1][0][nx-1][c]    = 0.;
-
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == FIXED) RHS_array[0][ny-1][nx-1][c]    = BCU_array[0][ny-1][nx-1][c];
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == ONE)   RHS_array[0][ny-1][nx-1][c]    = 1.;
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == ZERO)  RHS_array[0][ny-1][nx-1][c]    = 0.;
-
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == FIXED) RHS_array[nz-1][ny-1][nx-1][c] = BCU_array[nz-1][ny-1][nx-1][c];
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == ONE)   RHS_array[nz-1][ny-1][nx-1][c] = 1.;
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == ZERO)  RHS_array[nz-1][ny-1][nx-1][c] = 0.;
-  }
-  
-  if (dim == 2) {
-    ierr = DMDAVecRestoreArrayDOF(da,RHS,&RHS_array[0]);CHKERRQ(ierr);
-    ierr = DMDAVecRestoreArrayDOF(da,BCU,&BCU_array[0]);CHKERRQ(ierr);
-    ierr = PetscFree(RHS_array);CHKERRQ(ierr);
-    ierr = PetscFree(BCU_array);CHKERRQ(ierr);
-  } else {
-    ierr = DMDAVecRestoreArrayDOF(da,RHS,&RHS_array);CHKERRQ(ierr);
-    ierr = DMDAVecRestoreArrayDOF(da,BCU,&BCU_array);CHKERRQ(ierr);
   }
-  PetscFunctionReturn(0);
+  *flops += VFCARTFE_BATCH * (4 * e->ng + 8 * e->ng * e->nphiz + 12 * 2 * e->ng1D * e->ng1D + 4 * 4 * e->ng1D);
 }
 
 #undef __FUNCT__
-#define __FUNCT__ "ResidualApplyDirichletBC"
+#define __FUNCT__ "VFCartFEElement3DIntegrateBatch"
 /*
-  ResidualApplyDirichletBC
-
-  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+  VFCartFEElement3DIntegrateBatch: VFCartFEElement3DIntegrate for VFCARTFE_BATCH cells sharing the same element, 
+  with the same layout as VFCartFEElement3DInterpolateBatch: residual_local[l*VFCARTFE_BATCH+b].
 */
-extern PetscErrorCode ResidualApplyDirichletBC(Vec residual,Vec U,Vec BCU,VFBC *BC)
+extern PetscErrorCode VFCartFEElement3DIntegrateBatch(VFCartFEElement3D *e,const PetscReal *f_elem,const PetscReal *df_elem,PetscReal *residual_local)
+{
+  PetscErrorCode ierr;
+  PetscLogDouble flops = 0.;
+  
+  PetscFunctionBegin;
+  VFCartFEElement3DIntegrateBatch_Kernel(e,f_elem,df_elem,residual_local,&flops);
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEDistinctSizes"
+/*
+  VFCartFEDistinctSizes: Given the n coordinates X of the grid lines along one axis, 
+  computes the nh distinct sizes h of the n-1 cells, and the index id[i] in h of the size of cell i.
+  Sizes within a relative tolerance of each other are considered identical.
+*/
+static PetscErrorCode VFCartFEDistinctSizes(PetscInt n,const PetscReal *X,PetscInt *id,PetscReal *h,PetscInt *nh)
+{
+  PetscInt       i,l;
+  PetscReal      hi;
+  
+  PetscFunctionBegin;
+  *nh = 0;
+  for (i = 0; i < n-1; i++) {
+    hi = X[i+1] - X[i];
+    for (l = 0; l < *nh; l++) {
+      if (PetscAbsReal(hi - h[l]) <= 1.e-10 * PetscMax(PetscAbsReal(hi),PetscAbsReal(h[l]))) break;
+    }
+    if (l == *nh) {
+      h[l] = hi;
+      (*nh)++;
+    }
+    id[i] = l;
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEElementCacheCreate"
+/*
+  VFCartFEElementCacheCreate: Initializes the 1D, 2D and 3D elements of the tensor product grid whose
+  grid lines are at X[0..nx-1], Y[0..ny-1] and Z[0..nz-1], once for each distinct cell size, 
+  using ng1D integration points along each axis.
+  For a uniform grid, this amounts to a single element of each type.
+*/
+extern PetscErrorCode VFCartFEElementCacheCreate(VFCartFEElementCache *cache,PetscInt nx,PetscInt ny,PetscInt nz,const PetscReal *X,const PetscReal *Y,const PetscReal *Z,PetscInt ng1D)
+{
+  PetscErrorCode ierr;
+  PetscInt       ix,iy,iz;
+  
+  PetscFunctionBegin;
+  cache->nx = nx-1;
+  cache->ny = ny-1;
+  cache->nz = nz-1;
+  cache->ng1D = ng1D;
+  ierr = PetscMalloc3(cache->nx,&cache->idx,cache->ny,&cache->idy,cache->nz,&cache->idz);CHKERRQ(ierr);
+  ierr = PetscMalloc3(cache->nx,&cache->hx,cache->ny,&cache->hy,cache->nz,&cache->hz);CHKERRQ(ierr);
+  ierr = VFCartFEDistinctSizes(nx,X,cache->idx,cache->hx,&cache->nhx);CHKERRQ(ierr);
+  ierr = VFCartFEDistinctSizes(ny,Y,cache->idy,cache->hy,&cache->nhy);CHKERRQ(ierr);
+  ierr = VFCartFEDistinctSizes(nz,Z,cache->idz,cache->hz,&cache->nhz);CHKERRQ(ierr);
+
+  ierr = PetscMalloc3(cache->nhx,&cache->e1DX,cache->nhy,&cache->e1DY,cache->nhz,&cache->e1DZ);CHKERRQ(ierr);
+  for (ix = 0; ix < cache->nhx; ix++) {
+    ierr = VFCartFEElement1DInitQuadrature(&cache->e1DX[ix],cache->hx[ix],ng1D);CHKERRQ(ierr);
+  }
+  for (iy = 0; iy < cache->nhy; iy++) {
+    ierr = VFCartFEElement1DInitQuadrature(&cache->e1DY[iy],cache->hy[iy],ng1D);CHKERRQ(ierr);
+  }
+  for (iz = 0; iz < cache->nhz; iz++) {
+    ierr = VFCartFEElement1DInitQuadrature(&cache->e1DZ[iz],cache->hz[iz],ng1D);CHKERRQ(ierr);
+  }
+
+  ierr = PetscMalloc3(cache->nhz*cache->nhy,&cache->e2DX,cache->nhz*cache->nhx,&cache->e2DY,cache->nhy*cache->nhx,&cache->e2DZ);CHKERRQ(ierr);
+  for (iz = 0; iz < cache->nhz; iz++) {
+    for (iy = 0; iy < cache->nhy; iy++) {
+      ierr = VFCartFEElement2DInitQuadrature(&cache->e2DX[iz*cache->nhy+iy],cache->hz[iz],cache->hy[iy],ng1D);CHKERRQ(ierr);
+    }
+    for (ix = 0; ix < cache->nhx; ix++) {
+      ierr = VFCartFEElement2DInitQuadrature(&cache->e2DY[iz*cache->nhx+ix],cache->hx[ix],cache->hz[iz],ng1D);CHKERRQ(ierr);
+    }
+  }
+  for (iy = 0; iy < cache->nhy; iy++) {
+    for (ix = 0; ix < cache->nhx; ix++) {
+      ierr = VFCartFEElement2DInitQuadrature(&cache->e2DZ[iy*cache->nhx+ix],cache->hx[ix],cache->hy[iy],ng1D);CHKERRQ(ierr);
+    }
+  }
+
+  ierr = PetscMalloc(cache->nhz*cache->nhy*cache->nhx*sizeof(VFCartFEElement3D),&cache->e3D);CHKERRQ(ierr);
+  for (iz = 0; iz < cache->nhz; iz++) {
+    for (iy = 0; iy < cache->nhy; iy++) {
+      for (ix = 0; ix < cache->nhx; ix++) {
+        ierr = VFCartFEElement3DInitQuadrature(&cache->e3D[(iz*cache->nhy+iy)*cache->nhx+ix],cache->hx[ix],cache->hy[iy],cache->hz[iz],ng1D);CHKERRQ(ierr);
+      }
+    }
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEElementCacheDestroy"
+/*
+  VFCartFEElementCacheDestroy
+*/
+extern PetscErrorCode VFCartFEElementCacheDestroy(VFCartFEElementCache *cache)
+{
+  PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  ierr = PetscFree(cache->e3D);CHKERRQ(ierr);
+  ierr = PetscFree3(cache->e2DX,cache->e2DY,cache->e2DZ);CHKERRQ(ierr);
+  ierr = PetscFree3(cache->e1DX,cache->e1DY,cache->e1DZ);CHKERRQ(ierr);
+  ierr = PetscFree3(cache->hx,cache->hy,cache->hz);CHKERRQ(ierr);
+  ierr = PetscFree3(cache->idx,cache->idy,cache->idz);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEElementCacheGet1D"
+/*
+  VFCartFEElementCacheGet1D: returns the element of the ei^th cell along the axis dir (0, 1 or 2)
+*/
+extern PetscErrorCode VFCartFEElementCacheGet1D(VFCartFEElementCache *cache,PetscInt dir,PetscInt ei,VFCartFEElement1D **e)
+{
+  PetscFunctionBegin;
+  switch (dir) {
+  case 0:
+    *e = &cache->e1DX[cache->idx[ei]];
+    break;
+  case 1:
+    *e = &cache->e1DY[cache->idy[ei]];
+    break;
+  case 2:
+    *e = &cache->e1DZ[cache->idz[ei]];
+    break;
+  default:
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_OUTOFRANGE,"ERROR: invalid direction %i in %s\n",dir,__FUNCT__);
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEElementCacheGet2D"
+/*
+  VFCartFEElementCacheGet2D: returns the element of the face of cell (ei,ej,ek), 
+  with the same orientation conventions as the boundary integration routines.
+*/
+extern PetscErrorCode VFCartFEElementCacheGet2D(VFCartFEElementCache *cache,FACE face,PetscInt ei,PetscInt ej,PetscInt ek,VFCartFEElement2D **e)
+{
+  PetscFunctionBegin;
+  switch (face) {
+  case X0:
+  case X1:
+    *e = &cache->e2DX[cache->idz[ek]*cache->nhy+cache->idy[ej]];
+    break;
+  case Y0:
+  case Y1:
+    *e = &cache->e2DY[cache->idz[ek]*cache->nhx+cache->idx[ei]];
+    break;
+  case Z0:
+  case Z1:
+    *e = &cache->e2DZ[cache->idy[ej]*cache->nhx+cache->idx[ei]];
+    break;
+  }
+  PetscFunctionReturn(0);
+}
+
+/*
+  VFCartFEElementCacheGet3D_Kernel: VFCartFEElementCacheGet3D without PETSc calls
+*/
+extern void VFCartFEElementCacheGet3D_Kernel(const VFCartFEElementCache *cache,PetscInt ei,PetscInt ej,PetscInt ek,VFCartFEElement3D **e)
+{
+  *e = &cache->e3D[(cache->idz[ek]*cache->nhy+cache->idy[ej])*cache->nhx+cache->idx[ei]];
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEElementCacheGet3D"
+/*
+  VFCartFEElementCacheGet3D: returns the element of cell (ei,ej,ek)
+*/
+extern PetscErrorCode VFCartFEElementCacheGet3D(VFCartFEElementCache *cache,PetscInt ei,PetscInt ej,PetscInt ek,VFCartFEElement3D **e)
+{
+  PetscFunctionBegin;
+  VFCartFEElementCacheGet3D_Kernel(cache,ei,ej,ek,e);
+  PetscFunctionReturn(0);
+}
+
+/*
+  VFCartFEElementCacheGet3DBatch_Kernel: VFCartFEElementCacheGet3DBatch without PETSc calls
+*/
+extern void VFCartFEElementCacheGet3DBatch_Kernel(const VFCartFEElementCache *cache,PetscInt ei,PetscInt ej,PetscInt ek,PetscInt xe,VFCartFEElement3D **e,PetscInt *nb)
+{
+  *e  = &cache->e3D[(cache->idz[ek]*cache->nhy+cache->idy[ej])*cache->nhx+cache->idx[ei]];
+  *nb = 1;
+  while (*nb < VFCARTFE_BATCH && ei + *nb < xe && cache->idx[ei + *nb] == cache->idx[ei]) (*nb)++;
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEElementCacheGet3DBatch"
+/*
+  VFCartFEElementCacheGet3DBatch: returns the element of cell (ei,ej,ek) and the number nb <= VFCARTFE_BATCH of 
+  consecutive cells (ei,ej,ek) ... (ei+nb-1,ej,ek) with ei+nb-1 < xe sharing this element
+*/
+extern PetscErrorCode VFCartFEElementCacheGet3DBatch(VFCartFEElementCache *cache,PetscInt ei,PetscInt ej,PetscInt ek,PetscInt xe,VFCartFEElement3D **e,PetscInt *nb)
+{
+  PetscFunctionBegin;
+  VFCartFEElementCacheGet3DBatch_Kernel(cache,ei,ej,ek,xe,e,nb);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEMatCOOCreate"
+/*
+  VFCartFEMatCOOCreate: allocates the element blocks of the local cells of daCell, for a matrix on da
+*/
+extern PetscErrorCode VFCartFEMatCOOCreate(VFCartFEMatCOO *coo,DM da,DM daCell)
+{
+  PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  coo->da = da;
+  ierr = DMDAGetInfo(da,NULL,NULL,NULL,NULL,NULL,NULL,NULL,&coo->dof,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(daCell,&coo->xs,&coo->ys,&coo->zs,&coo->xm,&coo->ym,&coo->zm);CHKERRQ(ierr);
+  coo->nrow = 8 * coo->dof;
+  ierr = PetscMalloc(coo->xm * coo->ym * coo->zm * coo->nrow * coo->nrow * sizeof(PetscScalar),&coo->v);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEMatCOODestroy"
+extern PetscErrorCode VFCartFEMatCOODestroy(VFCartFEMatCOO *coo)
+{
+  PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  ierr = PetscFree(coo->v);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEMatCOOSetPreallocation"
+/*
+  VFCartFEMatCOOSetPreallocation: sets the nonzero structure of K from the element connectivity, 
+  in the order of the element blocks of coo. 
+  Since the element blocks are full, this is the same pattern as the one of DMCreateMatrix.
+*/
+extern PetscErrorCode VFCartFEMatCOOSetPreallocation(VFCartFEMatCOO *coo,Mat K)
+{
+  PetscErrorCode         ierr;
+  PetscInt               gxs,gys,gzs,gxm,gym,gzm;
+  PetscInt               ei,ej,ek,i,j,k,c,l,m,n;
+  PetscInt               *idx,*coo_i,*coo_j;
+  ISLocalToGlobalMapping ltog;
+  
+  PetscFunctionBegin;
+  if (!coo->v) PetscFunctionReturn(0);
+  ierr = DMDAGetGhostCorners(coo->da,&gxs,&gys,&gzs,&gxm,&gym,&gzm);CHKERRQ(ierr);
+  ierr = DMGetLocalToGlobalMapping(coo->da,&ltog);CHKERRQ(ierr);
+  n    = coo->xm * coo->ym * coo->zm * coo->nrow * coo->nrow;
+  ierr = PetscMalloc3(coo->nrow,&idx,n,&coo_i,n,&coo_j);CHKERRQ(ierr);
+  for (n = 0,ek = coo->zs; ek < coo->zs + coo->zm; ek++) {
+    for (ej = coo->ys; ej < coo->ys + coo->ym; ej++) {
+      for (ei = coo->xs; ei < coo->xs + coo->xm; ei++) {
+        for (l = 0,k = 0; k < 2; k++) {
+          for (j = 0; j < 2; j++) {
+            for (i = 0; i < 2; i++) {
+              for (c = 0; c < coo->dof; c++,l++) {
+                idx[l] = (((ek+k-gzs) * gym + ej+j-gys) * gxm + ei+i-gxs) * coo->dof + c;
+              }
+            }
+          }
+        }
+        ierr = ISLocalToGlobalMappingApply(ltog,coo->nrow,idx,idx);CHKERRQ(ierr);
+        for (l = 0; l < coo->nrow; l++) {
+          for (m = 0; m < coo->nrow; m++,n++) {
+            coo_i[n] = idx[l];
+            coo_j[n] = idx[m];
+          }
+        }
+      }
+    }
+  }
+#if PETSC_VERSION_GE(3,14,0)
+  ierr = MatSetPreallocationCOO(K,n,coo_i,coo_j);CHKERRQ(ierr);
+#else
+  SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_SUP,"ERROR: COO assembly needs PETSc 3.14 or later in %s\n",__FUNCT__);
+#endif
+  /*
+    The COO preallocation resets the matrix, so the zeroed BC rows must again keep their pattern
+  */
+  ierr = MatSetOption(K,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = PetscFree3(idx,coo_i,coo_j);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEMatCOOZeroEntries"
+extern PetscErrorCode VFCartFEMatCOOZeroEntries(VFCartFEMatCOO *coo,Mat K)
+{
+  PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  if (coo->v) {
+    ierr = PetscMemzero(coo->v,coo->xm * coo->ym * coo->zm * coo->nrow * coo->nrow * sizeof(PetscScalar));CHKERRQ(ierr);
+  } else {
+    ierr = MatZeroEntries(K);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEMatCOOSetValuesStencil"
+/*
+  VFCartFEMatCOOSetValuesStencil: same as MatSetValuesStencil(K,nrow,row,ncol,col,v,ADD_VALUES), for rows and
+  columns in the cell (ei,ej,ek), but adds to the element block of this cell 
+*/
+extern PetscErrorCode VFCartFEMatCOOSetValuesStencil(VFCartFEMatCOO *coo,Mat K,PetscInt ei,PetscInt ej,PetscInt ek,PetscInt nrow,const MatStencil *row,PetscInt ncol,const MatStencil *col,const PetscScalar *v)
+{
+  PetscErrorCode ierr;
+  PetscInt       l,m,lrow,lcol;
+  PetscScalar    *K_elem;
+  
+  PetscFunctionBegin;
+  if (!coo->v) {
+    ierr = MatSetValuesStencil(K,nrow,row,ncol,col,v,ADD_VALUES);CHKERRQ(ierr);
+    PetscFunctionReturn(0);
+  }
+  K_elem = &coo->v[(((ek-coo->zs) * coo->ym + ej-coo->ys) * coo->xm + ei-coo->xs) * coo->nrow * coo->nrow];
+  for (l = 0; l < nrow; l++) {
+    lrow = (((row[l].k-ek) * 2 + row[l].j-ej) * 2 + row[l].i-ei) * coo->dof + row[l].c;
+    for (m = 0; m < ncol; m++) {
+      lcol = (((col[m].k-ek) * 2 + col[m].j-ej) * 2 + col[m].i-ei) * coo->dof + col[m].c;
+      K_elem[lrow * coo->nrow + lcol] += v[l * ncol + m];
+    }
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFEMatCOOAssemble"
+/*
+  VFCartFEMatCOOAssemble: overwrites K with the sum of the element blocks
+*/
+extern PetscErrorCode VFCartFEMatCOOAssemble(VFCartFEMatCOO *coo,Mat K)
+{
+  PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  if (coo->v) {
+#if PETSC_VERSION_GE(3,14,0)
+    ierr = MatSetValuesCOO(K,coo->v,INSERT_VALUES);CHKERRQ(ierr);
+#else
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_SUP,"ERROR: COO assembly needs PETSc 3.14 or later in %s\n",__FUNCT__);
+#endif
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFELocatorSetUpSpacing"
+/*
+  VFCartFELocatorSetUpSpacing: detects the axes with a uniform spacing
+*/
+static PetscErrorCode VFCartFELocatorSetUpSpacing(VFCartFELocator *loc)
+{
+  PetscInt       d,i;
+  
+  PetscFunctionBegin;
+  for (d = 0; d < 3; d++) {
+    loc->h[d] = (loc->x[d][loc->m[d]] - loc->x[d][0]) / loc->m[d];
+    for (i = 0; i < loc->m[d]; i++) {
+      if (PetscAbs(loc->x[d][i+1] - loc->x[d][i] - loc->h[d]) > 1.e-8 * loc->h[d]) {
+        loc->h[d] = 0.;
+        break;
+      }
+    }
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFELocatorCreate"
+/*
+  VFCartFELocatorCreate: builds the locator of the cells (xs ... xs+xm-1, ys ..., zs ...) 
+  from the coordinates of a nodal array covering them
+*/
+extern PetscErrorCode VFCartFELocatorCreate(VFCartFELocator *loc,PetscReal ****coords_array,PetscInt xs,PetscInt ys,PetscInt zs,PetscInt xm,PetscInt ym,PetscInt zm)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  
+  PetscFunctionBegin;
+  loc->s[0] = xs; loc->m[0] = xm;
+  loc->s[1] = ys; loc->m[1] = ym;
+  loc->s[2] = zs; loc->m[2] = zm;
+  ierr = PetscMalloc3(xm+1,&loc->x[0],ym+1,&loc->x[1],zm+1,&loc->x[2]);CHKERRQ(ierr);
+  for (i = 0; i <= xm; i++) loc->x[0][i] = coords_array[zs][ys][xs+i][0];
+  for (i = 0; i <= ym; i++) loc->x[1][i] = coords_array[zs][ys+i][xs][1];
+  for (i = 0; i <= zm; i++) loc->x[2][i] = coords_array[zs+i][ys][xs][2];
+  ierr = VFCartFELocatorSetUpSpacing(loc);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFELocatorCreateFromAxes"
+/*
+  VFCartFELocatorCreateFromAxes: same as VFCartFELocatorCreate, from the node coordinates axes[d][] 
+  of the whole grid along each axis
+*/
+extern PetscErrorCode VFCartFELocatorCreateFromAxes(VFCartFELocator *loc,PetscReal **axes,PetscInt xs,PetscInt ys,PetscInt zs,PetscInt xm,PetscInt ym,PetscInt zm)
+{
+  PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  loc->s[0] = xs; loc->m[0] = xm;
+  loc->s[1] = ys; loc->m[1] = ym;
+  loc->s[2] = zs; loc->m[2] = zm;
+  ierr = PetscMalloc3(xm+1,&loc->x[0],ym+1,&loc->x[1],zm+1,&loc->x[2]);CHKERRQ(ierr);
+  ierr = PetscMemcpy(loc->x[0],&axes[0][xs],(xm+1)*sizeof(PetscReal));CHKERRQ(ierr);
+  ierr = PetscMemcpy(loc->x[1],&axes[1][ys],(ym+1)*sizeof(PetscReal));CHKERRQ(ierr);
+  ierr = PetscMemcpy(loc->x[2],&axes[2][zs],(zm+1)*sizeof(PetscReal));CHKERRQ(ierr);
+  ierr = VFCartFELocatorSetUpSpacing(loc);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFELocatorDestroy"
+extern PetscErrorCode VFCartFELocatorDestroy(VFCartFELocator *loc)
+{
+  PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  ierr = PetscFree3(loc->x[0],loc->x[1],loc->x[2]);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFCartFELocatorFind"
+/*
+  VFCartFELocatorFind: finds the cell (ei,ej,ek) containing the point x. When x is on a face shared by two cells, 
+  the one with the largest index is returned. found is PETSC_FALSE if x is outside of the cells of the locator.
+  Along each axis, the cell is computed directly for a uniform spacing, by bisection otherwise.
+*/
+extern PetscErrorCode VFCartFELocatorFind(VFCartFELocator *loc,const PetscReal *x,PetscInt *ei,PetscInt *ej,PetscInt *ek,PetscBool *found)
+{
+  PetscInt       d,i,lo,hi,mid,idx[3];
+  const PetscReal *xd;
+  
+  PetscFunctionBegin;
+  *found = PETSC_FALSE;
+  for (d = 0; d < 3; d++) {
+    xd = loc->x[d];
+    if (!(x[d] >= xd[0] && x[d] <= xd[loc->m[d]])) PetscFunctionReturn(0);
+    /*
+      i is the last cell such that xd[i] <= x[d]
+    */
+    if (loc->h[d] > 0.) {
+      i = (PetscInt)((x[d] - xd[0]) / loc->h[d]);
+      if (i > loc->m[d]-1) i = loc->m[d]-1;
+      while (i > 0 && xd[i] > x[d]) i--;
+      while (i < loc->m[d]-1 && xd[i+1] <= x[d]) i++;
+    } else {
+      lo = 0; hi = loc->m[d]-1;
+      while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (xd[mid] <= x[d]) lo = mid;
+        else hi = mid-1;
+      }
+      i = lo;
+    }
+    idx[d] = loc->s[d] + i;
+  }
+  *ei = idx[0]; *ej = idx[1]; *ek = idx[2];
+  *found = PETSC_TRUE;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VecSetFromBC"
+/*
+  
+  VecSetFromBC:
+  
+  (c) 2014 Blaise Bourdin bourdin@lsu.edu
+*/
+extern PetscErrorCode VecSetFromBC(Vec BCVec,VFBC *BC)
 {
   PetscErrorCode ierr;
   PetscInt       xs,xm,nx;
   PetscInt       ys,ym,ny;
   PetscInt       zs,zm,nz;
   PetscInt       i,j,k,c;
+  PetscReal  ****BC_array,BCValue = 0.;
+  PetscInt       dof;
   DM             da;
-  PetscReal  ****residual_array;
-  PetscReal  ****BCU_array,****U_array;
-  PetscInt       dim,dof;
   
   PetscFunctionBegin;
-  ierr = VecGetDM(residual,&da);CHKERRQ(ierr);
-  ierr = DMDAGetInfo(da,&dim,&nx,&ny,&nz,NULL,NULL,NULL,
+  ierr = VecGetDM(BCVec,&da);CHKERRQ(ierr);
+  ierr = DMDAGetInfo(da,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                     &dof,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(da,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
   
-  if (dim == 2) {
-    ierr = PetscMalloc(sizeof(PetscReal ***),&residual_array);CHKERRQ(ierr);
-    ierr = PetscMalloc(sizeof(PetscReal ***),&BCU_array);CHKERRQ(ierr);
-    ierr = PetscMalloc(sizeof(PetscReal ***),&U_array);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOF(da,residual,&residual_array[0]);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOFRead(da,BCU,&BCU_array[0]);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOFRead(da,U,&U_array[0]);CHKERRQ(ierr);
-  } else {
-    ierr = DMDAVecGetArrayDOF(da,residual,&residual_array);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOFRead(da,BCU,&BCU_array);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOFRead(da,U,&U_array);CHKERRQ(ierr);
-  }
+  ierr = DMDAVecGetArrayDOF(da,BCVec,&BC_array);CHKERRQ(ierr);
   
   for (c = 0;c < dof;c++) {
     /* 
       Faces
     */
-    if (xs == 0) {
+    if (xs == 0 && BC[c].face[X0] != NONE) {
       /*
         x == 0
       */
-      i = 0;
-      if (BC[c].face[X0] == FIXED) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c]-BCU_array[k][j][i][c];
-          }
-        }
-      }
-      if (BC[c].face[X0] == ONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c]-1.;
-          }
-        }
-      }
-      if (BC[c].face[X0] == ZERO) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c];
-          }
+      switch(BC[c].face[X0]) {
+        case ZERO:
+          BCValue = 0.;
+          break;
+        case ONE:
+          BCValue = 1.;
+          break;
+        case FIXED:
+          BCValue = BC[c].faceValue[X0];
+          break;
+        case NONE:
+          break;
+      }      
+      for (k = zs; k < zs + zm; k++) {
+        for (j = ys; j < ys + ym; j++) {
+          BC_array[k][j][0][c] = BCValue;
         }
       }
     }
-    if (xs + xm == nx) {
+
+    if (xs + xm == nx && BC[c].face[X1] != NONE) {
       /*
         x == nx-1
       */
-      i = nx-1;
-      if (BC[c].face[X1] == FIXED) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c]-BCU_array[k][j][i][c];
-          }
-        }
-      }
-      if (BC[c].face[X1] == ONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c]-1.;
-          }
-        }
-      }
-      if (BC[c].face[X1] == ZERO) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c];
-          }
+      switch(BC[c].face[X1]) {
+        case ZERO:
+          BCValue = 0.;
+          break;
+        case ONE:
+          BCValue = 1.;
+          break;
+        case FIXED:
+          BCValue = BC[c].faceValue[X1];
+          break;
+        case NONE:
+          break;
+      }      
+      for (k = zs; k < zs + zm; k++) {
+        for (j = ys; j < ys + ym; j++) {
+          BC_array[k][j][nx-1][c] = BCValue;
         }
       }
     }
-    if (ys == 0) {
+
+    if (ys == 0 && BC[c].face[Y0] != NONE) {
       /*
         y == 0
       */
-      j = 0;
-      if (BC[c].face[Y0] == FIXED) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c]-BCU_array[k][j][i][c];
-          }
-        }
-      }
-      if (BC[c].face[Y0] == ONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c]-1;
-          }
-        }
-      }
-      if (BC[c].face[Y0] == ZERO) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c];
-          }
+      switch(BC[c].face[Y0]) {
+        case ZERO:
+          BCValue = 0.;
+          break;
+        case ONE:
+          BCValue = 1.;
+          break;
+        case FIXED:
+          BCValue = BC[c].faceValue[Y0];
+          break;
+        case NONE:
+          break;
+      }      
+      for (k = zs; k < zs + zm; k++) {
+        for (i = xs; i < xs + xm; i++) {
+          BC_array[k][0][i][c] = BCValue;
         }
       }
     }
-    if (ys + ym == ny) {
+    if (ys + ym == ny && BC[c].face[Y1] != NONE) {
       /*
         y == ny-1
       */
-      j = ny-1;
-      if (BC[c].face[Y1] == FIXED) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c]-BCU_array[k][j][i][c];
-          }
-        }
-      }
-      if (BC[c].face[Y1] == ONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c]-1.;
-          }
-        }
-      }
-      if (BC[c].face[Y1] == ZERO) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            residual_array[k][j][i][c] = U_array[k][j][i][c];
-          }
+      switch(BC[c].face[Y1]) {
+        case ZERO:
+          BCValue = 0.;
+          break;
+        case ONE:
+          BCValue = 1.;
+          break;
+        case FIXED:
+          BCValue = BC[c].faceValue[Y1];
+          break;
+        case NONE:
+          break;
+      }      
+      for (k = zs; k < zs + zm; k++) {
+        for (i = xs; i < xs + xm; i++) {
+          BC_array[k][ny-1][i][c] = BCValue;
         }
       }
     }
-    if (dim == 3) {
-      if (zs == 0) {
+    if (zs == 0 && BC[c].face[Z0] != NONE) {
         /*
           z == 0
         */
-        k = 0;
-        if (BC[c].face[Z0] == FIXED) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              residual_array[k][j][i][c] = U_array[k][j][i][c]-BCU_array[k][j][i][c];
-            }
-          }
-        }
-        if (BC[c].face[Z0] == ONE) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              residual_array[k][j][i][c] = U_array[k][j][i][c]-1.;
-            }
-          }
-        }
-        if (BC[c].face[Z0] == ZERO) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              residual_array[k][j][i][c] = U_array[k][j][i][c];
-            }
-          }
+      switch(BC[c].face[Z0]) {
+        case ZERO:
+          BCValue = 0.;
+          break;
+        case ONE:
+          BCValue = 1.;
+          break;
+        case FIXED:
+          BCValue = BC[c].faceValue[Z0];
+          break;
+        case NONE:
+          break;
+      }      
+      for (j = ys; j < ys + ym; j++) {
+        for (i = xs; i < xs + xm; i++) {
+          BC_array[0][j][i][c] = BCValue;
         }
       }
-      if (zs + zm == nz) {
-        /*
-          z == nz-1
-        */
-        k = nz-1;
-        if (BC[c].face[Z1] == FIXED) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              residual_array[k][j][i][c] = U_array[k][j][i][c]-BCU_array[k][j][i][c];
-            }
-          }
-        }
-        if (BC[c].face[Z1] == ONE) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              residual_array[k][j][i][c] = U_array[k][j][i][c]-1.;
-            }
-          }
-        }
-        if (BC[c].face[Z1] == ZERO) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              residual_array[k][j][i][c] = U_array[k][j][i][c];
-            }
-          }
+    }
+    if (zs + zm == nz && BC[c].face[Z1] != NONE) {
+      /*
+        z == nz-1
+      */
+      switch(BC[c].face[Z1]) {
+        case ZERO:
+          BCValue = 0.;
+          break;
+        case ONE:
+          BCValue = 1.;
+          break;
+        case FIXED:
+          BCValue = BC[c].faceValue[Z1];
+          break;
+        case NONE:
+          break;
+      }      
+      for (j = ys; j < ys + ym; j++) {
+        for (i = xs; i < xs + xm; i++) {
+          BC_array[nz-1][j][i][c] = BCValue;
         }
       }
     }
@@ -949,51 +1495,299 @@ extern PetscErrorCode ResidualApplyDirichletBC(Vec residual,Vec U,Vec BCU,VFBC *
     /* 
       vertices
     */
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == FIXED) residual_array[0][0][0][c]          = U_array[0][0][0][c]-BCU_array[0][0][0][c];
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == ONE)   residual_array[0][0][0][c]          = U_array[0][0][0][c]-1.;
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == ZERO)  residual_array[0][0][0][c]          = U_array[0][0][0][c];
+    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == FIXED) BC_array[0][0][0][c]          = BC[c].vertexValue[X0Y0Z0];
+    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == ONE)   BC_array[0][0][0][c]          = 1.;
+    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] == ZERO)  BC_array[0][0][0][c]          = 0.;
+
+    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == FIXED) BC_array[nz-1][0][0][c]       = BC[c].vertexValue[X0Y0Z1];
+    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == ONE)   BC_array[nz-1][0][0][c]       = 1.;
+    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == ZERO)  BC_array[nz-1][0][0][c]       = 0.;
+
+    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == FIXED) BC_array[0][ny-1][0][c]       = BC[c].vertexValue[X0Y1Z0];
+    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == ONE)   BC_array[0][ny-1][0][c]       = 1.;
+    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == ZERO)  BC_array[0][ny-1][0][c]       = 0.;
+
+    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == FIXED) BC_array[nz-1][ny-1][0][c]    = BC[c].vertexValue[X0Y1Z1];
+    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == ONE)   BC_array[nz-1][ny-1][0][c]    = 1.;
+    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == ZERO)  BC_array[nz-1][ny-1][0][c]    = 0.;
+
+    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == FIXED) BC_array[0][0][nx-1][c]       = BC[c].vertexValue[X1Y0Z0];
+    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == ONE)   BC_array[0][0][nx-1][c]       = 1.;
+    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == ZERO)  BC_array[0][0][nx-1][c]       = 0.;
+
+    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == FIXED) BC_array[nz-1][0][nx-1][c]    = BC[c].vertexValue[X1Y0Z1];
+    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == ONE)   BC_array[nz-1][0][nx-1][c]    = 1.;
+    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == ZERO)  BC_array[nz-1][0][nx-1][c]    = 0.;
+
+    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == FIXED) BC_array[0][ny-1][nx-1][c]    = BC[c].vertexValue[X1Y1Z0];
+    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == ONE)   BC_array[0][ny-1][nx-1][c]    = 1.;
+    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == ZERO)  BC_array[0][ny-1][nx-1][c]    = 0.;
+
+    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == FIXED) BC_array[nz-1][ny-1][nx-1][c] = BC[c].vertexValue[X1Y1Z1];
+    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == ONE)   BC_array[nz-1][ny-1][nx-1][c] = 1.;
+    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == ZERO)  BC_array[nz-1][ny-1][nx-1][c] = 0.;
+  }
+  
+  ierr = DMDAVecRestoreArrayDOF(da,BCVec,&BC_array);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+  
 
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == FIXED) residual_array[nz-1][0][0][c]       = U_array[nz-1][0][0][c]-BCU_array[nz-1][0][0][c];
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == ONE)   residual_array[nz-1][0][0][c]       = U_array[nz-1][0][0][c]-1.;
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] == ZERO)  residual_array[nz-1][0][0][c]       = U_array[nz-1][0][0][c];
+#undef __FUNCT__
+#define __FUNCT__ "VFBCISDestroy"
+/*
+  VFBCISDestroy: destructor of the VFBCIS attached to a DM by VFBCISGet
+*/
+static PetscErrorCode VFBCISDestroy(void *ptr)
+{
+  PetscErrorCode ierr;
+  VFBCIS        *bcis = (VFBCIS *)ptr;
+  
+  PetscFunctionBegin;
+  ierr = ISDestroy(&bcis->isRow);CHKERRQ(ierr);
+  ierr = ISDestroy(&bcis->isFixed);CHKERRQ(ierr);
+  ierr = ISDestroy(&bcis->isOne);CHKERRQ(ierr);
+  ierr = ISDestroy(&bcis->isZero);CHKERRQ(ierr);
+  ierr = PetscFree(bcis->type);CHKERRQ(ierr);
+  ierr = PetscFree(bcis);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
 
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == FIXED) residual_array[0][ny-1][0][c]       = U_array[0][ny-1][0][c]-BCU_array[0][ny-1][0][c];
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == ONE)   residual_array[0][ny-1][0][c]       = U_array[0][ny-1][0][c]-1.;
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] == ZERO)  residual_array[0][ny-1][0][c]       = U_array[0][ny-1][0][c];
+#undef __FUNCT__
+#define __FUNCT__ "VFBCISCompile"
+/*
+  VFBCISCompile: builds the index sets of the degrees of freedom of da constrained by BC.
+  The faces are applied before the vertices, so that the type of a vertex overrides the one of the faces 
+  it belongs to. As in the previous stencil based implementation, the z faces are ignored in 2D, and so are 
+  the z=nz-1 vertices when zeroing rows. 
+*/
+static PetscErrorCode VFBCISCompile(VFBCIS *bcis,DM da,VFBC *BC)
+{
+  PetscErrorCode         ierr;
+  PetscInt               s[3],m[3],n[3],gs[3],gm[3];
+  PetscInt               range[3][3][2];
+  PetscInt               sel[3];
+  PetscInt               i,j,k,c,d,e,l,gl,dim,dof,nloc;
+  PetscInt               nRow = 0,nFixed = 0,nOne = 0,nZero = 0;
+  PetscInt               *idxRow,*idxFixed,*idxOne,*idxZero;
+  BCTYPE                 type,*nodeType;
+  PetscBool              *nodeRow;
+  ISLocalToGlobalMapping ltog;
+  
+  PetscFunctionBegin;
+  ierr = DMDAGetInfo(da,&dim,&n[0],&n[1],&n[2],NULL,NULL,NULL,
+                    &dof,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(da,&s[0],&s[1],&s[2],&m[0],&m[1],&m[2]);CHKERRQ(ierr);
+  ierr = DMDAGetGhostCorners(da,&gs[0],&gs[1],&gs[2],&gm[0],&gm[1],&gm[2]);CHKERRQ(ierr);
+  ierr = DMGetLocalToGlobalMapping(da,&ltog);CHKERRQ(ierr);
+  /*
+    range[d][0]: low boundary, range[d][1]: high boundary, range[d][2]: all local nodes along the axis d.
+    The boundary ranges are empty if the boundary is not on this processor
+  */
+  for (d = 0; d < 3; d++) {
+    range[d][0][0] = 0;
+    range[d][0][1] = (s[d] == 0) ? 1 : 0;
+    range[d][1][0] = n[d]-1;
+    range[d][1][1] = (s[d] + m[d] == n[d]) ? n[d] : n[d]-1;
+    range[d][2][0] = s[d];
+    range[d][2][1] = s[d] + m[d];
+  }
+  nloc = m[0] * m[1] * m[2] * dof;
+  ierr = PetscMalloc2(nloc,&nodeType,nloc,&nodeRow);CHKERRQ(ierr);
+  for (l = 0; l < nloc; l++) {
+    nodeType[l] = NONE;
+    nodeRow[l]  = PETSC_FALSE;
+  }
+  for (c = 0; c < dof; c++) {
+    /*
+      entities 0 ... 5 are the faces, 6 ... 13 the vertices
+    */
+    for (e = 0; e < 14; e++) {
+      if (e < 6) {
+        if (e >= Z0 && dim < 3) continue;
+        type = BC[c].face[e];
+        sel[0] = 2; sel[1] = 2; sel[2] = 2;
+        sel[e/2] = e%2;
+      } else {
+        type = BC[c].vertex[e-6];
+        sel[0] = (e-6) & 1; sel[1] = ((e-6) >> 1) & 1; sel[2] = ((e-6) >> 2) & 1;
+      }
+      bcis->type[c*14+e] = type;
+      if (type == NONE) continue;
+      for (k = range[2][sel[2]][0]; k < range[2][sel[2]][1]; k++) {
+        for (j = range[1][sel[1]][0]; j < range[1][sel[1]][1]; j++) {
+          for (i = range[0][sel[0]][0]; i < range[0][sel[0]][1]; i++) {
+            l = (((k-s[2]) * m[1] + j-s[1]) * m[0] + i-s[0]) * dof + c;
+            nodeType[l] = type;
+            if (e < 6 || sel[2] == 0 || dim == 3) nodeRow[l] = PETSC_TRUE;
+          }
+        }
+      }
+    }
+  }
+  for (l = 0; l < nloc; l++) {
+    if (nodeRow[l])          nRow++;
+    if (nodeType[l] == FIXED) nFixed++;
+    if (nodeType[l] == ONE)   nOne++;
+    if (nodeType[l] == ZERO)  nZero++;
+  }
+  ierr = PetscMalloc(nRow * sizeof(PetscInt),&idxRow);CHKERRQ(ierr);
+  ierr = PetscMalloc(nFixed * sizeof(PetscInt),&idxFixed);CHKERRQ(ierr);
+  ierr = PetscMalloc(nOne * sizeof(PetscInt),&idxOne);CHKERRQ(ierr);
+  ierr = PetscMalloc(nZero * sizeof(PetscInt),&idxZero);CHKERRQ(ierr);
+  nRow = 0; nFixed = 0; nOne = 0; nZero = 0;
+  for (l = 0,k = s[2]; k < s[2] + m[2]; k++) {
+    for (j = s[1]; j < s[1] + m[1]; j++) {
+      for (i = s[0]; i < s[0] + m[0]; i++) {
+        for (c = 0; c < dof; c++,l++) {
+          gl = (((k-gs[2]) * gm[1] + j-gs[1]) * gm[0] + i-gs[0]) * dof + c;
+          if (nodeRow[l])           idxRow[nRow++]     = gl;
+          if (nodeType[l] == FIXED) idxFixed[nFixed++] = gl;
+          if (nodeType[l] == ONE)   idxOne[nOne++]     = gl;
+          if (nodeType[l] == ZERO)  idxZero[nZero++]   = gl;
+        }
+      }
+    }
+  }
+  ierr = PetscFree2(nodeType,nodeRow);CHKERRQ(ierr);
+  ierr = ISLocalToGlobalMappingApply(ltog,nRow,idxRow,idxRow);CHKERRQ(ierr);
+  ierr = ISLocalToGlobalMappingApply(ltog,nFixed,idxFixed,idxFixed);CHKERRQ(ierr);
+  ierr = ISLocalToGlobalMappingApply(ltog,nOne,idxOne,idxOne);CHKERRQ(ierr);
+  ierr = ISLocalToGlobalMappingApply(ltog,nZero,idxZero,idxZero);CHKERRQ(ierr);
+  ierr = ISCreateGeneral(PETSC_COMM_WORLD,nRow,idxRow,PETSC_OWN_POINTER,&bcis->isRow);CHKERRQ(ierr);
+  ierr = ISCreateGeneral(PETSC_COMM_WORLD,nFixed,idxFixed,PETSC_OWN_POINTER,&bcis->isFixed);CHKERRQ(ierr);
+  ierr = ISCreateGeneral(PETSC_COMM_WORLD,nOne,idxOne,PETSC_OWN_POINTER,&bcis->isOne);CHKERRQ(ierr);
+  ierr = ISCreateGeneral(PETSC_COMM_WORLD,nZero,idxZero,PETSC_OWN_POINTER,&bcis->isZero);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
 
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == FIXED) residual_array[nz-1][ny-1][0][c]    = U_array[nz-1][ny-1][0][c]-BCU_array[nz-1][ny-1][0][c];
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == ONE)   residual_array[nz-1][ny-1][0][c]    = U_array[nz-1][ny-1][0][c]-1.;
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] == ZERO)  residual_array[nz-1][ny-1][0][c]    = U_array[nz-1][ny-1][0][c];
+#undef __FUNCT__
+#define __FUNCT__ "VFBCISGet"
+/*
+  VFBCISGet: returns the index sets of the degrees of freedom of da constrained by the VFBC array BC.
+  They are compiled on the first call for a given (da,BC) pair, attached to da, and compiled again only if 
+  the boundary condition types in BC have changed since.
+*/
+extern PetscErrorCode VFBCISGet(DM da,VFBC *BC,VFBCIS **bcis)
+{
+  PetscErrorCode ierr;
+  char           name[64];
+  PetscContainer container = NULL;
+  PetscInt       c,e,dof;
+  PetscBool      current = PETSC_TRUE;
+  
+  PetscFunctionBegin;
+  ierr = PetscSNPrintf(name,sizeof(name),"VFBCIS_%p",(void*)BC);CHKERRQ(ierr);
+  ierr = PetscObjectQuery((PetscObject)da,name,(PetscObject *)&container);CHKERRQ(ierr);
+  if (container) {
+    ierr = PetscContainerGetPointer(container,(void **)bcis);CHKERRQ(ierr);
+    for (c = 0; c < (*bcis)->dof; c++) {
+      for (e = 0; e < 14; e++) {
+        if ((*bcis)->type[c*14+e] != ((e < 6) ? BC[c].face[e] : BC[c].vertex[e-6])) current = PETSC_FALSE;
+      }
+    }
+    if (!current) {
+      ierr = ISDestroy(&(*bcis)->isRow);CHKERRQ(ierr);
+      ierr = ISDestroy(&(*bcis)->isFixed);CHKERRQ(ierr);
+      ierr = ISDestroy(&(*bcis)->isOne);CHKERRQ(ierr);
+      ierr = ISDestroy(&(*bcis)->isZero);CHKERRQ(ierr);
+      ierr = VFBCISCompile(*bcis,da,BC);CHKERRQ(ierr);
+    }
+  } else {
+    ierr = DMDAGetInfo(da,NULL,NULL,NULL,NULL,NULL,NULL,NULL,&dof,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+    ierr = PetscMalloc(sizeof(VFBCIS),bcis);CHKERRQ(ierr);
+    ierr = PetscMemzero(*bcis,sizeof(VFBCIS));CHKERRQ(ierr);
+    (*bcis)->dof = dof;
+    ierr = PetscMalloc(dof * 14 * sizeof(BCTYPE),&(*bcis)->type);CHKERRQ(ierr);
+    ierr = VFBCISCompile(*bcis,da,BC);CHKERRQ(ierr);
+    ierr = PetscContainerCreate(PETSC_COMM_WORLD,&container);CHKERRQ(ierr);
+    ierr = PetscContainerSetPointer(container,*bcis);CHKERRQ(ierr);
+    ierr = PetscContainerSetUserDestroy(container,VFBCISDestroy);CHKERRQ(ierr);
+    ierr = PetscObjectCompose((PetscObject)da,name,(PetscObject)container);CHKERRQ(ierr);
+    ierr = PetscContainerDestroy(&container);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
 
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == FIXED) residual_array[0][0][nx-1][c]       = U_array[0][0][nx-1][c]-BCU_array[0][0][nx-1][c];
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == ONE)   residual_array[0][0][nx-1][c]       = U_array[0][0][nx-1][c]-1.;
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] == ZERO)  residual_array[0][0][nx-1][c]       = U_array[0][0][nx-1][c];
+#undef __FUNCT__
+#define __FUNCT__ "VecApplyDirichletBC"
+/*
+  VecApplyDirichletBC
 
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == FIXED) residual_array[nz-1][0][nx-1][c]    = U_array[nz-1][0][nx-1][c]-BCU_array[nz-1][0][nx-1][c];
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == ONE)   residual_array[nz-1][0][nx-1][c]    = U_array[nz-1][0][nx-1][c]-1.;
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] == ZERO)  residual_array[nz-1][0][nx-1][c]    = U_array[nz-1][0][nx-1][c];
+  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+*/
+extern PetscErrorCode VecApplyDirichletBC(Vec RHS,Vec BCU,VFBC *BC)
+{
+  PetscErrorCode    ierr;
+  DM                da;
+  VFBCIS           *bcis;
+  PetscInt          l,n,rstart;
+  const PetscInt   *idx;
+  PetscScalar      *RHS_array;
+  const PetscScalar *BCU_array;
+  
+  PetscFunctionBegin;
+  ierr = VecGetDM(RHS,&da);CHKERRQ(ierr);
+  ierr = VFBCISGet(da,BC,&bcis);CHKERRQ(ierr);
+  if (RHS != BCU) {
+    ierr = VecGetOwnershipRange(RHS,&rstart,NULL);CHKERRQ(ierr);
+    ierr = ISGetLocalSize(bcis->isFixed,&n);CHKERRQ(ierr);
+    ierr = ISGetIndices(bcis->isFixed,&idx);CHKERRQ(ierr);
+    ierr = VecGetArray(RHS,&RHS_array);CHKERRQ(ierr);
+    ierr = VecGetArrayRead(BCU,&BCU_array);CHKERRQ(ierr);
+    for (l = 0; l < n; l++) RHS_array[idx[l]-rstart] = BCU_array[idx[l]-rstart];
+    ierr = VecRestoreArrayRead(BCU,&BCU_array);CHKERRQ(ierr);
+    ierr = VecRestoreArray(RHS,&RHS_array);CHKERRQ(ierr);
+    ierr = ISRestoreIndices(bcis->isFixed,&idx);CHKERRQ(ierr);
+  }
+  ierr = VecISSet(RHS,bcis->isOne,1.);CHKERRQ(ierr);
+  ierr = VecISSet(RHS,bcis->isZero,0.);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
 
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == FIXED) residual_array[0][ny-1][nx-1][c]    = U_array[0][ny-1][nx-1][c]-BCU_array[0][ny-1][nx-1][c];
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == ONE)   residual_array[0][ny-1][nx-1][c]    = U_array[0][ny-1][nx-1][c]-1.;
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] == ZERO)  residual_array[0][ny-1][nx-1][c]    = U_array[0][ny-1][nx-1][c];
+#undef __FUNCT__
+#define __FUNCT__ "ResidualApplyDirichletBC"
+/*
+  ResidualApplyDirichletBC
 
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == FIXED) residual_array[nz-1][ny-1][nx-1][c] = U_array[nz-1][ny-1][nx-1][c]-BCU_array[nz-1][ny-1][nx-1][c];
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == ONE)   residual_array[nz-1][ny-1][nx-1][c] = U_array[nz-1][ny-1][nx-1][c]-1.;
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] == ZERO)  residual_array[nz-1][ny-1][nx-1][c] = U_array[nz-1][ny-1][nx-1][c];
-  }
+  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+*/
+extern PetscErrorCode ResidualApplyDirichletBC(Vec residual,Vec U,Vec BCU,VFBC *BC)
+{
+  PetscErrorCode    ierr;
+  DM                da;
+  VFBCIS           *bcis;
+  PetscInt          l,n,rstart;
+  const PetscInt   *idx;
+  PetscScalar      *residual_array;
+  const PetscScalar *BCU_array,*U_array;
   
-  if (dim == 2) {
-    ierr = DMDAVecRestoreArrayDOF(da,residual,&residual_array[0]);CHKERRQ(ierr);
-    ierr = DMDAVecRestoreArrayDOFRead(da,BCU,&BCU_array[0]);CHKERRQ(ierr);
-    ierr = DMDAVecRestoreArrayDOFRead(da,U,&U_array[0]);CHKERRQ(ierr);
-    ierr = PetscFree(residual_array);CHKERRQ(ierr);
-    ierr = PetscFree(BCU_array);CHKERRQ(ierr);
-    ierr = PetscFree(U_array);CHKERRQ(ierr);
-  } else {
-    ierr = DMDAVecRestoreArrayDOF(da,residual,&residual_array);CHKERRQ(ierr);
-    ierr = DMDAVecRestoreArrayDOFRead(da,BCU,&BCU_array);CHKERRQ(ierr);
-    ierr = DMDAVecRestoreArrayDOFRead(da,U,&U_array);CHKERRQ(ierr);
-  }
+  PetscFunctionBegin;
+  ierr = VecGetDM(residual,&da);CHKERRQ(ierr);
+  ierr = VFBCISGet(da,BC,&bcis);CHKERRQ(ierr);
+  ierr = VecGetOwnershipRange(residual,&rstart,NULL);CHKERRQ(ierr);
+  ierr = VecGetArray(residual,&residual_array);CHKERRQ(ierr);
+  ierr = VecGetArrayRead(BCU,&BCU_array);CHKERRQ(ierr);
+  ierr = VecGetArrayRead(U,&U_array);CHKERRQ(ierr);
+  
+  ierr = ISGetLocalSize(bcis->isFixed,&n);CHKERRQ(ierr);
+  ierr = ISGetIndices(bcis->isFixed,&idx);CHKERRQ(ierr);
+  for (l = 0; l < n; l++) residual_array[idx[l]-rstart] = U_array[idx[l]-rstart] - BCU_array[idx[l]-rstart];
+  ierr = ISRestoreIndices(bcis->isFixed,&idx);CHKERRQ(ierr);
+  
+  ierr = ISGetLocalSize(bcis->isOne,&n);CHKERRQ(ierr);
+  ierr = ISGetIndices(bcis->isOne,&idx);CHKERRQ(ierr);
+  for (l = 0; l < n; l++) residual_array[idx[l]-rstart] = U_array[idx[l]-rstart] - 1.;
+  ierr = ISRestoreIndices(bcis->isOne,&idx);CHKERRQ(ierr);
+  
+  ierr = ISGetLocalSize(bcis->isZero,&n);CHKERRQ(ierr);
+  ierr = ISGetIndices(bcis->isZero,&idx);CHKERRQ(ierr);
+  for (l = 0; l < n; l++) residual_array[idx[l]-rstart] = U_array[idx[l]-rstart];
+  ierr = ISRestoreIndices(bcis->isZero,&idx);CHKERRQ(ierr);
+  
+  ierr = VecRestoreArrayRead(U,&U_array);CHKERRQ(ierr);
+  ierr = VecRestoreArrayRead(BCU,&BCU_array);CHKERRQ(ierr);
+  ierr = VecRestoreArray(residual,&residual_array);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -1007,133 +1801,15 @@ extern PetscErrorCode ResidualApplyDirichletBC(Vec residual,Vec U,Vec BCU,VFBC *
 extern PetscErrorCode GradientApplyDirichletBC(Vec gradient,VFBC *BC)
 {
   PetscErrorCode ierr;
-  PetscInt       xs,xm,nx;
-  PetscInt       ys,ym,ny;
-  PetscInt       zs,zm,nz;
-  PetscInt       i,j,k,c;
   DM             da;
-  PetscReal  ****gradient_array;
-  PetscInt       dim,dof;
+  VFBCIS        *bcis;
   
   PetscFunctionBegin;
   ierr = VecGetDM(gradient,&da);CHKERRQ(ierr);
-  ierr = DMDAGetInfo(da,&dim,&nx,&ny,&nz,NULL,NULL,NULL,
-                    &dof,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
-  ierr = DMDAGetCorners(da,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  
-  if (dim == 2) {
-    ierr = PetscMalloc(sizeof(PetscReal ***),&gradient_array);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOF(da,gradient,&gradient_array[0]);CHKERRQ(ierr);
-  } else {
-    ierr = DMDAVecGetArrayDOF(da,gradient,&gradient_array);CHKERRQ(ierr);
-  }
-  
-  for (c = 0;c < dof;c++) {
-    /* 
-      Faces
-    */
-    if (xs == 0) {
-      /*
-        x == 0
-      */
-      i = 0;
-      if (BC[c].face[X0] != NONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            gradient_array[k][j][i][c] = 0.;
-          }
-        }
-      }
-    }
-    if (xs + xm == nx) {
-      /*
-        x == nx-1
-      */
-      i = nx-1;
-      if (BC[c].face[X1] != NONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (j = ys; j < ys + ym; j++) {
-            gradient_array[k][j][i][c] = 0.;
-          }
-        }
-      }
-    }
-    if (ys == 0) {
-      /*
-        y == 0
-      */
-      j = 0;
-      if (BC[c].face[Y0] != NONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            gradient_array[k][j][i][c] = 0.;
-          }
-        }
-      }
-    }
-    if (ys + ym == ny) {
-      /*
-        y == ny-1
-      */
-      j = ny-1;
-      if (BC[c].face[Y1] != NONE) {
-        for (k = zs; k < zs + zm; k++) {
-          for (i = xs; i < xs + xm; i++) {
-            gradient_array[k][j][i][c] = 0.;
-          }
-        }
-      }
-    }
-    if (dim == 3) {
-      if (zs == 0) {
-        /*
-          z == 0
-        */
-        k = 0;
-        if (BC[c].face[Z0] != NONE) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              gradient_array[k][j][i][c] = 0.;
-            }
-          }
-        }
-      }
-      if (zs + zm == nz) {
-        /*
-          z == nz-1
-        */
-        k = nz-1;
-        if (BC[c].face[Z1] != NONE) {
-          for (j = ys; j < ys + ym; j++) {
-            for (i = xs; i < xs + xm; i++) {
-              gradient_array[k][j][i][c] = 0.;
-            }
-          }
-        }
-      }
-    }
-    /*
-      edges
-    */
-    /* 
-      vertices
-    */
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] !=NONE) gradient_array[0][0][0][c]          = 0.;
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] !=NONE) gradient_array[nz-1][0][0][c]       = 0.;
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] !=NONE) gradient_array[0][ny-1][0][c]       = 0.;
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] !=NONE) gradient_array[nz-1][ny-1][0][c]    = 0.;
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] !=NONE) gradient_array[0][0][nx-1][c]       = 0.;
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] !=NONE) gradient_array[nz-1][0][nx-1][c]    = 0.;
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] !=NONE) gradient_array[0][ny-1][nx-1][c]    = 0.;
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] !=NONE) gradient_array[nz-1][ny-1][nx-1][c] = 0.;
-  }
-  
-  if (dim == 2) {
-    ierr = DMDAVecRestoreArrayDOF(da,gradient,&gradient_array[0]);CHKERRQ(ierr);
-    ierr = PetscFree(gradient_array);CHKERRQ(ierr);
-  } else {
-    ierr = DMDAVecRestoreArrayDOF(da,gradient,&gradient_array);CHKERRQ(ierr);
-  }
+  ierr = VFBCISGet(da,BC,&bcis);CHKERRQ(ierr);
+  ierr = VecISSet(gradient,bcis->isFixed,0.);CHKERRQ(ierr);
+  ierr = VecISSet(gradient,bcis->isOne,0.);CHKERRQ(ierr);
+  ierr = VecISSet(gradient,bcis->isZero,0.);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -1147,151 +1823,13 @@ extern PetscErrorCode GradientApplyDirichletBC(Vec gradient,VFBC *BC)
 extern PetscErrorCode MatApplyDirichletBC(Mat K,VFBC *BC)
 {
   PetscErrorCode ierr;
-  PetscInt       xs,xm,nx;
-  PetscInt       ys,ym,ny;
-  PetscInt       zs,zm,nz;
-  PetscInt       i,j,k,c;
-  MatStencil    *row;
-  PetscReal      one=1.;
-  PetscInt       numBC=0,l=0;
-  PetscInt       dim,dof;
   DM             da;
+  VFBCIS        *bcis;
 
   PetscFunctionBegin;
   ierr = MatGetDM(K,&da);CHKERRQ(ierr);
-  ierr = DMDAGetInfo(da,&dim,&nx,&ny,&nz,NULL,NULL,NULL,
-                    &dof,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
-  ierr = DMDAGetCorners(da,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-
-  /*
-    Compute the number of boundary nodes on each processor. 
-    Edges and corners are counted multiple times (2 and 3 resp)
-  */
-  for (c = 0; c < dof; c++){
-    if (xs == 0       && BC[c].face[X0] != NONE)             numBC += ym * zm;
-    if (xs + xm == nx && BC[c].face[X1] != NONE)             numBC += ym * zm;
-    if (ys == 0       && BC[c].face[Y0] != NONE)             numBC += xm * zm;
-    if (ys + ym == ny && BC[c].face[Y1] != NONE)             numBC += xm * zm;
-    if (zs == 0       && BC[c].face[Z0] != NONE && dim == 3) numBC += xm * ym;
-    if (zs + zm == nz && BC[c].face[Z1] != NONE && dim == 3) numBC += xm * ym;
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] != NONE) numBC++;
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] != NONE) numBC++;
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] != NONE) numBC++;
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] != NONE) numBC++;
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] != NONE && dim == 3) numBC++;
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] != NONE && dim == 3) numBC++;
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] != NONE && dim == 3) numBC++;
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] != NONE && dim == 3) numBC++;
-  }
-  ierr = PetscMalloc(numBC * sizeof(MatStencil),&row);CHKERRQ(ierr);
-  /*
-    Create an array of rows to be zeroed out
-  */
-  /*
-    i == 0
-  */
-  for (c = 0; c < dof; c++) {
-    if (xs == 0 && BC[c].face[X0] != NONE) {
-      for (k = zs; k < zs + zm; k++) {
-        for (j = ys; j < ys + ym; j++) {
-          row[l].i = 0; row[l].j = j; row[l].k = k; row[l].c = c; 
-          l++;
-        }
-      }
-    }
-    /* 
-      i == nx-1
-    */
-    if (xs + xm == nx && BC[c].face[X1] != NONE) {
-      for (k = zs; k < zs + zm; k++) {
-        for (j = ys; j < ys + ym; j++) {
-          row[l].i = nx-1; row[l].j = j; row[l].k = k; row[l].c = c; 
-          l++;
-        }
-      }
-    }
-    /*
-      y == 0
-    */
-    if (ys == 0 && BC[c].face[Y0] != NONE) {
-      for (k = zs; k < zs + zm; k++) {
-        for (i = xs; i < xs + xm; i++) {
-          row[l].i = i; row[l].j = 0; row[l].k = k; row[l].c = c; 
-          l++;
-        }
-      }
-    }
-    /*
-      y == ny-1
-    */
-    if (ys + ym == ny && BC[c].face[Y1] != NONE) {
-      for (k = zs; k < zs + zm; k++) {
-        for (i = xs; i < xs + xm; i++) {
-          row[l].i = i; row[l].j = ny-1; row[l].k = k; row[l].c = c; 
-          l++;
-        }
-      }
-    }
-    if (dim==3){
-      /*
-        z == 0
-      */
-      if (zs == 0 && BC[c].face[Z0] != NONE) {
-        for (j = ys; j < ys + ym; j++) {
-          for (i = xs; i < xs + xm; i++) {
-            row[l].i = i; row[l].j = j; row[l].k = 0; row[l].c = c; 
-            l++;
-          }
-        }
-      }
-      /*
-        z == nz-1
-      */
-      if (zs + zm == nz && BC[c].face[Z1] != NONE) {
-        for (j = ys; j < ys + ym; j++) {
-          for (i = xs; i < xs + xm; i++) {
-            row[l].i = i; row[l].j = j; row[l].k = nz-1; row[l].c = c; 
-            l++;
-          }
-        }
-      }
-    }
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] != NONE) { 
-      row[l].i = 0; row[l].j = 0; row[l].k = 0; row[l].c = c; 
-      l++;
-    }
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] != NONE && dim ==3) { 
-      row[l].i = 0; row[l].j = 0; row[l].k = nz-1; row[l].c = c; 
-      l++;
-    }
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] != NONE) { 
-      row[l].i = 0; row[l].j = ny-1; row[l].k = 0; row[l].c = c; 
-      l++;
-    }
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] != NONE && dim ==3) { 
-      row[l].i = 0; row[l].j = ny-1; row[l].k = nz-1; row[l].c = c; 
-      l++;
-    }
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] != NONE) { 
-      row[l].i = nx-1; row[l].j = 0; row[l].k = 0; row[l].c = c; 
-      l++;
-    }
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] != NONE && dim ==3) { 
-      row[l].i = nx-1; row[l].j = 0; row[l].k = nz-1; row[l].c = c; 
-      l++;
-    }
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] != NONE) { 
-      row[l].i = nx-1; row[l].j = ny-1; row[l].k = 0; row[l].c = c; 
-      l++;
-    }
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] != NONE && dim ==3) { 
-      row[l].i = nx-1; row[l].j = ny-1; row[l].k = nz-1; row[l].c = c; 
-      l++;
-    }
-    
-  }
-  ierr = MatZeroRowsStencil(K,numBC,row,one,NULL,NULL);CHKERRQ(ierr);
-  ierr = PetscFree(row);CHKERRQ(ierr);
+  ierr = VFBCISGet(da,BC,&bcis);CHKERRQ(ierr);
+  ierr = MatZeroRowsIS(K,bcis->isRow,1.,NULL,NULL);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -1305,151 +1843,13 @@ extern PetscErrorCode MatApplyDirichletBC(Mat K,VFBC *BC)
 extern PetscErrorCode MatApplyDirichletBCRowCol(Mat K,VFBC *BC)
 {
   PetscErrorCode ierr;
-  PetscInt       xs,xm,nx;
-  PetscInt       ys,ym,ny;
-  PetscInt       zs,zm,nz;
-  PetscInt       i,j,k,c;
-  MatStencil    *row;
-  PetscReal      one=1.;
-  PetscInt       numBC=0,l=0;
-  PetscInt       dim,dof;
   DM             da;
+  VFBCIS        *bcis;
 
   PetscFunctionBegin;
   ierr = MatGetDM(K,&da);CHKERRQ(ierr);
-  ierr = DMDAGetInfo(da,&dim,&nx,&ny,&nz,NULL,NULL,NULL,
-                    &dof,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
-  ierr = DMDAGetCorners(da,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-
-  /*
-    Compute the number of boundary nodes on each processor. 
-    Edges and corners are counted multiple times (2 and 3 resp)
-  */
-  for (c = 0; c < dof; c++){
-    if (xs == 0       && BC[c].face[X0] != NONE)             numBC += ym * zm;
-    if (xs + xm == nx && BC[c].face[X1] != NONE)             numBC += ym * zm;
-    if (ys == 0       && BC[c].face[Y0] != NONE)             numBC += xm * zm;
-    if (ys + ym == ny && BC[c].face[Y1] != NONE)             numBC += xm * zm;
-    if (zs == 0       && BC[c].face[Z0] != NONE && dim == 3) numBC += xm * ym;
-    if (zs + zm == nz && BC[c].face[Z1] != NONE && dim == 3) numBC += xm * ym;
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] != NONE) numBC++;
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] != NONE) numBC++;
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] != NONE) numBC++;
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] != NONE) numBC++;
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] != NONE && dim == 3) numBC++;
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] != NONE && dim == 3) numBC++;
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] != NONE && dim == 3) numBC++;
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] != NONE && dim == 3) numBC++;
-  }
-  ierr = PetscMalloc(numBC * sizeof(MatStencil),&row);CHKERRQ(ierr);
-  /*
-    Create an array of rows to be zeroed out
-  */
-  /*
-    i == 0
-  */
-  for (c = 0; c < dof; c++) {
-    if (xs == 0 && BC[c].face[X0] != NONE) {
-      for (k = zs; k < zs + zm; k++) {
-        for (j = ys; j < ys + ym; j++) {
-          row[l].i = 0; row[l].j = j; row[l].k = k; row[l].c = c; 
-          l++;
-        }
-      }
-    }
-    /* 
-      i == nx-1
-    */
-    if (xs + xm == nx && BC[c].face[X1] != NONE) {
-      for (k = zs; k < zs + zm; k++) {
-        for (j = ys; j < ys + ym; j++) {
-          row[l].i = nx-1; row[l].j = j; row[l].k = k; row[l].c = c; 
-          l++;
-        }
-      }
-    }
-    /*
-      y == 0
-    */
-    if (ys == 0 && BC[c].face[Y0] != NONE) {
-      for (k = zs; k < zs + zm; k++) {
-        for (i = xs; i < xs + xm; i++) {
-          row[l].i = i; row[l].j = 0; row[l].k = k; row[l].c = c; 
-          l++;
-        }
-      }
-    }
-    /*
-      y == ny-1
-    */
-    if (ys + ym == ny && BC[c].face[Y1] != NONE) {
-      for (k = zs; k < zs + zm; k++) {
-        for (i = xs; i < xs + xm; i++) {
-          row[l].i = i; row[l].j = ny-1; row[l].k = k; row[l].c = c; 
-          l++;
-        }
-      }
-    }
-    if (dim==3){
-      /*
-        z == 0
-      */
-      if (zs == 0 && BC[c].face[Z0] != NONE) {
-        for (j = ys; j < ys + ym; j++) {
-          for (i = xs; i < xs + xm; i++) {
-            row[l].i = i; row[l].j = j; row[l].k = 0; row[l].c = c; 
-            l++;
-          }
-        }
-      }
-      /*
-        z == nz-1
-      */
-      if (zs + zm == nz && BC[c].face[Z1] != NONE) {
-        for (j = ys; j < ys + ym; j++) {
-          for (i = xs; i < xs + xm; i++) {
-            row[l].i = i; row[l].j = j; row[l].k = nz-1; row[l].c = c; 
-            l++;
-          }
-        }
-      }
-    }
-    if (xs == 0       && ys == 0       && zs == 0       && BC[c].vertex[X0Y0Z0] != NONE) { 
-      row[l].i = 0; row[l].j = 0; row[l].k = 0; row[l].c = c; 
-      l++;
-    }
-    if (xs == 0       && ys == 0       && zs + zm == nz && BC[c].vertex[X0Y0Z1] != NONE && dim ==3) { 
-      row[l].i = 0; row[l].j = 0; row[l].k = nz-1; row[l].c = c; 
-      l++;
-    }
-    if (xs == 0       && ys + ym == ny && zs == 0       && BC[c].vertex[X0Y1Z0] != NONE) { 
-      row[l].i = 0; row[l].j = ny-1; row[l].k = 0; row[l].c = c; 
-      l++;
-    }
-    if (xs == 0       && ys + ym == ny && zs + zm == nz && BC[c].vertex[X0Y1Z1] != NONE && dim ==3) { 
-      row[l].i = 0; row[l].j = ny-1; row[l].k = nz-1; row[l].c = c; 
-      l++;
-    }
-    if (xs + xm == nx && ys == 0       && zs == 0       && BC[c].vertex[X1Y0Z0] != NONE) { 
-      row[l].i = nx-1; row[l].j = 0; row[l].k = 0; row[l].c = c; 
-      l++;
-    }
-    if (xs + xm == nx && ys == 0       && zs + zm == nz && BC[c].vertex[X1Y0Z1] != NONE && dim ==3) { 
-      row[l].i = nx-1; row[l].j = 0; row[l].k = nz-1; row[l].c = c; 
-      l++;
-    }
-    if (xs + xm == nx && ys + ym == ny && zs == 0       && BC[c].vertex[X1Y1Z0] != NONE) { 
-      row[l].i = nx-1; row[l].j = ny-1; row[l].k = 0; row[l].c = c; 
-      l++;
-    }
-    if (xs + xm == nx && ys + ym == ny && zs + zm == nz && BC[c].vertex[X1Y1Z1] != NONE && dim ==3) { 
-      row[l].i = nx-1; row[l].j = ny-1; row[l].k = nz-1; row[l].c = c; 
-      l++;
-    }
-    
-  }
-  ierr = MatZeroRowsColumnsStencil(K,numBC,row,one,NULL,NULL);CHKERRQ(ierr);
-  ierr = PetscFree(row);CHKERRQ(ierr);
+  ierr = VFBCISGet(da,BC,&bcis);CHKERRQ(ierr);
+  ierr = MatZeroRowsColumnsIS(K,bcis->isRow,1.,NULL,NULL);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -7,7 +7,20 @@
   Uses 3 points / 5th order quadrature from 
     A. Ern  and J.-L. Guermond "Theory and Practice of Finite Elements"
     Table 8.1 p. 359
+  or the 2 points / 3rd order Gauss rule along each axis (see VFCartFEElement1DInitQuadrature).
+  The arrays are sized for the largest rule, ng is the number of points actually used.
 */
+#define VFCARTFE_MAXNG1D 3
+#define VFCARTFE_MAXNG2D (VFCARTFE_MAXNG1D*VFCARTFE_MAXNG1D)
+#define VFCARTFE_MAXNG3D (VFCARTFE_MAXNG1D*VFCARTFE_MAXNG1D*VFCARTFE_MAXNG1D)
+/*
+  Number of consecutive cells evaluated together by the batched element routines, stored as the fastest index
+  of their arrays (structure of arrays) so that the compiler can vectorize over cells.
+  Use 4 for AVX2 and 8 for AVX-512 in double precision.
+*/
+#ifndef VFCARTFE_BATCH
+#define VFCARTFE_BATCH 4
+#endif
 
 typedef struct {
   PetscInt     dim;                  /* dimension of the space */
@@ -19,9 +32,9 @@ typedef struct {
   PetscReal    ly;                   /* length of the element */     
   PetscReal    lz;                   /* length of the element */     
   /*PetscReal    *weight;*/              /* integration weight */
-  PetscReal    weight[3];            /* integration weight */
-  PetscReal    phi[1][1][2][3];      /* phi[i][g] = value of i^th basis function at g^th integration point */
-  PetscReal    dphi[1][1][2][3];     /* dphi[i][g] = value of the derivative of the i^th basis function at g^th integration point */
+  PetscReal    weight[VFCARTFE_MAXNG1D];         /* integration weight */
+  PetscReal    phi[1][1][2][VFCARTFE_MAXNG1D];   /* phi[i][g] = value of i^th basis function at g^th integration point */
+  PetscReal    dphi[1][1][2][VFCARTFE_MAXNG1D];  /* dphi[i][g] = value of the derivative of the i^th basis function at g^th integration point */
 } VFCartFEElement1D;
 
 typedef struct {
@@ -30,13 +43,14 @@ typedef struct {
   PetscInt     nphix;                /* number of basis functions along the x axis */
   PetscInt     nphiy;                /* number of basis functions along the y axis */
   PetscInt     nphiz;                /* number of basis functions along the z axis */
+  PetscInt     ng1D;                 /* number of integration points along each axis */
   PetscReal    lx;                   /* length of the element */     
   PetscReal    ly;                   /* length of the element */     
   PetscReal    lz;                   /* length of the element */     
   /*PetscReal    *weight;*/              /* integration weight */
-  PetscReal    weight[9];            /* integration weight */
-  PetscReal    phi[1][2][2][9];      /* phi[j][i][g] = value of (i,j)^th basis function at g^th integration point */
-  PetscReal    dphi[1][2][2][2][9];  /* phi[j][i][l][g] = value of the derivative w.r.t. x_l of the (i,j)^th basis function at g^th integration point */
+  PetscReal    weight[VFCARTFE_MAXNG2D];            /* integration weight */
+  PetscReal    phi[1][2][2][VFCARTFE_MAXNG2D];      /* phi[j][i][g] = value of (i,j)^th basis function at g^th integration point */
+  PetscReal    dphi[1][2][2][2][VFCARTFE_MAXNG2D];  /* phi[j][i][l][g] = value of the derivative w.r.t. x_l of the (i,j)^th basis function at g^th integration point */
 } VFCartFEElement2D;
 
 
@@ -63,15 +77,59 @@ typedef struct {
   PetscInt     nphix;                /* number of basis functions along the x axis */
   PetscInt     nphiy;                /* number of basis functions along the y axis */
   PetscInt     nphiz;                /* number of basis functions along the z axis */
+  PetscInt     ng1D;                 /* number of integration points along each axis */
   PetscReal    lx;                   /* length of the element */     
   PetscReal    ly;                   /* length of the element */     
   PetscReal    lz;                   /* length of the element */     
   /*PetscReal    *weight;*/              /* integration weight */
-  PetscReal    weight[27];           /* integration weight */
-  PetscReal    phi[2][2][2][27];     /* phi[k][j][i][g] = value of (i,j,k)^th basis function at g^th integration point */
-  PetscReal    dphi[2][2][2][3][27]; /* phi[k][j][i][l][g] = value of the derivative w.r.t. x_l of the (i,j,k)^th basis function at g^th integration point */
+  PetscReal    weight[VFCARTFE_MAXNG3D];           /* integration weight */
+  PetscReal    phi[2][2][2][VFCARTFE_MAXNG3D];     /* phi[k][j][i][g] = value of (i,j,k)^th basis function at g^th integration point */
+  PetscReal    dphi[2][2][2][3][VFCARTFE_MAXNG3D]; /* phi[k][j][i][l][g] = value of the derivative w.r.t. x_l of the (i,j,k)^th basis function at g^th integration point */
+  PetscReal    phi1D[3][2][VFCARTFE_MAXNG1D];      /* phi1D[l][i][g] = value of the i^th 1D basis function along x_l at the g^th 1D integration point */
+  PetscReal    dphi1D[3][2][VFCARTFE_MAXNG1D];     /* dphi1D[l][i][g] = value of its derivative */
 } VFCartFEElement3D;
 
+/*
+  Elements of a tensor product grid, initialized once for each distinct cell size along each axis.
+  The element of cell (ei,ej,ek) is e3D[(idz[ek]*nhy+idy[ej])*nhx+idx[ei]].
+*/
+typedef struct {
+  PetscInt           nx,ny,nz;             /* number of cells along each axis */
+  PetscInt           nhx,nhy,nhz;          /* number of distinct cell sizes along each axis */
+  PetscInt           ng1D;                 /* number of integration points along each axis */
+  PetscInt          *idx,*idy,*idz;        /* idx[ei] = index in hx of the size of the cells in the ei^th slab */
+  PetscReal         *hx,*hy,*hz;           /* distinct cell sizes */
+  VFCartFEElement1D *e1DX,*e1DY,*e1DZ;     /* e1DX[ix], ... */
+  VFCartFEElement2D *e2DX,*e2DY,*e2DZ;     /* faces normal to x (hz,hy), y (hx,hz) and z (hx,hy) */
+  VFCartFEElement3D *e3D;
+} VFCartFEElementCache;
+
+/*
+  Coordinate (COO) assembly of a matrix on a DMDA, from the element blocks of the local cells.
+  The block of cell (ei,ej,ek) is v[(((ek-zs)*ym+ej-ys)*xm+ei-xs)*nrow*nrow], with rows and columns ordered
+  as the degrees of freedom of the element: ((k*2+j)*2+i)*dof+c.
+  When v is NULL, the VFCartFEMatCOO functions fall back to MatZeroEntries / MatSetValuesStencil.
+  The blocks take xm*ym*zm*(8 dof)^2 scalars, and MatSetPreallocationCOO / MatSetValuesCOO need PETSc 3.14 or later.
+*/
+typedef struct {
+  DM                 da;                   /* DMDA of the matrix */
+  PetscInt           xs,ys,zs,xm,ym,zm;    /* local cells */
+  PetscInt           dof;                  /* number of degrees of freedom per node */
+  PetscInt           nrow;                 /* size of the element blocks (8 dof) */
+  PetscScalar       *v;                    /* element blocks */
+} VFCartFEMatCOO;
+
+/*
+ Point locator on the tensor grid of the local (ghosted) cells: 
+ x[d][0..m[d]] are the node coordinates along the axis d of the cells s[d] ... s[d]+m[d]-1.
+ h[d] is the cell size if the spacing is uniform, 0 otherwise
+*/
+typedef struct {
+  PetscInt     s[3],m[3];
+  PetscReal   *x[3];
+  PetscReal    h[3];
+} VFCartFELocator;
+
 typedef struct {
   PetscInt     dim;                  /* dimension of the space */
   PetscInt     ng;                   /* number of integration points */
@@ -143,6 +201,19 @@ typedef struct {
   PetscReal     vertexValue[8];   
 } VFBC;
 
+/*
+  Dirichlet boundary conditions of a VFBC array compiled on a DMDA: global indices of the local constrained
+  degrees of freedom, split by boundary condition type. Attached to the DM by VFBCISGet.
+*/
+typedef struct {
+  PetscInt      dof;                 /* number of degrees of freedom per node */
+  BCTYPE       *type;                /* type[c*14+e]: types of the faces (e<6) and vertices the IS were compiled from */
+  IS            isRow;               /* rows zeroed by MatApplyDirichletBC */
+  IS            isFixed;             /* FIXED dof */
+  IS            isOne;               /* ONE dof */
+  IS            isZero;              /* ZERO dof */
+} VFBCIS;
+
 typedef struct {
   PetscInt     dim;                  /* dimension of the space */
   PetscInt     nphix;                /* number of basis functions along the x axis */
@@ -174,10 +245,37 @@ typedef struct {
 extern PetscErrorCode VFCartFEInit();
 extern PetscErrorCode VFCartFEElement1DCreate1D(VFCartFEElement1D *e);
 extern PetscErrorCode VFCartFEElement1DInit(VFCartFEElement1D *e,PetscReal lx);
+extern PetscErrorCode VFCartFEElement1DInitQuadrature(VFCartFEElement1D *e,PetscReal lx,PetscInt ng);
 extern PetscErrorCode VFCartFEElement2DCreate(VFCartFEElement2D *e);
 extern PetscErrorCode VFCartFEElement2DInit(VFCartFEElement2D *e,PetscReal lx,PetscReal ly);
+extern PetscErrorCode VFCartFEElement2DInitQuadrature(VFCartFEElement2D *e,PetscReal lx,PetscReal ly,PetscInt ng1D);
 extern PetscErrorCode VFCartFEElement3DCreate(VFCartFEElement3D *e);
 extern PetscErrorCode VFCartFEElement3DInit(VFCartFEElement3D *e,PetscReal lx,PetscReal ly,PetscReal lz);
+extern PetscErrorCode VFCartFEElement3DInitQuadrature(VFCartFEElement3D *e,PetscReal lx,PetscReal ly,PetscReal lz,PetscInt ng1D);
+extern PetscErrorCode VFCartFEElement3DInterpolate(VFCartFEElement3D *e,const PetscReal *f_local,PetscReal *f_elem,PetscReal *df_elem);
+extern PetscErrorCode VFCartFEElement3DIntegrate(VFCartFEElement3D *e,const PetscReal *f_elem,const PetscReal *df_elem,PetscReal *residual_local);
+extern PetscErrorCode VFCartFEElement3DInterpolateBatch(VFCartFEElement3D *e,const PetscReal *f_local,PetscReal *f_elem,PetscReal *df_elem);
+extern PetscErrorCode VFCartFEElement3DIntegrateBatch(VFCartFEElement3D *e,const PetscReal *f_elem,const PetscReal *df_elem,PetscReal *residual_local);
+extern void VFCartFEElement3DInterpolateBatch_Kernel(VFCartFEElement3D *e,const PetscReal *f_local,PetscReal *f_elem,PetscReal *df_elem,PetscLogDouble *flops);
+extern void VFCartFEElement3DIntegrateBatch_Kernel(VFCartFEElement3D *e,const PetscReal *f_elem,const PetscReal *df_elem,PetscReal *residual_local,PetscLogDouble *flops);
+extern PetscErrorCode VFCartFEElementCacheCreate(VFCartFEElementCache *cache,PetscInt nx,PetscInt ny,PetscInt nz,const PetscReal *X,const PetscReal *Y,const PetscReal *Z,PetscInt ng1D);
+extern PetscErrorCode VFCartFEElementCacheDestroy(VFCartFEElementCache *cache);
+extern PetscErrorCode VFCartFEElementCacheGet1D(VFCartFEElementCache *cache,PetscInt dir,PetscInt ei,VFCartFEElement1D **e);
+extern PetscErrorCode VFCartFEElementCacheGet2D(VFCartFEElementCache *cache,FACE face,PetscInt ei,PetscInt ej,PetscInt ek,VFCartFEElement2D **e);
+extern PetscErrorCode VFCartFEElementCacheGet3D(VFCartFEElementCache *cache,PetscInt ei,PetscInt ej,PetscInt ek,VFCartFEElement3D **e);
+extern PetscErrorCode VFCartFEElementCacheGet3DBatch(VFCartFEElementCache *cache,PetscInt ei,PetscInt ej,PetscInt ek,PetscInt xe,VFCartFEElement3D **e,PetscInt *nb);
+extern void VFCartFEElementCacheGet3D_Kernel(const VFCartFEElementCache *cache,PetscInt ei,PetscInt ej,PetscInt ek,VFCartFEElement3D **e);
+extern void VFCartFEElementCacheGet3DBatch_Kernel(const VFCartFEElementCache *cache,PetscInt ei,PetscInt ej,PetscInt ek,PetscInt xe,VFCartFEElement3D **e,PetscInt *nb);
+extern PetscErrorCode VFCartFEMatCOOCreate(VFCartFEMatCOO *coo,DM da,DM daCell);
+extern PetscErrorCode VFCartFEMatCOODestroy(VFCartFEMatCOO *coo);
+extern PetscErrorCode VFCartFEMatCOOSetPreallocation(VFCartFEMatCOO *coo,Mat K);
+extern PetscErrorCode VFCartFEMatCOOZeroEntries(VFCartFEMatCOO *coo,Mat K);
+extern PetscErrorCode VFCartFEMatCOOSetValuesStencil(VFCartFEMatCOO *coo,Mat K,PetscInt ei,PetscInt ej,PetscInt ek,PetscInt nrow,const MatStencil *row,PetscInt ncol,const MatStencil *col,const PetscScalar *v);
+extern PetscErrorCode VFCartFEMatCOOAssemble(VFCartFEMatCOO *coo,Mat K);
+extern PetscErrorCode VFCartFELocatorCreate(VFCartFELocator *loc,PetscReal ****coords_array,PetscInt xs,PetscInt ys,PetscInt zs,PetscInt xm,PetscInt ym,PetscInt zm);
+extern PetscErrorCode VFCartFELocatorCreateFromAxes(VFCartFELocator *loc,PetscReal **axes,PetscInt xs,PetscInt ys,PetscInt zs,PetscInt xm,PetscInt ym,PetscInt zm);
+extern PetscErrorCode VFCartFELocatorDestroy(VFCartFELocator *loc);
+extern PetscErrorCode VFCartFELocatorFind(VFCartFELocator *loc,const PetscReal *x,PetscInt *ei,PetscInt *ej,PetscInt *ek,PetscBool *found);
 
 extern PetscErrorCode DAReadCoordinatesHDF5(DM da,const char filename[]);
 
@@ -185,6 +283,7 @@ extern PetscErrorCode VFBCCreate(VFBC *bc,PetscInt dof);
 extern PetscErrorCode VFBCSetFromOptions(VFBC *bc,const char prefix[],PetscInt dof);
 extern PetscErrorCode VFBCView(VFBC *bc,PetscViewer viewer,PetscInt dof);
 extern PetscErrorCode VecSetFromBC(Vec BCVec,VFBC *BC);
+extern PetscErrorCode VFBCISGet(DM da,VFBC *BC,VFBCIS **bcis);
 
 extern PetscErrorCode VecApplyDirichletBC(Vec RHS,Vec BCU,VFBC *BC);
 extern PetscErrorCode ResidualApplyDirichletBC(Vec Residual,Vec U,Vec BCU,VFBC *BC);
@@ -7,6 +7,7 @@
 #include "VFHeat.h"
 #include "VFWell.h"
 #include "VFCracks.h"
+#include "VFPermfield.h"
 #include "VFHeat.h"
 
 #include "xdmf.h"
@@ -111,8 +112,38 @@ extern PetscErrorCode VFCtxGet(VFCtx *ctx)
     ctx->width_tol = 0.1;
     ierr           = PetscOptionsReal("-widthremoval_tol","\n\tTolerance for removal of tip effect","",ctx->width_tol,&ctx->width_tol,NULL);CHKERRQ(ierr);
 
+    ctx->widthInterpolation = PETSC_TRUE;
+    ierr                    = PetscOptionsBool("-width_interpolation","\n\tInterpolate V, grad V and u along the width integration rays from their cell centred values","",ctx->widthInterpolation,&ctx->widthInterpolation,NULL);CHKERRQ(ierr);
+
+    ctx->widthDistributed = PETSC_FALSE;
+    ierr                  = PetscOptionsBool("-width_distributed","\n\tForward the width integration rays to the neighbouring processors instead of using wide ghost layers","",ctx->widthDistributed,&ctx->widthDistributed,NULL);CHKERRQ(ierr);
+    ctx->daWCacheCell     = NULL;
+
+    ctx->widthEulerian = PETSC_FALSE;
+    ierr               = PetscOptionsBool("-width_eulerian","\n\tCompute the fracture width by integrating u.grad V along the grid axes instead of along rays","",ctx->widthEulerian,&ctx->widthEulerian,NULL);CHKERRQ(ierr);
+    if (ctx->widthEulerian && ctx->widthDistributed) SETERRQ1(PETSC_COMM_WORLD,PETSC_ERR_USER,"ERROR: -width_eulerian needs the wide ghost layers and cannot be used with -width_distributed in %s\n",__FUNCT__);
+    ctx->widthCompare = PETSC_FALSE;
+    ierr              = PetscOptionsBool("-width_compare","\n\tWith -width_eulerian, also compute the width by ray marching and print the difference","",ctx->widthCompare,&ctx->widthCompare,NULL);CHKERRQ(ierr);
+
+    ctx->bandDilation = 0;
+    ierr              = PetscOptionsInt("-band_dilation","\n\tNumber of layers of cells added around the damage band (0<V<1) in the fracture sweeps","",ctx->bandDilation,&ctx->bandDilation,NULL);CHKERRQ(ierr);
+    if (ctx->bandDilation < 0) SETERRQ2(PETSC_COMM_WORLD,PETSC_ERR_USER,"ERROR: -band_dilation must be nonnegative, got %i in %s\n",ctx->bandDilation,__FUNCT__);
+    ctx->bandTol      = 0.;
+    ierr              = PetscOptionsReal("-band_tol","\n\tTolerance on V for the cells of the damage band (tol<V<1-tol). The default 0 only skips the cells where V is exactly 0 or 1, a positive value also drops their fracture flow terms","",ctx->bandTol,&ctx->bandTol,NULL);CHKERRQ(ierr);
+    ctx->bandMask     = NULL;
+    ctx->bandCell     = NULL;
+    ctx->bandCount    = NULL;
+    ctx->daBand       = NULL;
+    ctx->bandActive   = NULL;
+    ctx->bandVlocal   = NULL;
+    ctx->nBand        = 0;
+    ctx->irrevIS      = NULL;
+    ctx->irrevV       = NULL;
+
     ctx->flowsolver = FLOWSOLVER_NONE;
     ierr            = PetscOptionsEnum("-flowsolver","\n\tFlow solver","",VFFlowSolverName,(PetscEnum)ctx->flowsolver,(PetscEnum*)&ctx->flowsolver,NULL);CHKERRQ(ierr);
+    ctx->flowFieldSplit = PETSC_FALSE;
+    ierr                = PetscOptionsBool("-flow_fieldsplit","\n\tSchur complement field split preconditioner (velocity, pressure) for the mixed FEM flow solvers","",ctx->flowFieldSplit,&ctx->flowFieldSplit,NULL);CHKERRQ(ierr);
 
     ctx->FlowDisplCoupling    = PETSC_FALSE;
     ierr                      = PetscOptionsBool("-poroelasticity","\n\t Geomechanics (coupled reservoir flow and deformation)","",ctx->FlowDisplCoupling,&ctx->FlowDisplCoupling,NULL);CHKERRQ(ierr);
@@ -175,6 +206,21 @@ extern PetscErrorCode VFCtxGet(VFCtx *ctx)
     ierr            = PetscOptionsInt("-altminmaxit","\n\tMaximum number of alternate minimizations iterations","",ctx->altminmaxit,&ctx->altminmaxit,NULL);CHKERRQ(ierr);
     ctx->unilateral = UNILATERAL_NONE;
     ierr            = PetscOptionsEnum("-unilateral","\n\tType of unilateral conditions","",VFUnilateralName,(PetscEnum)ctx->unilateral,(PetscEnum*)&ctx->unilateral,NULL);CHKERRQ(ierr);
+    ctx->Umatfree   = PETSC_FALSE;
+    ierr            = PetscOptionsBool("-U_matfree","\n\tMatrix free elasticity operator preconditioned by geometric multigrid","",ctx->Umatfree,&ctx->Umatfree,NULL);CHKERRQ(ierr);
+    ctx->UMGnlevels = 3;
+    ierr            = PetscOptionsInt("-U_matfree_mg_levels","\n\tNumber of multigrid levels of the matrix free elasticity solver","",ctx->UMGnlevels,&ctx->UMGnlevels,NULL);CHKERRQ(ierr);
+    ctx->cooAssembly = PETSC_FALSE;
+    ierr            = PetscOptionsBool("-coo_assembly","\n\tAssemble the U, V and flow matrices from stored element blocks (faster, stores a dense (8 dof)^2 block per local cell: 576 scalars for U, 64 for V, 1024 for the mixed flow; needs PETSc 3.14)","",ctx->cooAssembly,&ctx->cooAssembly,NULL);CHKERRQ(ierr);
+#if !PETSC_VERSION_GE(3,14,0)
+    if (ctx->cooAssembly) SETERRQ1(PETSC_COMM_WORLD,PETSC_ERR_SUP,"ERROR: -coo_assembly needs MatSetValuesCOO, available from PETSc 3.14 on, in %s\n",__FUNCT__);
+#endif
+    ctx->USuperposition = PETSC_FALSE;
+    ierr            = PetscOptionsBool("-U_superposition","\n\tWith uniform pressure and no unilateral conditions, get U, crack volume and energies from cached zero and unit pressure responses","",ctx->USuperposition,&ctx->USuperposition,NULL);CHKERRQ(ierr);
+    ctx->residualEnergy = PETSC_FALSE;
+    ierr            = PetscOptionsBool("-residual_energy","\n\tAccumulate the energies while evaluating the U and V residuals, instead of in a separate sweep","",ctx->residualEnergy,&ctx->residualEnergy,NULL);CHKERRQ(ierr);
+    ctx->flowReuseMatrix = PETSC_TRUE;
+    ierr            = PetscOptionsBool("-flow_reuse_matrix","\n\tKeep the flow matrices and preconditioner when permeability, V, U, width, storage and time step did not change","",ctx->flowReuseMatrix,&ctx->flowReuseMatrix,NULL);CHKERRQ(ierr);
     ctx->fileformat = FILEFORMAT_VTK;
     ierr            = PetscOptionsEnum("-format","\n\tFileFormat","",VFFileFormatName,(PetscEnum)ctx->fileformat,(PetscEnum*)&ctx->fileformat,NULL);CHKERRQ(ierr);
 
@@ -283,13 +329,16 @@ extern PetscErrorCode VFGeometryInitialize(VFCtx *ctx)
   PetscReal      *X,*Y,*Z;
   PetscReal      ****coords_array;
   PetscInt       xs,xm,ys,ym,zs,zm;
-  int            i,j,k;
+  int            i,j,k,c;
   int            nval;
+  Vec            vol_local;
+  PetscReal      ***vol_array,cellvol;
   PetscInt       *n,nx,ny,nz;
   PetscReal      *l,lx,ly,lz;
   const PetscInt *lx1,*ly1,*lz1;
   PetscInt       x_nprocs,y_nprocs,z_nprocs,*olx,*oly,*olz;
   PetscBool      flg;
+  PetscInt       ng1D,ng1DU,ng1DV;
 
   PetscFunctionBegin;
   ierr = PetscOptionsBegin(PETSC_COMM_WORLD,NULL,"\n\nVF-Chevron: geometry options:","");CHKERRQ(ierr);
@@ -313,6 +362,16 @@ extern PetscErrorCode VFGeometryInitialize(VFCtx *ctx)
     ny   = n[1];
     nz   = n[2];
     ierr = PetscFree(n);CHKERRQ(ierr);
+
+    ng1D = 3;
+    ierr = PetscOptionsInt("-fe_quadrature","\n\tNumber of integration points along each axis of an element (2 or 3, default 3)","",ng1D,&ng1D,NULL);CHKERRQ(ierr);
+    ng1DU = ng1D;
+    ierr = PetscOptionsInt("-U_fe_quadrature","\n\tNumber of integration points along each axis in the U operators (2 or 3, default -fe_quadrature)","",ng1DU,&ng1DU,NULL);CHKERRQ(ierr);
+    ng1DV = ng1D;
+    ierr = PetscOptionsInt("-V_fe_quadrature","\n\tNumber of integration points along each axis in the V operators (2 or 3, default -fe_quadrature)","",ng1DV,&ng1DV,NULL);CHKERRQ(ierr);
+    if (ng1D < 2 || ng1D > VFCARTFE_MAXNG1D || ng1DU < 2 || ng1DU > VFCARTFE_MAXNG1D || ng1DV < 2 || ng1DV > VFCARTFE_MAXNG1D) {
+      SETERRQ1(PETSC_COMM_WORLD,PETSC_ERR_USER,"ERROR: the number of integration points must be 2 or 3 in %s\n",__FUNCT__);
+    }
   }
   ierr = PetscOptionsEnd();CHKERRQ(ierr);
 
@@ -336,6 +395,10 @@ extern PetscErrorCode VFGeometryInitialize(VFCtx *ctx)
                       NULL,NULL,NULL,&ctx->daFlow);CHKERRQ(ierr);
   ierr = DMSetFromOptions(ctx->daFlow);CHKERRQ(ierr);
   ierr = DMSetUp(ctx->daFlow);CHKERRQ(ierr);
+  ierr = DMDASetFieldName(ctx->daFlow,0,"Velocity_X");CHKERRQ(ierr);
+  ierr = DMDASetFieldName(ctx->daFlow,1,"Velocity_Y");CHKERRQ(ierr);
+  ierr = DMDASetFieldName(ctx->daFlow,2,"Velocity_Z");CHKERRQ(ierr);
+  ierr = DMDASetFieldName(ctx->daFlow,3,"Pressure");CHKERRQ(ierr);
 
 
   ierr = DMDAGetCorners(ctx->daScal,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
@@ -377,6 +440,7 @@ extern PetscErrorCode VFGeometryInitialize(VFCtx *ctx)
 
   ierr = VFCartFEInit();CHKERRQ(ierr);
   ierr = VFCartFEElement3DCreate(&ctx->e3D);CHKERRQ(ierr);
+  ierr = VFCartFEElement2DCreate(&ctx->e2D);CHKERRQ(ierr);
   /*
    Constructs coordinates Vec
   */
@@ -404,6 +468,43 @@ extern PetscErrorCode VFGeometryInitialize(VFCtx *ctx)
         coords_array[k][j][i][0] = X[i];
       }
   }
+  /*
+   The grid is a tensor product, so a cell element only depends on the sizes of the cell along each axis.
+   The 2 points rule is exact for the U stiffness but underintegrates the terms involving v^2 or products of fields.
+  */
+  ierr = PetscMemzero(ctx->feCacheQ,sizeof(ctx->feCacheQ));CHKERRQ(ierr);
+  ierr = VFCartFEElementCacheCreate(&ctx->feCacheQ[ng1D-1],nx,ny,nz,X,Y,Z,ng1D);CHKERRQ(ierr);
+  if (!ctx->feCacheQ[ng1DU-1].e3D) {
+    ierr = VFCartFEElementCacheCreate(&ctx->feCacheQ[ng1DU-1],nx,ny,nz,X,Y,Z,ng1DU);CHKERRQ(ierr);
+  }
+  if (!ctx->feCacheQ[ng1DV-1].e3D) {
+    ierr = VFCartFEElementCacheCreate(&ctx->feCacheQ[ng1DV-1],nx,ny,nz,X,Y,Z,ng1DV);CHKERRQ(ierr);
+  }
+  ctx->feCache  = &ctx->feCacheQ[ng1D-1];
+  ctx->feCacheU = &ctx->feCacheQ[ng1DU-1];
+  ctx->feCacheV = &ctx->feCacheQ[ng1DV-1];
+  /*
+   Inverse of the lumped nodal volumes (sum of the volumes of the cells sharing a node), used by CellToNodeInterpolation
+  */
+  ierr = DMCreateGlobalVector(ctx->daScal,&ctx->NodalVolumeInv);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daScal,&vol_local);CHKERRQ(ierr);
+  ierr = VecSet(vol_local,0.);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScal,vol_local,&vol_array);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  for (k = zs; k < zs + zm; k++) {
+    for (j = ys; j < ys + ym; j++) {
+      for (i = xs; i < xs + xm; i++) {
+        cellvol = (X[i+1]-X[i])*(Y[j+1]-Y[j])*(Z[k+1]-Z[k]);
+        for (c = 0; c < 8; c++) vol_array[k+c/4][j+(c/2)%2][i+c%2] += cellvol;
+      }
+    }
+  }
+  ierr = DMDAVecRestoreArray(ctx->daScal,vol_local,&vol_array);CHKERRQ(ierr);
+  ierr = VecSet(ctx->NodalVolumeInv,0.);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalBegin(ctx->daScal,vol_local,ADD_VALUES,ctx->NodalVolumeInv);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalEnd(ctx->daScal,vol_local,ADD_VALUES,ctx->NodalVolumeInv);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&vol_local);CHKERRQ(ierr);
+  ierr = VecReciprocal(ctx->NodalVolumeInv);CHKERRQ(ierr);
   ierr = PetscFree3(X,Y,Z);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
 
@@ -914,6 +1015,11 @@ extern PetscErrorCode VFFieldsInitialize(VFCtx *ctx,VFFields *fields)
   ctx->WidthIntLenght = (3*res+4*ctx->vfprop.epsilon);
 
   st = ctx->WidthIntLenght/(res);
+  /*
+    The rays of the width integration are forwarded to the processors owning the cells they reach, 
+    the usual layer of ghost nodes is enough
+  */
+  if (ctx->widthDistributed) st = 0;
   if (ctx->FractureFlowCoupling == PETSC_TRUE) {
     ierr = DMDACreate3d(PETSC_COMM_WORLD,DM_BOUNDARY_NONE,DM_BOUNDARY_NONE,DM_BOUNDARY_NONE,
                         DMDA_STENCIL_BOX,nx,ny,nz,x_nprocs,y_nprocs,z_nprocs,1,st+1,
@@ -936,6 +1042,14 @@ extern PetscErrorCode VFFieldsInitialize(VFCtx *ctx,VFFields *fields)
     ierr = DMSetFromOptions(ctx->daWScalCell);CHKERRQ(ierr);
     ierr = DMSetUp(ctx->daWScalCell);CHKERRQ(ierr);
 
+    if (ctx->widthDistributed) {
+      ierr = DMDACreate3d(PETSC_COMM_WORLD,DM_BOUNDARY_NONE,DM_BOUNDARY_NONE,DM_BOUNDARY_NONE,
+                          DMDA_STENCIL_BOX,nx-1,ny-1,nz-1,x_nprocs,y_nprocs,z_nprocs,VF_WIDTHCACHE_NC,1,
+                          olx,oly,olz,&ctx->daWCacheCell);CHKERRQ(ierr);
+      ierr = DMSetFromOptions(ctx->daWCacheCell);CHKERRQ(ierr);
+      ierr = DMSetUp(ctx->daWCacheCell);CHKERRQ(ierr);
+    }
+
   }
   PetscFunctionReturn(0);
 }
@@ -1011,11 +1125,16 @@ extern PetscErrorCode VFSolversInitialize(VFCtx *ctx)
   Mat            JacV,JacU,JacPCU;
   Vec            residualV,residualU;
   SNESLineSearch lsU;
+  PetscInt       l;
 
   PetscFunctionBegin;
   /*
    U solver initialization
    */
+  ierr = PetscMalloc(ctx->nlayer * sizeof(VFUStiffness),&ctx->UStiffness);CHKERRQ(ierr);
+  for (l = 0; l < ctx->nlayer; l++) {
+    ierr = PetscMemzero(&ctx->UStiffness[l],sizeof(VFUStiffness));CHKERRQ(ierr);
+  }
 
   ierr = SNESCreate(PETSC_COMM_WORLD,&ctx->snesU);CHKERRQ(ierr);
   ierr = SNESSetDM(ctx->snesU,ctx->daVect);CHKERRQ(ierr);
@@ -1029,22 +1148,46 @@ extern PetscErrorCode VFSolversInitialize(VFCtx *ctx)
   ierr = SNESLineSearchSetType(lsU,SNESLINESEARCHL2);CHKERRQ(ierr);
 
   ierr = DMCreateGlobalVector(ctx->daVect,&residualU);CHKERRQ(ierr);
-  ierr = DMCreateMatrix(ctx->daVect,&JacU);CHKERRQ(ierr);
-  ierr = MatSetOption(JacU,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
-  ierr = DMCreateMatrix(ctx->daVect,&JacPCU);CHKERRQ(ierr);
-  ierr = MatSetOption(JacPCU,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
   ierr = SNESSetFunction(ctx->snesU,residualU,VF_UResidual,ctx);CHKERRQ(ierr);
-  ierr = SNESSetJacobian(ctx->snesU,JacU,JacPCU,VF_UIJacobian,ctx);CHKERRQ(ierr);
+  if (ctx->Umatfree) {
+    ierr = VF_UMatFreeInitialize(ctx,&JacU);CHKERRQ(ierr);
+    ierr = SNESSetJacobian(ctx->snesU,JacU,JacU,VF_UMatFreeJacobian,ctx);CHKERRQ(ierr);
+  } else {
+    ierr = DMCreateMatrix(ctx->daVect,&JacU);CHKERRQ(ierr);
+    ierr = MatSetOption(JacU,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+    ierr = DMCreateMatrix(ctx->daVect,&JacPCU);CHKERRQ(ierr);
+    ierr = MatSetOption(JacPCU,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+    /*
+      The preconditioner only differs from the operator with unilateral conditions
+    */
+    ierr = PetscMemzero(&ctx->cooU,sizeof(VFCartFEMatCOO));CHKERRQ(ierr);
+    ierr = PetscMemzero(&ctx->cooUPC,sizeof(VFCartFEMatCOO));CHKERRQ(ierr);
+    if (ctx->cooAssembly) {
+      ierr = VFCartFEMatCOOCreate(&ctx->cooU,ctx->daVect,ctx->daScalCell);CHKERRQ(ierr);
+      ierr = VFCartFEMatCOOSetPreallocation(&ctx->cooU,JacU);CHKERRQ(ierr);
+      ierr = VFCartFEMatCOOSetPreallocation(&ctx->cooU,JacPCU);CHKERRQ(ierr);
+      if (ctx->unilateral != UNILATERAL_NONE) {
+        ierr = VFCartFEMatCOOCreate(&ctx->cooUPC,ctx->daVect,ctx->daScalCell);CHKERRQ(ierr);
+      }
+    }
+    ierr = SNESSetJacobian(ctx->snesU,JacU,JacPCU,VF_UIJacobian,ctx);CHKERRQ(ierr);
+  }
+  ierr = PetscMemzero(&ctx->USup,sizeof(VFUSuperposition));CHKERRQ(ierr);
+  ierr = PetscMemzero(&ctx->REnergy,sizeof(VFResidualEnergy));CHKERRQ(ierr);
 
   ierr = SNESGetKSP(ctx->snesU,&kspU);CHKERRQ(ierr);
   ierr = KSPSetTolerances(kspU,1.e-8,1.e-10,PETSC_DEFAULT,PETSC_DEFAULT);CHKERRQ(ierr);
   ierr = KSPSetType(kspU,KSPCG);CHKERRQ(ierr);
   ierr = KSPSetFromOptions(kspU);CHKERRQ(ierr);
   ierr = KSPGetPC(kspU,&pcU);CHKERRQ(ierr);
+  if (ctx->Umatfree) {
+    ierr = VF_UMatFreePCSetUp(pcU,ctx);CHKERRQ(ierr);
+  } else {
 #ifdef PETSC_HAS_HYPRE
-  ierr = PCSetType(pcU,PCHYPRE);CHKERRQ(ierr);
-  ierr = PetscOptionsInsertString(NULL,"-u_pc_hypre_boomeramg_strong_threshold 0.7 -u_pc_hypre_type boomeramg");CHKERRQ(ierr);
+    ierr = PCSetType(pcU,PCHYPRE);CHKERRQ(ierr);
+    ierr = PetscOptionsInsertString(NULL,"-u_pc_hypre_boomeramg_strong_threshold 0.7 -u_pc_hypre_type boomeramg");CHKERRQ(ierr);
 #endif
+  }
   ierr = PCSetFromOptions(pcU);CHKERRQ(ierr);
 
   /*
@@ -1074,6 +1217,11 @@ extern PetscErrorCode VFSolversInitialize(VFCtx *ctx)
   ierr = DMCreateGlobalVector(ctx->daScal,&residualV);CHKERRQ(ierr);
   ierr = DMCreateMatrix(ctx->daScal,&JacV);CHKERRQ(ierr);
   ierr = MatSetOption(JacV,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = PetscMemzero(&ctx->cooV,sizeof(VFCartFEMatCOO));CHKERRQ(ierr);
+  if (ctx->cooAssembly) {
+    ierr = VFCartFEMatCOOCreate(&ctx->cooV,ctx->daScal,ctx->daScalCell);CHKERRQ(ierr);
+    ierr = VFCartFEMatCOOSetPreallocation(&ctx->cooV,JacV);CHKERRQ(ierr);
+  }
   ierr = SNESSetFunction(ctx->snesV,residualV,VF_VResidual,ctx);CHKERRQ(ierr);
   ierr = SNESSetJacobian(ctx->snesV,JacV,JacV,VF_VIJacobian,ctx);CHKERRQ(ierr);
 
@@ -1123,7 +1271,7 @@ extern PetscErrorCode VFLayerInit(VFCtx *ctx)
 #define __FUNCT__ "VFTimeStepPrepare"
 /*
  VFTimeStepPrepare: Prepare for a new time step:
- - Update VIrrev
+ - Update VIrrev and the set of irreversibly broken nodes
  - Read boundary displacement from files if necessary
  - Set boundary values of U and V
 
@@ -1139,6 +1287,9 @@ extern PetscErrorCode VFTimeStepPrepare(VFCtx *ctx,VFFields *fields)
    Initialize VIrrev with the result of past iteration
    */
   ierr = VecCopy(fields->V,fields->VIrrev);CHKERRQ(ierr);
+  if (ctx->vfprop.atnum == 2) {
+    ierr = VF_IrrevUpdate(fields->VIrrev,&ctx->vfprop,ctx);CHKERRQ(ierr);
+  }
 
   /*
    Set boundary values for U and V,
@@ -1244,6 +1395,7 @@ extern PetscErrorCode VFFinalize(VFCtx *ctx,VFFields *fields)
   char           filename[FILENAME_MAX];
   PetscViewer    optionsviewer;
   PetscInt       nopts;
+  PetscInt       i;
 
   PetscFunctionBegin;
 
@@ -1260,13 +1412,36 @@ extern PetscErrorCode VFFinalize(VFCtx *ctx,VFFields *fields)
   ierr = DMDestroy(&ctx->daFlow);CHKERRQ(ierr);
   ierr = DMDestroy(&ctx->daScalCell);CHKERRQ(ierr);
   ierr = DMDestroy(&ctx->daVectCell);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->NodalVolumeInv);CHKERRQ(ierr);
+  for (i = 0; i < VFCARTFE_MAXNG1D; i++) {
+    if (ctx->feCacheQ[i].e3D) {
+      ierr = VFCartFEElementCacheDestroy(&ctx->feCacheQ[i]);CHKERRQ(ierr);
+    }
+  }
   if (ctx->flowsolver != FLOWSOLVER_NONE) {
     ierr = DMDestroy(&ctx->daWScalCell);CHKERRQ(ierr);
     ierr = DMDestroy(&ctx->daWScal);CHKERRQ(ierr);
     ierr = DMDestroy(&ctx->daWVect);CHKERRQ(ierr);
+    ierr = DMDestroy(&ctx->daWCacheCell);CHKERRQ(ierr);
   }
   ierr = SNESDestroy(&ctx->snesU);CHKERRQ(ierr);
   ierr = SNESDestroy(&ctx->snesV);CHKERRQ(ierr);
+  for (i = 0; i < ctx->nlayer; i++) {
+    ierr = VF_UStiffnessDestroy(&ctx->UStiffness[i]);CHKERRQ(ierr);
+  }
+  ierr = PetscFree(ctx->UStiffness);CHKERRQ(ierr);
+  if (ctx->Umatfree) {
+    ierr = VF_UMatFreeFinalize(ctx);CHKERRQ(ierr);
+  } else {
+    ierr = VFCartFEMatCOODestroy(&ctx->cooU);CHKERRQ(ierr);
+    ierr = VFCartFEMatCOODestroy(&ctx->cooUPC);CHKERRQ(ierr);
+  }
+  ierr = VFCartFEMatCOODestroy(&ctx->cooV);CHKERRQ(ierr);
+  ierr = VF_USuperpositionDestroy(ctx);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->REnergy.U);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->REnergy.V);CHKERRQ(ierr);
+  ierr = VFDamageBandDestroy(ctx);CHKERRQ(ierr);
+  ierr = ISDestroy(&ctx->irrevIS);CHKERRQ(ierr);
   ierr = VecDestroy(&ctx->pressure_old);CHKERRQ(ierr);
 
 
@@ -20,6 +20,18 @@ static const char banner[] = "\n\nVPFHF: A Variational Phase-Field based Hydro-F
   "# or \"FreeBSD\") license. See the LICENSE file in the root of the software distribution\n\n"
   "# See the CONTRIBUTORS.txt file for a list of contributors to this software.\n\n";
 
+/*
+ VFPragmaOMP: OpenMP pragma, ignored unless compiled with OpenMP (PETSc configured with --with-openmp).
+ The parallel regions only call the plain C *_Kernel functions, which neither allocate nor raise errors and add 
+ their flops to a reduction variable logged once after the loop, so PETSc needs no --with-threadsafety.
+ */
+#if defined(_OPENMP)
+#define VFStringize_(...) #__VA_ARGS__
+#define VFPragmaOMP(...) _Pragma(VFStringize_(omp __VA_ARGS__))
+#else
+#define VFPragmaOMP(...)
+#endif
+
 typedef struct {
 	PetscReal   mu;             /* Fluid viscosity              */
 	PetscReal   rho;            /* Fluid density                */
@@ -132,7 +144,8 @@ typedef enum {
 	FLOWSOLVER_TSMIXEDFEM,
 	FLOWSOLVER_FAKE,
 	FLOWSOLVER_READFROMFILES,
-	FLOWSOLVER_NONE
+	FLOWSOLVER_NONE,
+	FLOWSOLVER_TPFA
 } VFFlowSolverType;
 
 typedef enum {
@@ -210,6 +223,65 @@ typedef struct {
 	 */
 } VFResProp;
 
+/*
+ Reference stiffness of the elasticity bilinear form at the gauss points:
+ Kg[g*nrow*nrow+l] = w_g (lambda A_g + mu B_g) for the element matrix entry l,
+ so that the element matrix is \sum_g s(v_g) Kg[g]
+ */
+typedef struct {
+	PetscReal           hx,hy,hz;       /* cell size the tensors were built for */
+	PetscReal           lambda,mu;      /* Lame coefficients used to build them */
+	PetscInt            ng,nrow;
+	PetscReal          *Kg;
+} VFUStiffness;
+
+/*
+ Responses of the linear (no unilateral conditions) U problem to a uniform pressure at fixed V, theta and BC:
+ U(p) = U0 + p U1, so that the crack volume is affine in p and the energies quadratic in p.
+ */
+typedef struct {
+	PetscBool           valid;
+	Vec                 U0,U1;
+	Vec                 VolCrackOpening0,VolCrackOpening1;
+	PetscReal           CrackVolume[2];        /* coefficients of 1, p */
+	PetscReal           ElasticEnergy[3];      /* coefficients of 1, p, p^2 */
+	PetscReal           InsituWork[3];
+	PetscReal           PressureWork[3];
+	PetscInt            timestep;
+	PetscBool           hasCrackPressure,hasInsitu;
+	PetscObjectState    Vstate,thetastate,thetaRefstate;
+	PetscReal           p;                     /* pressure of the last superposed U */
+	PetscObjectState    Ustate,pressurestate;
+} VFUSuperposition;
+
+/*
+ Energies accumulated by the last evaluations of VF_UResidual and VF_VResidual (-residual_energy).
+ They are attached to fields->U (resp. fields->V) by VF_StepU (resp. VF_StepV) when the last residual 
+ was evaluated at the solution, and then returned by VF_UEnergy3D (resp. VF_VEnergy3D).
+ */
+typedef struct {
+	Vec                 U,V;                   /* copies of the arguments of the last residual evaluations */
+	PetscReal           myUWork[3],UWork[3];   /* local and global elastic energy, pressure work, in-situ work */
+	PetscReal           mySurfaceEnergy,SurfaceEnergy;
+	PetscBool           Uvalid,Vvalid;
+	PetscObjectState    Ustate,Vstate;         /* state of fields->U, fields->V when attached */
+	PetscObjectState    UVstate,pressurestate,thetastate,thetaRefstate; /* states of the U residual inputs */
+	PetscBool           hasCrackPressure,hasInsitu;
+} VFResidualEnergy;
+
+#define VFFLOWMAT_MAXINPUTS 8
+/*
+ Inputs of the last assembly of the flow matrices (-flow_reuse_matrix), see VFFlowMatInputsChanged.
+ */
+typedef struct {
+	PetscInt            n;
+	Vec                 x[VFFLOWMAT_MAXINPUTS];      /* input vectors */
+	Vec                 copy[VFFLOWMAT_MAXINPUTS];   /* their values at the last assembly */
+	PetscObjectState    state[VFFLOWMAT_MAXINPUTS];  /* their states when last compared */
+	PetscReal           theta,timevalue,mu;
+	PetscBool           valid;
+} VFFlowMatInputs;
+
 typedef struct {
 	PetscBool           printhelp;
 	PetscInt            nlayer;
@@ -221,10 +293,15 @@ typedef struct {
 	VFBC                bcT[1];
 	DM                  daVect;
 	DM                  daScal;
-	VFCartFEElement3D    e3D;
-	VFCartFEElement2D    e2D;
+	VFCartFEElement3D    e3D;            /* reference elements, only used for their sizes. */
+	VFCartFEElement2D    e2D;            /* The elements of a given cell are obtained from feCache */
+	VFCartFEElementCache feCacheQ[VFCARTFE_MAXNG1D]; /* feCacheQ[ng1D-1]: elements with ng1D integration points per axis, only built if used */
+	VFCartFEElementCache *feCache;       /* elements of the flow, heat and post-processing operators (-fe_quadrature) */
+	VFCartFEElementCache *feCacheU;      /* elements of the U operators (-U_fe_quadrature) */
+	VFCartFEElementCache *feCacheV;      /* elements of the V operators (-V_fe_quadrature) */
 	char                prefix[PETSC_MAX_PATH_LEN];
 	Vec                 coordinates;
+	Vec                 NodalVolumeInv;      /* inverse of the lumped nodal volumes, used by CellToNodeInterpolation */
 	PetscInt            verbose;
 	SNES                snesV;
 	SNES                snesU;
@@ -258,8 +335,12 @@ typedef struct {
 	Vec                 RHSVelPpre;
 	Vec                 Source;
 	DM                  daScalCell;
-	Mat                 KVelPlhs;
+	Mat                 KVelPlhs;            /* storage matrix of the TS mixed solver, not stored by the KSP and SNES ones */
+	Mat                 KVelPStorage;        /* storage block of KVelP on daScal, see MixedFEMFlowStorageAssemble */
+	PetscObjectState    KVelPStoragestate[2]; /* states of M_inv and K_dr when KVelPStorage was assembled */
 	Mat                 JacVelP;
+	PetscBool           flowFieldSplit;      /* Schur complement field split preconditioner for the mixed Darcy solvers */
+	Mat                 KVelPSchur;          /* approximate pressure Schur complement, see MixedFEMFlowSchurPreAssemble */
 	TS                  tsVelP;
 	SNES                snesVelP;
 	Vec                 FlowFunct;
@@ -271,6 +352,18 @@ typedef struct {
 	PetscBool           hasFluidSources;
 	Vec                 VelBCArray;
 	Vec				          PresBCArray;
+	/*
+	 Global variables for the cell centred (TPFA) Darcy flow
+	 */
+	DM                  daTPFA;              /* daScalCell with a star stencil of width 1 */
+	DM                  daTPFACond;          /* same layout, 3 dof: directional conductivity of the cells */
+	Mat                 KPCell;
+	KSP                 kspPCell;
+	Vec                 RHSPCell;
+	Vec                 PCell;               /* cell pressure */
+	Vec                 PCellOld;            /* cell pressure at the end of the previous time step */
+	Vec                 CondCell;
+	PetscInt            PCellStep;           /* time step PCellOld was last advanced at, -1 before the first solve */
 	
 	/*
 	 Global Variables for Heat Transfer
@@ -279,7 +372,6 @@ typedef struct {
 	Mat                 KTlhs;
 	PC                  pcT;
 	KSP                 kspT;
-	Mat                 JacT;
 	Vec                 PreHeatFields;
 	Vec                 RHST;
 	Vec                 HeatFunct;
@@ -294,6 +386,25 @@ typedef struct {
 	PetscReal           altmintol;
 	PetscInt            altminmaxit;
 	VFMatProp          *matprop;
+	VFUStiffness       *UStiffness;    /* dim=nlayer. Reference stiffness of each layer */
+	PetscBool           Umatfree;      /* matrix free U solver with geometric multigrid */
+	PetscInt            UMGnlevels;
+	DM                 *daVectMG;      /* dim=UMGnlevels, coarsest first. The finest levels are daVect and daScal */
+	DM                 *daScalMG;
+	Mat                *KUMG;          /* rediscretized U operator on the coarse levels */
+	Mat                *VinjectMG;     /* injection of V from level l+1 to level l */
+	Vec                *VMG;
+	Vec                *VlocalMG;
+	Vec                 UBCMask;       /* 0 on Dirichlet dofs of U, 1 elsewhere */
+	PetscBool           cooAssembly;   /* assemble the U, V and flow matrices from the element blocks (COO) */
+	VFCartFEMatCOO      cooU,cooUPC,cooV;
+	VFCartFEMatCOO      cooVelP;
+	PetscBool           USuperposition; /* U by superposition of cached responses when the pressure is uniform */
+	VFUSuperposition    USup;
+	PetscBool           residualEnergy; /* accumulate the energies in VF_UResidual and VF_VResidual */
+	VFResidualEnergy    REnergy;
+	PetscBool           flowReuseMatrix; /* only reassemble the flow matrices when their inputs changed */
+	VFFlowMatInputs     flowMatInputs;
 	VFResProp           resprop;
 	VFProp              vfprop;
 	PetscReal           insitumin[6];
@@ -377,6 +488,25 @@ typedef struct {
   PetscReal           pmult_vtol;          /* v threshold for pmult              */
   PetscReal           width_tol;          /* tolerance for tip removal              */
   PetscBool           removeTipEffect;
+  PetscBool           widthInterpolation; /* interpolate the ray samples from the cell centred fields */
+  PetscBool           widthDistributed;   /* forward the rays to the neighbouring processors */
+  PetscBool           widthEulerian;      /* integrate the width along the grid axes instead of along rays */
+  PetscBool           widthCompare;       /* with widthEulerian, also run the ray marching and print the difference */
+  DM                  daWCacheCell;       /* cell centred fields sampled by the rays, if widthDistributed */
+  PetscInt            bandDilation;       /* layers of cells added around the damage band */
+  PetscReal           bandTol;            /* V within bandTol of 0 or 1 is considered intact or broken (default 0) */
+  DM                  daBand;             /* daScalCell with a box stencil of width bandDilation */
+  Vec                 bandActive;         /* local vector of daBand. 1 on the undilated damage band */
+  Vec                 bandVlocal;         /* ghosted V at the last damage band update */
+  PetscInt           *bandCount;          /* dim=number of local cells. number of undilated band cells within bandDilation layers */
+  PetscInt            nBand;              /* number of local cells in the damage band */
+  PetscInt           *bandCell;           /* dim=3*nBand. (ei,ej,ek) of the damage band cells */
+  PetscBool          *bandMask;           /* dim=number of local cells. PETSC_TRUE in the damage band */
+  Vec                 bandV;              /* V the damage band was computed for */
+  PetscObjectState    bandVstate;
+  IS                  irrevIS;            /* sorted global indices of the local irreversibly broken nodes */
+  Vec                 irrevV;             /* VIrrev irrevIS was last updated from */
+  PetscObjectState    irrevVstate;
 } VFCtx;
 
 extern PetscErrorCode VFCtxGet(VFCtx *ctx);
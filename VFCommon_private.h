@@ -36,6 +36,7 @@ static const char *VFFlowSolverName[] = {
 	"FAKE",
 	"READFROMFILES",
 	"FLOWSOLVER_NONE",
+	"FLOWSOLVER_TPFA",
 	"VFFlowSolverName",
 	"",
 	0
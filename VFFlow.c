@@ -16,6 +16,7 @@
 #include "VFFlow_KSPMixedFEM.h"
 #include "VFFlow_SNESMixedFEM.h"
 #include "VFFlow_TSMixedFEM.h"
+#include "VFFlow_TPFA.h"
 #include "VFHeat_SNESFEM.h"
 #include "VFFlow_SNESStandardFEM.h"
 #include "VFPermfield.h"
@@ -40,7 +41,10 @@ extern PetscErrorCode FlowSolverFinalize(VFCtx *ctx,VFFields *fields)
 
   ierr = MatDestroy(&ctx->KVelP);CHKERRQ(ierr);
 	ierr = MatDestroy(&ctx->KVelPlhs);CHKERRQ(ierr);
+  ierr = MatDestroy(&ctx->KVelPStorage);CHKERRQ(ierr);
+  ierr = VFCartFEMatCOODestroy(&ctx->cooVelP);CHKERRQ(ierr);
 	ierr = MatDestroy(&ctx->JacVelP);CHKERRQ(ierr);
+  ierr = MatDestroy(&ctx->KVelPSchur);CHKERRQ(ierr);
   
   ierr = VecDestroy(&ctx->RHSP);CHKERRQ(ierr);
 	ierr = VecDestroy(&ctx->RHSPpre);CHKERRQ(ierr);
@@ -49,6 +53,7 @@ extern PetscErrorCode FlowSolverFinalize(VFCtx *ctx,VFFields *fields)
   ierr = MatDestroy(&ctx->KP);CHKERRQ(ierr);
 	ierr = MatDestroy(&ctx->KPlhs);CHKERRQ(ierr);
 	ierr = MatDestroy(&ctx->JacP);CHKERRQ(ierr);
+  ierr = VFFlowMatInputsDestroy(&ctx->flowMatInputs);CHKERRQ(ierr);
   
   switch (ctx->flowsolver) {
   case FLOWSOLVER_KSPMIXEDFEM:
@@ -60,6 +65,9 @@ extern PetscErrorCode FlowSolverFinalize(VFCtx *ctx,VFFields *fields)
   case FLOWSOLVER_SNESMIXEDFEM:
     ierr = MixedFEMSNESFlowSolverFinalize(ctx,fields);CHKERRQ(ierr);
     break;
+  case FLOWSOLVER_TPFA:
+    ierr = TPFAFlowSolverFinalize(ctx,fields);CHKERRQ(ierr);
+    break;
   case FLOWSOLVER_SNESSTANDARDFEM:
     ierr = VFFlow_SNESStandardFEMFinalize(ctx,fields);CHKERRQ(ierr);
     break;
@@ -92,26 +100,59 @@ extern PetscErrorCode FlowSolverInitialize(VFCtx *ctx,VFFields *fields)
     
 	ierr = GetFlowProp(&ctx->flowprop,&ctx->resprop,ctx->matprop,ctx,fields,ctx->nlayer);CHKERRQ(ierr);
   
-  ierr = DMCreateMatrix(ctx->daScal,&ctx->KP);CHKERRQ(ierr);
-  ierr = MatSetOption(ctx->KP,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
-  ierr = MatZeroEntries(ctx->KP);CHKERRQ(ierr);
-
-  ierr = DMCreateMatrix(ctx->daScal,&ctx->KPlhs);CHKERRQ(ierr);
-  ierr = MatSetOption(ctx->KPlhs,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
-  ierr = MatZeroEntries(ctx->KPlhs);CHKERRQ(ierr);
+  /*
+    The TPFA solver assembles its own cell centred matrix (see TPFAFlowSolverInitialize), 
+    none of the nodal flow matrices below are created for it
+  */
+  ctx->KP    = NULL;
+  ctx->KPlhs = NULL;
+  ctx->KVelP = NULL;
+  if (ctx->flowsolver != FLOWSOLVER_TPFA) {
+    ierr = DMCreateMatrix(ctx->daScal,&ctx->KP);CHKERRQ(ierr);
+    ierr = MatSetOption(ctx->KP,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+    ierr = MatZeroEntries(ctx->KP);CHKERRQ(ierr);
+
+    ierr = DMCreateMatrix(ctx->daScal,&ctx->KPlhs);CHKERRQ(ierr);
+    ierr = MatSetOption(ctx->KPlhs,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+    ierr = MatZeroEntries(ctx->KPlhs);CHKERRQ(ierr);
+  }
 
-  ierr = DMCreateMatrix(ctx->daScal,&ctx->JacP);CHKERRQ(ierr);
-  ierr = MatSetOption(ctx->JacP,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
-  ierr = MatZeroEntries(ctx->JacP);CHKERRQ(ierr);  
+  /*
+    The SNES solvers use KP and KVelP as their Jacobians, only the TS solvers need separate Jacobian matrices
+    (JacP is created by FEMTSFlowSolverInitialize)
+  */
+  ctx->JacP = NULL;
   
   ierr = MPI_Comm_size(PETSC_COMM_WORLD,&comm_size);CHKERRQ(ierr);
-  ierr = DMCreateMatrix(ctx->daFlow,&ctx->KVelP);CHKERRQ(ierr);
-  ierr = MatSetOption(ctx->KVelP,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
-  ierr = MatZeroEntries(ctx->KVelP);CHKERRQ(ierr);
+  if (ctx->flowsolver != FLOWSOLVER_TPFA) {
+    ierr = DMCreateMatrix(ctx->daFlow,&ctx->KVelP);CHKERRQ(ierr);
+    ierr = MatSetOption(ctx->KVelP,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+    ierr = MatZeroEntries(ctx->KVelP);CHKERRQ(ierr);
+  }
 
-  ierr = DMCreateMatrix(ctx->daFlow,&ctx->KVelPlhs);CHKERRQ(ierr);
-  ierr = MatSetOption(ctx->KVelPlhs,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
-  ierr = MatZeroEntries(ctx->KVelPlhs);CHKERRQ(ierr);
+  /*
+    The KSP and SNES mixed solvers only store K = M + theta A, the explicit part of the theta scheme is applied from K
+    and the pressure storage block M (see MixedFEMFlowExplicitMultAdd)
+  */
+  ctx->KVelPlhs = NULL;
+  ctx->KVelPStorage = NULL;
+  ctx->KVelPStoragestate[0] = -1;
+  ctx->KVelPStoragestate[1] = -1;
+  if (ctx->flowsolver == FLOWSOLVER_KSPMIXEDFEM || ctx->flowsolver == FLOWSOLVER_SNESMIXEDFEM) {
+    ierr = DMCreateMatrix(ctx->daScal,&ctx->KVelPStorage);CHKERRQ(ierr);
+    ierr = MatSetOption(ctx->KVelPStorage,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+    ierr = MatZeroEntries(ctx->KVelPStorage);CHKERRQ(ierr);
+  } else if (ctx->flowsolver != FLOWSOLVER_TPFA) {
+    ierr = DMCreateMatrix(ctx->daFlow,&ctx->KVelPlhs);CHKERRQ(ierr);
+    ierr = MatSetOption(ctx->KVelPlhs,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+    ierr = MatZeroEntries(ctx->KVelPlhs);CHKERRQ(ierr);
+  }
+  
+  ierr = PetscMemzero(&ctx->cooVelP,sizeof(VFCartFEMatCOO));CHKERRQ(ierr);
+  if (ctx->cooAssembly && (ctx->flowsolver == FLOWSOLVER_KSPMIXEDFEM || ctx->flowsolver == FLOWSOLVER_SNESMIXEDFEM)) {
+    ierr = VFCartFEMatCOOCreate(&ctx->cooVelP,ctx->daFlow,ctx->daScalCell);CHKERRQ(ierr);
+    ierr = VFCartFEMatCOOSetPreallocation(&ctx->cooVelP,ctx->KVelP);CHKERRQ(ierr);
+  }
   
   ierr = DMCreateGlobalVector(ctx->daFlow,&ctx->RHSVelP);CHKERRQ(ierr);
   ierr = PetscObjectSetName((PetscObject)ctx->RHSVelP,"RHS of flow solver");CHKERRQ(ierr);
@@ -121,9 +162,17 @@ extern PetscErrorCode FlowSolverInitialize(VFCtx *ctx,VFFields *fields)
   ierr = PetscObjectSetName((PetscObject)ctx->RHSVelPpre,"Previous RHS of flow solver");CHKERRQ(ierr);
   ierr = VecSet(ctx->RHSVelPpre,0.);CHKERRQ(ierr);
   
-  ierr = DMCreateMatrix(ctx->daFlow,&ctx->JacVelP);CHKERRQ(ierr);
-	ierr = MatZeroEntries(ctx->JacVelP);CHKERRQ(ierr);
-	ierr = MatSetOption(ctx->JacVelP,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+  ctx->JacVelP = NULL;
+  if (ctx->flowsolver == FLOWSOLVER_TSMIXEDFEM) {
+    ierr = DMCreateMatrix(ctx->daFlow,&ctx->JacVelP);CHKERRQ(ierr);
+    ierr = MatZeroEntries(ctx->JacVelP);CHKERRQ(ierr);
+    ierr = MatSetOption(ctx->JacVelP,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+  }
+  ctx->KVelPSchur = NULL;
+  if (ctx->flowFieldSplit) {
+    ierr = DMCreateMatrix(ctx->daScal,&ctx->KVelPSchur);CHKERRQ(ierr);
+    ierr = MatSetOption(ctx->KVelPSchur,MAT_NEW_NONZERO_ALLOCATION_ERR,PETSC_FALSE);CHKERRQ(ierr);
+  }
   
 	ierr = DMCreateGlobalVector(ctx->daFlow,&ctx->FlowFunct);CHKERRQ(ierr);
 	ierr = PetscObjectSetName((PetscObject)ctx->FlowFunct,"RHS of SNES flow solver");CHKERRQ(ierr);
@@ -140,6 +189,7 @@ extern PetscErrorCode FlowSolverInitialize(VFCtx *ctx,VFFields *fields)
 	ierr = DMCreateGlobalVector(ctx->daScal,&ctx->PFunct);CHKERRQ(ierr);
   ierr = PetscObjectSetName((PetscObject)ctx->PFunct,"Residual of Standard FEM Flow Formulation");CHKERRQ(ierr);
   ierr = VecSet(ctx->PFunct,0.);CHKERRQ(ierr);
+  ierr = PetscMemzero(&ctx->flowMatInputs,sizeof(VFFlowMatInputs));CHKERRQ(ierr);
   
   switch (ctx->flowsolver) {
   case FLOWSOLVER_KSPMIXEDFEM:
@@ -151,6 +201,9 @@ extern PetscErrorCode FlowSolverInitialize(VFCtx *ctx,VFFields *fields)
   case FLOWSOLVER_SNESMIXEDFEM:
     ierr = MixedFEMSNESFlowSolverInitialize(ctx,fields);CHKERRQ(ierr);
     break;
+  case FLOWSOLVER_TPFA:
+    ierr = TPFAFlowSolverInitialize(ctx,fields);CHKERRQ(ierr);
+    break;
   case FLOWSOLVER_SNESSTANDARDFEM:
     ierr = VFFlow_SNESStandardFEMInitialize(ctx,fields);CHKERRQ(ierr);
     break;
@@ -172,6 +225,86 @@ extern PetscErrorCode FlowSolverInitialize(VFCtx *ctx,VFFields *fields)
   PetscFunctionReturn(0);
 }
 
+#undef __FUNCT__
+#define __FUNCT__ "VFFlowMatInputsChanged"
+/*
+  VFFlowMatInputsChanged: Checks whether the n inputs x of a flow matrix, theta, the time step size or the viscosity
+  changed since the last call which returned changed = PETSC_TRUE, in which case the matrix is to be reassembled.
+  An input whose state changed is compared to a copy of its values at the last assembly, since pmult, widthc
+  and vfperm are recomputed, most of the time to the same values, in each iteration of the U-P loop.
+  Always returns PETSC_TRUE without -flow_reuse_matrix.
+*/
+extern PetscErrorCode VFFlowMatInputsChanged(VFFlowMatInputs *mi,PetscInt n,Vec *x,VFCtx *ctx,PetscBool *changed)
+{
+  PetscErrorCode   ierr;
+  PetscObjectState state[VFFLOWMAT_MAXINPUTS];
+  PetscInt         i;
+  PetscMPIInt      mystale[VFFLOWMAT_MAXINPUTS],stale[VFFLOWMAT_MAXINPUTS];
+  PetscBool        flg;
+  
+  PetscFunctionBegin;
+  if (n > VFFLOWMAT_MAXINPUTS) SETERRQ3(PETSC_COMM_WORLD,PETSC_ERR_ARG_OUTOFRANGE,"ERROR: at most %i flow matrix inputs, got %i in %s\n",VFFLOWMAT_MAXINPUTS,n,__FUNCT__);
+  *changed = PETSC_TRUE;
+  if (!ctx->flowReuseMatrix) PetscFunctionReturn(0);
+  for (i = 0; i < n; i++) {
+    ierr = PetscObjectStateGet((PetscObject)x[i],&state[i]);CHKERRQ(ierr);
+  }
+  if (mi->valid && mi->n == n && mi->theta == ctx->theta && mi->timevalue == ctx->timevalue && mi->mu == ctx->flowprop.mu) {
+    *changed = PETSC_FALSE;
+    for (i = 0; i < n; i++) {
+      if (x[i] != mi->x[i]) *changed = PETSC_TRUE;
+      mystale[i] = (state[i] != mi->state[i]);
+    }
+  }
+  if (!*changed) {
+    /*
+      The states of the inputs may differ between processors, decide collectively which inputs are compared
+    */
+    ierr = MPI_Allreduce(mystale,stale,n,MPI_INT,MPI_LOR,PETSC_COMM_WORLD);CHKERRQ(ierr);
+    for (i = 0; i < n && !*changed; i++) {
+      if (!stale[i]) continue;
+      ierr = VecEqual(x[i],mi->copy[i],&flg);CHKERRQ(ierr);
+      if (flg) mi->state[i] = state[i];
+      else *changed = PETSC_TRUE;
+    }
+  }
+  if (*changed) {
+    for (i = 0; i < n; i++) {
+      if (i >= mi->n || x[i] != mi->x[i]) {
+        ierr = VecDestroy(&mi->copy[i]);CHKERRQ(ierr);
+        ierr = VecDuplicate(x[i],&mi->copy[i]);CHKERRQ(ierr);
+        mi->x[i] = x[i];
+      }
+      ierr = VecCopy(x[i],mi->copy[i]);CHKERRQ(ierr);
+      mi->state[i] = state[i];
+    }
+    for (i = n; i < mi->n; i++) {
+      ierr = VecDestroy(&mi->copy[i]);CHKERRQ(ierr);
+      mi->x[i] = NULL;
+    }
+    mi->n         = n;
+    mi->theta     = ctx->theta;
+    mi->timevalue = ctx->timevalue;
+    mi->mu        = ctx->flowprop.mu;
+    mi->valid     = PETSC_TRUE;
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFFlowMatInputsDestroy"
+extern PetscErrorCode VFFlowMatInputsDestroy(VFFlowMatInputs *mi)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  
+  PetscFunctionBegin;
+  for (i = 0; i < mi->n; i++) {
+    ierr = VecDestroy(&mi->copy[i]);CHKERRQ(ierr);
+  }
+  ierr = PetscMemzero(mi,sizeof(VFFlowMatInputs));CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
 
 /*
  VF_StepP: Does one time step of the flow solver selected in ctx.flowsolver
@@ -204,6 +337,9 @@ extern PetscErrorCode VF_StepP(VFFields *fields,VFCtx *ctx)
     case FLOWSOLVER_SNESMIXEDFEM:
       ierr = MixedFlowFEMSNESSolve(ctx,fields);CHKERRQ(ierr);
       break;
+    case FLOWSOLVER_TPFA:
+      ierr = TPFAFlowSolve(ctx,fields);CHKERRQ(ierr);
+      break;
     case FLOWSOLVER_SNESSTANDARDFEM:
     ierr = VF_FlowStandardFEMSNESSolve(ctx,fields);CHKERRQ(ierr);
       break;
@@ -13,12 +13,227 @@
 #include "VFFlow.h"
 /* #include "PetscFixes.h" */
 #include "VFFlow_KSPMixedFEM.h"
+#include "VFFlow_TPFA.h"
 
 /*
  MixedFlowFEMKSPSolve
  */
 
 
+#undef __FUNCT__
+#define __FUNCT__ "MixedFEMFlowFieldSplitSetUp"
+/*
+  MixedFEMFlowFieldSplitSetUp: Sets a Schur complement field split preconditioner for the mixed Darcy system on daFlow.
+  The velocity (dof 0,1,2) is eliminated and the pressure Schur complement is preconditioned by ctx->KVelPSchur,
+  see MixedFEMFlowSchurPreAssemble. The Schur complement is solved iteratively, so the outer Krylov method is flexible.
+  Call before KSPSetFromOptions, so that all of this can still be changed from the command line.
+*/
+extern PetscErrorCode MixedFEMFlowFieldSplitSetUp(KSP ksp,VFCtx *ctx)
+{
+  PetscErrorCode ierr;
+  PC             pc;
+  const PetscInt velfields[3] = {0,1,2};
+  const PetscInt presfields[1] = {3};
+  
+  PetscFunctionBegin;
+  ierr = KSPSetType(ksp,KSPFGMRES);CHKERRQ(ierr);
+  ierr = KSPGetPC(ksp,&pc);CHKERRQ(ierr);
+  ierr = PCSetType(pc,PCFIELDSPLIT);CHKERRQ(ierr);
+  ierr = PCFieldSplitSetBlockSize(pc,4);CHKERRQ(ierr);
+  ierr = PCFieldSplitSetFields(pc,"velocity",3,velfields,velfields);CHKERRQ(ierr);
+  ierr = PCFieldSplitSetFields(pc,"pressure",1,presfields,presfields);CHKERRQ(ierr);
+  ierr = PCFieldSplitSetType(pc,PC_COMPOSITE_SCHUR);CHKERRQ(ierr);
+  ierr = PCFieldSplitSetSchurFactType(pc,PC_FIELDSPLIT_SCHUR_FACT_FULL);CHKERRQ(ierr);
+  ierr = PCFieldSplitSetSchurPre(pc,PC_FIELDSPLIT_SCHUR_PRE_USER,ctx->KVelPSchur);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "MixedFEMFlowSchurPreAssemble"
+/*
+  MixedFEMFlowSchurPreAssemble: Assembles the approximation of the pressure Schur complement of the mixed Darcy system
+    S = -alpha L - beta M
+  L is the 7 points Laplacian on the nodes. The transmissibility of the edge between two nodes uses the harmonic mean of
+  the permeabilities of the (up to 4) cells sharing the edge, weighted by their share of the dual face, so that a tight
+  cell blocks the edge instead of being averaged out by its neighbours. Cells with a zero permeability are ignored.
+  M is the lumped storage mass matrix (M_inv, plus beta^2/K_dr with the fixed stress split).
+  On the faces with a pressure boundary condition, L also has the half cell transmissibility k A / (h/2) of the
+  boundary cells, lumped on the nodes of the face, as in the TPFA solver. Without it, S would be the Neumann
+  Laplacian there, a poor approximation of the Schur complement.
+  With the fracture flow coupling and fields not NULL, the permeability of the cells is replaced by their conductivity
+  from TPFACellConductivity, which adds the in plane conductivity pmult w^3 |grad V| / 3 of the crack in the damage band.
+  This stands for the KAf / KDf fracture terms of the mixed system, so that the crack is also a fast path in S.
+*/
+extern PetscErrorCode MixedFEMFlowSchurPreAssemble(Mat S,Vec perm,VFFields *fields,PetscReal alpha,PetscReal beta,VFCtx *ctx)
+{
+  PetscErrorCode       ierr;
+  VFCartFEElementCache *cache = ctx->feCache;
+  PetscInt             xs,xm,ys,ym,zs,zm;
+  PetscInt             nx,ny,nz;
+  PetscInt             ei,ej,ek,i,j,k,c,d,a,b,s;
+  PetscInt             o[3],n[3],ijk[3];
+  PetscReal            h[3],area,storage,T;
+  PetscReal            ****perm_array;
+  PetscReal            ***m_inv_array,***k_dr_array = NULL;
+  PetscReal            ****area_array,****resist_array;
+  PetscReal            ***storage_array,***bdry_array;
+  Vec                  area_local,resist_local,storage_local,bdry_local;
+  Vec                  areaVec,resistVec,storageVec,bdryVec;
+  Vec                  condVec = NULL;
+  MatStencil           row[2];
+  PetscScalar          val[4];
+  
+  PetscFunctionBegin;
+  /*
+    Dual face area and area weighted resistance of the edges, stored at their lower node: 
+    area_array[k][j][i][d] for the edge from (i,j,k) along the axis d
+    Boundary transmissibility of the nodes on the faces with a pressure boundary condition in bdry_array
+  */
+  ierr = DMGetLocalVector(ctx->daVect,&area_local);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daVect,&resist_local);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daScal,&storage_local);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daScal,&bdry_local);CHKERRQ(ierr);
+  ierr = VecSet(area_local,0.);CHKERRQ(ierr);
+  ierr = VecSet(resist_local,0.);CHKERRQ(ierr);
+  ierr = VecSet(storage_local,0.);CHKERRQ(ierr);
+  ierr = VecSet(bdry_local,0.);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(ctx->daVect,area_local,&area_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(ctx->daVect,resist_local,&resist_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScal,storage_local,&storage_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScal,bdry_local,&bdry_array);CHKERRQ(ierr);
+  if (fields && ctx->FractureFlowCoupling) {
+    ierr = DMGetGlobalVector(ctx->daVectCell,&condVec);CHKERRQ(ierr);
+    ierr = TPFACellConductivity(condVec,fields,ctx);CHKERRQ(ierr);
+    ierr = DMDAVecGetArrayDOFRead(ctx->daVectCell,condVec,&perm_array);CHKERRQ(ierr);
+  } else {
+    ierr = DMDAVecGetArrayDOFRead(ctx->daVFperm,perm,&perm_array);CHKERRQ(ierr);
+  }
+  ierr = DMDAVecGetArrayRead(ctx->daScalCell,ctx->M_inv,&m_inv_array);CHKERRQ(ierr);
+  if (ctx->FlowDisplCoupling && ctx->ResFlowMechCoupling == FIXEDSTRESS) {
+    ierr = DMDAVecGetArrayRead(ctx->daScalCell,ctx->K_dr,&k_dr_array);CHKERRQ(ierr);
+  }
+  
+  ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  n[0] = nx; n[1] = ny; n[2] = nz;
+  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  for (ek = zs; ek < zs+zm; ek++) {
+    for (ej = ys; ej < ys+ym; ej++) {
+      for (ei = xs; ei < xs+xm; ei++) {
+        h[0] = cache->hx[cache->idx[ei]];
+        h[1] = cache->hy[cache->idy[ej]];
+        h[2] = cache->hz[cache->idz[ek]];
+        storage = m_inv_array[ek][ej][ei];
+        if (k_dr_array) storage += pow(ctx->matprop[ctx->layer[ek]].beta,2)/k_dr_array[ek][ej][ei];
+        for (c = 0; c < 8; c++) storage_array[ek+c/4][ej+(c/2)%2][ei+c%2] += 0.125*storage*h[0]*h[1]*h[2];
+        for (d = 0; d < 3; d++) {
+          if (perm_array[ek][ej][ei][d] <= 0.) continue;
+          area = 0.25*h[(d+1)%3]*h[(d+2)%3];
+          for (a = 0; a < 2; a++) {
+            for (b = 0; b < 2; b++) {
+              o[d] = 0; o[(d+1)%3] = a; o[(d+2)%3] = b;
+              area_array[ek+o[2]][ej+o[1]][ei+o[0]][d]   += area;
+              resist_array[ek+o[2]][ej+o[1]][ei+o[0]][d] += area/perm_array[ek][ej][ei][d];
+            }
+          }
+          ijk[0] = ei; ijk[1] = ej; ijk[2] = ek;
+          for (s = 0; s < 2; s++) {
+            if (ijk[d] != s*(n[d]-1) || ctx->bcP[0].face[2*d+s] != FIXED) continue;
+            T = 4.*area*perm_array[ek][ej][ei][d]/(0.5*h[d]);
+            for (a = 0; a < 2; a++) {
+              for (b = 0; b < 2; b++) {
+                o[d] = s; o[(d+1)%3] = a; o[(d+2)%3] = b;
+                bdry_array[ek+o[2]][ej+o[1]][ei+o[0]] += 0.25*T;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  if (k_dr_array) {
+    ierr = DMDAVecRestoreArrayRead(ctx->daScalCell,ctx->K_dr,&k_dr_array);CHKERRQ(ierr);
+  }
+  ierr = DMDAVecRestoreArrayRead(ctx->daScalCell,ctx->M_inv,&m_inv_array);CHKERRQ(ierr);
+  if (condVec) {
+    ierr = DMDAVecRestoreArrayDOFRead(ctx->daVectCell,condVec,&perm_array);CHKERRQ(ierr);
+    ierr = DMRestoreGlobalVector(ctx->daVectCell,&condVec);CHKERRQ(ierr);
+  } else {
+    ierr = DMDAVecRestoreArrayDOFRead(ctx->daVFperm,perm,&perm_array);CHKERRQ(ierr);
+  }
+  ierr = DMDAVecRestoreArray(ctx->daScal,bdry_local,&bdry_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daScal,storage_local,&storage_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,resist_local,&resist_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,area_local,&area_array);CHKERRQ(ierr);
+  
+  ierr = DMGetGlobalVector(ctx->daVect,&areaVec);CHKERRQ(ierr);
+  ierr = DMGetGlobalVector(ctx->daVect,&resistVec);CHKERRQ(ierr);
+  ierr = DMGetGlobalVector(ctx->daScal,&storageVec);CHKERRQ(ierr);
+  ierr = DMGetGlobalVector(ctx->daScal,&bdryVec);CHKERRQ(ierr);
+  ierr = VecSet(areaVec,0.);CHKERRQ(ierr);
+  ierr = VecSet(resistVec,0.);CHKERRQ(ierr);
+  ierr = VecSet(storageVec,0.);CHKERRQ(ierr);
+  ierr = VecSet(bdryVec,0.);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalBegin(ctx->daVect,area_local,ADD_VALUES,areaVec);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalEnd(ctx->daVect,area_local,ADD_VALUES,areaVec);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalBegin(ctx->daVect,resist_local,ADD_VALUES,resistVec);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalEnd(ctx->daVect,resist_local,ADD_VALUES,resistVec);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalBegin(ctx->daScal,storage_local,ADD_VALUES,storageVec);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalEnd(ctx->daScal,storage_local,ADD_VALUES,storageVec);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalBegin(ctx->daScal,bdry_local,ADD_VALUES,bdryVec);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalEnd(ctx->daScal,bdry_local,ADD_VALUES,bdryVec);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&bdry_local);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&storage_local);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daVect,&resist_local);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daVect,&area_local);CHKERRQ(ierr);
+  
+  /*
+    Each edge is assembled by the processor owning its lower node
+  */
+  ierr = MatZeroEntries(S);CHKERRQ(ierr);
+  ierr = DMDAGetInfo(ctx->daScal,NULL,&nx,&ny,&nz,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  n[0] = nx; n[1] = ny; n[2] = nz;
+  ierr = DMDAGetCorners(ctx->daScal,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOFRead(ctx->daVect,areaVec,&area_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOFRead(ctx->daVect,resistVec,&resist_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScal,storageVec,&storage_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScal,bdryVec,&bdry_array);CHKERRQ(ierr);
+  for (k = zs; k < zs+zm; k++) {
+    for (j = ys; j < ys+ym; j++) {
+      for (i = xs; i < xs+xm; i++) {
+        row[0].i = i; row[0].j = j; row[0].k = k; row[0].c = 0;
+        val[0] = -beta*storage_array[k][j][i]-alpha*bdry_array[k][j][i];
+        ierr = MatSetValuesStencil(S,1,row,1,row,val,ADD_VALUES);CHKERRQ(ierr);
+        ijk[0] = i; ijk[1] = j; ijk[2] = k;
+        for (d = 0; d < 3; d++) {
+          if (ijk[d] == n[d]-1 || resist_array[k][j][i][d] <= 0.) continue;
+          h[0] = cache->hx[cache->idx[i]];
+          h[1] = cache->hy[cache->idy[j]];
+          h[2] = cache->hz[cache->idz[k]];
+          T = alpha*area_array[k][j][i][d]*area_array[k][j][i][d]/(resist_array[k][j][i][d]*h[d]);
+          row[1] = row[0];
+          if (d == 0) row[1].i++;
+          if (d == 1) row[1].j++;
+          if (d == 2) row[1].k++;
+          val[0] = -T; val[1] = T;
+          val[2] = T;  val[3] = -T;
+          ierr = MatSetValuesStencil(S,2,row,2,row,val,ADD_VALUES);CHKERRQ(ierr);
+        }
+      }
+    }
+  }
+  ierr = DMDAVecRestoreArrayRead(ctx->daScal,bdryVec,&bdry_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daScal,storageVec,&storage_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOFRead(ctx->daVect,resistVec,&resist_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOFRead(ctx->daVect,areaVec,&area_array);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daScal,&bdryVec);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daScal,&storageVec);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daVect,&resistVec);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daVect,&areaVec);CHKERRQ(ierr);
+  ierr = MatAssemblyBegin(S,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  ierr = MatAssemblyEnd(S,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
 #undef __FUNCT__
 #define __FUNCT__ "MixedFEMFlowSolverInitialize"
 extern PetscErrorCode MixedFEMFlowSolverInitialize(VFCtx *ctx, VFFields *fields)
@@ -32,11 +247,17 @@ extern PetscErrorCode MixedFEMFlowSolverInitialize(VFCtx *ctx, VFFields *fields)
   ierr = KSPSetOperators(ctx->kspVelP,ctx->KVelP,ctx->KVelP);CHKERRQ(ierr);
   ierr = KSPSetInitialGuessNonzero(ctx->kspVelP,PETSC_TRUE);CHKERRQ(ierr);
   ierr = KSPAppendOptionsPrefix(ctx->kspVelP,"Flowksp_");CHKERRQ(ierr);
-  ierr = KSPSetType(ctx->kspVelP,KSPBCGSL);CHKERRQ(ierr);
-  ierr = KSPSetFromOptions(ctx->kspVelP);CHKERRQ(ierr);
-  ierr = KSPGetPC(ctx->kspVelP,&ctx->pcVelP);CHKERRQ(ierr);
-  ierr = PCSetType(ctx->pcVelP,PCJACOBI);CHKERRQ(ierr);
-  ierr = PCSetFromOptions(ctx->pcVelP);CHKERRQ(ierr);
+  if (ctx->flowFieldSplit) {
+    ierr = MixedFEMFlowFieldSplitSetUp(ctx->kspVelP,ctx);CHKERRQ(ierr);
+    ierr = KSPSetFromOptions(ctx->kspVelP);CHKERRQ(ierr);
+    ierr = KSPGetPC(ctx->kspVelP,&ctx->pcVelP);CHKERRQ(ierr);
+  } else {
+    ierr = KSPSetType(ctx->kspVelP,KSPBCGSL);CHKERRQ(ierr);
+    ierr = KSPSetFromOptions(ctx->kspVelP);CHKERRQ(ierr);
+    ierr = KSPGetPC(ctx->kspVelP,&ctx->pcVelP);CHKERRQ(ierr);
+    ierr = PCSetType(ctx->pcVelP,PCJACOBI);CHKERRQ(ierr);
+    ierr = PCSetFromOptions(ctx->pcVelP);CHKERRQ(ierr);
+  }
   PetscFunctionReturn(0);
 }
 
@@ -67,6 +288,7 @@ extern PetscErrorCode MixedFlowFEMKSPSolve(VFCtx *ctx,VFFields *fields)
   Vec                vec;
 	PetscReal           Velmin,Velmax;
 	PetscReal           Pmin,Pmax;
+  PetscBool          assembleK;
   
   PetscFunctionBegin;
   theta = ctx->theta;
@@ -74,10 +296,16 @@ extern PetscErrorCode MixedFlowFEMKSPSolve(VFCtx *ctx,VFFields *fields)
   ierr = VecDuplicate(ctx->RHSVelP,&VecRHS);CHKERRQ(ierr);
   ierr = VecDuplicate(ctx->RHSVelP,&vec);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daFlow,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = FlowMatnVecAssemble(ctx->KVelP,ctx->KVelPlhs,ctx->RHSVelP,fields,ctx);CHKERRQ(ierr);
+  ierr = MixedFEMFlowMatInputsChanged(ctx,fields,&assembleK);CHKERRQ(ierr);
+  ierr = FlowMatnVecAssemble(ctx->KVelP,ctx->RHSVelP,assembleK,fields,ctx);CHKERRQ(ierr);
+  ierr = MixedFEMFlowStorageAssemble(ctx->KVelPStorage,ctx);CHKERRQ(ierr);
+  if (ctx->flowFieldSplit && assembleK) {
+    ierr = MixedFEMFlowSchurPreAssemble(ctx->KVelPSchur,fields->vfperm,fields,ctx->timevalue*ctx->theta/ctx->flowprop.mu,1.,ctx);CHKERRQ(ierr);
+  }
+  ierr = KSPSetReusePreconditioner(ctx->kspVelP,assembleK ? PETSC_FALSE : PETSC_TRUE);CHKERRQ(ierr);
   ierr = VecCopy(ctx->RHSVelP,VecRHS);CHKERRQ(ierr);
   ierr = VecAXPBY(VecRHS,one_minus_theta,theta,ctx->RHSVelPpre);CHKERRQ(ierr);
-  ierr = MatMultAdd(ctx->KVelPlhs,ctx->PreFlowFields,VecRHS,VecRHS);CHKERRQ(ierr);
+  ierr = MixedFEMFlowExplicitMultAdd(ctx->KVelP,ctx->KVelPStorage,ctx->PreFlowFields,VecRHS,ctx);CHKERRQ(ierr);
   ierr = VecApplyVelocityBC(VecRHS,ctx->VelBCArray,&ctx->bcQ[0],ctx);CHKERRQ(ierr);
   if (ctx->verbose > 1) {
     ierr = KSPMonitorSet(ctx->kspVelP,MixedFEMKSPMonitor,NULL,NULL);CHKERRQ(ierr);
@@ -457,11 +685,146 @@ extern PetscErrorCode VecApplyVelocityBC(Vec RHS,Vec BCV, VFBC *bcQ,VFCtx *ctx)
 	PetscFunctionReturn(0);
 }
 
+#undef __FUNCT__
+#define __FUNCT__ "MixedFEMFlowMatInputsChanged"
+/*
+  MixedFEMFlowMatInputsChanged: whether KVelP needs to be reassembled, see VFFlowMatInputsChanged.
+  KVelP depends on the permeability, V, the storage coefficients and, with the fracture flow coupling, U.
+*/
+extern PetscErrorCode MixedFEMFlowMatInputsChanged(VFCtx *ctx,VFFields *fields,PetscBool *changed)
+{
+  PetscErrorCode ierr;
+  Vec            x[5];
+  PetscInt       n = 0;
+  
+  PetscFunctionBegin;
+  x[n++] = fields->vfperm;
+  x[n++] = fields->V;
+  x[n++] = ctx->M_inv;
+  x[n++] = ctx->K_dr;
+  if (ctx->FractureFlowCoupling) x[n++] = fields->U;
+  ierr = VFFlowMatInputsChanged(&ctx->flowMatInputs,n,x,ctx,changed);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "MixedFEMFlowStorageAssemble"
+/*
+  MixedFEMFlowStorageAssemble: Assembles the storage block M of the mixed Darcy operator on the pressure nodes
+    M = -(M_inv + beta^2/K_dr) int phi_i phi_j
+  (beta^2/K_dr only with the fixed stress split). It is the only part of KVelP which is not scaled by theta, so that
+  the explicit part of the theta scheme can be recovered from KVelP and M, see MixedFEMFlowExplicitMultAdd.
+  M only depends on M_inv and K_dr and is reassembled when one of them has changed.
+*/
+extern PetscErrorCode MixedFEMFlowStorageAssemble(Mat M,VFCtx *ctx)
+{
+  PetscErrorCode    ierr;
+  VFCartFEElement3D *e3D;
+  PetscInt          xs,xm,ys,ym,zs,zm;
+  PetscInt          ek,ej,ei,i,j,k,l;
+  PetscInt          nrow = ctx->e3D.nphix*ctx->e3D.nphiy*ctx->e3D.nphiz;
+  PetscReal         ***m_inv_array,***k_dr_array = NULL;
+  PetscReal         ***one_array;
+  PetscReal         *KS_local,storage;
+  Vec               one_local;
+  MatStencil        *row;
+  PetscObjectState  m_invstate,k_drstate;
+  
+  PetscFunctionBegin;
+  ierr = PetscObjectStateGet((PetscObject)ctx->M_inv,&m_invstate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->K_dr,&k_drstate);CHKERRQ(ierr);
+  if (m_invstate == ctx->KVelPStoragestate[0] && k_drstate == ctx->KVelPStoragestate[1]) PetscFunctionReturn(0);
+  
+  ierr = MatZeroEntries(M);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daScal,&one_local);CHKERRQ(ierr);
+  ierr = VecSet(one_local,1.);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScal,one_local,&one_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScalCell,ctx->M_inv,&m_inv_array);CHKERRQ(ierr);
+  if (ctx->FlowDisplCoupling && ctx->ResFlowMechCoupling == FIXEDSTRESS) {
+    ierr = DMDAVecGetArrayRead(ctx->daScalCell,ctx->K_dr,&k_dr_array);CHKERRQ(ierr);
+  }
+  ierr = PetscMalloc2(nrow*nrow,&KS_local,nrow,&row);CHKERRQ(ierr);
+  
+  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  for (ek = zs; ek < zs+zm; ek++) {
+    for (ej = ys; ej < ys+ym; ej++) {
+      for (ei = xs; ei < xs+xm; ei++) {
+        ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
+        ierr = VF_MatA_local(KS_local,e3D,ek,ej,ei,one_array);CHKERRQ(ierr);
+        storage = m_inv_array[ek][ej][ei];
+        if (k_dr_array) storage += pow(ctx->matprop[ctx->layer[ek]].beta,2)/k_dr_array[ek][ej][ei];
+        for (l = 0; l < nrow*nrow; l++) KS_local[l] = -1.*storage*KS_local[l];
+        for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
+          for (j = 0; j < ctx->e3D.nphiy; j++) {
+            for (i = 0; i < ctx->e3D.nphix; i++,l++) {
+              row[l].i = ei+i;row[l].j = ej+j;row[l].k = ek+k;row[l].c = 0;
+            }
+          }
+        }
+        ierr = MatSetValuesStencil(M,nrow,row,nrow,row,KS_local,ADD_VALUES);CHKERRQ(ierr);
+      }
+    }
+  }
+  ierr = MatAssemblyBegin(M,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  ierr = MatAssemblyEnd(M,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  
+  ierr = PetscFree2(KS_local,row);CHKERRQ(ierr);
+  if (k_dr_array) {
+    ierr = DMDAVecRestoreArrayRead(ctx->daScalCell,ctx->K_dr,&k_dr_array);CHKERRQ(ierr);
+  }
+  ierr = DMDAVecRestoreArrayRead(ctx->daScalCell,ctx->M_inv,&m_inv_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daScal,one_local,&one_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&one_local);CHKERRQ(ierr);
+  ctx->KVelPStoragestate[0] = m_invstate;
+  ctx->KVelPStoragestate[1] = k_drstate;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "MixedFEMFlowExplicitMultAdd"
+/*
+  MixedFEMFlowExplicitMultAdd: y = y + Krhs x, where Krhs = M - (1-theta) A is the explicit part of the theta scheme.
+  Krhs is not stored: K = M + theta A is the assembled implicit operator and M the storage block acting on the
+  pressure (see MixedFEMFlowStorageAssemble), so that
+    Krhs x = (M x - (1-theta) K x) / theta
+  The Dirichlet velocity rows of K are the identity, they are overwritten by VecApplyVelocityBC afterwards.
+*/
+extern PetscErrorCode MixedFEMFlowExplicitMultAdd(Mat K,Mat M,Vec x,Vec y,VFCtx *ctx)
+{
+  PetscErrorCode ierr;
+  PetscReal      theta = ctx->theta;
+  Vec            Kx,p,Mp;
+  
+  PetscFunctionBegin;
+  if (theta <= 0.) SETERRQ2(PETSC_COMM_WORLD,PETSC_ERR_ARG_OUTOFRANGE,"ERROR: the mixed flow solvers need theta > 0, got %g in %s\n",(double)theta,__FUNCT__);
+  ierr = DMGetGlobalVector(ctx->daScal,&p);CHKERRQ(ierr);
+  ierr = DMGetGlobalVector(ctx->daScal,&Mp);CHKERRQ(ierr);
+  ierr = VecStrideGather(x,3,p,INSERT_VALUES);CHKERRQ(ierr);
+  ierr = MatMult(M,p,Mp);CHKERRQ(ierr);
+  ierr = VecScale(Mp,1./theta);CHKERRQ(ierr);
+  ierr = VecStrideScatter(Mp,3,y,ADD_VALUES);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daScal,&Mp);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daScal,&p);CHKERRQ(ierr);
+  if (theta != 1.) {
+    ierr = DMGetGlobalVector(ctx->daFlow,&Kx);CHKERRQ(ierr);
+    ierr = MatMult(K,x,Kx);CHKERRQ(ierr);
+    ierr = VecAXPY(y,-(1.-theta)/theta,Kx);CHKERRQ(ierr);
+    ierr = DMRestoreGlobalVector(ctx->daFlow,&Kx);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
 #undef __FUNCT__
 #define __FUNCT__ "FlowMatnVecAssemble"
-extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *fields,VFCtx *ctx)
+/*
+  FlowMatnVecAssemble: Assembles the implicit operator K of the theta scheme and the right hand side RHS.
+  K is left untouched unless assembleK, see VFFlowMatInputsChanged.
+*/
+extern PetscErrorCode FlowMatnVecAssemble(Mat K,Vec RHS,PetscBool assembleK,VFFields *fields,VFCtx *ctx)
 {
   PetscErrorCode ierr;
+  VFCartFEElement3D *e3D;
+  VFCartFEElement2D *e2D;
   PetscInt       xs,xm,nx;
   PetscInt       ys,ym,ny;
   PetscInt       zs,zm,nz;
@@ -477,17 +840,14 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
   Vec            perm_local;
   PetscReal      hx,hy,hz;
   PetscReal      *KA_local,*KB_local,*KD_local,*KBTrans_local,*KS_local;
-  PetscReal      *KArhs_local,*KBrhs_local,*KDrhs_local,*KBTransrhs_local;
-  PetscReal      *KL_local,*KLrhs_local;
+  PetscReal      *KL_local;
   PetscReal      *KAf_local,*KBf_local,*KDf_local,*KP_local,*KBfTrans_local;
-  PetscReal      *KAfrhs_local,*KBfrhs_local,*KDfrhs_local,*KPrhs_local,*KBfTransrhs_local;
   PetscReal      mu;
   PetscReal      theta,timestepsize;
   PetscInt       nrow = ctx->e3D.nphix*ctx->e3D.nphiy*ctx->e3D.nphiz;
   MatStencil     *row,*row1;
   PetscReal      ***source_array;
   Vec            source_local;
-  PetscReal      one_minus_theta;
   FACE           face;
   PetscReal      ***prebc_array;
   Vec            prebc_local;
@@ -521,12 +881,12 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
   PetscFunctionBegin;
   theta = ctx->theta;
   timestepsize = ctx->timevalue;
-  one_minus_theta = -1.*(1.-theta);
   mu     = ctx->flowprop.mu;
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = MatZeroEntries(K);CHKERRQ(ierr);
-  ierr = MatZeroEntries(Krhs);CHKERRQ(ierr);
+  if (assembleK) {
+    ierr = VFCartFEMatCOOZeroEntries(&ctx->cooVelP,K);CHKERRQ(ierr);
+  }
   ierr = VecSet(RHS,0.);CHKERRQ(ierr);
   ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMGetLocalVector(ctx->daFlow,&RHS_localVec);CHKERRQ(ierr);
@@ -614,11 +974,6 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
                       nrow*nrow,&KD_local,
                       nrow*nrow,&KBTrans_local,
                       nrow*nrow,&KS_local);CHKERRQ(ierr);
-  ierr = PetscMalloc4(nrow*nrow,&KArhs_local,
-                      nrow*nrow,&KBrhs_local,
-                      nrow*nrow,&KDrhs_local,
-                      nrow*nrow,&KBTransrhs_local);CHKERRQ(ierr);
-  
   ierr = PetscMalloc6(nrow*nrow,&KAf_local,
                       nrow*nrow,&KBf_local,
                       nrow*nrow,&KDf_local,
@@ -626,13 +981,6 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
                       nrow*nrow,&KP_local,
                       nrow*nrow,&KL_local);CHKERRQ(ierr);
   
-  ierr = PetscMalloc6(nrow*nrow,&KAfrhs_local,
-                      nrow*nrow,&KBfrhs_local,
-                      nrow*nrow,&KDfrhs_local,
-                      nrow*nrow,&KBfTransrhs_local,
-                      nrow*nrow,&KPrhs_local,
-                      nrow*nrow,&KLrhs_local);CHKERRQ(ierr);
-  
   ierr = PetscMalloc3(nrow,&RHS_local,
                       nrow,&row,
                       nrow,&row1);CHKERRQ(ierr);
@@ -642,70 +990,22 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
         hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
         hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
         hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
-        ierr = VF_MatA_local(KS_local,&ctx->e3D,ek,ej,ei,one_array);CHKERRQ(ierr);
-        for (l = 0; l < nrow*nrow; l++) {
-          if(ctx->FlowDisplCoupling && ctx->ResFlowMechCoupling == FIXEDSTRESS){
-            KS_local[l] = -1.*(m_inv_array[ek][ej][ei]+pow(ctx->matprop[ctx->layer[ek]].beta,2)/k_dr_array[ek][ej][ei])*KS_local[l];
-          }
-          else{
-            KS_local[l] = -1.*m_inv_array[ek][ej][ei]*KS_local[l];
-          }
-        }
-        for (c = 0; c < veldof; c++) {
-          ierr = Flow_MatA(KA_local,&ctx->e3D,ek,ej,ei,c,&ctx->flowprop,perm_array,one_array);CHKERRQ(ierr);
-          ierr = Flow_MatB(KB_local,&ctx->e3D,ek,ej,ei,c,one_array);CHKERRQ(ierr);
-          ierr = Flow_MatBTranspose(KBTrans_local,&ctx->e3D,ek,ej,ei,c,one_array);CHKERRQ(ierr);
-          ierr = VF_MatApplyFracturePressureBC_local(KP_local,&ctx->e3D,ek,ej,ei,c,v_array);CHKERRQ(ierr);
-          for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
-            for (j = 0; j < ctx->e3D.nphiy; j++) {
-              for (i = 0; i < ctx->e3D.nphix; i++,l++) {
-                row[l].i  = ei+i;row[l].j = ej+j;row[l].k = ek+k;row[l].c = c;
-                row1[l].i = ei+i;row1[l].j = ej+j;row1[l].k = ek+k;row1[l].c = 3;
-              }
-            }
-          }
-          for (l = 0; l < nrow*nrow; l++) {
-            KArhs_local[l] = 0.5*mu*one_minus_theta*KA_local[l];
-            KA_local[l] = 0.5*mu*theta*KA_local[l];
-            KBrhs_local[l] = one_minus_theta*KB_local[l];
-            KB_local[l] = theta*KB_local[l];
-            KBTransrhs_local[l] = timestepsize*one_minus_theta*KBTrans_local[l];
-            KBTrans_local[l] = timestepsize*theta*KBTrans_local[l];
-            KPrhs_local[l] = one_minus_theta*KP_local[l];
-            KP_local[l] = theta*KP_local[l];
-          }
-          ierr = MatSetValuesStencil(K,nrow,row,nrow,row,KA_local,ADD_VALUES);CHKERRQ(ierr);
-          ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row,KArhs_local,ADD_VALUES);CHKERRQ(ierr);
-          
-          ierr = MatSetValuesStencil(K,nrow,row,nrow,row1,KB_local,ADD_VALUES);CHKERRQ(ierr);
-          ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row1,KBrhs_local,ADD_VALUES);CHKERRQ(ierr);
-          
-          ierr = MatSetValuesStencil(K,nrow,row1,nrow,row,KBTrans_local,ADD_VALUES);CHKERRQ(ierr);
-          ierr = MatSetValuesStencil(Krhs,nrow,row1,nrow,row,KBTransrhs_local,ADD_VALUES);CHKERRQ(ierr);
-          
-          ierr = MatSetValuesStencil(K,nrow,row,nrow,row1,KP_local,ADD_VALUES);CHKERRQ(ierr);
-          ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row1,KPrhs_local,ADD_VALUES);CHKERRQ(ierr);
-        }
-        ierr = Flow_MatD(KD_local,&ctx->e3D,ek,ej,ei,&ctx->flowprop,perm_array,one_array);CHKERRQ(ierr);
-        for (l = 0; l < nrow*nrow; l++) {
-          KDrhs_local[l] = timestepsize*one_minus_theta*KD_local[l];
-          KD_local[l] = timestepsize*theta*KD_local[l];
-        }
-        ierr = MatSetValuesStencil(K,nrow,row1,nrow,row1,KD_local,ADD_VALUES);CHKERRQ(ierr);
-        ierr = MatSetValuesStencil(Krhs,nrow,row1,nrow,row1,KDrhs_local,ADD_VALUES);CHKERRQ(ierr);
-        ierr = MatSetValuesStencil(K,nrow,row1,nrow,row1,KS_local,ADD_VALUES);CHKERRQ(ierr);
-        ierr = MatSetValuesStencil(Krhs,nrow,row1,nrow,row1,KS_local,ADD_VALUES);CHKERRQ(ierr);
-        if(ctx->FractureFlowCoupling){
-          ierr = VF_MatAFractureFlowCoupling_local(KAf_local,&ctx->e3D,ek,ej,ei,u_array,v_array);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
+        if (assembleK) {
+          ierr = VF_MatA_local(KS_local,e3D,ek,ej,ei,one_array);CHKERRQ(ierr);
           for (l = 0; l < nrow*nrow; l++) {
-            KAfrhs_local[l] = 0.5*12*mu*one_minus_theta*KAf_local[l];
-            KAf_local[l] = 0.5*12*mu*theta*KAf_local[l];
+            if(ctx->FlowDisplCoupling && ctx->ResFlowMechCoupling == FIXEDSTRESS){
+              KS_local[l] = -1.*(m_inv_array[ek][ej][ei]+pow(ctx->matprop[ctx->layer[ek]].beta,2)/k_dr_array[ek][ej][ei])*KS_local[l];
+            }
+            else{
+              KS_local[l] = -1.*m_inv_array[ek][ej][ei]*KS_local[l];
+            }
           }
           for (c = 0; c < veldof; c++) {
-            ierr = VF_MatBTFractureFlowCoupling_local(KBfTrans_local,&ctx->e3D,ek,ej,ei,c,u_array,v_array);CHKERRQ(ierr);
-            ierr = VF_MatBFractureFlowCoupling_local(KBf_local,&ctx->e3D,ek,ej,ei,c,u_array,v_array);CHKERRQ(ierr);
-            ierr = VF_MatLeakOff_local(KL_local,&ctx->e3D,ek,ej,ei,c,v_array);CHKERRQ(ierr);
+            ierr = Flow_MatA(KA_local,e3D,ek,ej,ei,c,&ctx->flowprop,perm_array,one_array);CHKERRQ(ierr);
+            ierr = Flow_MatB(KB_local,e3D,ek,ej,ei,c,one_array);CHKERRQ(ierr);
+            ierr = Flow_MatBTranspose(KBTrans_local,e3D,ek,ej,ei,c,one_array);CHKERRQ(ierr);
+            ierr = VF_MatApplyFracturePressureBC_local(KP_local,e3D,ek,ej,ei,c,v_array);CHKERRQ(ierr);
             for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
               for (j = 0; j < ctx->e3D.nphiy; j++) {
                 for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -715,35 +1015,66 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
               }
             }
             for (l = 0; l < nrow*nrow; l++) {
-              KBfrhs_local[l] = 0.5*one_minus_theta*KBf_local[l];
-              KBf_local[l] = 0.5*theta*KBf_local[l];
-              
-              KBfTransrhs_local[l] = 0.5*timestepsize*one_minus_theta*KBfTrans_local[l];
-              KBfTrans_local[l] = 0.5*timestepsize*theta*KBfTrans_local[l];
-              
-              KLrhs_local[l] = -1.0*timestepsize*one_minus_theta*KL_local[l];
-              KL_local[l] = -1.0*timestepsize*theta*KL_local[l];
+              KA_local[l] = 0.5*mu*theta*KA_local[l];
+              KB_local[l] = theta*KB_local[l];
+              KBTrans_local[l] = timestepsize*theta*KBTrans_local[l];
+              KP_local[l] = theta*KP_local[l];
             }
-            
-            ierr = MatSetValuesStencil(K,nrow,row,nrow,row,KAf_local,ADD_VALUES);CHKERRQ(ierr);
-            ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row,KAfrhs_local,ADD_VALUES);CHKERRQ(ierr);
-            ierr = MatSetValuesStencil(K,nrow,row,nrow,row1,KBf_local,ADD_VALUES);CHKERRQ(ierr);
-            ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row1,KBfrhs_local,ADD_VALUES);CHKERRQ(ierr);
-            ierr = MatSetValuesStencil(K,nrow,row1,nrow,row,KBfTrans_local,ADD_VALUES);CHKERRQ(ierr);
-            ierr = MatSetValuesStencil(Krhs,nrow,row1,nrow,row,KBfTransrhs_local,ADD_VALUES);CHKERRQ(ierr);
-            ierr = MatSetValuesStencil(K,nrow,row1,nrow,row,KL_local,ADD_VALUES);CHKERRQ(ierr);
-            ierr = MatSetValuesStencil(Krhs,nrow,row1,nrow,row,KLrhs_local,ADD_VALUES);CHKERRQ(ierr);
+            ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooVelP,K,ei,ej,ek,nrow,row,nrow,row,KA_local);CHKERRQ(ierr);
+          
+            ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooVelP,K,ei,ej,ek,nrow,row,nrow,row1,KB_local);CHKERRQ(ierr);
+          
+            ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooVelP,K,ei,ej,ek,nrow,row1,nrow,row,KBTrans_local);CHKERRQ(ierr);
+          
+            ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooVelP,K,ei,ej,ek,nrow,row,nrow,row1,KP_local);CHKERRQ(ierr);
           }
-          ierr = VF_MatDFractureFlowCoupling_localOld(KDf_local,&ctx->e3D,ek,ej,ei,u_array,v_array);CHKERRQ(ierr);
+          ierr = Flow_MatD(KD_local,e3D,ek,ej,ei,&ctx->flowprop,perm_array,one_array);CHKERRQ(ierr);
           for (l = 0; l < nrow*nrow; l++) {
-            KDfrhs_local[l] = -timestepsize*one_minus_theta/(24.*mu)*KDf_local[l];
-            KDf_local[l] = -timestepsize*theta/(24.*mu)*KDf_local[l];
+            KD_local[l] = timestepsize*theta*KD_local[l];
+          }
+          ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooVelP,K,ei,ej,ek,nrow,row1,nrow,row1,KD_local);CHKERRQ(ierr);
+          ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooVelP,K,ei,ej,ek,nrow,row1,nrow,row1,KS_local);CHKERRQ(ierr);
+        }
+        if(ctx->FractureFlowCoupling){
+          if (assembleK) {
+            ierr = VF_MatAFractureFlowCoupling_local(KAf_local,e3D,ek,ej,ei,u_array,v_array);CHKERRQ(ierr);
+            for (l = 0; l < nrow*nrow; l++) {
+              KAf_local[l] = 0.5*12*mu*theta*KAf_local[l];
+            }
+            for (c = 0; c < veldof; c++) {
+              ierr = VF_MatBTFractureFlowCoupling_local(KBfTrans_local,e3D,ek,ej,ei,c,u_array,v_array);CHKERRQ(ierr);
+              ierr = VF_MatBFractureFlowCoupling_local(KBf_local,e3D,ek,ej,ei,c,u_array,v_array);CHKERRQ(ierr);
+              ierr = VF_MatLeakOff_local(KL_local,e3D,ek,ej,ei,c,v_array);CHKERRQ(ierr);
+              for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
+                for (j = 0; j < ctx->e3D.nphiy; j++) {
+                  for (i = 0; i < ctx->e3D.nphix; i++,l++) {
+                    row[l].i  = ei+i;row[l].j = ej+j;row[l].k = ek+k;row[l].c = c;
+                    row1[l].i = ei+i;row1[l].j = ej+j;row1[l].k = ek+k;row1[l].c = 3;
+                  }
+                }
+              }
+              for (l = 0; l < nrow*nrow; l++) {
+                KBf_local[l] = 0.5*theta*KBf_local[l];
+              
+                KBfTrans_local[l] = 0.5*timestepsize*theta*KBfTrans_local[l];
+              
+                KL_local[l] = -1.0*timestepsize*theta*KL_local[l];
+              }
+            
+              ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooVelP,K,ei,ej,ek,nrow,row,nrow,row,KAf_local);CHKERRQ(ierr);
+              ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooVelP,K,ei,ej,ek,nrow,row,nrow,row1,KBf_local);CHKERRQ(ierr);
+              ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooVelP,K,ei,ej,ek,nrow,row1,nrow,row,KBfTrans_local);CHKERRQ(ierr);
+              ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooVelP,K,ei,ej,ek,nrow,row1,nrow,row,KL_local);CHKERRQ(ierr);
+            }
+            ierr = VF_MatDFractureFlowCoupling_localOld(KDf_local,e3D,ek,ej,ei,u_array,v_array);CHKERRQ(ierr);
+            for (l = 0; l < nrow*nrow; l++) {
+              KDf_local[l] = -timestepsize*theta/(24.*mu)*KDf_local[l];
+            }
+            ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooVelP,K,ei,ej,ek,nrow,row1,nrow,row1,KDf_local);CHKERRQ(ierr);
           }
-          ierr = MatSetValuesStencil(K,nrow,row1,nrow,row1,KDf_local,ADD_VALUES);CHKERRQ(ierr);
-          ierr = MatSetValuesStencil(Krhs,nrow,row1,nrow,row1,KDfrhs_local,ADD_VALUES);CHKERRQ(ierr);
           
           if(ctx->hasFlowWells){
-            ierr = VecApplyFractureWellSource(RHS_local,fracflow_array,&ctx->e3D,ek,ej,ei,ctx,v_array);
+            ierr = VecApplyFractureWellSource(RHS_local,fracflow_array,e3D,ek,ej,ei,ctx,v_array);
             for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
               for (j = 0; j < ctx->e3D.nphiy; j++) {
                 for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -753,7 +1084,7 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
             }
           }
           
-          ierr = VF_RHSFractureFlowCoupling_localOld(RHS_local,&ctx->e3D,ek,ej,ei,u_array,v_array,u_old_array,v_old_array);
+          ierr = VF_RHSFractureFlowCoupling_localOld(RHS_local,e3D,ek,ej,ei,u_array,v_array,u_old_array,v_old_array);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++) {
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -764,7 +1095,7 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
         }
         /*Assembling the righthand side vector f*/
         for (c = 0; c < veldof; c++) {
-          ierr = Flow_Vecf(RHS_local,&ctx->e3D,ek,ej,ei,c,&ctx->flowprop,v_array);CHKERRQ(ierr);
+          ierr = Flow_Vecf(RHS_local,e3D,ek,ej,ei,c,&ctx->flowprop,v_array);CHKERRQ(ierr);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++) {
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -774,7 +1105,7 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
           }
         }
         /*Assembling the righthand side vector g*/
-        ierr = Flow_Vecg(RHS_local,&ctx->e3D,ek,ej,ei,&ctx->flowprop,perm_array,one_array);CHKERRQ(ierr);
+        ierr = Flow_Vecg(RHS_local,e3D,ek,ej,ei,&ctx->flowprop,perm_array,one_array);CHKERRQ(ierr);
         for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
           for (j = 0; j < ctx->e3D.nphiy; j++) {
             for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -783,7 +1114,7 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
           }
         }
         if(ctx->hasFluidSources){
-          ierr = VecApplySourceTerms(RHS_local,source_array,&ctx->e3D,ek,ej,ei,ctx,v_array);
+          ierr = VecApplySourceTerms(RHS_local,source_array,e3D,ek,ej,ei,ctx,v_array);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++) {
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -793,7 +1124,7 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
           }
         }
         if(ctx->FlowDisplCoupling){
-          ierr = VF_RHSFlowMechUCoupling_local(RHS_local,&ctx->e3D,ek,ej,ei,&ctx->matprop[ctx->layer[ek]],u_diff_array,v_array);
+          ierr = VF_RHSFlowMechUCoupling_local(RHS_local,e3D,ek,ej,ei,&ctx->matprop[ctx->layer[ek]],u_diff_array,v_array);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++) {
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -803,7 +1134,7 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
           }
         }
         if(ctx->FlowDisplCoupling && ctx->ResFlowMechCoupling == FIXEDSTRESS){
-          ierr = VF_RHSFlowMechUCouplingFIXSTRESS_local(RHS_local,&ctx->e3D,ek,ej,ei,&ctx->matprop[ctx->layer[ek]],pressure_diff_array,v_array);
+          ierr = VF_RHSFlowMechUCouplingFIXSTRESS_local(RHS_local,e3D,ek,ej,ei,&ctx->matprop[ctx->layer[ek]],pressure_diff_array,v_array);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++) {
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -815,9 +1146,9 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
         if (ei == 0) {
           /*                                       Face X0                        */
           face = X0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphix; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphiz; i++, l++) {
@@ -830,9 +1161,9 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
         if (ei == nx-1) {
           /*                                       Face X1                */
           face = X1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphix; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphiz; i++, l++) {
@@ -845,9 +1176,9 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
         if (ej == 0) {
           /*                                       Face Y0                */
           face = Y0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiy; k++){
               for (j = 0; j < ctx->e2D.nphiz; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -860,9 +1191,9 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
         if (ej == ny-1) {
           /*                                       Face Y1                */
           face = Y1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiy; k++){
               for (j = 0; j < ctx->e2D.nphiz; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -875,9 +1206,9 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
         if (ek == 0) {
           /*                                       Face Z0                */
           face = Z0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiz; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -890,9 +1221,9 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
         if (ek == nz-1) {
           /*                                       Face Z1                */
           face = Z1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiz; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -936,12 +1267,12 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
               hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
               hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
               hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-              ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+              ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
               hwx = (ctx->well[w_no].coords[0]-coords_array[ek][ej][ei][0])/hx;
               hwy = (ctx->well[w_no].coords[1]-coords_array[ek][ej][ei][1])/hy;
               hwz = (ctx->well[w_no].coords[2]-coords_array[ek][ej][ei][2])/hz;
               if(ctx->well[w_no].condition == RATE){
-                ierr = VecApplyWellFlowRate(RHS_local,&ctx->e3D,ctx->well[w_no].Qw,hwx,hwy,hwz,ek,ej,ei,v_array);CHKERRQ(ierr);
+                ierr = VecApplyWellFlowRate(RHS_local,e3D,ctx->well[w_no].Qw,hwx,hwy,hwz,ek,ej,ei,v_array);CHKERRQ(ierr);
                 for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
                   for (j = 0; j < ctx->e3D.nphiy; j++) {
                     for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -965,15 +1296,14 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
       }
     }
   }
-  ierr = MatAssemblyBegin(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyEnd(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatApplyKSPVelocityBC(K,Krhs,&ctx->bcQ[0]);CHKERRQ(ierr);
-  ierr = MatAssemblyBegin(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyEnd(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  if (assembleK) {
+    ierr = VFCartFEMatCOOAssemble(&ctx->cooVelP,K);CHKERRQ(ierr);
+    ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+    ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+    ierr = MatApplyKSPVelocityBC(K,&ctx->bcQ[0]);CHKERRQ(ierr);
+    ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+    ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  }
   ierr = DMDAVecRestoreArray(ctx->daScal,source_local,&source_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daScal,&source_local);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArrayDOF(ctx->daVFperm,perm_local,&perm_array);CHKERRQ(ierr);
@@ -1017,9 +1347,7 @@ extern PetscErrorCode FlowMatnVecAssemble(Mat K,Mat Krhs,Vec RHS,VFFields *field
   ierr = DMRestoreLocalVector(ctx->daScalCell,&k_dr_local);CHKERRQ(ierr);
   
   ierr = PetscFree6(KAf_local,KBf_local,KDf_local,KBfTrans_local,KP_local,KL_local);CHKERRQ(ierr);
-  ierr = PetscFree6(KAfrhs_local,KBfrhs_local,KDfrhs_local,KBfTransrhs_local,KPrhs_local,KLrhs_local);CHKERRQ(ierr);
   ierr = PetscFree5(KA_local,KB_local,KD_local,KBTrans_local,KS_local);CHKERRQ(ierr);
-  ierr = PetscFree4(KArhs_local,KBrhs_local,KDrhs_local,KBTransrhs_local);CHKERRQ(ierr);
   ierr = PetscFree3(RHS_local,row,row1);CHKERRQ(ierr);
   
   ierr = VecDestroy(&U_diff);CHKERRQ(ierr);
@@ -1295,7 +1623,7 @@ extern PetscErrorCode VecApplyPressureBC(PetscReal *RHS_local,PetscReal ***pre_a
 
 #undef __FUNCT__
 #define __FUNCT__ "MatApplyKSPVelocityBC"
-extern PetscErrorCode MatApplyKSPVelocityBC(Mat K,Mat Klhs,VFBC *bcQ)
+extern PetscErrorCode MatApplyKSPVelocityBC(Mat K,VFBC *bcQ)
 {
   PetscErrorCode ierr;
   PetscInt       xs,xm,nx;
@@ -1734,14 +2062,12 @@ extern PetscErrorCode Flow_MatA(PetscReal *A_local,VFCartFEElement3D *e,PetscInt
 #define __FUNCT__ "VF_MatA_local"
 extern PetscErrorCode VF_MatA_local(PetscReal *A_local,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscReal ***v_array)
 {
-  PetscErrorCode    ierr;
   PetscInt          i,j,k,l;
   PetscInt          ii,jj,kk;
   PetscInt          eg;
-  PetscReal         *v_elem;
+  PetscReal         v_elem[VFCARTFE_MAXNG3D];
   
   PetscFunctionBegin;
-  ierr = PetscMalloc(e->ng*sizeof(PetscReal),&v_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     v_elem[eg] = 0.;
   }
@@ -1770,7 +2096,6 @@ extern PetscErrorCode VF_MatA_local(PetscReal *A_local,VFCartFEElement3D *e,Pets
       }
     }
   }
-  ierr = PetscFree(v_elem);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -1778,18 +2103,13 @@ extern PetscErrorCode VF_MatA_local(PetscReal *A_local,VFCartFEElement3D *e,Pets
 #define __FUNCT__ "VF_RHSFlowMechUCoupling_local"
 extern PetscErrorCode VF_RHSFlowMechUCoupling_local(PetscReal *K_local,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,VFMatProp *matprop,PetscReal ****u_diff_array,PetscReal ***v_array)
 {
-  PetscErrorCode    ierr;
   PetscInt          i,j,k,l,c;
   PetscInt          eg;
-  PetscReal         *v_elem;
-  PetscReal         *du_elem[3],beta;
+  PetscReal         v_elem[VFCARTFE_MAXNG3D];
+  PetscReal         du_elem[3][VFCARTFE_MAXNG3D],beta;
   
   PetscFunctionBegin;
   beta  = matprop->beta;
-  ierr = PetscMalloc4(e->ng,&v_elem,
-                      e->ng,&du_elem[0],
-                      e->ng,&du_elem[1],
-                      e->ng,&du_elem[2]);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     v_elem[eg] = 0.;
     for (c = 0; c < 3; c++){
@@ -1820,7 +2140,6 @@ extern PetscErrorCode VF_RHSFlowMechUCoupling_local(PetscReal *K_local,VFCartFEE
       }
     }
   }
-  ierr = PetscFree4(v_elem,du_elem[0],du_elem[1],du_elem[2]);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -1831,15 +2150,13 @@ extern PetscErrorCode VF_RHSFlowMechUCoupling_local(PetscReal *K_local,VFCartFEE
 #define __FUNCT__ "VF_RHSFlowMechUCouplingFIXSTRESS_local"
 extern PetscErrorCode VF_RHSFlowMechUCouplingFIXSTRESS_local(PetscReal *K_local,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,VFMatProp *matprop,PetscReal ***pressure_diff_array,PetscReal ***v_array)
 {
-  PetscErrorCode    ierr;
   PetscInt          i,j,k,l;
   PetscInt          eg;
-  PetscReal         *v_elem;
-  PetscReal         *p_diff_elem,beta;
+  PetscReal         v_elem[VFCARTFE_MAXNG3D];
+  PetscReal         p_diff_elem[VFCARTFE_MAXNG3D],beta;
   
   PetscFunctionBegin;
   beta  = matprop->beta;
-  ierr = PetscMalloc2(e->ng,&v_elem,e->ng,&p_diff_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     v_elem[eg] = 0.;
     p_diff_elem[eg] = 0.;
@@ -1865,7 +2182,6 @@ extern PetscErrorCode VF_RHSFlowMechUCouplingFIXSTRESS_local(PetscReal *K_local,
     }
   }
   
-  ierr = PetscFree2(v_elem,p_diff_elem);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -1873,26 +2189,13 @@ extern PetscErrorCode VF_RHSFlowMechUCouplingFIXSTRESS_local(PetscReal *K_local,
 #define __FUNCT__ "VF_RHSFractureFlowCoupling_localOld"
 extern PetscErrorCode VF_RHSFractureFlowCoupling_localOld(PetscReal *K_local,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscReal ****u_array,PetscReal ***v_array,PetscReal ****u_old_array,PetscReal ***v_old_array)
 {
-  PetscErrorCode    ierr;
   PetscInt          i,j,k,l,c;
   PetscInt          eg;
-  PetscReal         *u_elem[3],*dv_elem[3];
-  PetscReal         *u_old_elem[3],*dv_old_elem[3];
+  PetscReal         u_elem[3][VFCARTFE_MAXNG3D],dv_elem[3][VFCARTFE_MAXNG3D];
+  PetscReal         u_old_elem[3][VFCARTFE_MAXNG3D],dv_old_elem[3][VFCARTFE_MAXNG3D];
   
   PetscFunctionBegin;
-  ierr = PetscMalloc6(e->ng,&dv_elem[0],
-                      e->ng,&dv_elem[1],
-                      e->ng,&dv_elem[2],
-                      e->ng,&u_elem[0],
-                      e->ng,&u_elem[1],
-                      e->ng,&u_elem[2]);CHKERRQ(ierr);
-  
-  ierr = PetscMalloc6(e->ng,&dv_old_elem[0],
-                      e->ng,&dv_old_elem[1],
-                      e->ng,&dv_old_elem[2],
-                      e->ng,&u_old_elem[0],
-                      e->ng,&u_old_elem[1],
-                      e->ng,&u_old_elem[2]);CHKERRQ(ierr);
+  
   for (eg = 0; eg < e->ng; eg++){
     for (c = 0; c < 3; c++){
       dv_elem[c][eg] = 0.;
@@ -1940,8 +2243,6 @@ extern PetscErrorCode VF_RHSFractureFlowCoupling_localOld(PetscReal *K_local,VFC
       }
     }
   }
-  ierr = PetscFree6(dv_elem[0],dv_elem[1],dv_elem[2],u_elem[0],u_elem[1],u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscFree6(dv_old_elem[0],dv_old_elem[1],dv_old_elem[2],u_old_elem[0],u_old_elem[1],u_old_elem[2]);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -1949,14 +2250,11 @@ extern PetscErrorCode VF_RHSFractureFlowCoupling_localOld(PetscReal *K_local,VFC
 #define __FUNCT__ "VF_MatAFractureFlowCoupling_local"
 extern PetscErrorCode VF_MatAFractureFlowCoupling_local(PetscReal *Kd_ele,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscReal ****u_array,PetscReal ***v_array)
 {
-  PetscErrorCode          ierr;
   PetscInt                i,j,k,l,c;
   PetscInt                ii,jj,kk;
-  PetscReal               *dv_elem[3],*u_elem[3],*v_mag_elem,*n_elem[3];
+  PetscReal               dv_elem[3][VFCARTFE_MAXNG3D],u_elem[3][VFCARTFE_MAXNG3D],v_mag_elem[VFCARTFE_MAXNG3D],n_elem[3][VFCARTFE_MAXNG3D];
   PetscInt                eg;
   
-  ierr = PetscMalloc6(e->ng,&dv_elem[0],e->ng,&dv_elem[1],e->ng,&dv_elem[2],e->ng,&u_elem[0],e->ng,&u_elem[1],e->ng,&u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscMalloc4(e->ng,&n_elem[0],e->ng,&n_elem[1],e->ng,&n_elem[2],e->ng,&v_mag_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     for(c = 0; c < 3; c++){
       dv_elem[c][eg] = 0;
@@ -2011,8 +2309,6 @@ extern PetscErrorCode VF_MatAFractureFlowCoupling_local(PetscReal *Kd_ele,VFCart
 			}
 		}
 	}
-  ierr = PetscFree6(dv_elem[0],dv_elem[1],dv_elem[2],u_elem[0],u_elem[1],u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscFree4(n_elem[0],n_elem[1],n_elem[2],v_mag_elem);CHKERRQ(ierr);
 	PetscFunctionReturn(0);
 }
 
@@ -2020,13 +2316,11 @@ extern PetscErrorCode VF_MatAFractureFlowCoupling_local(PetscReal *Kd_ele,VFCart
 #define __FUNCT__ "VF_MatLeakOff_local"
 extern PetscErrorCode VF_MatLeakOff_local(PetscReal *Kd_ele,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt dof,PetscReal ***v_array)
 {
-  PetscErrorCode          ierr;
   PetscInt                i,j,k,l;
   PetscInt                ii,jj,kk;
-  PetscReal               *dv_elem;
+  PetscReal               dv_elem[VFCARTFE_MAXNG3D];
   PetscInt                eg;
   
-  ierr = PetscMalloc(e->ng*sizeof(PetscReal),&dv_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     dv_elem[eg] = 0;
   }
@@ -2055,7 +2349,6 @@ extern PetscErrorCode VF_MatLeakOff_local(PetscReal *Kd_ele,VFCartFEElement3D *e
 			}
 		}
 	}
-  ierr = PetscFree(dv_elem);CHKERRQ(ierr);
 	PetscFunctionReturn(0);
 }
 
@@ -2064,14 +2357,11 @@ extern PetscErrorCode VF_MatLeakOff_local(PetscReal *Kd_ele,VFCartFEElement3D *e
 #define __FUNCT__ "VF_MatBTFractureFlowCoupling_local"
 extern PetscErrorCode VF_MatBTFractureFlowCoupling_local(PetscReal *Kd_ele,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt dof,PetscReal ****u_array,PetscReal ***v_array)
 {
-  PetscErrorCode          ierr;
   PetscInt                i,j,k,l,c;
   PetscInt                ii,jj,kk;
-  PetscReal               *dv_elem[3],*u_elem[3],*n_elem[3],*v_mag_elem;
+  PetscReal               dv_elem[3][VFCARTFE_MAXNG3D],u_elem[3][VFCARTFE_MAXNG3D],n_elem[3][VFCARTFE_MAXNG3D],v_mag_elem[VFCARTFE_MAXNG3D];
   PetscInt                eg;
   
-  ierr = PetscMalloc6(e->ng,&dv_elem[0],e->ng,&dv_elem[1],e->ng,&dv_elem[2],e->ng,&u_elem[0],e->ng,&u_elem[1],e->ng,&u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscMalloc4(e->ng,&n_elem[0],e->ng,&n_elem[1],e->ng,&n_elem[2],e->ng,&v_mag_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     for(c = 0; c < 3; c++){
       dv_elem[c][eg] = 0;
@@ -2146,8 +2436,6 @@ extern PetscErrorCode VF_MatBTFractureFlowCoupling_local(PetscReal *Kd_ele,VFCar
 			}
 		}
 	}
-  ierr = PetscFree6(dv_elem[0],dv_elem[1],dv_elem[2],u_elem[0],u_elem[1],u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscFree4(n_elem[0],n_elem[1],n_elem[2],v_mag_elem);CHKERRQ(ierr);
 	PetscFunctionReturn(0);
 }
 
@@ -2155,14 +2443,11 @@ extern PetscErrorCode VF_MatBTFractureFlowCoupling_local(PetscReal *Kd_ele,VFCar
 #define __FUNCT__ "VF_MatBFractureFlowCoupling_local"
 extern PetscErrorCode VF_MatBFractureFlowCoupling_local(PetscReal *Kd_ele,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt dof,PetscReal ****u_array,PetscReal ***v_array)
 {
-  PetscErrorCode          ierr;
   PetscInt                i,j,k,l,c;
   PetscInt                ii,jj,kk;
-  PetscReal               *dv_elem[3],*u_elem[3],*n_elem[3],*v_mag_elem;
+  PetscReal               dv_elem[3][VFCARTFE_MAXNG3D],u_elem[3][VFCARTFE_MAXNG3D],n_elem[3][VFCARTFE_MAXNG3D],v_mag_elem[VFCARTFE_MAXNG3D];
   PetscInt                eg;
   
-  ierr = PetscMalloc6(e->ng,&dv_elem[0],e->ng,&dv_elem[1],e->ng,&dv_elem[2],e->ng,&u_elem[0],e->ng,&u_elem[1],e->ng,&u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscMalloc4(e->ng,&n_elem[0],e->ng,&n_elem[1],e->ng,&n_elem[2],e->ng,&v_mag_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     for(c = 0; c < 3; c++){
       dv_elem[c][eg] = 0;
@@ -2237,8 +2522,6 @@ extern PetscErrorCode VF_MatBFractureFlowCoupling_local(PetscReal *Kd_ele,VFCart
 			}
     }
   }
-  ierr = PetscFree6(dv_elem[0],dv_elem[1],dv_elem[2],u_elem[0],u_elem[1],u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscFree4(n_elem[0],n_elem[1],n_elem[2],v_mag_elem);CHKERRQ(ierr);
 	PetscFunctionReturn(0);
 }
 
@@ -2247,14 +2530,11 @@ extern PetscErrorCode VF_MatBFractureFlowCoupling_local(PetscReal *Kd_ele,VFCart
 #define __FUNCT__ "VF_MatDFractureFlowCoupling_localOld"
 extern PetscErrorCode VF_MatDFractureFlowCoupling_localOld(PetscReal *Kd_ele,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscReal ****u_array,PetscReal ***v_array)
 {
-  PetscErrorCode          ierr;
   PetscInt                i,j,k,l,c;
   PetscInt                ii,jj,kk;
-  PetscReal               *dv_elem[3],*u_elem[3],*n_elem[3],*v_mag_elem,*v_elem;
+  PetscReal               dv_elem[3][VFCARTFE_MAXNG3D],u_elem[3][VFCARTFE_MAXNG3D],n_elem[3][VFCARTFE_MAXNG3D],v_mag_elem[VFCARTFE_MAXNG3D],v_elem[VFCARTFE_MAXNG3D];
   PetscInt                eg;
   
-  ierr = PetscMalloc6(e->ng,&dv_elem[0],e->ng,&dv_elem[1],e->ng,&dv_elem[2],e->ng,&u_elem[0],e->ng,&u_elem[1],e->ng,&u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscMalloc5(e->ng,&n_elem[0],e->ng,&n_elem[1],e->ng,&n_elem[2],e->ng,&v_mag_elem,e->ng,&v_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     for(c = 0; c < 3; c++){
       dv_elem[c][eg] = 0;
@@ -2335,8 +2615,6 @@ extern PetscErrorCode VF_MatDFractureFlowCoupling_localOld(PetscReal *Kd_ele,VFC
 			}
 		}
 	}
-  ierr = PetscFree6(dv_elem[0],dv_elem[1],dv_elem[2],u_elem[0],u_elem[1],u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscFree5(n_elem[0],n_elem[1],n_elem[2],v_mag_elem,v_elem);CHKERRQ(ierr);
 	PetscFunctionReturn(0);
 }
 
@@ -2344,13 +2622,11 @@ extern PetscErrorCode VF_MatDFractureFlowCoupling_localOld(PetscReal *Kd_ele,VFC
 #define __FUNCT__ "VF_MatFluidCompreStiffMatrix_local"
 extern PetscErrorCode VF_MatFluidCompreStiffMatrix_local(PetscReal *Kd_ele,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscReal ****u_array,PetscReal ***v_array)
 {
-  PetscErrorCode          ierr;
   PetscInt                i,j,k,l,c;
   PetscInt                ii,jj,kk;
-  PetscReal               *dv_elem[3],*u_elem[3];
+  PetscReal               dv_elem[3][VFCARTFE_MAXNG3D],u_elem[3][VFCARTFE_MAXNG3D];
   PetscInt                eg;
   
-  ierr = PetscMalloc6(e->ng,&dv_elem[0],e->ng,&dv_elem[1],e->ng,&dv_elem[2],e->ng,&u_elem[0],e->ng,&u_elem[1],e->ng,&u_elem[2]);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     for(c = 0; c < 3; c++){
       dv_elem[c][eg] = 0;
@@ -2388,7 +2664,6 @@ extern PetscErrorCode VF_MatFluidCompreStiffMatrix_local(PetscReal *Kd_ele,VFCar
 			}
 		}
 	}
-  ierr = PetscFree6(dv_elem[0],dv_elem[1],dv_elem[2],u_elem[0],u_elem[1],u_elem[2]);CHKERRQ(ierr);
 	PetscFunctionReturn(0);
 }
 
@@ -2396,19 +2671,17 @@ extern PetscErrorCode VF_MatFluidCompreStiffMatrix_local(PetscReal *Kd_ele,VFCar
 #define __FUNCT__ "VF_FlowStiffnessMatrixEps_local"
 extern PetscErrorCode VF_FlowStiffnessMatrixEps_local(PetscReal *Kd_ele,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscReal ***v_array)
 {
-  PetscErrorCode  ierr;
 	PetscInt        i,j,k,l;
 	PetscInt        ii,jj,kk;
 	PetscInt        eg;
 	PetscReal       kx_ep,ky_ep,kz_ep;
-  PetscReal		   *v_elem;
+  PetscReal		   v_elem[VFCARTFE_MAXNG3D];
   PetscReal		   val = 1e-17;
   
 	PetscFunctionBegin;
   kx_ep = val;
   ky_ep = val;
   kz_ep = val;
-  ierr = PetscMalloc(e->ng*sizeof(PetscReal),&v_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
 		v_elem[eg] = 0.;
 	}
@@ -2439,7 +2712,6 @@ extern PetscErrorCode VF_FlowStiffnessMatrixEps_local(PetscReal *Kd_ele,VFCartFE
 			}
 		}
 	}
-  ierr = PetscFree(v_elem);CHKERRQ(ierr);
 	PetscFunctionReturn(0);
 }
 
@@ -2466,14 +2738,11 @@ extern PetscErrorCode VF_FlowStiffnessMatrixEps_local(PetscReal *Kd_ele,VFCartFE
 #define __FUNCT__ "VF_MatDFractureFlowCouplingAveCOD_local"
 extern PetscErrorCode VF_MatDFractureFlowCouplingAveCOD_local(PetscReal *Kd_ele,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscReal ***pmult_array,PetscReal ***v_array)
 {
-  PetscErrorCode          ierr;
   PetscInt                i,j,k,l,c;
   PetscInt                ii,jj,kk;
-  PetscReal               *dv_elem[3],*n_elem[3],*v_mag_elem,*v_elem;
+  PetscReal               dv_elem[3][VFCARTFE_MAXNG3D],n_elem[3][VFCARTFE_MAXNG3D],v_mag_elem[VFCARTFE_MAXNG3D],v_elem[VFCARTFE_MAXNG3D];
   PetscInt                eg;
   
-  ierr = PetscMalloc3(e->ng,&dv_elem[0],e->ng,&dv_elem[1],e->ng,&dv_elem[2]);CHKERRQ(ierr);
-  ierr = PetscMalloc5(e->ng,&n_elem[0],e->ng,&n_elem[1],e->ng,&n_elem[2],e->ng,&v_mag_elem,e->ng,&v_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     for(c = 0; c < 3; c++){
       dv_elem[c][eg] = 0;
@@ -2557,8 +2826,6 @@ extern PetscErrorCode VF_MatDFractureFlowCouplingAveCOD_local(PetscReal *Kd_ele,
 			}
 		}
 	}
-  ierr = PetscFree3(dv_elem[0],dv_elem[1],dv_elem[2]);CHKERRQ(ierr);
-  ierr = PetscFree5(n_elem[0],n_elem[1],n_elem[2],v_mag_elem,v_elem);CHKERRQ(ierr);
 	PetscFunctionReturn(0);
 }
 
@@ -2566,13 +2833,11 @@ extern PetscErrorCode VF_MatDFractureFlowCouplingAveCOD_local(PetscReal *Kd_ele,
 #define __FUNCT__ "VF_MatApplyFracturePressureBC_local"
 extern PetscErrorCode VF_MatApplyFracturePressureBC_local(PetscReal *K_ele,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt dof,PetscReal ***v_array)
 {
-  PetscErrorCode          ierr;
   PetscInt                i,j,k,l;
   PetscInt                ii,jj,kk;
-  PetscReal               *dv_elem;
+  PetscReal               dv_elem[VFCARTFE_MAXNG3D];
   PetscInt                eg;
   
-  ierr = PetscMalloc(e->ng*sizeof(PetscReal),&dv_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     dv_elem[eg] = 0;
   }
@@ -2601,7 +2866,6 @@ extern PetscErrorCode VF_MatApplyFracturePressureBC_local(PetscReal *K_ele,VFCar
 			}
 		}
 	}
-  ierr = PetscFree(dv_elem);CHKERRQ(ierr);
 	PetscFunctionReturn(0);
 }
 
@@ -2643,14 +2907,11 @@ extern PetscErrorCode VF_MatApplyFracturePressureBC_local(PetscReal *K_ele,VFCar
 #define __FUNCT__ "VF_MatDFractureFlowCoupling_local"
 extern PetscErrorCode VF_MatDFractureFlowCoupling_local(PetscReal *Kd_ele,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscReal w,PetscReal ***v_array)
 {
-  PetscErrorCode          ierr;
   PetscInt                i,j,k,l,c;
   PetscInt                ii,jj,kk;
-  PetscReal               *dv_elem[3],*n_elem[3],*dv_mag_elem;
+  PetscReal               dv_elem[3][VFCARTFE_MAXNG3D],n_elem[3][VFCARTFE_MAXNG3D],dv_mag_elem[VFCARTFE_MAXNG3D];
   PetscInt                eg;
   
-  ierr = PetscMalloc3(e->ng,&dv_elem[0],e->ng,&dv_elem[1],e->ng,&dv_elem[2]);CHKERRQ(ierr);
-  ierr = PetscMalloc4(e->ng,&n_elem[0],e->ng,&n_elem[1],e->ng,&n_elem[2],e->ng,&dv_mag_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     for(c = 0; c < 3; c++){
       dv_elem[c][eg] = 0;
@@ -2719,8 +2980,6 @@ extern PetscErrorCode VF_MatDFractureFlowCoupling_local(PetscReal *Kd_ele,VFCart
 			}
 		}
 	}
-  ierr = PetscFree3(dv_elem[0],dv_elem[1],dv_elem[2]);CHKERRQ(ierr);
-  ierr = PetscFree4(n_elem[0],n_elem[1],n_elem[2],dv_mag_elem);CHKERRQ(ierr);
 	PetscFunctionReturn(0);
 }
 
@@ -2744,16 +3003,11 @@ extern PetscErrorCode VF_MatDFractureFlowCoupling_local(PetscReal *Kd_ele,VFCart
 #define __FUNCT__ "VF_RHSFractureFlowCoupling_local"
 extern PetscErrorCode VF_RHSFractureFlowCoupling_local(PetscReal *K_local,VFCartFEElement3D *e,PetscInt ek,PetscInt ej,PetscInt ei,PetscReal w,PetscReal ***v_array,PetscReal w_old)
 {
-  PetscErrorCode    ierr;
   PetscInt          i,j,k,l,c;
   PetscInt          eg;
-  PetscReal         *dv_elem[3],*dv_mag_elem;
+  PetscReal         dv_elem[3][VFCARTFE_MAXNG3D],dv_mag_elem[VFCARTFE_MAXNG3D];
   
   PetscFunctionBegin;
-  ierr = PetscMalloc4(e->ng,&dv_elem[0],
-                      e->ng,&dv_elem[1],
-                      e->ng,&dv_elem[2],
-                      e->ng,&dv_mag_elem);CHKERRQ(ierr);
   
   for (eg = 0; eg < e->ng; eg++){
     for (c = 0; c < 3; c++){
@@ -2784,7 +3038,6 @@ extern PetscErrorCode VF_RHSFractureFlowCoupling_local(PetscReal *K_local,VFCart
       }
     }
   }
-  ierr = PetscFree4(dv_elem[0],dv_elem[1],dv_elem[2],dv_mag_elem);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
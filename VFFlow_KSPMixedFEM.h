@@ -11,7 +11,12 @@
 
 extern PetscErrorCode VFFlow_DarcyMixedFEMSteadyState(VFCtx *ctx, VFFields *fields);
 extern PetscErrorCode MixedFEMFlowSolverInitialize(VFCtx *ctx, VFFields *fields);
-extern PetscErrorCode FlowMatnVecAssemble(Mat K, Mat Krhs, Vec RHS, VFFields *fields, VFCtx *ctx);
+extern PetscErrorCode MixedFEMFlowFieldSplitSetUp(KSP ksp,VFCtx *ctx);
+extern PetscErrorCode MixedFEMFlowSchurPreAssemble(Mat S,Vec perm,VFFields *fields,PetscReal alpha,PetscReal beta,VFCtx *ctx);
+extern PetscErrorCode MixedFEMFlowMatInputsChanged(VFCtx *ctx,VFFields *fields,PetscBool *changed);
+extern PetscErrorCode MixedFEMFlowStorageAssemble(Mat M,VFCtx *ctx);
+extern PetscErrorCode MixedFEMFlowExplicitMultAdd(Mat K,Mat M,Vec x,Vec y,VFCtx *ctx);
+extern PetscErrorCode FlowMatnVecAssemble(Mat K, Vec RHS, PetscBool assembleK, VFFields *fields, VFCtx *ctx);
 extern PetscErrorCode Flow_Vecg(PetscReal *Kg_local, VFCartFEElement3D *e,  PetscInt ek, PetscInt ej, PetscInt ei, VFFlowProp *flowpropty, PetscReal ****perm_array, PetscReal ***v_array);
 extern PetscErrorCode Flow_Vecf(PetscReal *Kf_ele, VFCartFEElement3D *e,  PetscInt ek, PetscInt ej, PetscInt ei, PetscInt c, VFFlowProp *flowpropty, PetscReal ***v_array);
 extern PetscErrorCode Flow_MatD(PetscReal *Kd_ele, VFCartFEElement3D *e,  PetscInt ek, PetscInt ej, PetscInt ei, VFFlowProp *flowpropty, PetscReal ****perm_array, PetscReal ***v_array);
@@ -24,7 +29,7 @@ extern PetscErrorCode Flow_MatBTranspose(PetscReal *KB_ele, VFCartFEElement3D *e
 extern PetscErrorCode VecApplySourceTerms(PetscReal *Ks_local, PetscReal ***source_array, VFCartFEElement3D *e, PetscInt ek, PetscInt ej, PetscInt ei, VFCtx *ctx, PetscReal ***v_array);
 extern PetscErrorCode ResetBoundaryTerms(VFCtx *ctx, VFFields *fields);
 extern PetscErrorCode MixedFEMKSPMonitor(KSP ksp,PetscInt its,PetscReal fnorm,void* ptr);
-extern PetscErrorCode MatApplyKSPVelocityBC(Mat K,Mat Klhs,VFBC *bcQ);
+extern PetscErrorCode MatApplyKSPVelocityBC(Mat K,VFBC *bcQ);
 extern PetscErrorCode VecApplyPressureBC(PetscReal *RHS_local,PetscReal ***pre_array,PetscInt ek,PetscInt ej,PetscInt ei,FACE face,VFCartFEElement2D *e,VFFlowProp *flowpropty,PetscReal ****perm_array, PetscReal ***v_array);
 extern PetscErrorCode VecApplyWellFlowRate(PetscReal *RHS_local,VFCartFEElement3D *e,PetscReal Q,PetscReal hwx,PetscReal hwy,PetscReal hwz,PetscInt ek,PetscInt ej,PetscInt ei,PetscReal ***v_array);
 extern PetscErrorCode MixedFlowFEMKSPSolve(VFCtx *ctx,VFFields *fields);
@@ -22,11 +22,8 @@ extern PetscErrorCode FEMSNESFlowSolverInitialize(VFCtx *ctx, VFFields *fields)
   ierr = MPI_Comm_size(PETSC_COMM_WORLD,&comm_size);CHKERRQ(ierr);
   ierr = DMCreateMatrix(ctx->daScal,&ctx->KP);CHKERRQ(ierr);
   ierr = DMCreateMatrix(ctx->daScal,&ctx->KPlhs);CHKERRQ(ierr);		
-  ierr = DMCreateMatrix(ctx->daScal,&ctx->JacP);CHKERRQ(ierr);
-  ierr = MatZeroEntries(ctx->JacP);CHKERRQ(ierr);
   ierr = MatSetOption(ctx->KP,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
   ierr = MatSetOption(ctx->KPlhs,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
-  ierr = MatSetOption(ctx->JacP,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
 
   ierr = DMCreateGlobalVector(ctx->daScal,&ctx->RHSP);CHKERRQ(ierr);
 	ierr = DMCreateGlobalVector(ctx->daScal,&ctx->RHSPpre);CHKERRQ(ierr);
@@ -67,7 +64,6 @@ extern PetscErrorCode FEMSNESFlowSolverFinalize(VFCtx *ctx,VFFields *fields)
 	PetscFunctionBegin;
   ierr = MatDestroy(&ctx->KP);CHKERRQ(ierr);
   ierr = MatDestroy(&ctx->KPlhs);CHKERRQ(ierr);
-	ierr = MatDestroy(&ctx->JacP);CHKERRQ(ierr);
 	ierr = VecDestroy(&ctx->pressure_old);CHKERRQ(ierr);
 	ierr = VecDestroy(&ctx->RHSP);CHKERRQ(ierr);
 	ierr = VecDestroy(&ctx->RHSPpre);CHKERRQ(ierr);	
@@ -90,9 +86,10 @@ extern PetscErrorCode FlowFEMSNESSolve(VFCtx *ctx,VFFields *fields)
 	ierr = VecSet(ctx->Perm,0.0);CHKERRQ(ierr);
 	ierr = VecCopy(fields->vfperm,ctx->Perm);CHKERRQ(ierr);
     ierr = VecCopy(fields->pressure,ctx->pressure_old);CHKERRQ(ierr);
+	ierr = FormSNESMatricesnVector_P(ctx->KP,ctx->KPlhs,ctx->RHSP,ctx);CHKERRQ(ierr);
 	
 	ierr = SNESSetFunction(ctx->snesP,ctx->PFunct,FormSNESIFunction_P,ctx);CHKERRQ(ierr);
-    ierr = SNESSetJacobian(ctx->snesP,ctx->JacP,ctx->JacP,FormSNESIJacobian_P,ctx);CHKERRQ(ierr);
+    ierr = SNESSetJacobian(ctx->snesP,ctx->KP,ctx->KP,FormSNESIJacobian_P,ctx);CHKERRQ(ierr);
 	if (ctx->verbose > 1) {
 	  ierr = SNESMonitorSet(ctx->snesP,FEMSNESMonitor,NULL,NULL);CHKERRQ(ierr);
 	}
@@ -115,6 +112,9 @@ extern PetscErrorCode FlowFEMSNESSolve(VFCtx *ctx,VFFields *fields)
 	PetscFunctionReturn(0);
 }
 
+/*
+  FormSNESIJacobian_P: The residual is linear in the pressure, the SNES uses the KP assembled by FlowFEMSNESSolve as its Jacobian.
+*/
 #undef __FUNCT__
 #define __FUNCT__ "FormSNESIJacobian_P"
 extern PetscErrorCode FormSNESIJacobian_P(SNES snes,Vec pressure,Mat Jac,Mat Jacpre,void *user)
@@ -123,12 +123,10 @@ extern PetscErrorCode FormSNESIJacobian_P(SNES snes,Vec pressure,Mat Jac,Mat Jac
 	VFCtx          *ctx=(VFCtx*)user;
 
 	PetscFunctionBegin;
-	ierr = MatZeroEntries(Jacpre);CHKERRQ(ierr);
-	ierr = MatCopy(ctx->KP,Jacpre,DIFFERENT_NONZERO_PATTERN);
-	ierr = MatAssemblyBegin(Jacpre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-	ierr = MatAssemblyEnd(Jacpre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+	if (Jacpre != ctx->KP) {
+		ierr = MatCopy(ctx->KP,Jacpre,DIFFERENT_NONZERO_PATTERN);CHKERRQ(ierr);
+	}
 	if (Jac != Jacpre) {
-  	ierr = MatCopy(Jacpre,Jac,DIFFERENT_NONZERO_PATTERN);
 		ierr = MatAssemblyBegin(Jac,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
 		ierr = MatAssemblyEnd(Jac,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
 	}	
@@ -141,6 +139,7 @@ extern PetscErrorCode FormSNESIJacobian_P(SNES snes,Vec pressure,Mat Jac,Mat Jac
 extern PetscErrorCode FormSNESMatricesnVector_P(Mat Kneu,Mat Kalt,Vec RHS,VFCtx *ctx)
 {
 	PetscErrorCode ierr;
+	VFCartFEElement3D *e3D;
 	PetscInt       xs,xm;
 	PetscInt       ys,ym;
 	PetscInt       zs,zm;
@@ -152,7 +151,6 @@ extern PetscErrorCode FormSNESMatricesnVector_P(Mat Kneu,Mat Kalt,Vec RHS,VFCtx
 	Vec            RHS_localVec;	
 	PetscReal      *RHS_local;
 	Vec            perm_local;
-	PetscReal      hx,hy,hz;
 	PetscReal      *K_local,*M_local;
 	PetscInt       nrow = ctx->e3D.nphix*ctx->e3D.nphiy*ctx->e3D.nphiz;
 	MatStencil     *row;
@@ -199,13 +197,10 @@ extern PetscErrorCode FormSNESMatricesnVector_P(Mat Kneu,Mat Kalt,Vec RHS,VFCtx
 	for (ek = zs; ek < zs+zm; ek++) {
 		for (ej = ys; ej < ys+ym; ej++) {
 			for (ei = xs; ei < xs+xm; ei++) {
-				hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-				hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-				hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-				ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+				ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
 
-				ierr = VFFlow_FEM_MatMPAssembly3D_local(M_local,&ctx->flowprop,ek,ej,ei,m_inv_array[ek][ej][ei],&ctx->e3D);CHKERRQ(ierr);
-        ierr = VFFlow_FEM_MatKPAssembly3D_local(K_local,&ctx->flowprop,perm_array,ek,ej,ei,&ctx->e3D);CHKERRQ(ierr);			
+				ierr = VFFlow_FEM_MatMPAssembly3D_local(M_local,&ctx->flowprop,ek,ej,ei,m_inv_array[ek][ej][ei],e3D);CHKERRQ(ierr);
+        ierr = VFFlow_FEM_MatKPAssembly3D_local(K_local,&ctx->flowprop,perm_array,ek,ej,ei,e3D);CHKERRQ(ierr);			
 				for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
 					for (j = 0; j < ctx->e3D.nphiy; j++) {
 						for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -216,7 +211,7 @@ extern PetscErrorCode FormSNESMatricesnVector_P(Mat Kneu,Mat Kalt,Vec RHS,VFCtx
 				ierr = MatSetValuesStencil(K,nrow,row,nrow,row,K_local,ADD_VALUES);CHKERRQ(ierr);
 				ierr = MatSetValuesStencil(M,nrow,row,nrow,row,M_local,ADD_VALUES);CHKERRQ(ierr);				
 				/*Assembling the right hand side vector g*/
-				ierr = Flow_Vecg_FEM(RHS_local,&ctx->e3D,ek,ej,ei,ctx->flowprop,perm_array);CHKERRQ(ierr);
+				ierr = Flow_Vecg_FEM(RHS_local,e3D,ek,ej,ei,ctx->flowprop,perm_array);CHKERRQ(ierr);
 				for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
 					for (j = 0; j < ctx->e3D.nphiy; j++) {
 						for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -226,7 +221,7 @@ extern PetscErrorCode FormSNESMatricesnVector_P(Mat Kneu,Mat Kalt,Vec RHS,VFCtx
 				}
 				/* Adding source term */
 				if(ctx->hasFluidSources){
-				  ierr = VecApplySourceTerms_FEM(RHS_local,source_array,&ctx->e3D,ek,ej,ei,ctx);
+				  ierr = VecApplySourceTerms_FEM(RHS_local,source_array,e3D,ek,ej,ei,ctx);
 				  for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
 					for (j = 0; j < ctx->e3D.nphiy; j++) {
 						for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -339,10 +334,8 @@ extern PetscErrorCode FormSNESIFunction_P(SNES snes,Vec pressure,Vec Func,void *
 	dt_dot_theta = timestepsize*theta;
 	dt_dot_one_minus_theta = timestepsize*(1.-theta);
 	ierr = VecDuplicate(ctx->RHSP,&VecRHS);CHKERRQ(ierr);
-	ierr = FormSNESMatricesnVector_P(ctx->KP,ctx->KPlhs,ctx->RHSP,ctx);CHKERRQ(ierr);
 	ierr = VecCopy(ctx->RHSP,VecRHS);CHKERRQ(ierr);
 	ierr = VecAXPBY(VecRHS,dt_dot_one_minus_theta,dt_dot_theta,ctx->RHSPpre);CHKERRQ(ierr);	
-	ierr = VecCopy(ctx->RHSP,ctx->RHSPpre);CHKERRQ(ierr);
 	ierr = MatMultAdd(ctx->KPlhs,ctx->pressure_old,VecRHS,VecRHS);CHKERRQ(ierr);
 //	ierr = VecApplyPressureBC_FEM(VecRHS,ctx->PresBCArray,&ctx->bcP[0]);CHKERRQ(ierr);
 
@@ -29,9 +29,14 @@
 extern PetscErrorCode MixedFEMSNESFlowSolverInitialize(VFCtx *ctx, VFFields *fields)
 {
 	PetscErrorCode ierr;
+	KSP            ksp;
   PetscFunctionBegin;
 	ierr = SNESCreate(PETSC_COMM_WORLD,&ctx->snesVelP);CHKERRQ(ierr);
   ierr = SNESAppendOptionsPrefix(ctx->snesVelP,"FlowSnes_");CHKERRQ(ierr);
+  if (ctx->flowFieldSplit) {
+    ierr = SNESGetKSP(ctx->snesVelP,&ksp);CHKERRQ(ierr);
+    ierr = MixedFEMFlowFieldSplitSetUp(ksp,ctx);CHKERRQ(ierr);
+  }
   ierr = SNESSetFromOptions(ctx->snesVelP);CHKERRQ(ierr);
 	PetscFunctionReturn(0);
 }
@@ -63,7 +68,7 @@ extern PetscErrorCode FormSNESIFunction(SNES snes,Vec VelnPress,Vec Func,void *u
 	ierr = VecDuplicate(ctx->RHSVelP,&VecRHS);CHKERRQ(ierr);
 	ierr = VecCopy(ctx->RHSVelP,VecRHS);CHKERRQ(ierr);
 	ierr = VecAXPBY(VecRHS,one_minus_theta,theta,ctx->RHSVelPpre);CHKERRQ(ierr);
-	ierr = MatMultAdd(ctx->KVelPlhs,ctx->PreFlowFields,VecRHS,VecRHS);CHKERRQ(ierr);
+	ierr = MixedFEMFlowExplicitMultAdd(ctx->KVelP,ctx->KVelPStorage,ctx->PreFlowFields,VecRHS,ctx);CHKERRQ(ierr);
 	ierr = VecApplyVelocityBC(VecRHS,ctx->VelBCArray,&ctx->bcQ[0],ctx);CHKERRQ(ierr);
 	ierr = MatMult(ctx->KVelP,VelnPress,Func);CHKERRQ(ierr);
   ierr = VecAXPY(Func,-1.0,VecRHS);CHKERRQ(ierr);
@@ -85,11 +90,20 @@ extern PetscErrorCode MixedFlowFEMSNESSolve(VFCtx *ctx,VFFields *fields)
 	PetscInt           its;
 	PetscReal           Velmin,Velmax;
 	PetscReal           Pmin,Pmax;
+	PetscBool          assembleK;
+	KSP                ksp;
 
 	PetscFunctionBegin;
-  ierr = FlowMatnVecAssemble(ctx->KVelP,ctx->KVelPlhs,ctx->RHSVelP,fields,ctx);CHKERRQ(ierr);
+  ierr = MixedFEMFlowMatInputsChanged(ctx,fields,&assembleK);CHKERRQ(ierr);
+  ierr = FlowMatnVecAssemble(ctx->KVelP,ctx->RHSVelP,assembleK,fields,ctx);CHKERRQ(ierr);
+  ierr = MixedFEMFlowStorageAssemble(ctx->KVelPStorage,ctx);CHKERRQ(ierr);
+  if (ctx->flowFieldSplit && assembleK) {
+    ierr = MixedFEMFlowSchurPreAssemble(ctx->KVelPSchur,fields->vfperm,fields,ctx->timevalue*ctx->theta/ctx->flowprop.mu,1.,ctx);CHKERRQ(ierr);
+  }
+  ierr = SNESGetKSP(ctx->snesVelP,&ksp);CHKERRQ(ierr);
+  ierr = KSPSetReusePreconditioner(ksp,assembleK ? PETSC_FALSE : PETSC_TRUE);CHKERRQ(ierr);
 	ierr = SNESSetFunction(ctx->snesVelP,ctx->FlowFunct,FormSNESIFunction,ctx);CHKERRQ(ierr);
-    ierr = SNESSetJacobian(ctx->snesVelP,ctx->JacVelP,ctx->JacVelP,FormSNESIJacobian,ctx);CHKERRQ(ierr);
+    ierr = SNESSetJacobian(ctx->snesVelP,ctx->KVelP,ctx->KVelP,FormSNESIJacobian,ctx);CHKERRQ(ierr);
 	if (ctx->verbose > 1) {
 		ierr = SNESMonitorSet(ctx->snesVelP,FEMSNESMonitor,NULL,NULL);CHKERRQ(ierr);
 	}
@@ -127,6 +141,10 @@ extern PetscErrorCode MixedFlowFEMSNESSolve(VFCtx *ctx,VFFields *fields)
 	PetscFunctionReturn(0);
 }
 
+/*
+  FormSNESIJacobian: The residual is linear in VelnPress, so the Jacobian is KVelP itself.
+  MixedFlowFEMSNESSolve hands KVelP to the SNES, the preconditioner is then only rebuilt when KVelP is reassembled.
+*/
 #undef __FUNCT__
 #define __FUNCT__ "FormSNESIJacobian"
 extern PetscErrorCode FormSNESIJacobian(SNES snes,Vec VelnPress,Mat Jac,Mat Jacpre,void *user)
@@ -135,11 +153,10 @@ extern PetscErrorCode FormSNESIJacobian(SNES snes,Vec VelnPress,Mat Jac,Mat Jacp
 	VFCtx             *ctx=(VFCtx*)user;
 	
 	PetscFunctionBegin;
-	ierr = MatCopy(ctx->KVelP,Jacpre,DIFFERENT_NONZERO_PATTERN);
-	ierr = MatAssemblyBegin(Jacpre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-	ierr = MatAssemblyEnd(Jacpre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+	if (Jacpre != ctx->KVelP) {
+		ierr = MatCopy(ctx->KVelP,Jacpre,DIFFERENT_NONZERO_PATTERN);CHKERRQ(ierr);
+	}
 	if (Jac != Jacpre) {
-    ierr = MatCopy(Jacpre,Jac,DIFFERENT_NONZERO_PATTERN);
 		ierr = MatAssemblyBegin(Jac,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
 		ierr = MatAssemblyEnd(Jac,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
 	}
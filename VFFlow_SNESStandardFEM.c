@@ -157,12 +157,11 @@ extern PetscErrorCode FractureFlowVelocityCompute_local(PetscReal ****cellveloci
 extern PetscErrorCode FractureFlowVelocityCompute(VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode  ierr;
+  VFCartFEElement3D *e3D;
   PetscInt        ek, ej, ei;
   PetscInt        xs,xm,nx;
   PetscInt        ys,ym,ny;
   PetscInt        zs,zm,nz;
-  PetscReal       hx,hy,hz;
-  PetscReal       ****coords_array;
   Vec             cellVelocity;
   Vec             cellVelocity_local;
   PetscReal       ****cellVelocity_array;
@@ -177,7 +176,6 @@ extern PetscErrorCode FractureFlowVelocityCompute(VFCtx *ctx, VFFields *fields)
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   
   ierr = DMGetLocalVector(ctx->daScal,&press_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalBegin(ctx->daScal,fields->pressure,INSERT_VALUES,press_local);CHKERRQ(ierr);
@@ -205,16 +203,12 @@ extern PetscErrorCode FractureFlowVelocityCompute(VFCtx *ctx, VFFields *fields)
   for (ek = zs; ek < zs+zm; ek++) {
     for (ej = ys; ej < ys+ym; ej++) {
       for (ei = xs; ei < xs+xm; ei++) {
-        hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
-        ierr = FractureFlowVelocityCompute_local(cellVelocity_array, press_array, u_array,v_array, &ctx->flowprop, ek, ej, ei, &ctx->e3D);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
+        ierr = FractureFlowVelocityCompute_local(cellVelocity_array, press_array, u_array,v_array, &ctx->flowprop, ek, ej, ei, e3D);CHKERRQ(ierr);
         
       }
     }
   }
-  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArrayDOF(ctx->daVect,u_local,&u_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daVect,&u_local);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArray(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
@@ -239,6 +233,9 @@ extern PetscErrorCode VF_FlowStandardFEMSNESSolve(VFCtx *ctx,VFFields *fields)
   SNESConvergedReason reason;
   PetscInt           its;
   PetscReal           Pmin,Pmax;
+  Vec                 matInputs[5];
+  PetscBool           assembleK;
+  KSP                 ksp;
   
   PetscFunctionBegin;
   
@@ -246,10 +243,20 @@ extern PetscErrorCode VF_FlowStandardFEMSNESSolve(VFCtx *ctx,VFFields *fields)
   ierr = VecCopy(fields->V,ctx->V);CHKERRQ(ierr);
   
   
-  
-  ierr = VF_FormFlowStandardFEMMatricesnVectors(ctx->KP,ctx->KPlhs,ctx->RHSP,fields,ctx);CHKERRQ(ierr);
+  /*
+    KP and KPlhs depend on the permeability, V, the fracture width and the storage coefficients
+  */
+  matInputs[0] = fields->vfperm;
+  matInputs[1] = fields->V;
+  matInputs[2] = fields->widthc;
+  matInputs[3] = ctx->M_inv;
+  matInputs[4] = ctx->K_dr;
+  ierr = VFFlowMatInputsChanged(&ctx->flowMatInputs,5,matInputs,ctx,&assembleK);CHKERRQ(ierr);
+  ierr = VF_FormFlowStandardFEMMatricesnVectors(ctx->KP,ctx->KPlhs,ctx->RHSP,assembleK,fields,ctx);CHKERRQ(ierr);
+  ierr = SNESGetKSP(ctx->snesP,&ksp);CHKERRQ(ierr);
+  ierr = KSPSetReusePreconditioner(ksp,assembleK ? PETSC_FALSE : PETSC_TRUE);CHKERRQ(ierr);
   ierr = SNESSetFunction(ctx->snesP,ctx->PFunct,VF_FormFlowStandardFEMIFunction,ctx);CHKERRQ(ierr);
-  ierr = SNESSetJacobian(ctx->snesP,ctx->JacP,ctx->JacP,VF_FormFlowStandardFEMIJacobian,ctx);CHKERRQ(ierr);
+  ierr = SNESSetJacobian(ctx->snesP,ctx->KP,ctx->KP,VF_FormFlowStandardFEMIJacobian,ctx);CHKERRQ(ierr);
   if (ctx->verbose > 1) {
     ierr = SNESMonitorSet(ctx->snesP,FEMSNESMonitor,NULL,NULL);CHKERRQ(ierr);
   }
@@ -276,12 +283,11 @@ extern PetscErrorCode VF_FlowStandardFEMSNESSolve(VFCtx *ctx,VFFields *fields)
 extern PetscErrorCode FlowVelocityCompute(VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode  ierr;
+  VFCartFEElement3D *e3D;
   PetscInt        ek, ej, ei;
   PetscInt        xs,xm,nx;
   PetscInt        ys,ym,ny;
   PetscInt        zs,zm,nz;
-  PetscReal       hx,hy,hz;
-  PetscReal       ****coords_array;
   Vec             cellVelocity;
   Vec             cellVelocity_local;
   PetscReal       ****cellVelocity_array;
@@ -296,7 +302,6 @@ extern PetscErrorCode FlowVelocityCompute(VFCtx *ctx, VFFields *fields)
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMGetLocalVector(ctx->daScal,&press_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalBegin(ctx->daScal,fields->pressure,INSERT_VALUES,press_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalEnd(ctx->daScal,fields->pressure,INSERT_VALUES,press_local);CHKERRQ(ierr);
@@ -318,15 +323,11 @@ extern PetscErrorCode FlowVelocityCompute(VFCtx *ctx, VFFields *fields)
   for (ek = zs; ek < zs+zm; ek++) {
     for (ej = ys; ej < ys+ym; ej++) {
       for (ei = xs; ei < xs+xm; ei++) {
-        hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
-        ierr = FlowVelocityCompute_local(cellVelocity_array, press_array, perm_array, v_array, &ctx->flowprop, ek, ej, ei, &ctx->e3D);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
+        ierr = FlowVelocityCompute_local(cellVelocity_array, press_array, perm_array, v_array, &ctx->flowprop, ek, ej, ei, e3D);CHKERRQ(ierr);
       }
     }
   }
-  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArrayDOF(ctx->daVFperm,perm_local,&perm_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daVFperm,&perm_local);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArray(ctx->daScal,press_local,&press_array);CHKERRQ(ierr);
@@ -394,9 +395,11 @@ extern PetscErrorCode FlowVelocityCompute_local(PetscReal ****cellvelocityrate_a
 
 #undef __FUNCT__
 #define __FUNCT__ "VF_FormFlowStandardFEMMatricesnVectors"
-extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec RHS,VFFields * fields,VFCtx *ctx)
+extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec RHS,PetscBool assembleK,VFFields * fields,VFCtx *ctx)
 {
   PetscErrorCode ierr;
+  VFCartFEElement3D *e3D;
+  VFCartFEElement2D *e2D;
   PetscInt       xs,xm,nx;
   PetscInt       ys,ym,ny;
   PetscInt       zs,zm,nz;
@@ -458,8 +461,10 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
   mu     = ctx->flowprop.mu;
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = MatZeroEntries(K);CHKERRQ(ierr);
-  ierr = MatZeroEntries(Krhs);CHKERRQ(ierr);
+  if (assembleK) {
+    ierr = MatZeroEntries(K);CHKERRQ(ierr);
+    ierr = MatZeroEntries(Krhs);CHKERRQ(ierr);
+  }
   ierr = VecSet(RHS,0.);CHKERRQ(ierr);
   
   ierr = DMGetLocalVector(ctx->daScal,&RHS_localVec);CHKERRQ(ierr);
@@ -568,6 +573,9 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
                       4,&RHS1_local,
                       nrow,&row);CHKERRQ(ierr);
   ierr = PetscMalloc4(nrow*nrow,&K3_local,nrow*nrow,&K4_local,nrow*nrow,&KDF_local,nrow*nrow,&KF_local);CHKERRQ(ierr);
+  if (ctx->FractureFlowCoupling) {
+    ierr = VFDamageBandUpdate(ctx,fields->V);CHKERRQ(ierr);
+  }
   
   for (ek = zs; ek < zs+zm; ek++) {
     for (ej = ys; ej < ys+ym; ej++) {
@@ -575,7 +583,7 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
         hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
         hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
         hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
         
         for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
           for (j = 0; j < ctx->e3D.nphiy; j++) {
@@ -584,36 +592,43 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
             }
           }
         }
-        ierr = VF_MatA_local(KS_local,&ctx->e3D,ek,ej,ei,one_array);CHKERRQ(ierr);
-        for (l = 0; l < nrow*nrow; l++) {
-          KS_local[l] = m_inv_array[ek][ej][ei]*KS_local[l];
-        }
-        ierr = MatSetValuesStencil(K,nrow,row,nrow,row,KS_local,ADD_VALUES);CHKERRQ(ierr);
-        ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row,KS_local,ADD_VALUES);CHKERRQ(ierr);
-        if(ctx->FlowDisplCoupling && ctx->ResFlowMechCoupling == FIXEDSTRESS){
-          ierr = VF_MatA_local(KF_local,&ctx->e3D,ek,ej,ei,v_array);CHKERRQ(ierr);
+        if (assembleK) {
+          ierr = VF_MatA_local(KS_local,e3D,ek,ej,ei,one_array);CHKERRQ(ierr);
           for (l = 0; l < nrow*nrow; l++) {
-            KF_local[l] = pow(ctx->matprop[ctx->layer[ek]].beta,2)*KF_local[l]/k_dr_array[ek][ej][ei];
+            KS_local[l] = m_inv_array[ek][ej][ei]*KS_local[l];
           }
-          ierr = MatSetValuesStencil(K,nrow,row,nrow,row,KF_local,ADD_VALUES);CHKERRQ(ierr);
-          ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row,KF_local,ADD_VALUES);CHKERRQ(ierr);
-        }
-        ierr = VF_HeatMatK_local(KD_local,&ctx->e3D,ek,ej,ei,perm_array,one_array);CHKERRQ(ierr);
-        for (l = 0; l < nrow*nrow; l++) {
-          K1_local[l] = theta/mu*timestepsize*KD_local[l];
-          K2_local[l] = -1.*(1.-theta)/mu*timestepsize*KD_local[l];
-        }
-        ierr = MatSetValuesStencil(K,nrow,row,nrow,row,K1_local,ADD_VALUES);CHKERRQ(ierr);
-        ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row,K2_local,ADD_VALUES);CHKERRQ(ierr);
-        if(ctx->FractureFlowCoupling){
-          ierr = VF_MatDFractureFlowCoupling_local(KD_local,&ctx->e3D,ek,ej,ei,w_array[ek][ej][ei],v_array);CHKERRQ(ierr);
+          ierr = MatSetValuesStencil(K,nrow,row,nrow,row,KS_local,ADD_VALUES);CHKERRQ(ierr);
+          ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row,KS_local,ADD_VALUES);CHKERRQ(ierr);
+          if(ctx->FlowDisplCoupling && ctx->ResFlowMechCoupling == FIXEDSTRESS){
+            ierr = VF_MatA_local(KF_local,e3D,ek,ej,ei,v_array);CHKERRQ(ierr);
+            for (l = 0; l < nrow*nrow; l++) {
+              KF_local[l] = pow(ctx->matprop[ctx->layer[ek]].beta,2)*KF_local[l]/k_dr_array[ek][ej][ei];
+            }
+            ierr = MatSetValuesStencil(K,nrow,row,nrow,row,KF_local,ADD_VALUES);CHKERRQ(ierr);
+            ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row,KF_local,ADD_VALUES);CHKERRQ(ierr);
+          }
+          ierr = VF_HeatMatK_local(KD_local,e3D,ek,ej,ei,perm_array,one_array);CHKERRQ(ierr);
           for (l = 0; l < nrow*nrow; l++) {
-            K1_local[l] = 4.*theta/(12.*mu)*timestepsize*KD_local[l];
-            K2_local[l] = -4.*(1.-theta)/(12.*mu)*timestepsize*KD_local[l];
+            K1_local[l] = theta/mu*timestepsize*KD_local[l];
+            K2_local[l] = -1.*(1.-theta)/mu*timestepsize*KD_local[l];
           }
           ierr = MatSetValuesStencil(K,nrow,row,nrow,row,K1_local,ADD_VALUES);CHKERRQ(ierr);
           ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row,K2_local,ADD_VALUES);CHKERRQ(ierr);
-          ierr = VF_RHSFractureFlowCoupling_local(RHS_local,&ctx->e3D,ek,ej,ei,w_array[ek][ej][ei],v_array,w_old_array[ek][ej][ei]);
+        }
+        if(ctx->FractureFlowCoupling){
+          /*
+            The fracture conductivity is proportional to |grad V|, which vanishes outside of the damage band
+          */
+          if (assembleK && ctx->bandMask[((ek-zs)*ym+ej-ys)*xm+ei-xs]) {
+            ierr = VF_MatDFractureFlowCoupling_local(KD_local,e3D,ek,ej,ei,w_array[ek][ej][ei],v_array);CHKERRQ(ierr);
+            for (l = 0; l < nrow*nrow; l++) {
+              K1_local[l] = 4.*theta/(12.*mu)*timestepsize*KD_local[l];
+              K2_local[l] = -4.*(1.-theta)/(12.*mu)*timestepsize*KD_local[l];
+            }
+            ierr = MatSetValuesStencil(K,nrow,row,nrow,row,K1_local,ADD_VALUES);CHKERRQ(ierr);
+            ierr = MatSetValuesStencil(Krhs,nrow,row,nrow,row,K2_local,ADD_VALUES);CHKERRQ(ierr);
+          }
+          ierr = VF_RHSFractureFlowCoupling_local(RHS_local,e3D,ek,ej,ei,w_array[ek][ej][ei],v_array,w_old_array[ek][ej][ei]);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++) {
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -622,7 +637,7 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
             }
           }
           if(ctx->hasFlowWells){
-            ierr = VecApplyFractureWellSource(RHS_local,fracflow_array,&ctx->e3D,ek,ej,ei,ctx,v_array);
+            ierr = VecApplyFractureWellSource(RHS_local,fracflow_array,e3D,ek,ej,ei,ctx,v_array);
             for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
               for (j = 0; j < ctx->e3D.nphiy; j++) {
                 for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -632,7 +647,7 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
             }
           }
         }
-        ierr = Flow_Vecg(RHS_local,&ctx->e3D,ek,ej,ei,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+        ierr = Flow_Vecg(RHS_local,e3D,ek,ej,ei,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
         for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
           for (j = 0; j < ctx->e3D.nphiy; j++) {
             for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -641,7 +656,7 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
           }
         }
         if(ctx->hasFluidSources){
-          ierr = VecApplySourceTerms(RHS_local,source_array,&ctx->e3D,ek,ej,ei,ctx,v_array);
+          ierr = VecApplySourceTerms(RHS_local,source_array,e3D,ek,ej,ei,ctx,v_array);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++) {
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -651,7 +666,7 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
           }
         }
         if(ctx->FlowDisplCoupling){
-          ierr = VF_RHSFlowMechUCoupling_local(RHS_local,&ctx->e3D,ek,ej,ei,&ctx->matprop[ctx->layer[ek]],u_diff_array,v_array);
+          ierr = VF_RHSFlowMechUCoupling_local(RHS_local,e3D,ek,ej,ei,&ctx->matprop[ctx->layer[ek]],u_diff_array,v_array);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++) {
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -661,7 +676,7 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
           }
         }
         if(ctx->FlowDisplCoupling && ctx->ResFlowMechCoupling == FIXEDSTRESS){
-          ierr = VF_RHSFlowMechUCouplingFIXSTRESS_local(RHS_local,&ctx->e3D,ek,ej,ei,&ctx->matprop[ctx->layer[ek]],pressure_diff_array,v_array);
+          ierr = VF_RHSFlowMechUCouplingFIXSTRESS_local(RHS_local,e3D,ek,ej,ei,&ctx->matprop[ctx->layer[ek]],pressure_diff_array,v_array);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++) {
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -670,7 +685,7 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
             }
           }
         }
-        ierr = RemoveModulusEffect(RHS_local,&ctx->e3D,ek,ej,ei,pressure_diff_array,v_array);
+        ierr = RemoveModulusEffect(RHS_local,e3D,ek,ej,ei,pressure_diff_array,v_array);
         for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
           for (j = 0; j < ctx->e3D.nphiy; j++) {
             for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -681,9 +696,9 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
         if (ei == 0) {
           /*                       Face X0  */
           face = X0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQ[0].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphix; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphiz; i++, l++) {
@@ -696,9 +711,9 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
         if (ei == nx-1) {
           /*                       Face X1  */
           face = X1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQ[0].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphix; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphiz; i++, l++) {
@@ -711,9 +726,9 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
         if (ej == 0) {
           /*                       Face Y0  */
           face = Y0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQ[1].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiy; k++){
               for (j = 0; j < ctx->e2D.nphiz; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -726,9 +741,9 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
         if (ej == ny-1) {
           /*                       Face Y1  */
           face = Y1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQ[1].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiy; k++){
               for (j = 0; j < ctx->e2D.nphiz; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -741,9 +756,9 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
         if (ek == 0) {
           /*                       Face Z0  */
           face = Z0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQ[2].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiz; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -756,9 +771,9 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
         if (ek == nz-1) {
           /*                       Face Z1  */
           face = Z1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQ[2].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS1_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiz; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -802,12 +817,12 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
               hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
               hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
               hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-              ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+              ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
               hwx = (ctx->well[w_no].coords[0]-coords_array[ek][ej][ei][0])/hx;
               hwy = (ctx->well[w_no].coords[1]-coords_array[ek][ej][ei][1])/hy;
               hwz = (ctx->well[w_no].coords[2]-coords_array[ek][ej][ei][2])/hz;
               if(ctx->well[w_no].condition == RATE){
-                ierr = VecApplyWellFlowRate(RHS_local,&ctx->e3D,ctx->well[w_no].Qw,hwx,hwy,hwz,ek,ej,ei,one_array);CHKERRQ(ierr);
+                ierr = VecApplyWellFlowRate(RHS_local,e3D,ctx->well[w_no].Qw,hwx,hwy,hwz,ek,ej,ei,one_array);CHKERRQ(ierr);
                 for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
                   for (j = 0; j < ctx->e3D.nphiy; j++) {
                     for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -831,15 +846,17 @@ extern PetscErrorCode VF_FormFlowStandardFEMMatricesnVectors(Mat K,Mat Krhs,Vec
       }
     }
   }
-  ierr = MatAssemblyBegin(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyEnd(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatApplyDirichletBC(K,&ctx->bcP[0]);CHKERRQ(ierr);
-  ierr = MatAssemblyBegin(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyEnd(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  if (assembleK) {
+    ierr = MatAssemblyBegin(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+    ierr = MatAssemblyEnd(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+    ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+    ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+    ierr = MatApplyDirichletBC(K,&ctx->bcP[0]);CHKERRQ(ierr);
+    ierr = MatAssemblyBegin(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+    ierr = MatAssemblyEnd(Krhs,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+    ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+    ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  }
   
   ierr = DMDAVecRestoreArrayDOF(ctx->daVect,u_old_local,&u_old_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daVect,&u_old_local);CHKERRQ(ierr);
@@ -914,10 +931,9 @@ extern PetscErrorCode VF_FormFlowStandardFEMIJacobian(SNES snes,Vec Pressure,Mat
   VFCtx             *ctx=(VFCtx*)user;
   
   PetscFunctionBegin;
-  ierr = MatZeroEntries(JacPre);CHKERRQ(ierr);
-  ierr = MatCopy(ctx->KP,JacPre,SAME_NONZERO_PATTERN);
-  ierr = MatAssemblyBegin(JacPre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyEnd(JacPre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  if (JacPre != ctx->KP) {
+    ierr = MatCopy(ctx->KP,JacPre,DIFFERENT_NONZERO_PATTERN);CHKERRQ(ierr);
+  }
   if (Jac != JacPre) {
     ierr = MatAssemblyBegin(Jac,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
     ierr = MatAssemblyEnd(Jac,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
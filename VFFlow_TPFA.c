@@ -0,0 +1,744 @@
+/*
+   VFFlow_TPFA.c
+   A cell centred two point flux approximation (TPFA) finite volume Darcy solver.
+
+   The unknown is the cell pressure on a copy of daScalCell with a star stencil of width 1. The transmissibility
+   of a face is the harmonic mean of the half transmissibilities of the two cells sharing it, so that the pressure
+   matrix is the usual symmetric positive definite 7 point operator. Only the diagonal of vfperm is used, to which
+   the fracture conductivity pmult w^3 |grad V| / 3 is added in the plane of the crack in the damage band. The
+   well, source, flux, pressure and fracture coupling inputs are the ones of the standard FEM solver, averaged on
+   the cells. The nodal pressure and velocity are interpolated from the cell pressures and face fluxes.
+*/
+#include "petsc.h"
+#include "VFCartFE.h"
+#include "VFCommon.h"
+#include "VFFlow.h"
+#include "VFFlow_TPFA.h"
+#include "VFPermfield.h"
+
+/*
+  Neighbours of a cell, in the order of the faces X0, X1, Y0, Y1, Z0, Z1
+*/
+static const PetscInt VFTPFAOffset[6][3] = {{-1,0,0},{1,0,0},{0,-1,0},{0,1,0},{0,0,-1},{0,0,1}};
+
+#undef __FUNCT__
+#define __FUNCT__ "TPFAFlowSolverInitialize"
+extern PetscErrorCode TPFAFlowSolverInitialize(VFCtx *ctx,VFFields *fields)
+{
+  PetscErrorCode ierr;
+  PetscInt       nx,ny,nz;
+  PetscInt       x_nprocs,y_nprocs,z_nprocs;
+  const PetscInt *lx,*ly,*lz;
+  PetscInt       w_no;
+  PC             pc;
+
+  PetscFunctionBegin;
+  if (ctx->hasFlowWells) {
+    for (w_no = 0; w_no < ctx->numWells; w_no++) {
+      if (ctx->well[w_no].condition == PRESSURE && ctx->well[w_no].rw <= 0.) {
+        SETERRQ3(PETSC_COMM_WORLD,PETSC_ERR_USER,"ERROR: the pressure well %s needs a positive radius (-w%i_rw) in %s\n",ctx->well[w_no].name,w_no,__FUNCT__);
+      }
+    }
+  }
+  /*
+    The cell DMs are meant for finite elements and have no ghost cells, the two point fluxes need one layer of them
+  */
+  ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,&x_nprocs,&y_nprocs,&z_nprocs,
+                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  ierr = DMDAGetOwnershipRanges(ctx->daScalCell,&lx,&ly,&lz);CHKERRQ(ierr);
+  ierr = DMDACreate3d(PETSC_COMM_WORLD,DM_BOUNDARY_NONE,DM_BOUNDARY_NONE,DM_BOUNDARY_NONE,
+                      DMDA_STENCIL_STAR,nx,ny,nz,x_nprocs,y_nprocs,z_nprocs,1,1,
+                      lx,ly,lz,&ctx->daTPFA);CHKERRQ(ierr);
+  ierr = DMSetUp(ctx->daTPFA);CHKERRQ(ierr);
+  ierr = DMDASetFieldName(ctx->daTPFA,0,"Pressure");CHKERRQ(ierr);
+  ierr = DMDACreate3d(PETSC_COMM_WORLD,DM_BOUNDARY_NONE,DM_BOUNDARY_NONE,DM_BOUNDARY_NONE,
+                      DMDA_STENCIL_STAR,nx,ny,nz,x_nprocs,y_nprocs,z_nprocs,3,1,
+                      lx,ly,lz,&ctx->daTPFACond);CHKERRQ(ierr);
+  ierr = DMSetUp(ctx->daTPFACond);CHKERRQ(ierr);
+
+  ierr = DMCreateMatrix(ctx->daTPFA,&ctx->KPCell);CHKERRQ(ierr);
+  ierr = MatSetOption(ctx->KPCell,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = MatSetOption(ctx->KPCell,MAT_SYMMETRIC,PETSC_TRUE);CHKERRQ(ierr);
+
+  ierr = DMCreateGlobalVector(ctx->daTPFA,&ctx->RHSPCell);CHKERRQ(ierr);
+  ierr = PetscObjectSetName((PetscObject)ctx->RHSPCell,"RHS of TPFA flow solver");CHKERRQ(ierr);
+  ierr = DMCreateGlobalVector(ctx->daTPFA,&ctx->PCell);CHKERRQ(ierr);
+  ierr = PetscObjectSetName((PetscObject)ctx->PCell,"Cell pressure");CHKERRQ(ierr);
+  ierr = DMCreateGlobalVector(ctx->daTPFA,&ctx->PCellOld);CHKERRQ(ierr);
+  ierr = PetscObjectSetName((PetscObject)ctx->PCellOld,"Previous cell pressure");CHKERRQ(ierr);
+  ierr = DMCreateGlobalVector(ctx->daTPFACond,&ctx->CondCell);CHKERRQ(ierr);
+  ierr = PetscObjectSetName((PetscObject)ctx->CondCell,"Cell conductivity");CHKERRQ(ierr);
+  ctx->PCellStep = -1;
+
+  ierr = KSPCreate(PETSC_COMM_WORLD,&ctx->kspPCell);CHKERRQ(ierr);
+  ierr = KSPSetOperators(ctx->kspPCell,ctx->KPCell,ctx->KPCell);CHKERRQ(ierr);
+  ierr = KSPAppendOptionsPrefix(ctx->kspPCell,"FlowTPFA_");CHKERRQ(ierr);
+  ierr = KSPSetType(ctx->kspPCell,KSPCG);CHKERRQ(ierr);
+  ierr = KSPGetPC(ctx->kspPCell,&pc);CHKERRQ(ierr);
+#ifdef PETSC_HAS_HYPRE
+  ierr = PCSetType(pc,PCHYPRE);CHKERRQ(ierr);
+  ierr = PCHYPRESetType(pc,"boomeramg");CHKERRQ(ierr);
+#else
+  ierr = PCSetType(pc,PCGAMG);CHKERRQ(ierr);
+#endif
+  ierr = KSPSetFromOptions(ctx->kspPCell);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "TPFAFlowSolverFinalize"
+extern PetscErrorCode TPFAFlowSolverFinalize(VFCtx *ctx,VFFields *fields)
+{
+  PetscErrorCode ierr;
+
+  PetscFunctionBegin;
+  ierr = KSPDestroy(&ctx->kspPCell);CHKERRQ(ierr);
+  ierr = MatDestroy(&ctx->KPCell);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->RHSPCell);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->PCell);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->PCellOld);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->CondCell);CHKERRQ(ierr);
+  ierr = DMDestroy(&ctx->daTPFA);CHKERRQ(ierr);
+  ierr = DMDestroy(&ctx->daTPFACond);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "TPFACellConductivity"
+/*
+  TPFACellConductivity: sets Cond (on a 3 dof cell DMDA such as daTPFACond) to the diagonal of the permeability of
+  the local cells. In the damage band, the conductivity pmult w^3 |grad V| / 3 of the crack is added in its plane,
+  (I - n n^T) with n = grad V / |grad V|, consistently with VF_MatDFractureFlowCoupling_local.
+*/
+extern PetscErrorCode TPFACellConductivity(Vec Cond,VFFields *fields,VFCtx *ctx)
+{
+  PetscErrorCode       ierr;
+  VFCartFEElementCache *cache = ctx->feCache;
+  PetscInt             xs,xm,ys,ym,zs,zm;
+  PetscInt             ek,ej,ei,i,j,k,d;
+  PetscReal            h[3],dv[3],dvmag,kf;
+  PetscReal            ****perm_array;
+  PetscReal            ****cond_array;
+  PetscReal            ***pmult_array;
+  PetscReal            ***w_array;
+  PetscReal            ***v_array;
+  Vec                  v_local;
+  DM                   daCond;
+
+  PetscFunctionBegin;
+  ierr = VecGetDM(Cond,&daCond);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOFRead(ctx->daVFperm,fields->vfperm,&perm_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(daCond,Cond,&cond_array);CHKERRQ(ierr);
+  if (ctx->FractureFlowCoupling) {
+    ierr = VFDamageBandUpdate(ctx,fields->V);CHKERRQ(ierr);
+    ierr = DMDAVecGetArrayRead(ctx->daScalCell,fields->pmult,&pmult_array);CHKERRQ(ierr);
+    ierr = DMDAVecGetArrayRead(ctx->daScalCell,fields->widthc,&w_array);CHKERRQ(ierr);
+    ierr = DMGetLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalEnd(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArrayRead(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
+  }
+  for (ek = zs; ek < zs+zm; ek++) {
+    for (ej = ys; ej < ys+ym; ej++) {
+      for (ei = xs; ei < xs+xm; ei++) {
+        for (d = 0; d < 3; d++) cond_array[ek][ej][ei][d] = perm_array[ek][ej][ei][d];
+        if (ctx->FractureFlowCoupling && ctx->bandMask[((ek-zs)*ym+ej-ys)*xm+ei-xs]) {
+          h[0] = cache->hx[cache->idx[ei]];
+          h[1] = cache->hy[cache->idy[ej]];
+          h[2] = cache->hz[cache->idz[ek]];
+          dv[0] = dv[1] = dv[2] = 0.;
+          for (k = 0; k < 2; k++) {
+            for (j = 0; j < 2; j++) {
+              for (i = 0; i < 2; i++) {
+                dv[0] += (2*i-1)*v_array[ek+k][ej+j][ei+i];
+                dv[1] += (2*j-1)*v_array[ek+k][ej+j][ei+i];
+                dv[2] += (2*k-1)*v_array[ek+k][ej+j][ei+i];
+              }
+            }
+          }
+          for (d = 0; d < 3; d++) dv[d] /= 4.*h[d];
+          dvmag = PetscSqrtReal(dv[0]*dv[0]+dv[1]*dv[1]+dv[2]*dv[2]);
+          if (dvmag > 0.) {
+            kf = pmult_array[ek][ej][ei]*PetscPowReal(w_array[ek][ej][ei],3)*dvmag/3.;
+            for (d = 0; d < 3; d++) cond_array[ek][ej][ei][d] += kf*(1.-dv[d]*dv[d]/(dvmag*dvmag));
+          }
+        }
+      }
+    }
+  }
+  if (ctx->FractureFlowCoupling) {
+    ierr = DMDAVecRestoreArrayRead(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
+    ierr = DMDAVecRestoreArrayRead(ctx->daScalCell,fields->widthc,&w_array);CHKERRQ(ierr);
+    ierr = DMDAVecRestoreArrayRead(ctx->daScalCell,fields->pmult,&pmult_array);CHKERRQ(ierr);
+  }
+  ierr = DMDAVecRestoreArrayDOF(daCond,Cond,&cond_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOFRead(ctx->daVFperm,fields->vfperm,&perm_array);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/*
+  TPFAWellInCell: whether the well lies in the closed cell (ei,ej,ek)
+*/
+static PetscBool TPFAWellInCell(VFWell *well,PetscReal ****coords_array,PetscInt ek,PetscInt ej,PetscInt ei)
+{
+  return (PetscBool)((coords_array[ek][ej][ei+1][0] >= well->coords[0]) && (coords_array[ek][ej][ei][0] <= well->coords[0]) &&
+                     (coords_array[ek][ej+1][ei][1] >= well->coords[1]) && (coords_array[ek][ej][ei][1] <= well->coords[1]) &&
+                     (coords_array[ek+1][ej][ei][2] >= well->coords[2]) && (coords_array[ek][ej][ei][2] <= well->coords[2]));
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "TPFAPeacemanWellIndex"
+/*
+  TPFAPeacemanWellIndex: well index 2 pi sqrt(kx ky) hz / ln(r0 / rw) of a vertical well of radius rw in a cell of size h
+  and diagonal conductivity cond, with the equivalent radius of Peaceman for anisotropic media
+    r0 = 0.28 (sqrt(ky/kx) hx^2 + sqrt(kx/ky) hy^2)^1/2 / ((ky/kx)^1/4 + (kx/ky)^1/4)
+*/
+static PetscErrorCode TPFAPeacemanWellIndex(PetscReal *WI,VFWell *well,const PetscReal *cond,const PetscReal *h)
+{
+  PetscReal kr,r0;
+
+  PetscFunctionBegin;
+  *WI = 0.;
+  if (cond[0] <= 0. || cond[1] <= 0.) PetscFunctionReturn(0);
+  kr = PetscSqrtReal(cond[1]/cond[0]);
+  r0 = 0.28*PetscSqrtReal(kr*h[0]*h[0]+h[1]*h[1]/kr)/(PetscSqrtReal(kr)+1./PetscSqrtReal(kr));
+  if (well->rw >= r0) {
+    SETERRQ4(PETSC_COMM_SELF,PETSC_ERR_ARG_OUTOFRANGE,"ERROR: the radius %g of the well %s is larger than the equivalent radius %g of its cell in %s\n",(double)well->rw,well->name,(double)r0,__FUNCT__);
+  }
+  *WI = 2.*PETSC_PI*PetscSqrtReal(cond[0]*cond[1])*h[2]/PetscLogReal(r0/well->rw);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "TPFAMatnVecAssemble"
+/*
+  TPFAMatnVecAssemble: assembles the theta scheme for the cell pressure
+
+    (S + theta dt L) P = (S - (1-theta) dt L) P_old + dt F
+
+  where S is the lumped storage, L the two point flux operator and F the gravity, boundary, source and well terms.
+  Pressure boundary conditions are imposed weakly through the half transmissibility of the boundary faces, and
+  pressure wells through the Peaceman well index WI of the cells containing them, as one more face of
+  transmissibility WI / mu.
+*/
+extern PetscErrorCode TPFAMatnVecAssemble(Mat K,Vec RHS,VFFields *fields,VFCtx *ctx)
+{
+  PetscErrorCode       ierr;
+  VFCartFEElementCache *cache = ctx->feCache;
+  PetscInt             xs,xm,nx;
+  PetscInt             ys,ym,ny;
+  PetscInt             zs,zm,nz;
+  PetscInt             ek,ej,ei,nk,nj,ni;
+  PetscInt             i,j,k,c,d,f,s,o[3];
+  PetscInt             ncol;
+  MatStencil           row,col[7];
+  PetscReal            val[7];
+  PetscReal            theta,dt,mu,rho,beta;
+  PetscReal            hc[3],hn,vol,area,tc,tn,T,dist;
+  PetscReal            vc,vf,dv[3],dvmag,divdu,src,pb,q,S,rhs;
+  PetscReal            ***rhs_array;
+  PetscReal            ***pold_array;
+  PetscReal            ***p_array;
+  PetscReal            ****cond_array;
+  PetscReal            ***v_array;
+  PetscReal            ****u_diff_array;
+  PetscReal            ***source_array;
+  PetscReal            ***fracflow_array;
+  PetscReal            ***presbc_array;
+  PetscReal            ****velbc_array;
+  PetscReal            ***w_array;
+  PetscReal            ***w_old_array;
+  PetscReal            ***m_inv_array;
+  PetscReal            ***k_dr_array;
+  PetscReal            ****coords_array;
+  Vec                  pold_local,cond_local,v_local,U_diff,u_diff_local,source_local,fracflow_local;
+  Vec                  presbc_local,velbc_local;
+  PetscInt             w_no,*myWellCells,*wellCells;
+  PetscReal            WI;
+  FACE                 face;
+
+  PetscFunctionBegin;
+  theta = ctx->theta;
+  dt    = ctx->timevalue;
+  mu    = ctx->flowprop.mu;
+  rho   = ctx->flowprop.rho;
+  ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+
+  ierr = TPFACellConductivity(ctx->CondCell,fields,ctx);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daTPFACond,&cond_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daTPFACond,ctx->CondCell,INSERT_VALUES,cond_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daTPFACond,ctx->CondCell,INSERT_VALUES,cond_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOFRead(ctx->daTPFACond,cond_local,&cond_array);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daTPFA,&pold_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daTPFA,ctx->PCellOld,INSERT_VALUES,pold_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daTPFA,ctx->PCellOld,INSERT_VALUES,pold_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daTPFA,pold_local,&pold_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daTPFA,ctx->PCell,&p_array);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
+
+  ierr = DMGetGlobalVector(ctx->daVect,&U_diff);CHKERRQ(ierr);
+  ierr = VecWAXPY(U_diff,-1.0,ctx->U_old,fields->U);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daVect,&u_diff_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daVect,U_diff,INSERT_VALUES,u_diff_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daVect,U_diff,INSERT_VALUES,u_diff_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOFRead(ctx->daVect,u_diff_local,&u_diff_array);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daScal,&source_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daScal,ctx->Source,INSERT_VALUES,source_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daScal,ctx->Source,INSERT_VALUES,source_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScal,source_local,&source_array);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daScal,&fracflow_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daScal,ctx->RegFracWellFlowRate,INSERT_VALUES,fracflow_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daScal,ctx->RegFracWellFlowRate,INSERT_VALUES,fracflow_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScal,fracflow_local,&fracflow_array);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daScal,&presbc_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daScal,ctx->PresBCArray,INSERT_VALUES,presbc_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daScal,ctx->PresBCArray,INSERT_VALUES,presbc_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScal,presbc_local,&presbc_array);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daVect,&velbc_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daVect,ctx->VelBCArray,INSERT_VALUES,velbc_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daVect,ctx->VelBCArray,INSERT_VALUES,velbc_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOFRead(ctx->daVect,velbc_local,&velbc_array);CHKERRQ(ierr);
+
+  ierr = DMDAVecGetArrayRead(ctx->daScalCell,fields->widthc,&w_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScalCell,ctx->widthc_old,&w_old_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScalCell,ctx->M_inv,&m_inv_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScalCell,ctx->K_dr,&k_dr_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daTPFA,RHS,&rhs_array);CHKERRQ(ierr);
+
+  /*
+    Number of cells containing each well, between which its rate or well index is shared
+  */
+  ierr = PetscMalloc2(ctx->numWells,&myWellCells,ctx->numWells,&wellCells);CHKERRQ(ierr);
+  if (ctx->hasFlowWells) {
+    for (w_no = 0; w_no < ctx->numWells; w_no++) {
+      myWellCells[w_no] = 0;
+      for (ek = zs; ek < zs+zm; ek++) {
+        for (ej = ys; ej < ys+ym; ej++) {
+          for (ei = xs; ei < xs+xm; ei++) {
+            if (TPFAWellInCell(&ctx->well[w_no],coords_array,ek,ej,ei)) myWellCells[w_no]++;
+          }
+        }
+      }
+    }
+    ierr = MPI_Allreduce(myWellCells,wellCells,ctx->numWells,MPIU_INT,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  }
+
+  for (ek = zs; ek < zs+zm; ek++) {
+    for (ej = ys; ej < ys+ym; ej++) {
+      for (ei = xs; ei < xs+xm; ei++) {
+        hc[0] = cache->hx[cache->idx[ei]];
+        hc[1] = cache->hy[cache->idy[ej]];
+        hc[2] = cache->hz[cache->idz[ek]];
+        vol   = hc[0]*hc[1]*hc[2];
+        beta  = ctx->matprop[ctx->layer[ek]].beta;
+        vc    = 0.;
+        dv[0] = dv[1] = dv[2] = 0.;
+        divdu = 0.;
+        src   = 0.;
+        q     = 0.;
+        for (k = 0; k < 2; k++) {
+          for (j = 0; j < 2; j++) {
+            for (i = 0; i < 2; i++) {
+              vc    += 0.125*v_array[ek+k][ej+j][ei+i];
+              src   += 0.125*source_array[ek+k][ej+j][ei+i];
+              q     += 0.125*fracflow_array[ek+k][ej+j][ei+i];
+              dv[0] += (2*i-1)*v_array[ek+k][ej+j][ei+i]/(4.*hc[0]);
+              dv[1] += (2*j-1)*v_array[ek+k][ej+j][ei+i]/(4.*hc[1]);
+              dv[2] += (2*k-1)*v_array[ek+k][ej+j][ei+i]/(4.*hc[2]);
+              divdu += (2*i-1)*u_diff_array[ek+k][ej+j][ei+i][0]/(4.*hc[0])
+                      +(2*j-1)*u_diff_array[ek+k][ej+j][ei+i][1]/(4.*hc[1])
+                      +(2*k-1)*u_diff_array[ek+k][ej+j][ei+i][2]/(4.*hc[2]);
+            }
+          }
+        }
+        dvmag = PetscSqrtReal(dv[0]*dv[0]+dv[1]*dv[1]+dv[2]*dv[2]);
+        /*
+          Storage
+        */
+        S = m_inv_array[ek][ej][ei]*vol;
+        if (ctx->FlowDisplCoupling && ctx->ResFlowMechCoupling == FIXEDSTRESS) {
+          S += beta*beta*vc*vc*vol/k_dr_array[ek][ej][ei];
+        }
+        row.i = ei; row.j = ej; row.k = ek; row.c = 0;
+        col[0] = row;
+        val[0] = S;
+        ncol   = 1;
+        rhs    = S*pold_array[ek][ej][ei];
+        /*
+          Two point fluxes
+        */
+        for (f = 0; f < 6; f++) {
+          d    = f/2;
+          s    = VFTPFAOffset[f][d];
+          ni   = ei+VFTPFAOffset[f][0];
+          nj   = ej+VFTPFAOffset[f][1];
+          nk   = ek+VFTPFAOffset[f][2];
+          area = vol/hc[d];
+          tc   = cond_array[ek][ej][ei][d]*area/(0.5*hc[d]);
+          if (ni >= 0 && ni < nx && nj >= 0 && nj < ny && nk >= 0 && nk < nz) {
+            switch (d) {
+            case 0:
+              hn = cache->hx[cache->idx[ni]];
+              break;
+            case 1:
+              hn = cache->hy[cache->idy[nj]];
+              break;
+            default:
+              hn = cache->hz[cache->idz[nk]];
+              break;
+            }
+            tn   = cond_array[nk][nj][ni][d]*area/(0.5*hn);
+            T    = (tc > 0. && tn > 0.) ? tc*tn/((tc+tn)*mu) : 0.;
+            dist = 0.5*(hc[d]+hn);
+            col[ncol].i = ni; col[ncol].j = nj; col[ncol].k = nk; col[ncol].c = 0;
+            val[ncol]   = -theta*dt*T;
+            val[0]     += theta*dt*T;
+            ncol++;
+            rhs += -(1.-theta)*dt*T*(pold_array[ek][ej][ei]-pold_array[nk][nj][ni])
+                   -dt*T*rho*ctx->flowprop.g[d]*s*dist;
+          } else {
+            face = (FACE) f;
+            if (ctx->bcP[0].face[face] == FIXED) {
+              pb = 0.;
+              for (k = 0; k < 2; k++) {
+                for (j = 0; j < 2; j++) {
+                  for (i = 0; i < 2; i++) {
+                    o[0] = i; o[1] = j; o[2] = k;
+                    if (o[d] == (s > 0)) pb += 0.25*presbc_array[ek+k][ej+j][ei+i];
+                  }
+                }
+              }
+              T       = tc/mu;
+              val[0] += theta*dt*T;
+              rhs    += dt*T*pb-(1.-theta)*dt*T*pold_array[ek][ej][ei]
+                        -dt*T*rho*ctx->flowprop.g[d]*s*0.5*hc[d];
+            } else if (ctx->bcQ[d].face[face] == FIXED) {
+              pb = 0.;
+              vf = 0.;
+              for (k = 0; k < 2; k++) {
+                for (j = 0; j < 2; j++) {
+                  for (i = 0; i < 2; i++) {
+                    o[0] = i; o[1] = j; o[2] = k;
+                    if (o[d] == (s > 0)) {
+                      pb += 0.25*velbc_array[ek+k][ej+j][ei+i][d];
+                      vf += 0.25*v_array[ek+k][ej+j][ei+i];
+                    }
+                  }
+                }
+              }
+              rhs += -s*dt*pb*vf*vf*area;
+            }
+          }
+        }
+        /*
+          Sources, fracture and mechanical coupling, with the same damage weights as the standard FEM solver
+        */
+        if (ctx->hasFluidSources) {
+          rhs += dt*src*vc*vc*vol;
+        }
+        if (ctx->FractureFlowCoupling) {
+          rhs += -(w_array[ek][ej][ei]-w_old_array[ek][ej][ei])*dvmag*vol;
+          if (ctx->hasFlowWells) {
+            rhs += dt*q*dvmag*vol;
+          }
+        }
+        if (ctx->FlowDisplCoupling) {
+          rhs += -beta*divdu*vc*vc*vol;
+          if (ctx->ResFlowMechCoupling == FIXEDSTRESS) {
+            rhs += beta*beta*(p_array[ek][ej][ei]-pold_array[ek][ej][ei])*vc*vc*vol/k_dr_array[ek][ej][ei];
+          }
+        }
+        rhs += m_inv_array[ek][ej][ei]*(p_array[ek][ej][ei]-pold_array[ek][ej][ei])*(1.-vc*vc)*vol;
+        /*
+          Pressure wells
+        */
+        if (ctx->hasFlowWells) {
+          for (w_no = 0; w_no < ctx->numWells; w_no++) {
+            if (ctx->well[w_no].condition != PRESSURE || !TPFAWellInCell(&ctx->well[w_no],coords_array,ek,ej,ei)) continue;
+            ierr = TPFAPeacemanWellIndex(&WI,&ctx->well[w_no],cond_array[ek][ej][ei],hc);CHKERRQ(ierr);
+            T       = WI/(mu*wellCells[w_no]);
+            val[0] += theta*dt*T;
+            rhs    += dt*T*ctx->well[w_no].Pw-(1.-theta)*dt*T*pold_array[ek][ej][ei];
+          }
+        }
+        rhs_array[ek][ej][ei] = rhs;
+        ierr = MatSetValuesStencil(K,1,&row,ncol,col,val,INSERT_VALUES);CHKERRQ(ierr);
+      }
+    }
+  }
+  /*
+    Rate wells, shared by the cells containing the well
+  */
+  if (ctx->hasFlowWells) {
+    for (w_no = 0; w_no < ctx->numWells; w_no++) {
+      if (ctx->well[w_no].condition != RATE) continue;
+      for (ek = zs; ek < zs+zm; ek++) {
+        for (ej = ys; ej < ys+ym; ej++) {
+          for (ei = xs; ei < xs+xm; ei++) {
+            if (TPFAWellInCell(&ctx->well[w_no],coords_array,ek,ej,ei)) {
+              vc = 0.;
+              for (c = 0; c < 8; c++) vc += 0.125*v_array[ek+c/4][ej+(c/2)%2][ei+c%2];
+              if (ctx->well[w_no].type == INJECTOR) {
+                rhs_array[ek][ej][ei] += dt*ctx->well[w_no].Qw*vc*vc/wellCells[w_no];
+              } else if (ctx->well[w_no].type == PRODUCER) {
+                rhs_array[ek][ej][ei] += -dt*ctx->well[w_no].Qw*vc*vc/wellCells[w_no];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  ierr = PetscFree2(myWellCells,wellCells);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daTPFA,RHS,&rhs_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daScalCell,ctx->K_dr,&k_dr_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daScalCell,ctx->M_inv,&m_inv_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daScalCell,ctx->widthc_old,&w_old_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daScalCell,fields->widthc,&w_array);CHKERRQ(ierr);
+
+  ierr = DMDAVecRestoreArrayDOFRead(ctx->daVect,velbc_local,&velbc_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daVect,&velbc_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daScal,presbc_local,&presbc_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&presbc_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daScal,fracflow_local,&fracflow_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&fracflow_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daScal,source_local,&source_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&source_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOFRead(ctx->daVect,u_diff_local,&u_diff_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daVect,&u_diff_local);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daVect,&U_diff);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daTPFA,ctx->PCell,&p_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daTPFA,pold_local,&pold_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daTPFA,&pold_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOFRead(ctx->daTPFACond,cond_local,&cond_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daTPFACond,&cond_local);CHKERRQ(ierr);
+
+  ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "TPFAFluxReconstruct"
+/*
+  TPFAFluxReconstruct: interpolates the cell pressures to fields->pressure and the Darcy velocities, averaged from
+  the two point fluxes of the faces of each cell, to fields->velocity. Uses the conductivity of the last assembly.
+*/
+extern PetscErrorCode TPFAFluxReconstruct(VFCtx *ctx,VFFields *fields)
+{
+  PetscErrorCode       ierr;
+  VFCartFEElementCache *cache = ctx->feCache;
+  PetscInt             xs,xm,nx;
+  PetscInt             ys,ym,ny;
+  PetscInt             zs,zm,nz;
+  PetscInt             ek,ej,ei,nk,nj,ni;
+  PetscInt             i,j,k,d,f,s,o[3];
+  PetscReal            mu,rho;
+  PetscReal            hc[3],hn,vol,area,tc,tn,T,pb,vf,flux;
+  PetscReal            ***p_array;
+  PetscReal            ****cond_array;
+  PetscReal            ****vel_array;
+  PetscReal            ***v_array;
+  PetscReal            ***presbc_array;
+  PetscReal            ****velbc_array;
+  Vec                  p_local,cond_local,v_local,presbc_local,velbc_local;
+  Vec                  cellVelocity;
+  FACE                 face;
+
+  PetscFunctionBegin;
+  mu  = ctx->flowprop.mu;
+  rho = ctx->flowprop.rho;
+  ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daTPFA,&p_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daTPFA,ctx->PCell,INSERT_VALUES,p_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daTPFA,ctx->PCell,INSERT_VALUES,p_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daTPFA,p_local,&p_array);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daTPFACond,&cond_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daTPFACond,ctx->CondCell,INSERT_VALUES,cond_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daTPFACond,ctx->CondCell,INSERT_VALUES,cond_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOFRead(ctx->daTPFACond,cond_local,&cond_array);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daScal,&presbc_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daScal,ctx->PresBCArray,INSERT_VALUES,presbc_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daScal,ctx->PresBCArray,INSERT_VALUES,presbc_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayRead(ctx->daScal,presbc_local,&presbc_array);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daVect,&velbc_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daVect,ctx->VelBCArray,INSERT_VALUES,velbc_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daVect,ctx->VelBCArray,INSERT_VALUES,velbc_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOFRead(ctx->daVect,velbc_local,&velbc_array);CHKERRQ(ierr);
+
+  ierr = DMGetGlobalVector(ctx->daVectCell,&cellVelocity);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(ctx->daVectCell,cellVelocity,&vel_array);CHKERRQ(ierr);
+  for (ek = zs; ek < zs+zm; ek++) {
+    for (ej = ys; ej < ys+ym; ej++) {
+      for (ei = xs; ei < xs+xm; ei++) {
+        hc[0] = cache->hx[cache->idx[ei]];
+        hc[1] = cache->hy[cache->idy[ej]];
+        hc[2] = cache->hz[cache->idz[ek]];
+        vol   = hc[0]*hc[1]*hc[2];
+        for (d = 0; d < 3; d++) vel_array[ek][ej][ei][d] = 0.;
+        for (f = 0; f < 6; f++) {
+          d    = f/2;
+          s    = VFTPFAOffset[f][d];
+          ni   = ei+VFTPFAOffset[f][0];
+          nj   = ej+VFTPFAOffset[f][1];
+          nk   = ek+VFTPFAOffset[f][2];
+          area = vol/hc[d];
+          tc   = cond_array[ek][ej][ei][d]*area/(0.5*hc[d]);
+          /*
+            flux is the outgoing flux through the face
+          */
+          flux = 0.;
+          if (ni >= 0 && ni < nx && nj >= 0 && nj < ny && nk >= 0 && nk < nz) {
+            switch (d) {
+            case 0:
+              hn = cache->hx[cache->idx[ni]];
+              break;
+            case 1:
+              hn = cache->hy[cache->idy[nj]];
+              break;
+            default:
+              hn = cache->hz[cache->idz[nk]];
+              break;
+            }
+            tn   = cond_array[nk][nj][ni][d]*area/(0.5*hn);
+            T    = (tc > 0. && tn > 0.) ? tc*tn/((tc+tn)*mu) : 0.;
+            flux = T*(p_array[ek][ej][ei]-p_array[nk][nj][ni]+rho*ctx->flowprop.g[d]*s*0.5*(hc[d]+hn));
+          } else {
+            face = (FACE) f;
+            pb = 0.;
+            vf = 0.;
+            for (k = 0; k < 2; k++) {
+              for (j = 0; j < 2; j++) {
+                for (i = 0; i < 2; i++) {
+                  o[0] = i; o[1] = j; o[2] = k;
+                  if (o[d] == (s > 0)) {
+                    if (ctx->bcP[0].face[face] == FIXED) {
+                      pb += 0.25*presbc_array[ek+k][ej+j][ei+i];
+                    } else {
+                      pb += 0.25*velbc_array[ek+k][ej+j][ei+i][d];
+                      vf += 0.25*v_array[ek+k][ej+j][ei+i];
+                    }
+                  }
+                }
+              }
+            }
+            if (ctx->bcP[0].face[face] == FIXED) {
+              flux = tc/mu*(p_array[ek][ej][ei]-pb+rho*ctx->flowprop.g[d]*s*0.5*hc[d]);
+            } else if (ctx->bcQ[d].face[face] == FIXED) {
+              flux = s*pb*vf*vf*area;
+            }
+          }
+          vel_array[ek][ej][ei][d] += 0.5*s*flux/area;
+        }
+      }
+    }
+  }
+  ierr = DMDAVecRestoreArrayDOF(ctx->daVectCell,cellVelocity,&vel_array);CHKERRQ(ierr);
+  ierr = CellToNodeInterpolation(fields->velocity,cellVelocity,ctx);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daVectCell,&cellVelocity);CHKERRQ(ierr);
+
+  ierr = DMDAVecRestoreArrayDOFRead(ctx->daVect,velbc_local,&velbc_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daVect,&velbc_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daScal,presbc_local,&presbc_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&presbc_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOFRead(ctx->daTPFACond,cond_local,&cond_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daTPFACond,&cond_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayRead(ctx->daTPFA,p_local,&p_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daTPFA,&p_local);CHKERRQ(ierr);
+
+  ierr = CellToNodeInterpolation(fields->pressure,ctx->PCell,ctx);CHKERRQ(ierr);
+  ierr = VecApplyDirichletBC(fields->pressure,ctx->PresBCArray,&ctx->bcP[0]);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "TPFAFlowSolve"
+extern PetscErrorCode TPFAFlowSolve(VFCtx *ctx,VFFields *fields)
+{
+  PetscErrorCode     ierr;
+  PetscInt           xs,xm,ys,ym,zs,zm;
+  PetscInt           ek,ej,ei,c;
+  PetscInt           its;
+  KSPConvergedReason reason;
+  PetscReal          ***pold_array;
+  PetscReal          ***pnode_array;
+  Vec                pnode_local;
+  PetscReal          Velmin,Velmax;
+  PetscReal          Pmin,Pmax;
+
+  PetscFunctionBegin;
+  /*
+    VF_StepP is called several times per time step by the U-P loop, the cell pressure of the previous
+    step only moves forward with ctx->timestep. The first one is the cell average of ctx->pressure_old.
+  */
+  if (ctx->PCellStep != ctx->timestep) {
+    if (ctx->PCellStep < 0) {
+      ierr = DMDAGetCorners(ctx->daTPFA,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+      ierr = DMGetLocalVector(ctx->daScal,&pnode_local);CHKERRQ(ierr);
+      ierr = DMGlobalToLocalBegin(ctx->daScal,ctx->pressure_old,INSERT_VALUES,pnode_local);CHKERRQ(ierr);
+      ierr = DMGlobalToLocalEnd(ctx->daScal,ctx->pressure_old,INSERT_VALUES,pnode_local);CHKERRQ(ierr);
+      ierr = DMDAVecGetArrayRead(ctx->daScal,pnode_local,&pnode_array);CHKERRQ(ierr);
+      ierr = DMDAVecGetArray(ctx->daTPFA,ctx->PCellOld,&pold_array);CHKERRQ(ierr);
+      for (ek = zs; ek < zs+zm; ek++) {
+        for (ej = ys; ej < ys+ym; ej++) {
+          for (ei = xs; ei < xs+xm; ei++) {
+            pold_array[ek][ej][ei] = 0.;
+            for (c = 0; c < 8; c++) pold_array[ek][ej][ei] += 0.125*pnode_array[ek+c/4][ej+(c/2)%2][ei+c%2];
+          }
+        }
+      }
+      ierr = DMDAVecRestoreArray(ctx->daTPFA,ctx->PCellOld,&pold_array);CHKERRQ(ierr);
+      ierr = DMDAVecRestoreArrayRead(ctx->daScal,pnode_local,&pnode_array);CHKERRQ(ierr);
+      ierr = DMRestoreLocalVector(ctx->daScal,&pnode_local);CHKERRQ(ierr);
+    } else {
+      ierr = VecCopy(ctx->PCell,ctx->PCellOld);CHKERRQ(ierr);
+    }
+    ierr = VecCopy(ctx->PCellOld,ctx->PCell);CHKERRQ(ierr);
+    ctx->PCellStep = ctx->timestep;
+  }
+  ierr = TPFAMatnVecAssemble(ctx->KPCell,ctx->RHSPCell,fields,ctx);CHKERRQ(ierr);
+  ierr = KSPSolve(ctx->kspPCell,ctx->RHSPCell,ctx->PCell);CHKERRQ(ierr);
+  ierr = KSPGetConvergedReason(ctx->kspPCell,&reason);CHKERRQ(ierr);
+  if (reason < 0) {
+    ierr = PetscPrintf(PETSC_COMM_WORLD,"[ERROR] ksp_TPFAFlowSolver diverged with reason %d\n",(int)reason);CHKERRQ(ierr);
+  } else {
+    ierr = KSPGetIterationNumber(ctx->kspPCell,&its);CHKERRQ(ierr);
+    ierr = PetscPrintf(PETSC_COMM_WORLD,"      ksp_TPFAFlowSolver converged in %d iterations %d.\n",(int)its,(int)reason);CHKERRQ(ierr);
+  }
+  ierr = TPFAFluxReconstruct(ctx,fields);CHKERRQ(ierr);
+  ierr = VecMin(fields->velocity,NULL,&Velmin);CHKERRQ(ierr);
+  ierr = VecMax(fields->velocity,NULL,&Velmax);CHKERRQ(ierr);
+  ierr = VecMin(fields->pressure,NULL,&Pmin);CHKERRQ(ierr);
+  ierr = VecMax(fields->pressure,NULL,&Pmax);CHKERRQ(ierr);
+  ierr = PetscPrintf(PETSC_COMM_WORLD,"      Velocity min / max:     %e %e\n",Velmin,Velmax);CHKERRQ(ierr);
+  ierr = PetscPrintf(PETSC_COMM_WORLD,"      Pressure min / max:     %e %e\n",Pmin,Pmax);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
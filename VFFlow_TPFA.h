@@ -0,0 +1,15 @@
+/*
+   VFFlow_TPFA.h
+   A cell centred two point flux approximation (TPFA) finite volume Darcy solver
+*/
+
+#ifndef VFFLOW_TPFA_H
+#define VFFLOW_TPFA_H
+
+extern PetscErrorCode TPFAFlowSolverInitialize(VFCtx *ctx,VFFields *fields);
+extern PetscErrorCode TPFAFlowSolverFinalize(VFCtx *ctx,VFFields *fields);
+extern PetscErrorCode TPFACellConductivity(Vec Cond,VFFields *fields,VFCtx *ctx);
+extern PetscErrorCode TPFAMatnVecAssemble(Mat K,Vec RHS,VFFields *fields,VFCtx *ctx);
+extern PetscErrorCode TPFAFluxReconstruct(VFCtx *ctx,VFFields *fields);
+extern PetscErrorCode TPFAFlowSolve(VFCtx *ctx,VFFields *fields);
+#endif
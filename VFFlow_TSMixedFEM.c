@@ -22,6 +22,8 @@
 extern PetscErrorCode MixedFEMTSFlowSolverInitialize(VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode ierr;
+  SNES           snes;
+  KSP            ksp;
   PetscFunctionBegin;
 
   ierr = TSCreate(PETSC_COMM_WORLD,&ctx->tsVelP);CHKERRQ(ierr);
@@ -29,6 +31,11 @@ extern PetscErrorCode MixedFEMTSFlowSolverInitialize(VFCtx *ctx, VFFields *field
   ierr = TSSetDM(ctx->tsVelP,ctx->daFlow);CHKERRQ(ierr);
   ierr = TSSetProblemType(ctx->tsVelP,TS_LINEAR);CHKERRQ(ierr);
   ierr = TSSetType(ctx->tsVelP,TSBEULER);CHKERRQ(ierr);
+  if (ctx->flowFieldSplit) {
+    ierr = TSGetSNES(ctx->tsVelP,&snes);CHKERRQ(ierr);
+    ierr = SNESGetKSP(snes,&ksp);CHKERRQ(ierr);
+    ierr = MixedFEMFlowFieldSplitSetUp(ksp,ctx);CHKERRQ(ierr);
+  }
   PetscFunctionReturn(0);
 }
 
@@ -173,6 +180,12 @@ extern PetscErrorCode FormIJacobian(TS ts,PetscReal t,Vec VelnPress,Vec VelnPres
   ierr = MatAXPY(Jacpre,shift,ctx->KVelPlhs,DIFFERENT_NONZERO_PATTERN);CHKERRQ(ierr);
   ierr = MatAssemblyBegin(Jacpre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
   ierr = MatAssemblyEnd(Jacpre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  if (ctx->flowFieldSplit) {
+    /*
+      The velocity block of the TS operator is not scaled by mu/2, hence the 1/4 from B^T A^{-1} B
+    */
+    ierr = MixedFEMFlowSchurPreAssemble(ctx->KVelPSchur,ctx->Perm,NULL,0.5/ctx->flowprop.mu+0.25,shift,ctx);CHKERRQ(ierr);
+  }
   if (Jac != Jacpre) {
     ierr = MatCopy(Jacpre,Jac,DIFFERENT_NONZERO_PATTERN);
     ierr = MatAssemblyBegin(Jacpre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
@@ -332,6 +345,8 @@ extern PetscErrorCode MatApplyTSVelocityBC(Mat K,Mat Klhs,VFBC *bcQ)
 extern PetscErrorCode FormTSMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx)
 {
   PetscErrorCode ierr;
+  VFCartFEElement3D *e3D;
+  VFCartFEElement2D *e2D;
   PetscInt       xs,xm,nx;
   PetscInt       ys,ym,ny;
   PetscInt       zs,zm,nz;
@@ -408,14 +423,14 @@ extern PetscErrorCode FormTSMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx)
         hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
         hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
         hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
         /*	This computes the local contribution of the global A matrix	*/
-        ierr = VF_MatA_local(Klhs_local,&ctx->e3D,ek,ej,ei,v_array);CHKERRQ(ierr);
+        ierr = VF_MatA_local(Klhs_local,e3D,ek,ej,ei,v_array);CHKERRQ(ierr);
         for (l = 0; l < nrow*nrow; l++) Klhs_local[l] = -1.*m_inv_array[ek][ej][ei]*Klhs_local[l];
         for (c = 0; c < veldof; c++) {
-          ierr = Flow_MatA(KA_local,&ctx->e3D,ek,ej,ei,c,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
-          ierr = Flow_MatB(KB_local,&ctx->e3D,ek,ej,ei,c,v_array);CHKERRQ(ierr);
-          ierr = Flow_MatBTranspose(KBTrans_local,&ctx->e3D,ek,ej,ei,c,v_array);CHKERRQ(ierr);
+          ierr = Flow_MatA(KA_local,e3D,ek,ej,ei,c,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+          ierr = Flow_MatB(KB_local,e3D,ek,ej,ei,c,v_array);CHKERRQ(ierr);
+          ierr = Flow_MatBTranspose(KBTrans_local,e3D,ek,ej,ei,c,v_array);CHKERRQ(ierr);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++)
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -427,23 +442,23 @@ extern PetscErrorCode FormTSMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx)
           ierr = MatSetValuesStencil(K,nrow,row,nrow,row1,KB_local,ADD_VALUES);CHKERRQ(ierr);
           ierr = MatSetValuesStencil(K,nrow,row1,nrow,row,KBTrans_local,ADD_VALUES);CHKERRQ(ierr);
         }
-        ierr = Flow_MatD(KD_local,&ctx->e3D,ek,ej,ei,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+        ierr = Flow_MatD(KD_local,e3D,ek,ej,ei,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
         ierr = MatSetValuesStencil(K,nrow,row1,nrow,row1,KD_local,ADD_VALUES);CHKERRQ(ierr);
         ierr = MatSetValuesStencil(Klhs,nrow,row1,nrow,row1,Klhs_local,ADD_VALUES);CHKERRQ(ierr);
         /*Assembling the righthand side vector f*/
         for (c = 0; c < veldof; c++) {
-          ierr = Flow_Vecf(RHS_local,&ctx->e3D,ek,ej,ei,c,&ctx->flowprop,v_array);CHKERRQ(ierr);
+          ierr = Flow_Vecf(RHS_local,e3D,ek,ej,ei,c,&ctx->flowprop,v_array);CHKERRQ(ierr);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++)
             for (j = 0; j < ctx->e3D.nphiy; j++)
               for (i = 0; i < ctx->e3D.nphix; i++,l++) RHS_array[ek+k][ej+j][ei+i][c] += RHS_local[l];
         }
         /*Assembling the right hand side vector g*/
-        ierr = Flow_Vecg(RHS_local,&ctx->e3D,ek,ej,ei,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+        ierr = Flow_Vecg(RHS_local,e3D,ek,ej,ei,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
         for (l = 0,k = 0; k < ctx->e3D.nphiz; k++)
           for (j = 0; j < ctx->e3D.nphiy; j++)
             for (i = 0; i < ctx->e3D.nphix; i++,l++) RHS_array[ek+k][ej+j][ei+i][3] += RHS_local[l];
         if (ctx->hasFluidSources) {
-          ierr = VecApplySourceTerms(RHS_local,source_array,&ctx->e3D,ek,ej,ei,ctx,v_array);
+          ierr = VecApplySourceTerms(RHS_local,source_array,e3D,ek,ej,ei,ctx,v_array);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++)
             for (j = 0; j < ctx->e3D.nphiy; j++)
               for (i = 0; i < ctx->e3D.nphix; i++,l++) RHS_array[ek+k][ej+j][ei+i][3] += RHS_local[l];
@@ -451,9 +466,9 @@ extern PetscErrorCode FormTSMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx)
         if (ei == 0) {
           /*					 Face X0			*/
           face = X0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphix; k++)
               for (j = 0; j < ctx->e2D.nphiy; j++)
                 for (i = 0; i < ctx->e2D.nphiz; i++, l++) RHS_array[ek+k][ej+j][ei+i][0] -= RHS_local[l];
@@ -462,9 +477,9 @@ extern PetscErrorCode FormTSMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx)
         if (ei == nx-1) {
           /*					 Face X1		*/
           face = X1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphix; k++)
               for (j = 0; j < ctx->e2D.nphiy; j++)
                 for (i = 0; i < ctx->e2D.nphiz; i++, l++) RHS_array[ek+k][ej+j][ei+1][0] += RHS_local[l];
@@ -473,9 +488,9 @@ extern PetscErrorCode FormTSMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx)
         if (ej == 0) {
           /*					 Face Y0		*/
           face = Y0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiy; k++)
               for (j = 0; j < ctx->e2D.nphiz; j++)
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) RHS_array[ek+k][ej+j][ei+i][1] -= RHS_local[l];
@@ -484,9 +499,9 @@ extern PetscErrorCode FormTSMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx)
         if (ej == ny-1) {
           /*					 Face Y1		*/
           face = Y1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiy; k++)
               for (j = 0; j < ctx->e2D.nphiz; j++)
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) RHS_array[ek+k][ej+1][ei+i][1] += RHS_local[l];
@@ -495,9 +510,9 @@ extern PetscErrorCode FormTSMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx)
         if (ek == 0) {
           /*					 Face Z0		*/
           face = Z0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiz; k++)
               for (j = 0; j < ctx->e2D.nphiy; j++)
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) RHS_array[ek+k][ej+j][ei+i][2] -= RHS_local[l];
@@ -506,9 +521,9 @@ extern PetscErrorCode FormTSMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx)
         if (ek == nz-1) {
           /*					 Face Z1		*/
           face = Z1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcP[0].face[face] == FIXED) {
-            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,&ctx->e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
+            ierr = VecApplyPressureBC(RHS_local,prebc_array,ek,ej,ei,face,e2D,&ctx->flowprop,perm_array,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiz; k++)
               for (j = 0; j < ctx->e2D.nphiy; j++)
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) RHS_array[ek+1][ej+j][ei+i][2] += RHS_local[l];
@@ -540,12 +555,12 @@ extern PetscErrorCode FormTSMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx)
               hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
               hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
               hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-              ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+              ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
               hwx  = (ctx->well[w_no].coords[0]-coords_array[ek][ej][ei][0])/hx;
               hwy  = (ctx->well[w_no].coords[1]-coords_array[ek][ej][ei][1])/hy;
               hwz  = (ctx->well[w_no].coords[2]-coords_array[ek][ej][ei][2])/hz;
               if (ctx->well[w_no].condition == RATE) {
-                ierr = VecApplyWellFlowRate(RHS_local,&ctx->e3D,ctx->well[w_no].Qw,hwx,hwy,hwz,ek,ej,ei,v_array);CHKERRQ(ierr);
+                ierr = VecApplyWellFlowRate(RHS_local,e3D,ctx->well[w_no].Qw,hwx,hwy,hwz,ek,ej,ei,v_array);CHKERRQ(ierr);
                 for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
                   for (j = 0; j < ctx->e3D.nphiy; j++)
                     for (i = 0; i < ctx->e3D.nphix; i++,l++) {
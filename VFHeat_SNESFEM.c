@@ -33,13 +33,10 @@ extern PetscErrorCode VF_FEMSNESHeatSolverInitialize(VFCtx *ctx, VFFields *field
   ierr = MPI_Comm_size(PETSC_COMM_WORLD,&comm_size);CHKERRQ(ierr);
   ierr = DMCreateMatrix(ctx->daScal,&ctx->KT);CHKERRQ(ierr);
   ierr = DMCreateMatrix(ctx->daScal,&ctx->KTlhs);CHKERRQ(ierr);
-  ierr = DMCreateMatrix(ctx->daScal,&ctx->JacT);CHKERRQ(ierr);
   ierr = MatZeroEntries(ctx->KT);CHKERRQ(ierr);
   ierr = MatZeroEntries(ctx->KTlhs);CHKERRQ(ierr);
-  ierr = MatZeroEntries(ctx->JacT);CHKERRQ(ierr);
   ierr = MatSetOption(ctx->KT,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
   ierr = MatSetOption(ctx->KTlhs,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
-  ierr = MatSetOption(ctx->JacT,MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
   ierr = DMCreateGlobalVector(ctx->daScal,&ctx->prevT);CHKERRQ(ierr);
   ierr = VecSet(ctx->prevT,0.0);CHKERRQ(ierr);
   ierr = DMCreateGlobalVector(ctx->daScal,&ctx->RHST);CHKERRQ(ierr);
@@ -66,7 +63,6 @@ extern PetscErrorCode VF_FEMSNESHeatSolverFinalize(VFCtx *ctx,VFFields *fields)
   PetscFunctionBegin;
   ierr = MatDestroy(&ctx->KT);CHKERRQ(ierr);
   ierr = MatDestroy(&ctx->KTlhs);CHKERRQ(ierr);
-  ierr = MatDestroy(&ctx->JacT);CHKERRQ(ierr);
   ierr = VecDestroy(&ctx->prevT);CHKERRQ(ierr);
   ierr = VecDestroy(&ctx->RHST);CHKERRQ(ierr);
   ierr = VecDestroy(&ctx->HeatFunct);CHKERRQ(ierr);
@@ -87,7 +83,7 @@ extern PetscErrorCode VF_HeatFEMSNESSolve(VFCtx *ctx,VFFields *fields)
   PetscFunctionBegin; 
   ierr = FormHeatMatricesnVector(ctx->KT,ctx->KTlhs,ctx->RHST,ctx,fields);CHKERRQ(ierr);
   ierr = SNESSetFunction(ctx->snesT,ctx->HeatFunct,FormSNESHeatIFunction,ctx);CHKERRQ(ierr);
-    ierr = SNESSetJacobian(ctx->snesT,ctx->JacT,ctx->JacT,FormSNESHeatIJacobian,ctx);CHKERRQ(ierr);
+    ierr = SNESSetJacobian(ctx->snesT,ctx->KT,ctx->KT,FormSNESHeatIJacobian,ctx);CHKERRQ(ierr);
   if (ctx->verbose > 1) {
     ierr = SNESMonitorSet(ctx->snesT,FEMSNESMonitor,NULL,NULL);CHKERRQ(ierr);
   } 
@@ -105,6 +101,9 @@ extern PetscErrorCode VF_HeatFEMSNESSolve(VFCtx *ctx,VFFields *fields)
   PetscFunctionReturn(0);
 }
 
+/*
+  FormSNESHeatIJacobian: The heat residual is linear in T, the SNES uses the assembled KT as its Jacobian.
+*/
 #undef __FUNCT__
 #define __FUNCT__ "FormSNESHeatIJacobian"
 extern PetscErrorCode FormSNESHeatIJacobian(SNES snes,Vec T,Mat Jac,Mat Jacpre,void *user)
@@ -113,11 +112,10 @@ extern PetscErrorCode FormSNESHeatIJacobian(SNES snes,Vec T,Mat Jac,Mat Jacpre,v
   VFCtx          *ctx=(VFCtx*)user;
   
   PetscFunctionBegin;
-  ierr = MatCopy(ctx->KT,Jacpre,DIFFERENT_NONZERO_PATTERN);
-  ierr = MatAssemblyBegin(Jacpre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
-  ierr = MatAssemblyEnd(Jacpre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  if (Jacpre != ctx->KT) {
+    ierr = MatCopy(ctx->KT,Jacpre,DIFFERENT_NONZERO_PATTERN);CHKERRQ(ierr);
+  }
   if (Jac != Jacpre) {
-    ierr = MatCopy(Jacpre,Jac,DIFFERENT_NONZERO_PATTERN);
     ierr = MatAssemblyBegin(Jac,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
     ierr = MatAssemblyEnd(Jac,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
   } 
@@ -155,17 +153,17 @@ extern PetscErrorCode FormSNESHeatIFunction(SNES snes,Vec T,Vec Func,void *user)
 extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode ierr;
+  VFCartFEElement3D *e3D;
+  VFCartFEElement2D *e2D;
   PetscInt       xs,xm,nx;
   PetscInt       ys,ym,ny;
   PetscInt       zs,zm,nz;
   PetscInt       ek,ej,ei;
   PetscInt       i,j,k,l;
-  PetscReal      ****coords_array;
   PetscReal      ***RHS_array;
   PetscReal      *RHS_local;
   PetscReal      *RHS1_local;
   Vec            RHS_localVec;
-  PetscReal      hx,hy,hz;
   PetscReal      theta,timestepsize;
   PetscInt       nrow = ctx->e3D.nphix*ctx->e3D.nphiy*ctx->e3D.nphiz;
   MatStencil     *row;
@@ -200,7 +198,6 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
   ierr = MatZeroEntries(K);CHKERRQ(ierr);
   ierr = MatZeroEntries(Klhs);CHKERRQ(ierr);
   ierr = VecSet(RHS,0.);CHKERRQ(ierr);
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMGetLocalVector(ctx->daScal,&RHS_localVec);CHKERRQ(ierr);
   ierr = VecSet(RHS_localVec,0.);CHKERRQ(ierr);
   ierr = DMDAVecGetArray(ctx->daScal,RHS_localVec,&RHS_array);CHKERRQ(ierr);  
@@ -264,13 +261,10 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
   for (ek = zs; ek < zs+zm; ek++) {
     for (ej = ys; ej < ys+ym; ej++) {
       for (ei = xs; ei < xs+xm; ei++) {
-        hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
         /*  Assembling the sub-Matrices */
         rhoCp_eff_array=rho_liq_array*Cp_liq_array+rho_sol_array*Cp_sol_array;
-        ierr = VF_MatA_local(KM_local,&ctx->e3D,ek,ej,ei,v_array);CHKERRQ(ierr);
+        ierr = VF_MatA_local(KM_local,e3D,ek,ej,ei,v_array);CHKERRQ(ierr);
         for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
           for (j = 0; j < ctx->e3D.nphiy; j++) {
             for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -280,7 +274,7 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
         }
         ierr = MatSetValuesStencil(K,nrow,row,nrow,row,KM_local,ADD_VALUES);CHKERRQ(ierr);
         ierr = MatSetValuesStencil(Klhs,nrow,row,nrow,row,KM_local,ADD_VALUES);CHKERRQ(ierr);
-        ierr = VF_HeatMatK_local(KD_local,&ctx->e3D,ek,ej,ei,diffsvty_array,v_array);CHKERRQ(ierr);
+        ierr = VF_HeatMatK_local(KD_local,e3D,ek,ej,ei,diffsvty_array,v_array);CHKERRQ(ierr);
 
         for (l = 0; l < nrow*nrow; l++) {
           K1_local[l] = theta*timestepsize*(1./rhoCp_eff_array)*KD_local[l];
@@ -288,7 +282,7 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
         }
         ierr = MatSetValuesStencil(K,nrow,row,nrow,row,K1_local,ADD_VALUES);CHKERRQ(ierr);
         ierr = MatSetValuesStencil(Klhs,nrow,row,nrow,row,K2_local,ADD_VALUES);CHKERRQ(ierr);
-        ierr = VF_HeatMatC_local(KC_local,&ctx->e3D,ek,ej,ei,vel_array,v_array);CHKERRQ(ierr);
+        ierr = VF_HeatMatC_local(KC_local,e3D,ek,ej,ei,vel_array,v_array);CHKERRQ(ierr);
 
         for (l = 0; l < nrow*nrow; l++) {
           K1_local[l] = theta*timestepsize*(rho_liq_array*Cp_liq_array/rhoCp_eff_array)*KC_local[l];
@@ -297,7 +291,7 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
         }
         ierr = MatSetValuesStencil(K,nrow,row,nrow,row,K1_local,ADD_VALUES);CHKERRQ(ierr);
         ierr = MatSetValuesStencil(Klhs,nrow,row,nrow,row,K2_local,ADD_VALUES);CHKERRQ(ierr);
-        ierr = VF_HeatMatN_local(KN_local,&ctx->e3D,ek,ej,ei,vel_array,v_array);CHKERRQ(ierr);
+        ierr = VF_HeatMatN_local(KN_local,e3D,ek,ej,ei,vel_array,v_array);CHKERRQ(ierr);
 
         for (l = 0; l < nrow*nrow; l++) {   
           K1_local[l] = 1./2.*theta*timestepsize*timestepsize*(rho_liq_array*Cp_liq_array/rhoCp_eff_array)*(rho_liq_array*Cp_liq_array/rhoCp_eff_array)*KN_local[l];
@@ -309,7 +303,7 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
         ierr = MatSetValuesStencil(Klhs,nrow,row,nrow,row,K2_local,ADD_VALUES);CHKERRQ(ierr);   */
         /*  Assembling the righthand side vector  */
         if(ctx->hasHeatSources){
-          ierr = VecApplyHeatSourceTerms(RHS_local,RHS1_local,heatsource_array,&ctx->e3D,ek,ej,ei,ctx,vel_array,v_array);
+          ierr = VecApplyHeatSourceTerms(RHS_local,RHS1_local,heatsource_array,e3D,ek,ej,ei,ctx,vel_array,v_array);
           for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++) {
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
@@ -322,9 +316,9 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
         if (ei == 0) {
           /*           Face X0      */
           face = X0;  
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQT[0].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphix; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphiz; i++, l++) {
@@ -337,9 +331,9 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
         if (ei == nx-1) {
           /*           Face X1    */
           face = X1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQT[0].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphix; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphiz; i++, l++) {
@@ -352,9 +346,9 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
         if (ej == 0) {
           /*           Face Y0    */
           face = Y0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQT[1].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiy; k++){
               for (j = 0; j < ctx->e2D.nphiz; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -367,9 +361,9 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
         if (ej == ny-1) {
           /*           Face Y1    */
           face = Y1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQT[1].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiy; k++){
               for (j = 0; j < ctx->e2D.nphiz; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -382,9 +376,9 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
         if (ek == 0) {
           /*           Face Z0    */
           face = Z0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQT[2].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiz; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -397,9 +391,9 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
         if (ek == nz-1) {
           /*           Face Z1    */
           face = Z1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
           if (ctx->bcQT[2].face[face] == FIXED) {
-            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,&ctx->e2D,v_array);CHKERRQ(ierr);
+            ierr = VecApplyFluxBC(RHS_local,fluxbc_array,ek,ej,ei,face,e2D,v_array);CHKERRQ(ierr);
             for (l=0,k = 0; k < ctx->e2D.nphiz; k++){
               for (j = 0; j < ctx->e2D.nphiy; j++) {
                 for (i = 0; i < ctx->e2D.nphix; i++, l++) {
@@ -432,7 +426,6 @@ extern PetscErrorCode FormHeatMatricesnVector(Mat K,Mat Klhs,Vec RHS,VFCtx *ctx,
   ierr = DMLocalToGlobalBegin(ctx->daScal,RHS_localVec,ADD_VALUES,RHS);CHKERRQ(ierr);
   ierr = DMLocalToGlobalEnd(ctx->daScal,RHS_localVec,ADD_VALUES,RHS);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daScal,&RHS_localVec);CHKERRQ(ierr); 
-  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   
   ierr = DMDAVecRestoreArray(ctx->daVect,fluxbc_local,&fluxbc_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daVect,&fluxbc_local);CHKERRQ(ierr);
@@ -2,13 +2,34 @@
 #include "VFCartFE.h"
 #include "VFCommon.h"
 #include "VFMech.h"
+#include "VFPermfield.h"
 
 #define UNILATERAL_THRES 0
+#define VFUSTIFFNESS_RTOL 1.e-10
 /*
   use UNILATERAL_THRES -1e+10 in order to test the tensile part of the energy (equivalent to unilateral none)
   use UNILATERAL_THRES  1e+10 in order to test the compressive part of the energy (equivalent to the defunct shear only)
 */
 
+/*
+ VF_GatherBatch: gathers in f_local[l*VFCARTFE_BATCH+b] the nodal values of the nb cells (ei+b,ej,ek) of a batch
+ of a scalar field (array) or of the c^th component of a vector field (vec_array, if array is NULL).
+ The unused lanes are set to 0.
+ */
+static void VF_GatherBatch(PetscReal *f_local,PetscReal ***array,PetscReal ****vec_array,PetscInt c,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt nb,VFCartFEElement3D *e)
+{
+  PetscInt i,j,k,l,b;
+  
+  for (l = 0,k = 0; k < e->nphiz; k++) {
+    for (j = 0; j < e->nphiy; j++) {
+      for (i = 0; i < e->nphix; i++,l++) {
+        for (b = 0; b < nb; b++) f_local[l*VFCARTFE_BATCH+b] = array ? array[ek+k][ej+j][ei+b+i] : vec_array[ek+k][ej+j][ei+b+i][c];
+        for (; b < VFCARTFE_BATCH; b++) f_local[l*VFCARTFE_BATCH+b] = 0.;
+      }
+    }
+  }
+}
+
 #undef __FUNCT__
 #define __FUNCT__ "ElasticEnergyDensity3D_local"
 /*
@@ -32,8 +53,8 @@
 extern PetscErrorCode ElasticEnergyDensity3D_local(PetscReal *ElasticEnergyDensity_local,PetscReal ****u_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,VFMatProp *matprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
 {
   PetscErrorCode ierr;
-  PetscReal      *epsilon11_elem,*epsilon22_elem,*epsilon33_elem,*epsilon12_elem,*epsilon23_elem,*epsilon13_elem;
-  PetscReal      *sigma11_elem,*sigma22_elem,*sigma33_elem,*sigma12_elem,*sigma23_elem,*sigma13_elem;
+  PetscReal      epsilon11_elem[VFCARTFE_MAXNG3D],epsilon22_elem[VFCARTFE_MAXNG3D],epsilon33_elem[VFCARTFE_MAXNG3D],epsilon12_elem[VFCARTFE_MAXNG3D],epsilon23_elem[VFCARTFE_MAXNG3D],epsilon13_elem[VFCARTFE_MAXNG3D];
+  PetscReal      sigma11_elem[VFCARTFE_MAXNG3D],sigma22_elem[VFCARTFE_MAXNG3D],sigma33_elem[VFCARTFE_MAXNG3D],sigma12_elem[VFCARTFE_MAXNG3D],sigma23_elem[VFCARTFE_MAXNG3D],sigma13_elem[VFCARTFE_MAXNG3D];
   PetscInt       i,j,k,g;
   PetscReal      lambda,mu,alpha;
   /*
@@ -45,10 +66,6 @@ extern PetscErrorCode ElasticEnergyDensity3D_local(PetscReal *ElasticEnergyDensi
   mu       = matprop->mu;
   alpha    = matprop->alpha;
   
-  ierr = PetscMalloc3(e->ng,&sigma11_elem,e->ng,&sigma22_elem,e->ng,&sigma33_elem);CHKERRQ(ierr);
-  ierr = PetscMalloc3(e->ng,&sigma12_elem,e->ng,&sigma23_elem,e->ng,&sigma13_elem);CHKERRQ(ierr);
-  ierr = PetscMalloc3(e->ng,&epsilon11_elem,e->ng,&epsilon22_elem,e->ng,&epsilon33_elem);CHKERRQ(ierr);
-  ierr = PetscMalloc3(e->ng,&epsilon12_elem,e->ng,&epsilon23_elem,e->ng,&epsilon13_elem);CHKERRQ(ierr);
   
   for (g = 0; g < e->ng; g++) {
     epsilon11_elem[g]             = 0;
@@ -98,10 +115,69 @@ extern PetscErrorCode ElasticEnergyDensity3D_local(PetscReal *ElasticEnergyDensi
   }
   ierr = PetscLogFlops(46 * e->ng);CHKERRQ(ierr);
   
-  ierr = PetscFree3(sigma11_elem,sigma22_elem,sigma33_elem);CHKERRQ(ierr);
-  ierr = PetscFree3(sigma12_elem,sigma23_elem,sigma13_elem);CHKERRQ(ierr);
-  ierr = PetscFree3(epsilon11_elem,epsilon22_elem,epsilon33_elem);CHKERRQ(ierr);
-  ierr = PetscFree3(epsilon12_elem,epsilon23_elem,epsilon13_elem);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/*
+ ElasticEnergyDensity3DBatch_Kernel: ElasticEnergyDensity3DBatch_local without the PETSc calls, its flops are added to *flops
+ */
+static void ElasticEnergyDensity3DBatch_Kernel(PetscReal *ElasticEnergyDensity_local,PetscReal ****u_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,VFMatProp *matprop,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt nb,VFCartFEElement3D *e,PetscLogDouble *flops)
+{
+  PetscInt       c,l,g,b,gb,ng = e->ng;
+  PetscReal      lambda,mu,alpha;
+  PetscReal      f_local[8*VFCARTFE_BATCH],f2_local[8*VFCARTFE_BATCH];
+  PetscReal      theta_elem[VFCARTFE_MAXNG3D*VFCARTFE_BATCH];
+  PetscReal      du_elem[3][3*VFCARTFE_MAXNG3D*VFCARTFE_BATCH];
+  PetscReal      epsilon11,epsilon22,epsilon33,epsilon12,epsilon23,epsilon13;
+  PetscReal      sigma11,sigma22,sigma33;
+  
+  lambda   = matprop->lambda;
+  mu       = matprop->mu;
+  alpha    = matprop->alpha;
+  
+  for (c = 0; c < 3; c++) {
+    VF_GatherBatch(f_local,NULL,u_array,c,ek,ej,ei,nb,e);
+    VFCartFEElement3DInterpolateBatch_Kernel(e,f_local,NULL,du_elem[c],flops);
+  }
+  VF_GatherBatch(f_local,theta_array,NULL,0,ek,ej,ei,nb,e);
+  VF_GatherBatch(f2_local,thetaRef_array,NULL,0,ek,ej,ei,nb,e);
+  for (l = 0; l < 8*VFCARTFE_BATCH; l++) f_local[l] -= f2_local[l];
+  VFCartFEElement3DInterpolateBatch_Kernel(e,f_local,theta_elem,NULL,flops);
+  
+  for (g = 0; g < ng; g++) {
+    for (b = 0; b < VFCARTFE_BATCH; b++) {
+      gb = g*VFCARTFE_BATCH+b;
+      epsilon11 = du_elem[0][gb] - alpha * theta_elem[gb];
+      epsilon22 = du_elem[1][(ng+g)*VFCARTFE_BATCH+b] - alpha * theta_elem[gb];
+      epsilon33 = du_elem[2][(2*ng+g)*VFCARTFE_BATCH+b] - alpha * theta_elem[gb];
+      epsilon12 = (du_elem[1][gb] + du_elem[0][(ng+g)*VFCARTFE_BATCH+b]) * .5;
+      epsilon23 = (du_elem[2][(ng+g)*VFCARTFE_BATCH+b] + du_elem[1][(2*ng+g)*VFCARTFE_BATCH+b]) * .5;
+      epsilon13 = (du_elem[2][gb] + du_elem[0][(2*ng+g)*VFCARTFE_BATCH+b]) * .5;
+      sigma11   = (lambda + 2.*mu) * epsilon11 + lambda * epsilon22 + lambda * epsilon33;
+      sigma22   = lambda * epsilon11 + (lambda + 2.*mu) * epsilon22 + lambda * epsilon33;
+      sigma33   = lambda * epsilon11 + lambda * epsilon22 + (lambda + 2.*mu) * epsilon33;
+      ElasticEnergyDensity_local[gb] = (sigma11 * epsilon11 + sigma22 * epsilon22 + sigma33 * epsilon33) * .5
+                                     + 2. * mu * (epsilon12 * epsilon12 + epsilon23 * epsilon23 + epsilon13 * epsilon13);
+    }
+  }
+  *flops += VFCARTFE_BATCH * ng * 52;
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "ElasticEnergyDensity3DBatch_local"
+/*
+ ElasticEnergyDensity3DBatch_local: ElasticEnergyDensity3D_local for the nb cells (ei+b,ej,ek) of a batch sharing the 
+ element e, ElasticEnergyDensity_local[g*VFCARTFE_BATCH+b]. 
+ The strains are computed by sum factorization, all the cells of the batch at once.
+ */
+extern PetscErrorCode ElasticEnergyDensity3DBatch_local(PetscReal *ElasticEnergyDensity_local,PetscReal ****u_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,VFMatProp *matprop,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt nb,VFCartFEElement3D *e)
+{
+  PetscErrorCode ierr;
+  PetscLogDouble flops = 0.;
+  
+  PetscFunctionBegin;
+  ElasticEnergyDensity3DBatch_Kernel(ElasticEnergyDensity_local,u_array,theta_array,thetaRef_array,matprop,ek,ej,ei,nb,e,&flops);
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -115,12 +191,12 @@ extern PetscErrorCode ElasticEnergyDensity3D_local(PetscReal *ElasticEnergyDensi
 extern PetscErrorCode ElasticEnergyDensitySphericalDeviatoricNoCompression3D_local(PetscReal *ElasticEnergyDensityS_local,PetscReal *ElasticEnergyDensityD_local,PetscReal ****u_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,VFMatProp *matprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
 {
   PetscErrorCode ierr;
-  PetscReal      *epsilon11_elem,*epsilon22_elem,*epsilon33_elem,*epsilon12_elem,*epsilon23_elem,*epsilon13_elem;
-  PetscReal      *e0_11_elem,*e0_22_elem,*e0_33_elem;
-  PetscReal      *sigma11_elem,*sigma22_elem,*sigma33_elem,*sigma12_elem,*sigma23_elem,*sigma13_elem;
+  PetscReal      epsilon11_elem[VFCARTFE_MAXNG3D],epsilon22_elem[VFCARTFE_MAXNG3D],epsilon33_elem[VFCARTFE_MAXNG3D],epsilon12_elem[VFCARTFE_MAXNG3D],epsilon23_elem[VFCARTFE_MAXNG3D],epsilon13_elem[VFCARTFE_MAXNG3D];
+  PetscReal      e0_11_elem[VFCARTFE_MAXNG3D],e0_22_elem[VFCARTFE_MAXNG3D],e0_33_elem[VFCARTFE_MAXNG3D];
+  PetscReal      sigma11_elem[VFCARTFE_MAXNG3D],sigma22_elem[VFCARTFE_MAXNG3D],sigma33_elem[VFCARTFE_MAXNG3D],sigma12_elem[VFCARTFE_MAXNG3D],sigma23_elem[VFCARTFE_MAXNG3D],sigma13_elem[VFCARTFE_MAXNG3D];
   PetscInt       i,j,k,g;
   PetscReal      lambda,mu,alpha,kappa;
-  PetscReal      *ElasticEnergyDensity_local;
+  PetscReal      ElasticEnergyDensity_local[VFCARTFE_MAXNG3D];
   PetscReal      tr_epsilon;
   
   PetscFunctionBegin;
@@ -129,13 +205,7 @@ extern PetscErrorCode ElasticEnergyDensitySphericalDeviatoricNoCompression3D_loc
   alpha    = matprop->alpha;
   kappa    = lambda + 2.* mu / 3.;
 
-  ierr = PetscMalloc3(e->ng,&sigma11_elem,e->ng,&sigma22_elem,e->ng,&sigma33_elem);CHKERRQ(ierr);
-  ierr = PetscMalloc3(e->ng,&sigma12_elem,e->ng,&sigma23_elem,e->ng,&sigma13_elem);CHKERRQ(ierr);
-  ierr = PetscMalloc3(e->ng,&epsilon11_elem,e->ng,&epsilon22_elem,e->ng,&epsilon33_elem);CHKERRQ(ierr);
-  ierr = PetscMalloc3(e->ng,&epsilon12_elem,e->ng,&epsilon23_elem,e->ng,&epsilon13_elem);CHKERRQ(ierr);
-  ierr = PetscMalloc3(e->ng,&e0_11_elem,e->ng,&e0_22_elem,e->ng,&e0_33_elem);CHKERRQ(ierr);
   
-  ierr = PetscMalloc(e->ng * sizeof(PetscReal),&ElasticEnergyDensity_local);CHKERRQ(ierr);
   for (g = 0; g < e->ng; g++) {
     epsilon11_elem[g] = 0;
     epsilon22_elem[g] = 0;
@@ -208,32 +278,114 @@ extern PetscErrorCode ElasticEnergyDensitySphericalDeviatoricNoCompression3D_loc
   }
   ierr = PetscLogFlops(54 * e->ng);CHKERRQ(ierr);
   
-  ierr = PetscFree3(sigma11_elem,sigma22_elem,sigma33_elem);CHKERRQ(ierr);
-  ierr = PetscFree3(sigma12_elem,sigma23_elem,sigma13_elem);CHKERRQ(ierr);
-  ierr = PetscFree3(epsilon11_elem,epsilon22_elem,epsilon33_elem);CHKERRQ(ierr);
-  ierr = PetscFree3(epsilon12_elem,epsilon23_elem,epsilon13_elem);CHKERRQ(ierr);
-  ierr = PetscFree3(e0_11_elem,e0_22_elem,e0_33_elem);CHKERRQ(ierr);
-  ierr = PetscFree(ElasticEnergyDensity_local);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UStiffnessSetUp"
+/*
+ VF_UStiffnessSetUp: Build the reference stiffness tensors at each gauss point of an element
+ of size hx x hy x hz. Since all elements of a layer share the same geometry and Lame
+ coefficients, the tensors are only rebuilt when one of them changes.
+
+ The element matrix ordering is the one of VF_BilinearFormU3D_local.
+ */
+extern PetscErrorCode VF_UStiffnessSetUp(VFUStiffness *K,VFMatProp *matprop,PetscReal hx,PetscReal hy,PetscReal hz,VFCartFEElement3D *e)
+{
+  PetscInt       g,i1,i2,j1,j2,k1,k2,c1,c2,l;
+  PetscInt       nrow = e->dim * e->nphix * e->nphiy * e->nphiz;
+  PetscReal      *Kg;
+  PetscReal      mat_gauss;
+  PetscErrorCode ierr;
+
+  PetscFunctionBegin;
+  /*
+    Cell sizes computed from the coordinates of a uniform grid differ by round-off, so they are compared up to a relative tolerance
+  */
+  if (K->Kg && K->ng == e->ng && K->nrow == nrow &&
+      PetscAbsReal(K->hx - hx) <= VFUSTIFFNESS_RTOL * hx &&
+      PetscAbsReal(K->hy - hy) <= VFUSTIFFNESS_RTOL * hy &&
+      PetscAbsReal(K->hz - hz) <= VFUSTIFFNESS_RTOL * hz &&
+      K->lambda == matprop->lambda && K->mu == matprop->mu) PetscFunctionReturn(0);
+
+  if (K->Kg && (K->ng != e->ng || K->nrow != nrow)) {
+    ierr = PetscFree(K->Kg);CHKERRQ(ierr);
+  }
+  if (!K->Kg) {
+    ierr = PetscMalloc(e->ng * nrow * nrow * sizeof(PetscReal),&K->Kg);CHKERRQ(ierr);
+  }
+  K->hx     = hx;
+  K->hy     = hy;
+  K->hz     = hz;
+  K->lambda = matprop->lambda;
+  K->mu     = matprop->mu;
+  K->ng     = e->ng;
+  K->nrow   = nrow;
+
+  for (g = 0; g < e->ng; g++) {
+    Kg = &K->Kg[g * nrow * nrow];
+    for (l = 0,k1 = 0; k1 < e->nphiz; k1++) {
+      for (j1 = 0; j1 < e->nphiy; j1++) {
+        for (i1 = 0; i1 < e->nphix; i1++) {
+          for (c1 = 0; c1 < e->dim; c1++) {
+            for (k2 = 0; k2 < e->nphiz; k2++) {
+              for (j2 = 0; j2 < e->nphiy; j2++) {
+                for (i2 = 0; i2 < e->nphix; i2++) {
+                  for (c2 = 0; c2 < e->dim; c2++,l++) {
+                    mat_gauss  = matprop->lambda * e->dphi[k1][j1][i1][c1][g] * e->dphi[k2][j2][i2][c2][g];
+                    mat_gauss += matprop->mu * e->dphi[k1][j1][i1][c2][g] * e->dphi[k2][j2][i2][c1][g];
+                    if (c1 == c2) {
+                      mat_gauss += matprop->mu *
+                                   (e->dphi[k1][j1][i1][0][g] * e->dphi[k2][j2][i2][0][g] +
+                                    e->dphi[k1][j1][i1][1][g] * e->dphi[k2][j2][i2][1][g] +
+                                    e->dphi[k1][j1][i1][2][g] * e->dphi[k2][j2][i2][2][g]);
+                    }
+                    Kg[l] = e->weight[g] * mat_gauss;
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  ierr = PetscLogFlops(e->ng * nrow * nrow * 9);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UStiffnessDestroy"
+/*
+ VF_UStiffnessDestroy
+ */
+extern PetscErrorCode VF_UStiffnessDestroy(VFUStiffness *K)
+{
+  PetscErrorCode ierr;
+
+  PetscFunctionBegin;
+  ierr  = PetscFree(K->Kg);CHKERRQ(ierr);
+  K->Kg = NULL;
   PetscFunctionReturn(0);
 }
 
 #undef __FUNCT__
 #define __FUNCT__ "VF_BilinearFormU3D_local"
 /*
- VF_BilinearFormU3D_local
+ VF_BilinearFormU3D_local: element matrix of the damaged elasticity bilinear form,
+ \sum_g s(v_g) Kg where Kg are the reference stiffness tensors of the element (see VF_UStiffnessSetUp)
  
  (c) 2010-2014 Blaise Bourdin bourdin@lsu.edu
  */
-extern PetscErrorCode VF_BilinearFormU3D_local(PetscReal *Mat_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
+extern PetscErrorCode VF_BilinearFormU3D_local(PetscReal *Mat_local,PetscReal ***v_array,VFUStiffness *K,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
 {
-  PetscInt       g,i1,i2,j1,j2,k1,k2,c1,c2,l;
-  PetscReal      *s_elem;
-  PetscReal       mat_gauss;
+  PetscInt       g,i1,j1,k1,l;
+  PetscInt       nmat = K->nrow * K->nrow;
+  PetscReal      s_elem[VFCARTFE_MAXNG3D];
+  PetscReal      *Kg;
   PetscErrorCode ierr;
   
   PetscFunctionBegin;
-  ierr   = PetscMalloc(e->ng * sizeof(PetscReal),&s_elem);CHKERRQ(ierr);
-
   /*
     s_elem is the material's compliance multiplicator (s(v) = v^2+\eta)
   */
@@ -252,40 +404,124 @@ extern PetscErrorCode VF_BilinearFormU3D_local(PetscReal *Mat_local,PetscReal **
   }
   ierr = PetscLogFlops(2 * e->ng * (1. + e->nphix * e->nphiy * e->nphiz));CHKERRQ(ierr);
   
-  for (l = 0; l < 9 * e->nphix * e->nphiy * e->nphiz * e->nphix * e->nphiy * e->nphiz; l++) {
-  Mat_local[l] = 0;
+  for (l = 0; l < nmat; l++) Mat_local[l] = 0.;
+  for (g = 0; g < e->ng; g++) {
+    Kg = &K->Kg[g * nmat];
+    for (l = 0; l < nmat; l++) Mat_local[l] += s_elem[g] * Kg[l];
   }
-  for (l = 0,k1 = 0; k1 < e->nphiz; k1++) {
-    for (j1 = 0; j1 < e->nphiy; j1++) {
-      for (i1 = 0; i1 < e->nphix; i1++) {
-        for (c1 = 0; c1 < e->dim; c1++) {
-          for (k2 = 0; k2 < e->nphiz; k2++) {
-            for (j2 = 0; j2 < e->nphiy; j2++) {
-              for (i2 = 0; i2 < e->nphix; i2++) {
-                for (c2 = 0; c2 < e->dim; c2++,l++) {
-                  for (g = 0; g < e->ng; g++){
-                    mat_gauss = matprop->lambda * s_elem[g] * e->dphi[k1][j1][i1][c1][g] * e->dphi[k2][j2][i2][c2][g];
-                    mat_gauss += matprop->mu * s_elem[g] * e->dphi[k1][j1][i1][c2][g] * e->dphi[k2][j2][i2][c1][g];
-                    /* 7 flops */
-                    if (c1 == c2) {
-                      mat_gauss += matprop->mu * s_elem[g] * 
-                                    (e->dphi[k1][j1][i1][0][g] * e->dphi[k2][j2][i2][0][g] + 
-                                     e->dphi[k1][j1][i1][1][g] * e->dphi[k2][j2][i2][1][g] + 
-                                     e->dphi[k1][j1][i1][2][g] * e->dphi[k2][j2][i2][2][g]);
-                      /* 8 flops */
-                    }
-                  Mat_local[l] += e->weight[g] * mat_gauss;
-                  }
-                }
-              }
-            }
-          }
+  ierr = PetscLogFlops(2 * e->ng * nmat);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_ResidualU3D_local"
+/*
+ VF_ResidualU3D_local: accumulates in residual_local the product of the element matrix of VF_BilinearFormU3D_local
+ with the local displacement, without forming the element matrix:
+   \int s(v) A e(u) : e(\phi)
+ u, its gradient and v are evaluated at the integration points, and the result tested against the basis functions,
+ using the sum factorized routines VFCartFEElement3DInterpolate and VFCartFEElement3DIntegrate.
+ */
+extern PetscErrorCode VF_ResidualU3D_local(PetscReal *residual_local,PetscReal ****u_array,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
+{
+  PetscErrorCode ierr;
+  PetscInt       i,j,k,c,d,g,l;
+  PetscInt       nphi = e->nphix * e->nphiy * e->nphiz;
+  PetscReal      f_local[8],r_local[8];
+  PetscReal      s_elem[VFCARTFE_MAXNG3D],du_elem[3][3*VFCARTFE_MAXNG3D],sigma_elem[3][3*VFCARTFE_MAXNG3D];
+  PetscReal      divu;
+  
+  PetscFunctionBegin;
+  for (l = 0,k = 0; k < e->nphiz; k++)
+    for (j = 0; j < e->nphiy; j++)
+      for (i = 0; i < e->nphix; i++,l++) f_local[l] = v_array[ek+k][ej+j][ei+i];
+  ierr = VFCartFEElement3DInterpolate(e,f_local,s_elem,NULL);CHKERRQ(ierr);
+  for (g = 0; g < e->ng; g++) s_elem[g] = s_elem[g] * s_elem[g] + vfprop->eta;
+  /*
+    du_elem[c][d*ng+g] = \partial u_c / \partial x_d at the g^th integration point
+  */
+  for (c = 0; c < 3; c++) {
+    for (l = 0,k = 0; k < e->nphiz; k++)
+      for (j = 0; j < e->nphiy; j++)
+        for (i = 0; i < e->nphix; i++,l++) f_local[l] = u_array[ek+k][ej+j][ei+i][c];
+    ierr = VFCartFEElement3DInterpolate(e,f_local,NULL,du_elem[c]);CHKERRQ(ierr);
+  }
+  /*
+    sigma_elem[c][d*ng+g] = s(v) (\lambda div u \delta_cd + 2 \mu e(u)_cd)
+  */
+  for (g = 0; g < e->ng; g++) {
+    divu = du_elem[0][g] + du_elem[1][e->ng+g] + du_elem[2][2*e->ng+g];
+    for (c = 0; c < 3; c++) {
+      for (d = 0; d < 3; d++) {
+        sigma_elem[c][d*e->ng+g] = s_elem[g] * matprop->mu * (du_elem[c][d*e->ng+g] + du_elem[d][c*e->ng+g]);
+      }
+      sigma_elem[c][c*e->ng+g] += s_elem[g] * matprop->lambda * divu;
+    }
+  }
+  ierr = PetscLogFlops(e->ng * (3 + 4 * 9 + 3 * 3));CHKERRQ(ierr);
+  for (c = 0; c < 3; c++) {
+    for (l = 0; l < nphi; l++) r_local[l] = 0.;
+    ierr = VFCartFEElement3DIntegrate(e,NULL,sigma_elem[c],r_local);CHKERRQ(ierr);
+    for (l = 0; l < nphi; l++) residual_local[l*3+c] += r_local[l];
+  }
+  PetscFunctionReturn(0);
+}
+
+/*
+ VF_ResidualU3DBatch_Kernel: VF_ResidualU3DBatch_local without the PETSc calls, its flops are added to *flops
+ */
+static void VF_ResidualU3DBatch_Kernel(PetscReal *residual_local,PetscReal ****u_array,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt nb,VFCartFEElement3D *e,PetscLogDouble *flops)
+{
+  PetscInt       c,d,g,l,b,gb,ng = e->ng;
+  PetscInt       nphi = e->nphix * e->nphiy * e->nphiz;
+  PetscReal      f_local[8*VFCARTFE_BATCH],r_local[8*VFCARTFE_BATCH];
+  PetscReal      s_elem[VFCARTFE_MAXNG3D*VFCARTFE_BATCH];
+  PetscReal      du_elem[3][3*VFCARTFE_MAXNG3D*VFCARTFE_BATCH],sigma_elem[3][3*VFCARTFE_MAXNG3D*VFCARTFE_BATCH];
+  PetscReal      divu;
+  
+  VF_GatherBatch(f_local,v_array,NULL,0,ek,ej,ei,nb,e);
+  VFCartFEElement3DInterpolateBatch_Kernel(e,f_local,s_elem,NULL,flops);
+  for (gb = 0; gb < ng*VFCARTFE_BATCH; gb++) s_elem[gb] = s_elem[gb] * s_elem[gb] + vfprop->eta;
+  for (c = 0; c < 3; c++) {
+    VF_GatherBatch(f_local,NULL,u_array,c,ek,ej,ei,nb,e);
+    VFCartFEElement3DInterpolateBatch_Kernel(e,f_local,NULL,du_elem[c],flops);
+  }
+  for (g = 0; g < ng; g++) {
+    for (b = 0; b < VFCARTFE_BATCH; b++) {
+      gb   = g*VFCARTFE_BATCH+b;
+      divu = du_elem[0][gb] + du_elem[1][(ng+g)*VFCARTFE_BATCH+b] + du_elem[2][(2*ng+g)*VFCARTFE_BATCH+b];
+      for (c = 0; c < 3; c++) {
+        for (d = 0; d < 3; d++) {
+          sigma_elem[c][(d*ng+g)*VFCARTFE_BATCH+b] = s_elem[gb] * matprop->mu * (du_elem[c][(d*ng+g)*VFCARTFE_BATCH+b] + du_elem[d][(c*ng+g)*VFCARTFE_BATCH+b]);
         }
+        sigma_elem[c][(c*ng+g)*VFCARTFE_BATCH+b] += s_elem[gb] * matprop->lambda * divu;
       }
     }
   }
-  ierr = PetscLogFlops(e->nphix * e->nphiy * e->nphiz * e->nphix * e->nphiy * e->nphiz * (9 + e->ng * (9*7+3*8)));CHKERRQ(ierr);  
-  ierr = PetscFree(s_elem);CHKERRQ(ierr);
+  *flops += VFCARTFE_BATCH * ng * (3 + 4 * 9 + 3 * 3);
+  for (c = 0; c < 3; c++) {
+    for (l = 0; l < nphi*VFCARTFE_BATCH; l++) r_local[l] = 0.;
+    VFCartFEElement3DIntegrateBatch_Kernel(e,NULL,sigma_elem[c],r_local,flops);
+    for (l = 0; l < nphi; l++) {
+      for (b = 0; b < VFCARTFE_BATCH; b++) residual_local[(l*3+c)*VFCARTFE_BATCH+b] += r_local[l*VFCARTFE_BATCH+b];
+    }
+  }
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_ResidualU3DBatch_local"
+/*
+ VF_ResidualU3DBatch_local: VF_ResidualU3D_local for the nb cells (ei+b,ej,ek) of a batch sharing the element e.
+ residual_local[(l*3+c)*VFCARTFE_BATCH+b] is the contribution to the c^th component of the l^th node of the b^th cell.
+ */
+extern PetscErrorCode VF_ResidualU3DBatch_local(PetscReal *residual_local,PetscReal ****u_array,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt nb,VFCartFEElement3D *e)
+{
+  PetscErrorCode ierr;
+  PetscLogDouble flops = 0.;
+  
+  PetscFunctionBegin;
+  VF_ResidualU3DBatch_Kernel(residual_local,u_array,v_array,matprop,vfprop,ek,ej,ei,nb,e,&flops);
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -300,13 +536,11 @@ extern PetscErrorCode VF_BilinearFormUNoCompression3D_local(PetscReal *Mat_local
 {
   PetscInt       g,i1,i2,j1,j2,k1,k2,c1,c2,l;
   PetscReal      kappa;
-  PetscReal      *s_elem,*tr_epsilon;
+  PetscReal      s_elem[VFCARTFE_MAXNG3D],tr_epsilon[VFCARTFE_MAXNG3D];
   PetscReal      mat_gauss;
   PetscErrorCode ierr;
   
   PetscFunctionBegin;
-  ierr   = PetscMalloc2(e->ng,&s_elem,
-                        e->ng,&tr_epsilon);CHKERRQ(ierr);
   kappa  = matprop->lambda + 2. * matprop->mu / 3.;
   
   for (g = 0; g < e->ng; g++) {
@@ -371,7 +605,6 @@ extern PetscErrorCode VF_BilinearFormUNoCompression3D_local(PetscReal *Mat_local
   }
   ierr = PetscLogFlops(e->nphix * e->nphiy * e->nphiz * e->nphix * e->nphiy * e->nphiz * (9 + e->ng * (13*9+8*3)));CHKERRQ(ierr);  
 
-  ierr = PetscFree2(s_elem,tr_epsilon);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -388,16 +621,13 @@ extern PetscErrorCode VF_GradientUThermoPoro3D_local(PetscReal *residual_local,P
   PetscErrorCode ierr;
   PetscInt       l,i,j,k,g,c;
   PetscInt       dim=3;
-  PetscReal      *theta_elem,*pressure_elem,*v_elem;
+  PetscReal      theta_elem[VFCARTFE_MAXNG3D],pressure_elem[VFCARTFE_MAXNG3D],v_elem[VFCARTFE_MAXNG3D];
   PetscReal      coefalpha,beta;
   
   PetscFunctionBegin;
   coefalpha = (3.* matprop->lambda + 2. * matprop->mu) * matprop->alpha;
   beta      = matprop->beta;
   
-  ierr = PetscMalloc3(e->ng,&theta_elem,
-                      e->ng,&pressure_elem,
-                      e->ng,&v_elem);CHKERRQ(ierr);
   /*
    Initialize pressure_Elem, theta_Elem and v_elem
    */
@@ -442,7 +672,6 @@ extern PetscErrorCode VF_GradientUThermoPoro3D_local(PetscReal *residual_local,P
   /*
    Clean up
    */
-  ierr = PetscFree3(theta_elem,pressure_elem,v_elem);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -458,16 +687,12 @@ extern PetscErrorCode VF_GradientUThermoPoroNoCompression3D_local(PetscReal *res
   PetscErrorCode ierr;
   PetscInt       l,i,j,k,g,c;
   PetscInt       dim=3;
-  PetscReal      *theta_elem,*pressure_elem,*v_elem,*tr_epsilon;
+  PetscReal      theta_elem[VFCARTFE_MAXNG3D],pressure_elem[VFCARTFE_MAXNG3D],v_elem[VFCARTFE_MAXNG3D],tr_epsilon[VFCARTFE_MAXNG3D];
   PetscReal      coefalpha,beta;
   
   PetscFunctionBegin;
   coefalpha = (3.* matprop->lambda + 2. * matprop->mu) * matprop->alpha;
   beta      = matprop->beta;
-  ierr      = PetscMalloc4(e->ng,&theta_elem,
-                           e->ng,&pressure_elem,
-                           e->ng,&v_elem,
-                           e->ng,&tr_epsilon);CHKERRQ(ierr);
   /*
    Initialize theta_Elem and v_elem
    */
@@ -519,7 +744,6 @@ extern PetscErrorCode VF_GradientUThermoPoroNoCompression3D_local(PetscReal *res
   /*
    Clean up
    */
-  ierr = PetscFree4(theta_elem,pressure_elem,v_elem,tr_epsilon);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -534,13 +758,9 @@ extern PetscErrorCode VF_GradientUCrackPressure3D_local(PetscReal *residual_loca
 {
   PetscErrorCode ierr;
   PetscInt       l,i,j,k,g,c;
-  PetscReal      *pressure_elem,*gradv_elem[3];
+  PetscReal      pressure_elem[VFCARTFE_MAXNG3D],gradv_elem[3][VFCARTFE_MAXNG3D];
   
   PetscFunctionBegin;
-  ierr = PetscMalloc4(e->ng,&pressure_elem,
-                      e->ng,&gradv_elem[0],
-                      e->ng,&gradv_elem[1],
-                      e->ng,&gradv_elem[2]);CHKERRQ(ierr);
   
   /*
    Compute the projection of the fields in the local base functions basis
@@ -584,7 +804,6 @@ extern PetscErrorCode VF_GradientUCrackPressure3D_local(PetscReal *residual_loca
   /*
    Clean up
    */
-  ierr = PetscFree4(pressure_elem,gradv_elem[0],gradv_elem[1],gradv_elem[2]);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -598,13 +817,11 @@ extern PetscErrorCode VF_GradientUCrackPressure3D_local(PetscReal *residual_loca
 extern PetscErrorCode VF_GradientUInSituStresses3D_local(PetscReal *residual_local,PetscReal ****f_array,PetscInt ek,PetscInt ej,PetscInt ei,FACE face,VFCartFEElement3D *e)
 {
   PetscInt       i,j,k,l,c,g;
-  PetscReal      *f_elem[3];
-  PetscErrorCode ierr;
+  PetscReal      f_elem[3][VFCARTFE_MAXNG3D];
   PetscFunctionBegin;
   /*
    Initialize f_Elem
    */
-  ierr = PetscMalloc3(e->ng,&f_elem[0],e->ng,&f_elem[1],e->ng,&f_elem[2]);CHKERRQ(ierr);
   for (c = 0; c < e->dim; c++) {
     for (g = 0; g < e->ng; g++) {
       f_elem[c][g] = 0;
@@ -710,7 +927,6 @@ extern PetscErrorCode VF_GradientUInSituStresses3D_local(PetscReal *residual_loc
   /*
    Clean up
    */
-  ierr = PetscFree3(f_elem[0],f_elem[1],f_elem[2]);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -725,17 +941,13 @@ extern PetscErrorCode VF_GradientUInSituStresses3D_local(PetscReal *residual_loc
 extern PetscErrorCode VF_ElasticEnergy3D_local(PetscReal *ElasticEnergy_local,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
 {
   PetscInt       g,i,j,k;
-  PetscReal      *trepsilon_elem;
-  PetscReal      *D11_elem,*D22_elem,*D33_elem,*D12_elem,*D23_elem,*D13_elem;
+  PetscReal      trepsilon_elem[VFCARTFE_MAXNG3D];
+  PetscReal      D11_elem[VFCARTFE_MAXNG3D],D22_elem[VFCARTFE_MAXNG3D],D33_elem[VFCARTFE_MAXNG3D],D12_elem[VFCARTFE_MAXNG3D],D23_elem[VFCARTFE_MAXNG3D],D13_elem[VFCARTFE_MAXNG3D];
   PetscReal      lambda,mu,alpha,threekappa,coefbeta,WD;
-  PetscReal      *v_elem,*pressure_elem,*theta_elem;
+  PetscReal      v_elem[VFCARTFE_MAXNG3D],pressure_elem[VFCARTFE_MAXNG3D],theta_elem[VFCARTFE_MAXNG3D];
   PetscErrorCode ierr;
   
   PetscFunctionBegin;
-  ierr     = PetscMalloc3(e->ng,&D11_elem,e->ng,&D22_elem,e->ng,&D33_elem);CHKERRQ(ierr);
-  ierr     = PetscMalloc3(e->ng,&D12_elem,e->ng,&D23_elem,e->ng,&D13_elem);CHKERRQ(ierr);
-  ierr     = PetscMalloc2(e->ng,&v_elem,e->ng,&trepsilon_elem);CHKERRQ(ierr);
-  ierr     = PetscMalloc2(e->ng,&pressure_elem,e->ng,&theta_elem);CHKERRQ(ierr);
   lambda   = matprop->lambda;
   mu       = matprop->mu;
   alpha    = matprop->alpha;
@@ -801,14 +1013,91 @@ extern PetscErrorCode VF_ElasticEnergy3D_local(PetscReal *ElasticEnergy_local,Pe
     *ElasticEnergy_local += 3. * threekappa / 2. * WD * WD * e->weight[g];
     *ElasticEnergy_local += threekappa / 6. * trepsilon_elem[g] * trepsilon_elem[g] * vfprop->eta * e->weight[g];
   }
-  ierr = PetscFree3(D11_elem,D22_elem,D33_elem);CHKERRQ(ierr);
-  ierr = PetscFree3(D12_elem,D23_elem,D13_elem);CHKERRQ(ierr);
-  ierr = PetscFree2(v_elem,trepsilon_elem);CHKERRQ(ierr);
-  ierr = PetscFree2(pressure_elem,theta_elem);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
 
+/*
+ VF_ElasticEnergy3DBatch_Kernel: VF_ElasticEnergy3DBatch_local without the PETSc calls, its flops are added to *flops
+ */
+static void VF_ElasticEnergy3DBatch_Kernel(PetscReal *ElasticEnergy_local,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt nb,VFCartFEElement3D *e,PetscLogDouble *flops)
+{
+  PetscInt       c,l,g,b,gb,ng = e->ng;
+  PetscReal      lambda,mu,alpha,threekappa,coefbeta,WD;
+  PetscReal      f_local[8*VFCARTFE_BATCH],f2_local[8*VFCARTFE_BATCH];
+  PetscReal      du_elem[3][3*VFCARTFE_MAXNG3D*VFCARTFE_BATCH];
+  PetscReal      v_elem[VFCARTFE_MAXNG3D*VFCARTFE_BATCH],pressure_elem[VFCARTFE_MAXNG3D*VFCARTFE_BATCH],theta_elem[VFCARTFE_MAXNG3D*VFCARTFE_BATCH];
+  PetscReal      D11,D22,D33,D12,D23,D13,trepsilon;
+  PetscReal      energy[VFCARTFE_BATCH];
+  
+  lambda   = matprop->lambda;
+  mu       = matprop->mu;
+  alpha    = matprop->alpha;
+  threekappa = 3.*lambda + 2. *mu;
+  coefbeta = matprop->beta / threekappa;
+  
+  for (c = 0; c < 3; c++) {
+    VF_GatherBatch(f_local,NULL,u_array,c,ek,ej,ei,nb,e);
+    VFCartFEElement3DInterpolateBatch_Kernel(e,f_local,NULL,du_elem[c],flops);
+  }
+  VF_GatherBatch(f_local,v_array,NULL,0,ek,ej,ei,nb,e);
+  VFCartFEElement3DInterpolateBatch_Kernel(e,f_local,v_elem,NULL,flops);
+  VF_GatherBatch(f_local,pressure_array,NULL,0,ek,ej,ei,nb,e);
+  VFCartFEElement3DInterpolateBatch_Kernel(e,f_local,pressure_elem,NULL,flops);
+  VF_GatherBatch(f_local,theta_array,NULL,0,ek,ej,ei,nb,e);
+  VF_GatherBatch(f2_local,thetaRef_array,NULL,0,ek,ej,ei,nb,e);
+  for (l = 0; l < 8*VFCARTFE_BATCH; l++) f_local[l] -= f2_local[l];
+  VFCartFEElement3DInterpolateBatch_Kernel(e,f_local,theta_elem,NULL,flops);
+  
+  for (b = 0; b < VFCARTFE_BATCH; b++) energy[b] = 0.;
+  for (g = 0; g < ng; g++) {
+    for (b = 0; b < VFCARTFE_BATCH; b++) {
+      gb  = g*VFCARTFE_BATCH+b;
+      D11 = du_elem[0][gb];
+      D22 = du_elem[1][(ng+g)*VFCARTFE_BATCH+b];
+      D33 = du_elem[2][(2*ng+g)*VFCARTFE_BATCH+b];
+      D12 = (du_elem[1][gb] + du_elem[0][(ng+g)*VFCARTFE_BATCH+b]) * .5;
+      D23 = (du_elem[2][(ng+g)*VFCARTFE_BATCH+b] + du_elem[1][(2*ng+g)*VFCARTFE_BATCH+b]) * .5;
+      D13 = (du_elem[2][gb] + du_elem[0][(2*ng+g)*VFCARTFE_BATCH+b]) * .5;
+      trepsilon = D11 + D22 + D33;
+      D11 -= trepsilon / 3.;
+      D22 -= trepsilon / 3.;
+      D33 -= trepsilon / 3.;
+      /* 
+        Deviatoric part
+      */
+      energy[b] += (D11 * D11 + D22 * D22 + D33 * D33 + (D12 * D12 + D23 * D23 + D13 * D13) * 2.) 
+                 * v_elem[gb] * v_elem[gb] * (1. + vfprop->eta) * mu * e->weight[g];
+      /*
+        Spherical part
+      */
+      WD = (trepsilon / 3. - alpha * theta_elem[gb]) * v_elem[gb] - coefbeta * pressure_elem[gb];
+      energy[b] += 3. * threekappa / 2. * WD * WD * e->weight[g];
+      energy[b] += threekappa / 6. * trepsilon * trepsilon * vfprop->eta * e->weight[g];
+    }
+  }
+  *ElasticEnergy_local = 0.;
+  for (b = 0; b < nb; b++) *ElasticEnergy_local += energy[b];
+  *flops += VFCARTFE_BATCH * ng * 60;
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_ElasticEnergy3DBatch_local"
+/*
+ VF_ElasticEnergy3DBatch_local: sum of VF_ElasticEnergy3D_local over the nb cells (ei+b,ej,ek) of a batch sharing 
+ the element e. The fields are evaluated at the integration points by sum factorization, all the cells at once.
+ */
+extern PetscErrorCode VF_ElasticEnergy3DBatch_local(PetscReal *ElasticEnergy_local,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt nb,VFCartFEElement3D *e)
+{
+  PetscErrorCode ierr;
+  PetscLogDouble flops = 0.;
+  
+  PetscFunctionBegin;
+  VF_ElasticEnergy3DBatch_Kernel(ElasticEnergy_local,u_array,v_array,theta_array,thetaRef_array,pressure_array,matprop,vfprop,ek,ej,ei,nb,e,&flops);
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
 #undef __FUNCT__
 #define __FUNCT__ "VF_ElasticEnergyNoCompression3D_local"
 /*
@@ -819,17 +1108,13 @@ extern PetscErrorCode VF_ElasticEnergy3D_local(PetscReal *ElasticEnergy_local,Pe
 extern PetscErrorCode VF_ElasticEnergyNoCompression3D_local(PetscReal *ElasticEnergy_local,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
 {
   PetscInt       g,i,j,k;
-  PetscReal      *trepsilon_elem;
-  PetscReal      *D11_elem,*D22_elem,*D33_elem,*D12_elem,*D23_elem,*D13_elem;
+  PetscReal      trepsilon_elem[VFCARTFE_MAXNG3D];
+  PetscReal      D11_elem[VFCARTFE_MAXNG3D],D22_elem[VFCARTFE_MAXNG3D],D33_elem[VFCARTFE_MAXNG3D],D12_elem[VFCARTFE_MAXNG3D],D23_elem[VFCARTFE_MAXNG3D],D13_elem[VFCARTFE_MAXNG3D];
   PetscReal      lambda,mu,alpha,threekappa,coefbeta,WD;
-  PetscReal      *v_elem,*s_elem,*pressure_elem,*theta_elem;
+  PetscReal      v_elem[VFCARTFE_MAXNG3D],s_elem[VFCARTFE_MAXNG3D],pressure_elem[VFCARTFE_MAXNG3D],theta_elem[VFCARTFE_MAXNG3D];
   PetscErrorCode ierr;
   
   PetscFunctionBegin;
-  ierr     = PetscMalloc3(e->ng,&D11_elem,e->ng,&D22_elem,e->ng,&D33_elem);CHKERRQ(ierr);
-  ierr     = PetscMalloc3(e->ng,&D12_elem,e->ng,&D23_elem,e->ng,&D13_elem);CHKERRQ(ierr);
-  ierr     = PetscMalloc3(e->ng,&v_elem,e->ng,&s_elem,e->ng,&trepsilon_elem);CHKERRQ(ierr);
-  ierr     = PetscMalloc2(e->ng,&pressure_elem,e->ng,&theta_elem);CHKERRQ(ierr);
   lambda   = matprop->lambda;
   mu       = matprop->mu;
   alpha    = matprop->alpha;
@@ -900,37 +1185,17 @@ extern PetscErrorCode VF_ElasticEnergyNoCompression3D_local(PetscReal *ElasticEn
     *ElasticEnergy_local += 3. * threekappa / 2. * WD * WD * e->weight[g];
     *ElasticEnergy_local += threekappa / 6. * trepsilon_elem[g] * trepsilon_elem[g] * vfprop->eta * e->weight[g];
   }
-  ierr = PetscFree3(D11_elem,D22_elem,D33_elem);CHKERRQ(ierr);
-  ierr = PetscFree3(D12_elem,D23_elem,D13_elem);CHKERRQ(ierr);
-  ierr = PetscFree3(v_elem,s_elem,trepsilon_elem);CHKERRQ(ierr);
-  ierr = PetscFree2(pressure_elem,theta_elem);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
 
-#undef __FUNCT__
-#define __FUNCT__ "VF_PressureWork3D_local"
 /*
- VF_PressureWork3D_local: Compute the contribution of an element to the work of the pressure forces along the crack walls,
- given by
- \int_e p(x)\nabla v(x) \cdot u(x) \, dx
- 
- (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+ VF_PressureWork3D_Kernel: VF_PressureWork3D_local without the PETSc calls, its flops are added to *flops
  */
-extern PetscErrorCode VF_PressureWork3D_local(PetscReal *PressureWork_local,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
+extern void VF_PressureWork3D_Kernel(PetscReal *PressureWork_local,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e,PetscLogDouble *flops)
 {
-  PetscErrorCode ierr;
   PetscInt       i,j,k,g,c;
-  PetscReal      *pressure_elem,*gradv_elem[3],*u_elem[3];
-  
-  PetscFunctionBegin;
-  ierr = PetscMalloc4(e->ng,&pressure_elem,
-                      e->ng,&gradv_elem[0],
-                      e->ng,&gradv_elem[1],
-                      e->ng,&gradv_elem[2]);CHKERRQ(ierr);
-  ierr = PetscMalloc3(e->ng,&u_elem[0],
-                      e->ng,&u_elem[1],
-                      e->ng,&u_elem[2]);CHKERRQ(ierr);
+  PetscReal      pressure_elem[VFCARTFE_MAXNG3D],gradv_elem[3][VFCARTFE_MAXNG3D],u_elem[3][VFCARTFE_MAXNG3D];
   
   /*
    Compute the projection of the fields in the local base functions basis
@@ -955,7 +1220,7 @@ extern PetscErrorCode VF_PressureWork3D_local(PetscReal *PressureWork_local,Pets
       }
     }
   }
-  ierr = PetscLogFlops(15 * e->ng * e->nphix * e->nphiy * e->nphiz);CHKERRQ(ierr);
+  *flops += 15 * e->ng * e->nphix * e->nphiy * e->nphiz;
   
   /*
    Accumulate the contribution of the current element
@@ -964,12 +1229,26 @@ extern PetscErrorCode VF_PressureWork3D_local(PetscReal *PressureWork_local,Pets
     *PressureWork_local += e->weight[g] * pressure_elem[g]
     * (u_elem[0][g] * gradv_elem[0][g] + u_elem[1][g] * gradv_elem[1][g] + u_elem[2][g] * gradv_elem[2][g]);
   }
-  ierr = PetscLogFlops(e->ng * e->nphix * e->nphiy * e->nphiz);CHKERRQ(ierr);
-  /*
-   Clean up
-   */
-  ierr = PetscFree4(pressure_elem,gradv_elem[0],gradv_elem[1],gradv_elem[2]);CHKERRQ(ierr);
-  ierr = PetscFree3(u_elem[0],u_elem[1],u_elem[2]);CHKERRQ(ierr);
+  *flops += e->ng * e->nphix * e->nphiy * e->nphiz;
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_PressureWork3D_local"
+/*
+ VF_PressureWork3D_local: Compute the contribution of an element to the work of the pressure forces along the crack walls,
+ given by
+ \int_e p(x)\nabla v(x) \cdot u(x) \, dx
+ 
+ (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+ */
+extern PetscErrorCode VF_PressureWork3D_local(PetscReal *PressureWork_local,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
+{
+  PetscErrorCode ierr;
+  PetscLogDouble flops = 0.;
+  
+  PetscFunctionBegin;
+  VF_PressureWork3D_Kernel(PressureWork_local,u_array,v_array,pressure_array,matprop,vfprop,ek,ej,ei,e,&flops);
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -982,17 +1261,14 @@ extern PetscErrorCode VF_PressureWork3D_local(PetscReal *PressureWork_local,Pets
  */
 extern PetscErrorCode VF_InSituStressWork3D_local(PetscReal *Work_local,PetscReal ****u_array,PetscReal ****f_array,PetscInt ek,PetscInt ej,PetscInt ei,FACE face,VFCartFEElement3D *e)
 {
-  PetscErrorCode ierr;
   PetscInt       i,j,k,c,g;
   PetscInt       dim=3;
-  PetscReal      *u_elem[3],*f_elem[3];
+  PetscReal      u_elem[3][VFCARTFE_MAXNG3D],f_elem[3][VFCARTFE_MAXNG3D];
   
   PetscFunctionBegin;
   /*
    Initialize
    */
-  ierr = PetscMalloc3(e->ng,&u_elem[0],e->ng,&u_elem[1],e->ng,&u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscMalloc3(e->ng,&f_elem[0],e->ng,&f_elem[1],e->ng,&f_elem[2]);CHKERRQ(ierr);
   for (c = 0; c < dim; c++) {
     for (g = 0; g < e->ng; g++) {
       u_elem[c][g] = 0;
@@ -1096,61 +1372,294 @@ extern PetscErrorCode VF_InSituStressWork3D_local(PetscReal *Work_local,PetscRea
       *Work_local += e->weight[g] * u_elem[c][g] * f_elem[c][g];
     }
   }
-  ierr = PetscFree3(u_elem[0],u_elem[1],u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscFree3(f_elem[0],f_elem[1],f_elem[2]);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
+/*
+ VF_ElasticEnergyRowBatch_Kernel: accumulates in ElasticEnergy the elastic energy (VF_ElasticEnergy3D_local, 
+ no unilateral condition) of the row of cells (xs ... xe-1,ej,ek), VFCARTFE_BATCH neighbouring cells at a time.
+ The flops are added to *flops.
+ */
+extern void VF_ElasticEnergyRowBatch_Kernel(PetscReal *ElasticEnergy,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,PetscReal ***pressure_array,VFCtx *ctx,PetscInt ek,PetscInt ej,PetscInt xs,PetscInt xe,PetscLogDouble *flops)
+{
+  VFCartFEElement3D *e3D;
+  PetscInt          ei,nb;
+  PetscReal         ElasticEnergy_local;
+  
+  for (ei = xs; ei < xe; ei += nb) {
+    VFCartFEElementCacheGet3DBatch_Kernel(ctx->feCacheU,ei,ej,ek,xe,&e3D,&nb);
+    VF_ElasticEnergy3DBatch_Kernel(&ElasticEnergy_local,u_array,v_array,theta_array,thetaRef_array,pressure_array,
+                                   &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,nb,e3D,flops);
+    *ElasticEnergy += ElasticEnergy_local;
+  }
+}
+
 #undef __FUNCT__
-#define __FUNCT__ "VF_UEnergy3D"
+#define __FUNCT__ "VF_ElasticEnergyRowBatch_local"
 /*
- VF_UEnergy3D
- 
- (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+ VF_ElasticEnergyRowBatch_local: accumulates in ElasticEnergy the elastic energy (VF_ElasticEnergy3D_local, 
+ no unilateral condition) of the row of cells (xs ... xe-1,ej,ek), VFCARTFE_BATCH neighbouring cells at a time.
  */
-extern PetscErrorCode VF_UEnergy3D(PetscReal *ElasticEnergy,PetscReal *InsituWork,PetscReal *PressureWork,Vec U,VFCtx *ctx)
+extern PetscErrorCode VF_ElasticEnergyRowBatch_local(PetscReal *ElasticEnergy,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,PetscReal ***pressure_array,VFCtx *ctx,PetscInt ek,PetscInt ej,PetscInt xs,PetscInt xe)
+{
+  PetscErrorCode ierr;
+  PetscLogDouble flops = 0.;
+  
+  PetscFunctionBegin;
+  VF_ElasticEnergyRowBatch_Kernel(ElasticEnergy,u_array,v_array,theta_array,thetaRef_array,pressure_array,ctx,ek,ej,xs,xe,&flops);
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_InSituStressWorkCell_local"
+/*
+ VF_InSituStressWorkCell_local: accumulates in InsituWork the work of the in-situ stresses on the faces of the 
+ cell (ei,ej,ek) lying on the boundary of the domain. f_array is a local 3 components nodal array used as workspace.
+ */
+extern PetscErrorCode VF_InSituStressWorkCell_local(PetscReal *InsituWork,PetscReal ****u_array,PetscReal ****f_array,PetscReal ****coords_array,PetscReal *BBmin,PetscReal *BBmax,VFCtx *ctx,PetscInt nx,PetscInt ny,PetscInt nz,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e3D)
 {
   PetscErrorCode ierr;
-  PetscInt       xs,xm,nx;
-  PetscInt       ys,ym,ny;
-  PetscInt       zs,zm,nz;
-  PetscInt       ei,ej,ek;
   PetscInt       i,j,k,c;
-  Vec            u_localVec,v_localVec;
-  Vec            theta_localVec,thetaRef_localVec;
-  Vec            pressure_localVec;
-  PetscReal      ****u_array;
-  PetscReal      ***v_array;
-  PetscReal      ***theta_array;
-  PetscReal      ***thetaRef_array;
-  PetscReal      ***pressure_array;
-  PetscReal      myInsituWork,myPressureWork;
-  PetscReal      myElasticEnergy,myElasticEnergyLocal;
-  PetscReal      hx,hy,hz;
-  PetscReal      ****coords_array;
-  PetscReal      ****f_array;
-  Vec            f_localVec;
   FACE           face;
   PetscReal      z;
   int            stresscomp[3];
   PetscReal      stressdir[3];
   PetscReal      stressmag;
-  PetscReal      BBmin[3],BBmax[3];
   
   PetscFunctionBegin;
-  myElasticEnergy = 0.;
-  myInsituWork = 0.;
-  myPressureWork = 0.;
-  myElasticEnergyLocal = 0;
-  
-  ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
-                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
-  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  
   /*
-   Get coordinates
+   We need to reconstruct the external forces before computing their work.
+   This take a bit more effort
    */
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
+  if (ek == 0) {
+    /*
+     Face Z0
+     sigma.(0,0,-1) = (-s_13,-s_23,-s_33) = (-S4,-S3,-S2)
+     */
+    face          = Z0;
+    stresscomp[0] = 4; stressdir[0] = -1.;
+    stresscomp[1] = 3; stressdir[1] = -1.;
+    stresscomp[2] = 2; stressdir[2] = -1.;
+    for (c = 0; c < 3; c++) {
+      if (ctx->bcU[c].face[face] == NONE) {
+        for (k = 0; k < ctx->e3D.nphiz; k++) {
+          z         = coords_array[ek+k][ej][ei][2];
+          stressmag = stressdir[c] *
+          (ctx->insitumin[stresscomp[c]] + (z - BBmin[2]) / (BBmax[2] - BBmin[2])
+           * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
+          for (j = 0; j < ctx->e3D.nphiy; j++)
+            for (i = 0; i < ctx->e3D.nphix; i++)
+              f_array[ek+k][ej+j][ei+i][c] = stressmag;
+        }
+      }
+    }
+    ierr = VF_InSituStressWork3D_local(InsituWork,u_array,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
+  }
+
+  if (ek == nz-2) {
+    /*
+     Face Z1
+     sigma.(0,0,1) = (s_13,s_23,s_33) = (S4,S3,S2)
+     */
+    face          = Z1;
+    stresscomp[0] = 4; stressdir[0] = 1.;
+    stresscomp[1] = 3; stressdir[1] = 1.;
+    stresscomp[2] = 2; stressdir[2] = 1.;
+    for (c = 0; c < 3; c++) {
+      if (ctx->bcU[c].face[face] == NONE) {
+        for (k = 0; k < ctx->e3D.nphiz; k++) {
+          z         = coords_array[ek+k][ej][ei][2];
+          stressmag = stressdir[c] *
+          (ctx->insitumin[stresscomp[c]] + (z - BBmin[2]) / (BBmax[2] - BBmin[2])
+           * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
+          for (j = 0; j < ctx->e3D.nphiy; j++)
+            for (i = 0; i < ctx->e3D.nphix; i++)
+              f_array[ek+k][ej+j][ei+i][c] = stressmag;
+        }
+      }
+    }
+    ierr = VF_InSituStressWork3D_local(InsituWork,u_array,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
+  }
+
+  if (ej == 0) {
+    /*
+     Face Y0
+     sigma.(0,-1,0) = (-s_12,-s_22,-s_23) = (-S5,-S1,-S3)
+     */
+    face          = Y0;
+    stresscomp[0] = 5; stressdir[0] = -1.;
+    stresscomp[1] = 1; stressdir[1] = -1.;
+    stresscomp[2] = 3; stressdir[2] = -1.;
+    for (k = 0; k < ctx->e3D.nphiz; k++) {
+      for (j = 0; j < ctx->e3D.nphiy; j++) {
+        for (i = 0; i < ctx->e3D.nphix; i++) {
+          z = coords_array[ek+k][ej+j][ei+i][2];
+          for (c = 0; c < 3; c++) {
+            if (ctx->bcU[c].face[face] == NONE) {
+              f_array[ek+k][ej+j][ei+i][c] = stressdir[c] *
+              (ctx->insitumin[stresscomp[c]] +
+               (z - BBmin[2]) / (BBmax[2] - BBmin[2])
+               * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
+            }
+          }
+        }
+      }
+    }
+    ierr = VF_InSituStressWork3D_local(InsituWork,u_array,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
+  }
+
+  if (ej == ny-2) {
+    /*
+     Face Y1
+     sigma.(0,1,0) = (s_12,s_22,s_23) = (S5,S1,S3)
+     */
+    face          = Y1;
+    stresscomp[0] = 5; stressdir[0] = 1.;
+    stresscomp[1] = 1; stressdir[1] = 1.;
+    stresscomp[2] = 3; stressdir[2] = 1.;
+    for (k = 0; k < ctx->e3D.nphiz; k++) {
+      for (j = 0; j < ctx->e3D.nphiy; j++) {
+        for (i = 0; i < ctx->e3D.nphix; i++) {
+          z = coords_array[ek+k][ej+j][ei+i][2];
+          for (c = 0; c < 3; c++) {
+            if (ctx->bcU[c].face[face] == NONE) {
+              f_array[ek+k][ej+j][ei+i][c] = stressdir[c] *
+              (ctx->insitumin[stresscomp[c]] +
+               (z - BBmin[2]) / (BBmax[2] - BBmin[2])
+               * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
+            }
+          }
+        }
+      }
+    }
+    ierr = VF_InSituStressWork3D_local(InsituWork,u_array,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
+  }
+
+  if (ei == 0) {
+    /*
+     Face X0
+     sigma.(-1,0,0) = (-s_11,-s_12,-s_13) = (-S0,-S5,-S4)
+     */
+    face          = X0;
+    stresscomp[0] = 0; stressdir[0] = -1.;
+    stresscomp[1] = 5; stressdir[1] = -1.;
+    stresscomp[2] = 4; stressdir[2] = -1.;
+    for (k = 0; k < ctx->e3D.nphiz; k++) {
+      for (j = 0; j < ctx->e3D.nphiy; j++) {
+        for (i = 0; i < ctx->e3D.nphix; i++) {
+          z = coords_array[ek+k][ej+j][ei+i][2];
+          for (c = 0; c < 3; c++) {
+            if (ctx->bcU[c].face[face] == NONE) {
+              f_array[ek+k][ej+j][ei+i][c] = stressdir[c] *
+              (ctx->insitumin[stresscomp[c]] +
+               (z - BBmin[2]) / (BBmax[2] - BBmin[2])
+               * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
+            }
+          }
+        }
+      }
+    }
+    ierr = VF_InSituStressWork3D_local(InsituWork,u_array,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
+  }
+
+  if (ei == nx-2) {
+    /*
+     Face X1
+     sigma.(1,0,0) = (s_11,s_12,s_13) = (S0,S5,S4)
+     */
+    face          = X1;
+    stresscomp[0] = 0; stressdir[0] = 1.;
+    stresscomp[1] = 5; stressdir[1] = 1.;
+    stresscomp[2] = 4; stressdir[2] = 1.;
+    for (k = 0; k < ctx->e3D.nphiz; k++) {
+      for (j = 0; j < ctx->e3D.nphiy; j++) {
+        for (i = 0; i < ctx->e3D.nphix; i++) {
+          z = coords_array[ek+k][ej+j][ei+i][2];
+          for (c = 0; c < 3; c++) {
+            if (ctx->bcU[c].face[face] == NONE) {
+              f_array[ek+k][ej+j][ei+i][c] = stressdir[c] *
+              (ctx->insitumin[stresscomp[c]] +
+               (z - BBmin[2]) / (BBmax[2] - BBmin[2])
+               * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
+            }
+          }
+        }
+      }
+    }
+    ierr = VF_InSituStressWork3D_local(InsituWork,u_array,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UEnergy3D"
+/*
+ VF_UEnergy3D
+ 
+ (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+ */
+extern PetscErrorCode VF_UEnergy3D(PetscReal *ElasticEnergy,PetscReal *InsituWork,PetscReal *PressureWork,Vec U,VFCtx *ctx)
+{
+  PetscErrorCode ierr;
+  VFCartFEElement3D *e3D;
+  PetscInt       xs,xm,nx;
+  PetscInt       ys,ym,ny;
+  PetscInt       zs,zm,nz;
+  PetscInt       ei,ej,ek;
+  PetscLogDouble flops = 0.;
+  Vec            u_localVec,v_localVec;
+  Vec            theta_localVec,thetaRef_localVec;
+  Vec            pressure_localVec;
+  PetscReal      ****u_array;
+  PetscReal      ***v_array;
+  PetscReal      ***theta_array;
+  PetscReal      ***thetaRef_array;
+  PetscReal      ***pressure_array;
+  PetscReal      myInsituWork,myPressureWork;
+  PetscReal      myElasticEnergy,myElasticEnergyLocal;
+  PetscReal      myWork[3],Work[3];
+  PetscReal      ****coords_array;
+  PetscReal      ****f_array;
+  Vec            f_localVec;
+  PetscReal      BBmin[3],BBmax[3];
+  PetscBool      flg;
+  PetscReal      p;
+  
+  PetscFunctionBegin;
+  if (ctx->USuperposition) {
+    ierr = VF_USuperpositionIsCurrent(U,ctx,&flg);CHKERRQ(ierr);
+    if (flg) {
+      p              = ctx->USup.p;
+      *ElasticEnergy = ctx->USup.ElasticEnergy[0] + p * (ctx->USup.ElasticEnergy[1] + p * ctx->USup.ElasticEnergy[2]);
+      *InsituWork    = ctx->USup.InsituWork[0] + p * (ctx->USup.InsituWork[1] + p * ctx->USup.InsituWork[2]);
+      *PressureWork  = ctx->USup.PressureWork[0] + p * (ctx->USup.PressureWork[1] + p * ctx->USup.PressureWork[2]);
+      PetscFunctionReturn(0);
+    }
+  }
+  /*
+    Energies accumulated by VF_UResidual at the current U, if any
+  */
+  ierr = VF_UResidualEnergyIsCurrent(U,ctx,&flg);CHKERRQ(ierr);
+  if (flg) {
+    *ElasticEnergy = ctx->REnergy.UWork[0];
+    *PressureWork  = ctx->REnergy.UWork[1];
+    *InsituWork    = ctx->REnergy.UWork[2];
+    PetscFunctionReturn(0);
+  }
+  myElasticEnergy = 0.;
+  myInsituWork = 0.;
+  myPressureWork = 0.;
+  myElasticEnergyLocal = 0;
+  
+  ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
+                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  
+  /*
+   Get coordinates
+   */
+  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   /*
    Get bounding box from petsc DA
    */
@@ -1202,209 +1711,71 @@ extern PetscErrorCode VF_UEnergy3D(PetscReal *ElasticEnergy,PetscReal *InsituWor
   *ElasticEnergy = 0;
   *InsituWork    = 0;
   *PressureWork  = 0.;
+  if (ctx->unilateral == UNILATERAL_NONE) {
+    /*
+      The elastic energy is computed row by row, VFCARTFE_BATCH neighbouring cells at a time.
+      The rows are shared among the OpenMP threads, if any.
+    */
+    VFPragmaOMP(parallel for collapse(2) reduction(+:myElasticEnergy,flops))
+    for (ek = zs; ek < zs + zm; ek++) {
+      for (ej = ys; ej < ys+ym; ej++) {
+        VF_ElasticEnergyRowBatch_Kernel(&myElasticEnergy,u_array,v_array,theta_array,thetaRef_array,pressure_array,
+                                        ctx,ek,ej,xs,xs+xm,&flops);
+      }
+    }
+  }
+  if (ctx->hasCrackPressure) {
+    VFPragmaOMP(parallel for collapse(2) private(ei,e3D) reduction(+:myPressureWork,flops))
+    for (ek = zs; ek < zs + zm; ek++) {
+      for (ej = ys; ej < ys+ym; ej++) {
+        for (ei = xs; ei < xs+xm; ei++) {
+          VFCartFEElementCacheGet3D_Kernel(ctx->feCacheU,ei,ej,ek,&e3D);
+          VF_PressureWork3D_Kernel(&myPressureWork,u_array,v_array,pressure_array,
+                                   &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
+                                   ek,ej,ei,e3D,&flops);
+        }
+      }
+    }
+  }
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
   for (ek = zs; ek < zs + zm; ek++) {
     for (ej = ys; ej < ys+ym; ej++) {
       for (ei = xs; ei < xs+xm; ei++) {
-        hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCacheU,ei,ej,ek,&e3D);CHKERRQ(ierr);
 
         switch (ctx->unilateral) {
           case UNILATERAL_NONE:
-            ierr = VF_ElasticEnergy3D_local(&myElasticEnergyLocal,u_array,v_array,
-                                            theta_array,thetaRef_array,pressure_array,
-                                            &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
-                                            ek,ej,ei,&ctx->e3D);CHKERRQ(ierr);
+            /*
+              Already accounted for in the batched loop above
+            */
+            myElasticEnergyLocal = 0.;
             break;
           case UNILATERAL_NOCOMPRESSION:
             ierr = VF_ElasticEnergyNoCompression3D_local(&myElasticEnergyLocal,u_array,v_array,
                                             theta_array,thetaRef_array,pressure_array,
                                             &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
-                                            ek,ej,ei,&ctx->e3D);CHKERRQ(ierr);
+                                            ek,ej,ei,e3D);CHKERRQ(ierr);
             //ierr = VF_ElasticEnergy3D_local(&myElasticEnergyLocal,u_array,v_array,
             //                                theta_array,thetaRef_array,pressure_array,
             //                                &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
-            //                                ek,ej,ei,&ctx->e3D);CHKERRQ(ierr);
+            //                                ek,ej,ei,e3D);CHKERRQ(ierr);
             break;
         }
         myElasticEnergy += myElasticEnergyLocal;
-        if (ctx->hasCrackPressure) {
-          ierr = VF_PressureWork3D_local(&myPressureWork,u_array,v_array,pressure_array,
-                                         &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
-                                         ek,ej,ei,&ctx->e3D);CHKERRQ(ierr);
-        }
-        
         if (ctx->hasInsitu) {
-          /*
-           We need to reconstruct the external forces before computing their work.
-           This take a bit more effort
-           */
-          if (ek == 0) {
-            /*
-             Face Z0
-             sigma.(0,0,-1) = (-s_13,-s_23,-s_33) = (-S4,-S3,-S2)
-             */
-            face          = Z0;
-            stresscomp[0] = 4; stressdir[0] = -1.;
-            stresscomp[1] = 3; stressdir[1] = -1.;
-            stresscomp[2] = 2; stressdir[2] = -1.;
-            for (c = 0; c < 3; c++) {
-              if (ctx->bcU[c].face[face] == NONE) {
-                for (k = 0; k < ctx->e3D.nphiz; k++) {
-                  z         = coords_array[ek+k][ej][ei][2];
-                  stressmag = stressdir[c] *
-                  (ctx->insitumin[stresscomp[c]] + (z - BBmin[2]) / (BBmax[2] - BBmin[2])
-                   * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
-                  for (j = 0; j < ctx->e3D.nphiy; j++)
-                    for (i = 0; i < ctx->e3D.nphix; i++)
-                      f_array[ek+k][ej+j][ei+i][c] = stressmag;
-                }
-              }
-            }
-            ierr = VF_InSituStressWork3D_local(&myInsituWork,u_array,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
-          }
-          
-          if (ek == nz-2) {
-            /*
-             Face Z1
-             sigma.(0,0,1) = (s_13,s_23,s_33) = (S4,S3,S2)
-             */
-            face          = Z1;
-            stresscomp[0] = 4; stressdir[0] = 1.;
-            stresscomp[1] = 3; stressdir[1] = 1.;
-            stresscomp[2] = 2; stressdir[2] = 1.;
-            for (c = 0; c < 3; c++) {
-              if (ctx->bcU[c].face[face] == NONE) {
-                for (k = 0; k < ctx->e3D.nphiz; k++) {
-                  z         = coords_array[ek+k][ej][ei][2];
-                  stressmag = stressdir[c] *
-                  (ctx->insitumin[stresscomp[c]] + (z - BBmin[2]) / (BBmax[2] - BBmin[2])
-                   * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
-                  for (j = 0; j < ctx->e3D.nphiy; j++)
-                    for (i = 0; i < ctx->e3D.nphix; i++)
-                      f_array[ek+k][ej+j][ei+i][c] = stressmag;
-                }
-              }
-            }
-            ierr = VF_InSituStressWork3D_local(&myInsituWork,u_array,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
-          }
-          
-          if (ej == 0) {
-            /*
-             Face Y0
-             sigma.(0,-1,0) = (-s_12,-s_22,-s_23) = (-S5,-S1,-S3)
-             */
-            face          = Y0;
-            stresscomp[0] = 5; stressdir[0] = -1.;
-            stresscomp[1] = 1; stressdir[1] = -1.;
-            stresscomp[2] = 3; stressdir[2] = -1.;
-            for (k = 0; k < ctx->e3D.nphiz; k++) {
-              for (j = 0; j < ctx->e3D.nphiy; j++) {
-                for (i = 0; i < ctx->e3D.nphix; i++) {
-                  z = coords_array[ek+k][ej+j][ei+i][2];
-                  for (c = 0; c < 3; c++) {
-                    if (ctx->bcU[c].face[face] == NONE) {
-                      f_array[ek+k][ej+j][ei+i][c] = stressdir[c] *
-                      (ctx->insitumin[stresscomp[c]] +
-                       (z - BBmin[2]) / (BBmax[2] - BBmin[2])
-                       * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
-                    }
-                  }
-                }
-              }
-            }
-            ierr = VF_InSituStressWork3D_local(&myInsituWork,u_array,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
-          }
-          
-          if (ej == ny-2) {
-            /*
-             Face Y1
-             sigma.(0,1,0) = (s_12,s_22,s_23) = (S5,S1,S3)
-             */
-            face          = Y1;
-            stresscomp[0] = 5; stressdir[0] = 1.;
-            stresscomp[1] = 1; stressdir[1] = 1.;
-            stresscomp[2] = 3; stressdir[2] = 1.;
-            for (k = 0; k < ctx->e3D.nphiz; k++) {
-              for (j = 0; j < ctx->e3D.nphiy; j++) {
-                for (i = 0; i < ctx->e3D.nphix; i++) {
-                  z = coords_array[ek+k][ej+j][ei+i][2];
-                  for (c = 0; c < 3; c++) {
-                    if (ctx->bcU[c].face[face] == NONE) {
-                      f_array[ek+k][ej+j][ei+i][c] = stressdir[c] *
-                      (ctx->insitumin[stresscomp[c]] +
-                       (z - BBmin[2]) / (BBmax[2] - BBmin[2])
-                       * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
-                    }
-                  }
-                }
-              }
-            }
-            ierr = VF_InSituStressWork3D_local(&myInsituWork,u_array,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
-          }
-          
-          if (ei == 0) {
-            /*
-             Face X0
-             sigma.(-1,0,0) = (-s_11,-s_12,-s_13) = (-S0,-S5,-S4)
-             */
-            face          = X0;
-            stresscomp[0] = 0; stressdir[0] = -1.;
-            stresscomp[1] = 5; stressdir[1] = -1.;
-            stresscomp[2] = 4; stressdir[2] = -1.;
-            for (k = 0; k < ctx->e3D.nphiz; k++) {
-              for (j = 0; j < ctx->e3D.nphiy; j++) {
-                for (i = 0; i < ctx->e3D.nphix; i++) {
-                  z = coords_array[ek+k][ej+j][ei+i][2];
-                  for (c = 0; c < 3; c++) {
-                    if (ctx->bcU[c].face[face] == NONE) {
-                      f_array[ek+k][ej+j][ei+i][c] = stressdir[c] *
-                      (ctx->insitumin[stresscomp[c]] +
-                       (z - BBmin[2]) / (BBmax[2] - BBmin[2])
-                       * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
-                    }
-                  }
-                }
-              }
-            }
-            ierr = VF_InSituStressWork3D_local(&myInsituWork,u_array,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
-          }
-          
-          if (ei == nx-2) {
-            /*
-             Face X1
-             sigma.(1,0,0) = (s_11,s_12,s_13) = (S0,S5,S4)
-             */
-            face          = X1;
-            stresscomp[0] = 0; stressdir[0] = 1.;
-            stresscomp[1] = 5; stressdir[1] = 1.;
-            stresscomp[2] = 4; stressdir[2] = 1.;
-            for (k = 0; k < ctx->e3D.nphiz; k++) {
-              for (j = 0; j < ctx->e3D.nphiy; j++) {
-                for (i = 0; i < ctx->e3D.nphix; i++) {
-                  z = coords_array[ek+k][ej+j][ei+i][2];
-                  for (c = 0; c < 3; c++) {
-                    if (ctx->bcU[c].face[face] == NONE) {
-                      f_array[ek+k][ej+j][ei+i][c] = stressdir[c] *
-                      (ctx->insitumin[stresscomp[c]] +
-                       (z - BBmin[2]) / (BBmax[2] - BBmin[2])
-                       * (ctx->insitumax[stresscomp[c]] - ctx->insitumin[stresscomp[c]]));
-                    }
-                  }
-                }
-              }
-            }
-            ierr = VF_InSituStressWork3D_local(&myInsituWork,u_array,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
-          }
+          ierr = VF_InSituStressWorkCell_local(&myInsituWork,u_array,f_array,coords_array,BBmin,BBmax,ctx,nx,ny,nz,ek,ej,ei,e3D);CHKERRQ(ierr);
         }
       }
     }
   }
   
-  ierr = MPI_Allreduce(&myElasticEnergy,ElasticEnergy,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
-  ierr = MPI_Allreduce(&myPressureWork,PressureWork,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
-  ierr = MPI_Allreduce(&myInsituWork,InsituWork,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  myWork[0] = myElasticEnergy;
+  myWork[1] = myPressureWork;
+  myWork[2] = myInsituWork;
+  ierr = MPI_Allreduce(myWork,Work,3,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  *ElasticEnergy = Work[0];
+  *PressureWork  = Work[1];
+  *InsituWork    = Work[2];
 
   ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   
@@ -1427,20 +1798,21 @@ extern PetscErrorCode VF_UEnergy3D(PetscReal *ElasticEnergy,PetscReal *InsituWor
 }
 
 #undef __FUNCT__
-#define __FUNCT__ "VF_StepU"
+#define __FUNCT__ "VF_USolve"
 /*
- VF_StepU
- 
- (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+ VF_USolve: solves the U problem in U, using U as initial guess
  */
-extern PetscErrorCode VF_StepU(VFFields *fields,VFCtx *ctx)
+static PetscErrorCode VF_USolve(Vec U,VFCtx *ctx)
 {
   PetscErrorCode      ierr;
   SNESConvergedReason  reason;
   PetscInt            its;
   
   PetscFunctionBegin;
-  ierr = SNESSolve(ctx->snesU,NULL,fields->U);CHKERRQ(ierr);
+  ierr = SNESSolve(ctx->snesU,NULL,U);CHKERRQ(ierr);
+  if (ctx->residualEnergy) {
+    ierr = VF_UResidualEnergyAttach(U,ctx);CHKERRQ(ierr);
+  }
   ierr = SNESGetConvergedReason(ctx->snesU,&reason);CHKERRQ(ierr);
   if (reason < 0) {
     ierr = PetscPrintf(PETSC_COMM_WORLD,"[ERROR] snesU diverged with reason %d\n",(int)reason);CHKERRQ(ierr);
@@ -1451,6 +1823,351 @@ extern PetscErrorCode VF_StepU(VFFields *fields,VFCtx *ctx)
   PetscFunctionReturn(0);
 }
 
+#undef __FUNCT__
+#define __FUNCT__ "VF_USuperpositionIsCurrent"
+/*
+ VF_USuperpositionIsCurrent: flg is PETSC_TRUE if U is fields->U as last set by superposition, 
+ with pressure, V, theta and BC unchanged since. The crack volume and energies can then be computed by superposition.
+ */
+extern PetscErrorCode VF_USuperpositionIsCurrent(Vec U,VFCtx *ctx,PetscBool *flg)
+{
+  PetscErrorCode   ierr;
+  VFUSuperposition *sup = &ctx->USup;
+  PetscObjectState Ustate,pressurestate,Vstate,thetastate,thetaRefstate;
+  
+  PetscFunctionBegin;
+  *flg = PETSC_FALSE;
+  if (!sup->valid || U != ctx->fields->U || sup->timestep != ctx->timestep ||
+      sup->hasCrackPressure != ctx->hasCrackPressure || sup->hasInsitu != ctx->hasInsitu) PetscFunctionReturn(0);
+  ierr = PetscObjectStateGet((PetscObject)U,&Ustate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->pressure,&pressurestate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->V,&Vstate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->theta,&thetastate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->thetaRef,&thetaRefstate);CHKERRQ(ierr);
+  *flg = (PetscBool)(Ustate == sup->Ustate && pressurestate == sup->pressurestate && Vstate == sup->Vstate &&
+                     thetastate == sup->thetastate && thetaRefstate == sup->thetaRefstate);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UResidualEnergySet"
+/*
+ VF_UResidualEnergySet: records the local energies accumulated by VF_UResidual at U, and the state of its other inputs
+ */
+extern PetscErrorCode VF_UResidualEnergySet(Vec U,PetscReal ElasticEnergy,PetscReal PressureWork,PetscReal InsituWork,VFCtx *ctx)
+{
+  PetscErrorCode   ierr;
+  VFResidualEnergy *re = &ctx->REnergy;
+  
+  PetscFunctionBegin;
+  if (!re->U) {
+    ierr = VecDuplicate(U,&re->U);CHKERRQ(ierr);
+  }
+  ierr = VecCopy(U,re->U);CHKERRQ(ierr);
+  re->Uvalid     = PETSC_FALSE;
+  re->myUWork[0] = ElasticEnergy;
+  re->myUWork[1] = PressureWork;
+  re->myUWork[2] = InsituWork;
+  re->hasCrackPressure = ctx->hasCrackPressure;
+  re->hasInsitu        = ctx->hasInsitu;
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->V,&re->UVstate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->pressure,&re->pressurestate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->theta,&re->thetastate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->thetaRef,&re->thetaRefstate);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UResidualEnergyAttach"
+/*
+ VF_UResidualEnergyAttach: attaches the energies of the last VF_UResidual evaluation to U (fields->U after a solve), 
+ provided that the residual was evaluated at U.
+ */
+extern PetscErrorCode VF_UResidualEnergyAttach(Vec U,VFCtx *ctx)
+{
+  PetscErrorCode   ierr;
+  VFResidualEnergy *re = &ctx->REnergy;
+  PetscBool        flg;
+  
+  PetscFunctionBegin;
+  re->Uvalid = PETSC_FALSE;
+  if (!re->U || U != ctx->fields->U) PetscFunctionReturn(0);
+  ierr = VecEqual(re->U,U,&flg);CHKERRQ(ierr);
+  if (!flg) PetscFunctionReturn(0);
+  ierr = MPI_Allreduce(re->myUWork,re->UWork,3,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)U,&re->Ustate);CHKERRQ(ierr);
+  re->Uvalid = PETSC_TRUE;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UResidualEnergyIsCurrent"
+/*
+ VF_UResidualEnergyIsCurrent: flg is PETSC_TRUE if the energies attached by VF_UResidualEnergyAttach are those of U,
+ i.e. U is fields->U and neither U nor V, pressure and theta changed since.
+ */
+extern PetscErrorCode VF_UResidualEnergyIsCurrent(Vec U,VFCtx *ctx,PetscBool *flg)
+{
+  PetscErrorCode   ierr;
+  VFResidualEnergy *re = &ctx->REnergy;
+  PetscObjectState Ustate,pressurestate,Vstate,thetastate,thetaRefstate;
+  
+  PetscFunctionBegin;
+  *flg = PETSC_FALSE;
+  if (!ctx->residualEnergy || !re->Uvalid || U != ctx->fields->U ||
+      re->hasCrackPressure != ctx->hasCrackPressure || re->hasInsitu != ctx->hasInsitu) PetscFunctionReturn(0);
+  ierr = PetscObjectStateGet((PetscObject)U,&Ustate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->pressure,&pressurestate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->V,&Vstate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->theta,&thetastate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)ctx->fields->thetaRef,&thetaRefstate);CHKERRQ(ierr);
+  *flg = (PetscBool)(Ustate == re->Ustate && pressurestate == re->pressurestate && Vstate == re->UVstate &&
+                     thetastate == re->thetastate && thetaRefstate == re->thetaRefstate);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_VResidualEnergySet"
+/*
+ VF_VResidualEnergySet: records the local surface energy accumulated by VF_VResidual at V
+ */
+extern PetscErrorCode VF_VResidualEnergySet(Vec V,PetscReal SurfaceEnergy,VFCtx *ctx)
+{
+  PetscErrorCode   ierr;
+  VFResidualEnergy *re = &ctx->REnergy;
+  
+  PetscFunctionBegin;
+  if (!re->V) {
+    ierr = VecDuplicate(V,&re->V);CHKERRQ(ierr);
+  }
+  ierr = VecCopy(V,re->V);CHKERRQ(ierr);
+  re->Vvalid          = PETSC_FALSE;
+  re->mySurfaceEnergy = SurfaceEnergy;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_VResidualEnergyAttach"
+/*
+ VF_VResidualEnergyAttach: attaches the surface energy of the last VF_VResidual evaluation to V (fields->V after a solve), 
+ provided that the residual was evaluated at V.
+ */
+extern PetscErrorCode VF_VResidualEnergyAttach(Vec V,VFCtx *ctx)
+{
+  PetscErrorCode   ierr;
+  VFResidualEnergy *re = &ctx->REnergy;
+  PetscBool        flg;
+  
+  PetscFunctionBegin;
+  re->Vvalid = PETSC_FALSE;
+  if (!re->V || V != ctx->fields->V) PetscFunctionReturn(0);
+  ierr = VecEqual(re->V,V,&flg);CHKERRQ(ierr);
+  if (!flg) PetscFunctionReturn(0);
+  ierr = MPI_Allreduce(&re->mySurfaceEnergy,&re->SurfaceEnergy,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)V,&re->Vstate);CHKERRQ(ierr);
+  re->Vvalid = PETSC_TRUE;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_VResidualEnergyIsCurrent"
+/*
+ VF_VResidualEnergyIsCurrent: flg is PETSC_TRUE if the surface energy attached by VF_VResidualEnergyAttach is the one of V
+ */
+extern PetscErrorCode VF_VResidualEnergyIsCurrent(Vec V,VFCtx *ctx,PetscBool *flg)
+{
+  PetscErrorCode   ierr;
+  VFResidualEnergy *re = &ctx->REnergy;
+  PetscObjectState Vstate;
+  
+  PetscFunctionBegin;
+  *flg = PETSC_FALSE;
+  if (!ctx->residualEnergy || !re->Vvalid || V != ctx->fields->V) PetscFunctionReturn(0);
+  ierr = PetscObjectStateGet((PetscObject)V,&Vstate);CHKERRQ(ierr);
+  *flg = (PetscBool)(Vstate == re->Vstate);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_USuperpositionSetUp"
+/*
+ VF_USuperpositionSetUp: computes the responses U0 (p=0) and U1 (U(p=1)-U0) for the current V, theta and BC,
+ then the crack volume and energies as polynomials in p from their values at p=0, 1, -1.
+ fields->U and fields->pressure are overwritten.
+ */
+static PetscErrorCode VF_USuperpositionSetUp(VFFields *fields,VFCtx *ctx)
+{
+  PetscErrorCode   ierr;
+  VFUSuperposition *sup = &ctx->USup;
+  PetscReal        vol[2],E[3],W[3],PW[3];
+  
+  PetscFunctionBegin;
+  sup->valid = PETSC_FALSE;
+  if (!sup->U0) {
+    ierr = VecDuplicate(fields->U,&sup->U0);CHKERRQ(ierr);
+    ierr = VecDuplicate(fields->U,&sup->U1);CHKERRQ(ierr);
+    ierr = VecDuplicate(fields->VolCrackOpening,&sup->VolCrackOpening0);CHKERRQ(ierr);
+    ierr = VecDuplicate(fields->VolCrackOpening,&sup->VolCrackOpening1);CHKERRQ(ierr);
+    ierr = VecCopy(fields->U,sup->U0);CHKERRQ(ierr);
+    ierr = VecSet(sup->U1,0.);CHKERRQ(ierr);
+  }
+  /*
+   Zero pressure response, starting from the previous one
+   */
+  if (ctx->verbose > 0) {
+    ierr = PetscPrintf(PETSC_COMM_WORLD,"      Computing the zero and unit pressure U responses\n");CHKERRQ(ierr);
+  }
+  ierr = VecSet(fields->pressure,0.);CHKERRQ(ierr);
+  ierr = VF_USolve(sup->U0,ctx);CHKERRQ(ierr);
+  ierr = VecCopy(sup->U0,fields->U);CHKERRQ(ierr);
+  ierr = VolumetricCrackOpening(&vol[0],ctx,fields);CHKERRQ(ierr);
+  ierr = VecCopy(fields->VolCrackOpening,sup->VolCrackOpening0);CHKERRQ(ierr);
+  ierr = VF_UEnergy3D(&E[0],&W[0],&PW[0],fields->U,ctx);CHKERRQ(ierr);
+  /*
+   Unit pressure response, starting from U0 + the previous U1
+   */
+  ierr = VecSet(fields->pressure,1.);CHKERRQ(ierr);
+  ierr = VecAXPY(sup->U1,1.,sup->U0);CHKERRQ(ierr);
+  ierr = VF_USolve(sup->U1,ctx);CHKERRQ(ierr);
+  ierr = VecCopy(sup->U1,fields->U);CHKERRQ(ierr);
+  ierr = VolumetricCrackOpening(&vol[1],ctx,fields);CHKERRQ(ierr);
+  ierr = VecWAXPY(sup->VolCrackOpening1,-1.,sup->VolCrackOpening0,fields->VolCrackOpening);CHKERRQ(ierr);
+  ierr = VF_UEnergy3D(&E[1],&W[1],&PW[1],fields->U,ctx);CHKERRQ(ierr);
+  ierr = VecAXPY(sup->U1,-1.,sup->U0);CHKERRQ(ierr);
+  /*
+   p = -1 closes the quadratic fit of the energies
+   */
+  ierr = VecSet(fields->pressure,-1.);CHKERRQ(ierr);
+  ierr = VecWAXPY(fields->U,-1.,sup->U1,sup->U0);CHKERRQ(ierr);
+  ierr = VF_UEnergy3D(&E[2],&W[2],&PW[2],fields->U,ctx);CHKERRQ(ierr);
+  
+  sup->CrackVolume[0]   = vol[0];
+  sup->CrackVolume[1]   = vol[1] - vol[0];
+  sup->ElasticEnergy[0] = E[0];
+  sup->ElasticEnergy[1] = (E[1] - E[2]) * .5;
+  sup->ElasticEnergy[2] = (E[1] + E[2]) * .5 - E[0];
+  sup->InsituWork[0]    = W[0];
+  sup->InsituWork[1]    = (W[1] - W[2]) * .5;
+  sup->InsituWork[2]    = (W[1] + W[2]) * .5 - W[0];
+  sup->PressureWork[0]  = PW[0];
+  sup->PressureWork[1]  = (PW[1] - PW[2]) * .5;
+  sup->PressureWork[2]  = (PW[1] + PW[2]) * .5 - PW[0];
+  
+  sup->timestep         = ctx->timestep;
+  sup->hasCrackPressure = ctx->hasCrackPressure;
+  sup->hasInsitu        = ctx->hasInsitu;
+  ierr = PetscObjectStateGet((PetscObject)fields->V,&sup->Vstate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)fields->theta,&sup->thetastate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)fields->thetaRef,&sup->thetaRefstate);CHKERRQ(ierr);
+  sup->valid = PETSC_TRUE;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_USuperpositionDestroy"
+extern PetscErrorCode VF_USuperpositionDestroy(VFCtx *ctx)
+{
+  PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  ierr = VecDestroy(&ctx->USup.U0);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->USup.U1);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->USup.VolCrackOpening0);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->USup.VolCrackOpening1);CHKERRQ(ierr);
+  ctx->USup.valid = PETSC_FALSE;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_StepUSuperposition"
+/*
+ VF_StepUSuperposition: U = U0 + p U1 for the uniform pressure p, 
+ recomputing U0 and U1 only when V, theta, the time step or the loading changed.
+ */
+static PetscErrorCode VF_StepUSuperposition(VFFields *fields,VFCtx *ctx,PetscReal p)
+{
+  PetscErrorCode   ierr;
+  VFUSuperposition *sup = &ctx->USup;
+  PetscObjectState Vstate,thetastate,thetaRefstate;
+  
+  PetscFunctionBegin;
+  ierr = PetscObjectStateGet((PetscObject)fields->V,&Vstate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)fields->theta,&thetastate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)fields->thetaRef,&thetaRefstate);CHKERRQ(ierr);
+  if (!sup->valid || sup->timestep != ctx->timestep || 
+      sup->hasCrackPressure != ctx->hasCrackPressure || sup->hasInsitu != ctx->hasInsitu ||
+      Vstate != sup->Vstate || thetastate != sup->thetastate || thetaRefstate != sup->thetaRefstate) {
+    ierr = VF_USuperpositionSetUp(fields,ctx);CHKERRQ(ierr);
+    ierr = VecSet(fields->pressure,p);CHKERRQ(ierr);
+  }
+  ierr = VecWAXPY(fields->U,p,sup->U1,sup->U0);CHKERRQ(ierr);
+  sup->p = p;
+  ierr = PetscObjectStateGet((PetscObject)fields->U,&sup->Ustate);CHKERRQ(ierr);
+  ierr = PetscObjectStateGet((PetscObject)fields->pressure,&sup->pressurestate);CHKERRQ(ierr);
+  if (ctx->verbose > 0) {
+    ierr = PetscPrintf(PETSC_COMM_WORLD,"      U by superposition for pressure %e\n",p);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_StepU"
+/*
+ VF_StepU
+ 
+ (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+ */
+extern PetscErrorCode VF_StepU(VFFields *fields,VFCtx *ctx)
+{
+  PetscErrorCode      ierr;
+  PetscReal           pmin,pmax;
+  
+  PetscFunctionBegin;
+  if (ctx->USuperposition && ctx->unilateral == UNILATERAL_NONE) {
+    /*
+      The problem is then affine in the pressure, which makes superposition exact for a uniform pressure
+    */
+    ierr = VecMin(fields->pressure,NULL,&pmin);CHKERRQ(ierr);
+    ierr = VecMax(fields->pressure,NULL,&pmax);CHKERRQ(ierr);
+    if (pmin == pmax) {
+      ierr = VF_StepUSuperposition(fields,ctx,pmax);CHKERRQ(ierr);
+      PetscFunctionReturn(0);
+    }
+  }
+  ierr = VF_USolve(fields->U,ctx);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/*
+ VF_UResidualRowBatch_Kernel: accumulates in residual_array the action of the bilinear form VF_ResidualU3D_local 
+ (no unilateral condition) on the row of cells (xs ... xe-1,ej,ek), VFCARTFE_BATCH neighbouring cells at a time.
+ Only the nodes (*,ej..ej+1,ek..ek+1) are written. The flops are added to *flops.
+ */
+static void VF_UResidualRowBatch_Kernel(PetscReal ****residual_array,PetscReal ****u_array,PetscReal ***v_array,VFCtx *ctx,PetscInt ek,PetscInt ej,PetscInt xs,PetscInt xe,PetscLogDouble *flops)
+{
+  VFCartFEElement3D *e3D;
+  PetscInt          ei,nb,b,i,j,k,c,l;
+  PetscReal         residual_local[24*VFCARTFE_BATCH];
+  
+  for (ei = xs; ei < xe; ei += nb) {
+    VFCartFEElementCacheGet3DBatch_Kernel(ctx->feCacheU,ei,ej,ek,xe,&e3D,&nb);
+    for (l = 0; l < 24 * VFCARTFE_BATCH; l++) residual_local[l] = 0.;
+    VF_ResidualU3DBatch_Kernel(residual_local,u_array,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
+                               ek,ej,ei,nb,e3D,flops);
+    for (l = 0,k = 0; k < e3D->nphiz; k++) {
+      for (j = 0; j < e3D->nphiy; j++) {
+        for (i = 0; i < e3D->nphix; i++) {
+          for (c = 0; c < 3; c++,l++) {
+            for (b = 0; b < nb; b++) {
+              residual_array[ek+k][ej+j][ei+b+i][c] += residual_local[l*VFCARTFE_BATCH+b];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
 #undef __FUNCT__
 #define __FUNCT__ "VF_UResidual"
 extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
@@ -1458,10 +2175,12 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
   VFCtx          *ctx=(VFCtx*)user;
 
   PetscErrorCode ierr;
+  VFCartFEElement3D *e3D;
   PetscInt       xs,xm,nx;
   PetscInt       ys,ym,ny;
   PetscInt       zs,zm,nz;
-  PetscInt       ei,ej,ek;
+  PetscInt       ei,ej,ek,color;
+  PetscLogDouble flops = 0.;
   PetscInt       i,j,k,c,l;
   PetscInt       i1,j1,k1,c1;
   PetscInt       i2,j2,k2,c2;
@@ -1474,7 +2193,6 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
   PetscReal      ***theta_array,***thetaRef_array;
   PetscReal      ***pressure_array;
   PetscReal      *residual_local,*bilinearForm_local;
-  PetscReal      hx,hy,hz;
   PetscReal      ****coords_array;
   PetscReal      ****f_array;
   Vec            f_localVec;
@@ -1484,6 +2202,8 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
   PetscReal      stressdir[3];
   PetscReal      stressmag;
   PetscReal      BBmin[3],BBmax[3];
+  PetscReal      myElasticEnergy = 0.,myEnergyLocal;
+  PetscReal      myPressureWork = 0.,myInsituWork = 0.;
   
   PetscFunctionBegin;
   ierr = VecSet(residual,0.0);CHKERRQ(ierr);
@@ -1538,6 +2258,7 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
    */
   if (ctx->hasInsitu) {
     ierr = DMGetLocalVector(ctx->daVect,&f_localVec);CHKERRQ(ierr);
+    ierr = VecSet(f_localVec,0.);CHKERRQ(ierr);
     ierr = DMDAVecGetArrayDOF(ctx->daVect,f_localVec,&f_array);CHKERRQ(ierr);
   }
   /*
@@ -1549,50 +2270,69 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
   ierr = VecSet(residual_localVec,0.);CHKERRQ(ierr);
   ierr = DMDAVecGetArrayDOF(ctx->daVect,residual_localVec,&residual_array);CHKERRQ(ierr);
  
+  if (ctx->unilateral == UNILATERAL_NONE) {
+    /*
+      The bilinear form does not depend on U, so its action is evaluated directly at the integration points, 
+      without building the element matrix, row by row, VFCARTFE_BATCH neighbouring cells at a time.
+      Rows with the same parity of ej and ek share no node, so each of the 4 colors is shared among the 
+      OpenMP threads, if any. With -residual_energy, the elastic energy of the row is accumulated in the same pass.
+    */
+    for (color = 0; color < 4; color++) {
+      VFPragmaOMP(parallel for collapse(2) reduction(+:myElasticEnergy,flops))
+      for (ek = zs + color / 2; ek < zs + zm; ek += 2) {
+        for (ej = ys + color % 2; ej < ys+ym; ej += 2) {
+          VF_UResidualRowBatch_Kernel(residual_array,u_array,v_array,ctx,ek,ej,xs,xs+xm,&flops);
+          if (ctx->residualEnergy) {
+            VF_ElasticEnergyRowBatch_Kernel(&myElasticEnergy,u_array,v_array,theta_array,thetaRef_array,pressure_array,
+                                            ctx,ek,ej,xs,xs+xm,&flops);
+          }
+        }
+      }
+    }
+    ierr = PetscLogFlops(flops);CHKERRQ(ierr);
+  }
   /*
    loop through all elements (ei,ej)
    */
   for (ek = zs; ek < zs + zm; ek++) {
     for (ej = ys; ej < ys+ym; ej++) {
       for (ei = xs; ei < xs+xm; ei++) {
-        hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCacheU,ei,ej,ek,&e3D);CHKERRQ(ierr);
         /*
           Compute and accumulate the local contribution of the bilinear form
         */
-        for (l = 0; l < nrow * nrow; l++) bilinearForm_local[l] = 0.;
         switch (ctx->unilateral) {
           case UNILATERAL_NONE:
-            ierr = VF_BilinearFormU3D_local(bilinearForm_local,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
-                                   ek,ej,ei,&ctx->e3D);
+            /*
+              Already accounted for in the batched loop above
+            */
             break;
           case UNILATERAL_NOCOMPRESSION:
+            for (l = 0; l < nrow * nrow; l++) bilinearForm_local[l] = 0.;
             ierr = VF_BilinearFormUNoCompression3D_local(bilinearForm_local,u_array,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
-                                            ek,ej,ei,&ctx->e3D);
-            break;
-        }
-        /*
-          Accumulate residual += BilinearForm . U in local indexing
-          Note that the local indexing for matrices and arrays are different...
-        */
-        for (l = 0,k1 = 0; k1 < ctx->e3D.nphiz; k1++) {
-          for (j1 = 0; j1 < ctx->e3D.nphiy; j1++) {
-            for (i1 = 0; i1 < ctx->e3D.nphix; i1++) {
-              for (c1 = 0; c1 < ctx->e3D.dim; c1++) {
-                for (k2 = 0; k2 < ctx->e3D.nphiz; k2++) {
-                  for (j2 = 0; j2 < ctx->e3D.nphiy; j2++) {
-                    for (i2 = 0; i2 < ctx->e3D.nphix; i2++) {
-                      for (c2 = 0; c2 < ctx->e3D.dim; c2++,l++) {
-                        residual_array[ek+k1][ej+j1][ei+i1][c1] += bilinearForm_local[l] * u_array[ek+k2][ej+j2][ei+i2][c2];
+                                            ek,ej,ei,e3D);
+            /*
+              Accumulate residual += BilinearForm . U in local indexing
+              Note that the local indexing for matrices and arrays are different...
+            */
+            for (l = 0,k1 = 0; k1 < ctx->e3D.nphiz; k1++) {
+              for (j1 = 0; j1 < ctx->e3D.nphiy; j1++) {
+                for (i1 = 0; i1 < ctx->e3D.nphix; i1++) {
+                  for (c1 = 0; c1 < ctx->e3D.dim; c1++) {
+                    for (k2 = 0; k2 < ctx->e3D.nphiz; k2++) {
+                      for (j2 = 0; j2 < ctx->e3D.nphiy; j2++) {
+                        for (i2 = 0; i2 < ctx->e3D.nphix; i2++) {
+                          for (c2 = 0; c2 < ctx->e3D.dim; c2++,l++) {
+                            residual_array[ek+k1][ej+j1][ei+i1][c1] += bilinearForm_local[l] * u_array[ek+k2][ej+j2][ei+i2][c2];
+                          }
+                        }
                       }
                     }
                   }
                 }
               }
             }
-          }
+            break;
         }
         /*
          Compute and accumulate the local contribution of the effective strain contribution to the global RHS
@@ -1602,17 +2342,17 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
           case UNILATERAL_NONE:
             ierr = VF_GradientUThermoPoro3D_local(residual_local,v_array,theta_array,thetaRef_array,pressure_array,
                                            &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
-                                           ek,ej,ei,&ctx->e3D);CHKERRQ(ierr);
+                                           ek,ej,ei,e3D);CHKERRQ(ierr);
             break;
           case UNILATERAL_NOCOMPRESSION:
             ierr = VF_GradientUThermoPoroNoCompression3D_local(residual_local,u_array,v_array,theta_array,thetaRef_array,
                                                     pressure_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
-                                                    ek,ej,ei,&ctx->e3D);CHKERRQ(ierr);
+                                                    ek,ej,ei,e3D);CHKERRQ(ierr);
             break;
         }
         if (ctx->hasCrackPressure) {
           ierr = VF_GradientUCrackPressure3D_local(residual_local,v_array,pressure_array,
-                                                    &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,&ctx->e3D);CHKERRQ(ierr);
+                                                    &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3D);CHKERRQ(ierr);
         }
         for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
           for (j = 0; j < ctx->e3D.nphiy; j++) {
@@ -1650,7 +2390,7 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
                 }
               }
             }
-            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
+            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
             for (l= 0,k = 0; k < ctx->e3D.nphiz; k++) {
               for (j = 0; j < ctx->e3D.nphiy; j++) {
                 for (i = 0; i < ctx->e3D.nphix; i++) {
@@ -1686,7 +2426,7 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
                 }
               }
             }
-            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
+            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
             for (l= 0,k = 0; k < ctx->e3D.nphiz; k++) {
               for (j = 0; j < ctx->e3D.nphiy; j++) {
                 for (i = 0; i < ctx->e3D.nphix; i++) {
@@ -1723,7 +2463,7 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
                 }
               }
             }
-            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
+            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
             for (l= 0,k = 0; k < ctx->e3D.nphiz; k++) {
               for (j = 0; j < ctx->e3D.nphiy; j++) {
                 for (i = 0; i < ctx->e3D.nphix; i++) {
@@ -1759,7 +2499,7 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
                 }
               }
             }
-            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
+            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
             for (l= 0,k = 0; k < ctx->e3D.nphiz; k++) {
               for (j = 0; j < ctx->e3D.nphiy; j++) {
                 for (i = 0; i < ctx->e3D.nphix; i++) {
@@ -1796,7 +2536,7 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
                 }
               }
             }
-            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
+            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
             for (l= 0,k = 0; k < ctx->e3D.nphiz; k++) {
               for (j = 0; j < ctx->e3D.nphiy; j++) {
                 for (i = 0; i < ctx->e3D.nphix; i++) {
@@ -1833,7 +2573,7 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
                 }
               }
             }
-            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,&ctx->e3D);CHKERRQ(ierr);
+            ierr = VF_GradientUInSituStresses3D_local(residual_local,f_array,ek,ej,ei,face,e3D);CHKERRQ(ierr);
             for (l= 0,k = 0; k < ctx->e3D.nphiz; k++) {
               for (j = 0; j < ctx->e3D.nphiy; j++) {
                 for (i = 0; i < ctx->e3D.nphix; i++) {
@@ -1846,6 +2586,23 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
             }
           }
         }
+        /*
+         Energies of the element, using the arrays gathered for the residual
+         */
+        if (ctx->residualEnergy) {
+          if (ctx->unilateral == UNILATERAL_NOCOMPRESSION) {
+            ierr = VF_ElasticEnergyNoCompression3D_local(&myEnergyLocal,u_array,v_array,theta_array,thetaRef_array,pressure_array,
+                                                         &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3D);CHKERRQ(ierr);
+            myElasticEnergy += myEnergyLocal;
+          }
+          if (ctx->hasCrackPressure) {
+            ierr = VF_PressureWork3D_local(&myPressureWork,u_array,v_array,pressure_array,
+                                           &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3D);CHKERRQ(ierr);
+          }
+          if (ctx->hasInsitu) {
+            ierr = VF_InSituStressWorkCell_local(&myInsituWork,u_array,f_array,coords_array,BBmin,BBmax,ctx,nx,ny,nz,ek,ej,ei,e3D);CHKERRQ(ierr);
+          }
+        }
         /*
          Jump to next element
          */
@@ -1882,7 +2639,9 @@ extern PetscErrorCode VF_UResidual(SNES snesU,Vec U,Vec residual,void *user)
     ierr = DMRestoreLocalVector(ctx->daVect,&f_localVec);CHKERRQ(ierr);
   }
   ierr = PetscFree2(residual_local,bilinearForm_local);CHKERRQ(ierr);
- 
+  if (ctx->residualEnergy) {
+    ierr = VF_UResidualEnergySet(U,myElasticEnergy,myPressureWork,myInsituWork,ctx);CHKERRQ(ierr);
+  }
   PetscFunctionReturn(0);
 }
 
@@ -1899,6 +2658,7 @@ extern PetscErrorCode VF_UIJacobian(SNES snesU,Vec U,Mat K,Mat KPC,void *user)
   VFCtx          *ctx=(VFCtx*)user;
   
   PetscErrorCode ierr;
+  VFCartFEElement3D *e3D;
   PetscInt       xs,xm,nx;
   PetscInt       ys,ym,ny;
   PetscInt       zs,zm,nz;
@@ -1913,15 +2673,21 @@ extern PetscErrorCode VF_UIJacobian(SNES snesU,Vec U,Mat K,Mat KPC,void *user)
   PetscReal      ****coords_array;
   VFProp         PCvfprop;
   VFMatProp      PCmatprop;
+  VFCartFEMatCOO *cooPC;
   
   PetscFunctionBegin;
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
   
-  ierr = MatZeroEntries(K);CHKERRQ(ierr);
-  if (KPC != K) {
-    ierr = MatZeroEntries(KPC);CHKERRQ(ierr);
+  /*
+    Without unilateral conditions, the preconditioner is assembled from the element blocks of the operator
+  */
+  cooPC = &ctx->cooUPC;
+  if (ctx->unilateral == UNILATERAL_NONE && ctx->cooU.v) cooPC = &ctx->cooU;
+  ierr = VFCartFEMatCOOZeroEntries(&ctx->cooU,K);CHKERRQ(ierr);
+  if (KPC != K && cooPC != &ctx->cooU) {
+    ierr = VFCartFEMatCOOZeroEntries(cooPC,KPC);CHKERRQ(ierr);
   }
   /*
    Get coordinates
@@ -1962,7 +2728,7 @@ extern PetscErrorCode VF_UIJacobian(SNES snesU,Vec U,Mat K,Mat KPC,void *user)
         hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
         hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
         hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCacheU,ei,ej,ek,&e3D);CHKERRQ(ierr);
         /*
          Compute and accumulate the contribution of the local stiffness matrix to the global stiffness matrix
          */
@@ -1970,18 +2736,19 @@ extern PetscErrorCode VF_UIJacobian(SNES snesU,Vec U,Mat K,Mat KPC,void *user)
         ierr = PetscMemzero(bilinearFormPC_local,nrow * nrow * sizeof(PetscReal));
         switch (ctx->unilateral) {
           case UNILATERAL_NONE:
-            ierr = VF_BilinearFormU3D_local(bilinearForm_local,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
-                                            ek,ej,ei,&ctx->e3D); 
+            ierr = VF_UStiffnessSetUp(&ctx->UStiffness[ctx->layer[ek]],&ctx->matprop[ctx->layer[ek]],hx,hy,hz,e3D);CHKERRQ(ierr);
+            ierr = VF_BilinearFormU3D_local(bilinearForm_local,v_array,&ctx->UStiffness[ctx->layer[ek]],&ctx->vfprop,
+                                            ek,ej,ei,e3D);
             ierr = PetscMemcpy(bilinearFormPC_local,bilinearForm_local,nrow * nrow * sizeof(PetscReal));
             break;
           case UNILATERAL_NOCOMPRESSION:
             ierr = VF_BilinearFormUNoCompression3D_local(bilinearForm_local,u_array,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,
-                                                         ek,ej,ei,&ctx->e3D);
+                                                         ek,ej,ei,e3D);
             if (KPC != K) {
               ierr = PetscMemcpy(&PCvfprop,&ctx->vfprop,sizeof(VFProp));CHKERRQ(ierr);
               PCvfprop.eta = PCvfprop.PCeta;
               ierr = PetscMemcpy(&PCmatprop,&ctx->matprop[ctx->layer[ek]],sizeof(VFMatProp));CHKERRQ(ierr);
-              ierr = VF_BilinearFormUNoCompression3D_local(bilinearFormPC_local,u_array,v_array,&PCmatprop,&PCvfprop,ek,ej,ei,&ctx->e3D);
+              ierr = VF_BilinearFormUNoCompression3D_local(bilinearFormPC_local,u_array,v_array,&PCmatprop,&PCvfprop,ek,ej,ei,e3D);
             }
             break;
         }
@@ -1996,13 +2763,14 @@ extern PetscErrorCode VF_UIJacobian(SNES snesU,Vec U,Mat K,Mat KPC,void *user)
           }
         }
 
-        ierr = MatSetValuesStencil(K,nrow,row,nrow,row,bilinearForm_local,ADD_VALUES);CHKERRQ(ierr); 
-        if (KPC != K) {
-          ierr = MatSetValuesStencil(KPC,nrow,row,nrow,row,bilinearFormPC_local,ADD_VALUES);CHKERRQ(ierr); 
+        ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooU,K,ei,ej,ek,nrow,row,nrow,row,bilinearForm_local);CHKERRQ(ierr); 
+        if (KPC != K && cooPC != &ctx->cooU) {
+          ierr = VFCartFEMatCOOSetValuesStencil(cooPC,KPC,ei,ej,ek,nrow,row,nrow,row,bilinearFormPC_local);CHKERRQ(ierr); 
         }
       }
     }
   }
+  ierr = VFCartFEMatCOOAssemble(&ctx->cooU,K);CHKERRQ(ierr);
   ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
   ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);  
   ierr = MatApplyDirichletBC(K,&ctx->bcU[0]);CHKERRQ(ierr);
@@ -2010,6 +2778,7 @@ extern PetscErrorCode VF_UIJacobian(SNES snesU,Vec U,Mat K,Mat KPC,void *user)
   ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
 
   if (KPC != K) {
+      ierr = VFCartFEMatCOOAssemble(cooPC,KPC);CHKERRQ(ierr);
       ierr = MatAssemblyBegin(KPC,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
       ierr = MatAssemblyEnd(KPC,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);  
       ierr = MatApplyDirichletBC(KPC,&ctx->bcU[0]);CHKERRQ(ierr);
@@ -2029,6 +2798,506 @@ extern PetscErrorCode VF_UIJacobian(SNES snesU,Vec U,Mat K,Mat KPC,void *user)
 }
 
 
+#undef __FUNCT__
+#define __FUNCT__ "VF_UMatFreeMult"
+/*
+  VF_UMatFreeMult: Matrix free application of the elasticity operator, Y = K X.
+  K is the matrix of VF_BilinearFormU3D_local, applied without forming the element matrices by 
+  VF_UResidualRowBatch_Kernel, row by row and with the same 4 colors as VF_UResidual. 
+  Dirichlet rows are replaced by the identity, consistently with MatApplyDirichletBC.
+
+  V is the ghosted V of the finest level, gathered in VF_UMatFreeJacobian.
+*/
+extern PetscErrorCode VF_UMatFreeMult(Mat K,Vec X,Vec Y)
+{
+  VFCtx          *ctx;
+  PetscErrorCode ierr;
+  PetscLogDouble flops = 0.;
+  PetscInt       xs,xm,ys,ym,zs,zm;
+  PetscInt       ej,ek,color;
+  Vec            X_localVec,Y_localVec,W;
+  PetscReal      ***v_array,****x_array,****y_array;
+
+  PetscFunctionBegin;
+  ierr = MatShellGetContext(K,(void**)&ctx);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScal,ctx->VlocalMG[ctx->UMGnlevels-1],&v_array);CHKERRQ(ierr);
+
+  ierr = DMGetLocalVector(ctx->daVect,&X_localVec);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daVect,X,INSERT_VALUES,X_localVec);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daVect,X,INSERT_VALUES,X_localVec);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(ctx->daVect,X_localVec,&x_array);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daVect,&Y_localVec);CHKERRQ(ierr);
+  ierr = VecSet(Y_localVec,0.);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(ctx->daVect,Y_localVec,&y_array);CHKERRQ(ierr);
+
+  for (color = 0; color < 4; color++) {
+    VFPragmaOMP(parallel for collapse(2) reduction(+:flops))
+    for (ek = zs + color / 2; ek < zs + zm; ek += 2) {
+      for (ej = ys + color % 2; ej < ys+ym; ej += 2) {
+        VF_UResidualRowBatch_Kernel(y_array,x_array,v_array,ctx,ek,ej,xs,xs+xm,&flops);
+      }
+    }
+  }
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
+
+  ierr = DMDAVecRestoreArray(ctx->daScal,ctx->VlocalMG[ctx->UMGnlevels-1],&v_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,X_localVec,&x_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daVect,&X_localVec);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,Y_localVec,&y_array);CHKERRQ(ierr);
+  ierr = VecSet(Y,0.);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalBegin(ctx->daVect,Y_localVec,ADD_VALUES,Y);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalEnd(ctx->daVect,Y_localVec,ADD_VALUES,Y);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daVect,&Y_localVec);CHKERRQ(ierr);
+  /*
+    Dirichlet rows: Y = mask . Y + (1 - mask) . X
+  */
+  ierr = DMGetGlobalVector(ctx->daVect,&W);CHKERRQ(ierr);
+  ierr = VecPointwiseMult(W,X,ctx->UBCMask);CHKERRQ(ierr);
+  ierr = VecAXPY(W,-1.,X);CHKERRQ(ierr);
+  ierr = VecPointwiseMult(Y,Y,ctx->UBCMask);CHKERRQ(ierr);
+  ierr = VecAXPY(Y,-1.,W);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daVect,&W);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/*
+ VF_UDiagonal3DBatch_Kernel: accumulates in diag_local[(l*3+c)*VFCARTFE_BATCH+b] the diagonal of the element matrix of
+ VF_BilinearFormU3D_local for the nb cells (ei+b,ej,ek) of a batch, without forming it. The diagonal of the reference
+ stiffness tensor Kg of VF_UStiffnessSetUp is w_g ((lambda+mu) dphi_c^2 + mu |grad phi|^2), so only the integrals
+   D_d = \int s(v) (\partial_d phi)^2
+ are needed. The squares of the basis functions are tensor products of the squares of the 1D tables, 
+ so D_d is contracted one axis at a time, as in VFCartFEElement3DIntegrateBatch_Kernel. The flops are added to *flops.
+ */
+static void VF_UDiagonal3DBatch_Kernel(PetscReal *diag_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt nb,VFCartFEElement3D *e,PetscLogDouble *flops)
+{
+  PetscInt       i,j,k,c,gi,gj,gk,g,l,b;
+  PetscReal      phi2,dphi2,sumD;
+  PetscReal      f_local[8*VFCARTFE_BATCH];
+  PetscReal      s_elem[VFCARTFE_MAXNG3D*VFCARTFE_BATCH];
+  PetscReal      C[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D][VFCARTFE_BATCH],Cz[2][VFCARTFE_MAXNG1D][VFCARTFE_MAXNG1D][VFCARTFE_BATCH];
+  PetscReal      D[2][2][VFCARTFE_MAXNG1D][VFCARTFE_BATCH],Dy[2][2][VFCARTFE_MAXNG1D][VFCARTFE_BATCH];
+  PetscReal      Dz[2][2][VFCARTFE_MAXNG1D][VFCARTFE_BATCH];
+  PetscReal      E[3][VFCARTFE_BATCH];
+  
+  VF_GatherBatch(f_local,v_array,NULL,0,ek,ej,ei,nb,e);
+  VFCartFEElement3DInterpolateBatch_Kernel(e,f_local,s_elem,NULL,flops);
+  for (g = 0; g < e->ng; g++) {
+    for (b = 0; b < VFCARTFE_BATCH; b++) {
+      s_elem[g*VFCARTFE_BATCH+b] = e->weight[g] * (s_elem[g*VFCARTFE_BATCH+b] * s_elem[g*VFCARTFE_BATCH+b] + vfprop->eta);
+    }
+  }
+  /*
+    Contraction along z: C with phi^2, Cz with dphi^2
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (gj = 0; gj < e->ng1D; gj++) {
+      for (gi = 0; gi < e->ng1D; gi++) {
+        for (b = 0; b < VFCARTFE_BATCH; b++) {
+          C[k][gj][gi][b]  = 0.;
+          Cz[k][gj][gi][b] = 0.;
+        }
+        for (gk = 0; gk < e->ng1D; gk++) {
+          g     = (gk*e->ng1D+gj)*e->ng1D+gi;
+          phi2  = e->phi1D[2][k][gk] * e->phi1D[2][k][gk];
+          dphi2 = e->dphi1D[2][k][gk] * e->dphi1D[2][k][gk];
+          for (b = 0; b < VFCARTFE_BATCH; b++) {
+            C[k][gj][gi][b]  += s_elem[g*VFCARTFE_BATCH+b] * phi2;
+            Cz[k][gj][gi][b] += s_elem[g*VFCARTFE_BATCH+b] * dphi2;
+          }
+        }
+      }
+    }
+  }
+  /*
+    Contraction along y: D for the x derivative, Dy for the y derivative, Dz for the z derivative
+  */
+  for (k = 0; k < e->nphiz; k++) {
+    for (j = 0; j < e->nphiy; j++) {
+      for (gi = 0; gi < e->ng1D; gi++) {
+        for (b = 0; b < VFCARTFE_BATCH; b++) {
+          D[k][j][gi][b]  = 0.;
+          Dy[k][j][gi][b] = 0.;
+          Dz[k][j][gi][b] = 0.;
+        }
+        for (gj = 0; gj < e->ng1D; gj++) {
+          phi2  = e->phi1D[1][j][gj] * e->phi1D[1][j][gj];
+          dphi2 = e->dphi1D[1][j][gj] * e->dphi1D[1][j][gj];
+          for (b = 0; b < VFCARTFE_BATCH; b++) {
+            D[k][j][gi][b]  += C[k][gj][gi][b] * phi2;
+            Dy[k][j][gi][b] += C[k][gj][gi][b] * dphi2;
+            Dz[k][j][gi][b] += Cz[k][gj][gi][b] * phi2;
+          }
+        }
+      }
+    }
+  }
+  /*
+    Contraction along x, then the diagonal of each component
+  */
+  for (l = 0,k = 0; k < e->nphiz; k++) {
+    for (j = 0; j < e->nphiy; j++) {
+      for (i = 0; i < e->nphix; i++,l++) {
+        for (b = 0; b < VFCARTFE_BATCH; b++) E[0][b] = E[1][b] = E[2][b] = 0.;
+        for (gi = 0; gi < e->ng1D; gi++) {
+          phi2  = e->phi1D[0][i][gi] * e->phi1D[0][i][gi];
+          dphi2 = e->dphi1D[0][i][gi] * e->dphi1D[0][i][gi];
+          for (b = 0; b < VFCARTFE_BATCH; b++) {
+            E[0][b] += D[k][j][gi][b] * dphi2;
+            E[1][b] += Dy[k][j][gi][b] * phi2;
+            E[2][b] += Dz[k][j][gi][b] * phi2;
+          }
+        }
+        for (b = 0; b < VFCARTFE_BATCH; b++) {
+          sumD = E[0][b] + E[1][b] + E[2][b];
+          for (c = 0; c < 3; c++) {
+            diag_local[(l*3+c)*VFCARTFE_BATCH+b] += (matprop->lambda + matprop->mu) * E[c][b] + matprop->mu * sumD;
+          }
+        }
+      }
+    }
+  }
+  *flops += VFCARTFE_BATCH * (3 * e->ng + 4 * e->nphiz * e->ng + 6 * e->nphiz * e->nphiy * e->ng1D * e->ng1D + 6 * 8 * e->ng1D + 8 * (2 + 3 * 4));
+}
+
+/*
+ VF_UDiagonalRowBatch_Kernel: accumulates in diag_array the diagonal of the elasticity operator on the row of cells
+ (xs ... xe-1,ej,ek), VFCARTFE_BATCH neighbouring cells at a time, with the same write pattern as VF_UResidualRowBatch_Kernel.
+ */
+static void VF_UDiagonalRowBatch_Kernel(PetscReal ****diag_array,PetscReal ***v_array,VFCtx *ctx,PetscInt ek,PetscInt ej,PetscInt xs,PetscInt xe,PetscLogDouble *flops)
+{
+  VFCartFEElement3D *e3D;
+  PetscInt          ei,nb,b,i,j,k,c,l;
+  PetscReal         diag_local[24*VFCARTFE_BATCH];
+  
+  for (ei = xs; ei < xe; ei += nb) {
+    VFCartFEElementCacheGet3DBatch_Kernel(ctx->feCacheU,ei,ej,ek,xe,&e3D,&nb);
+    for (l = 0; l < 24 * VFCARTFE_BATCH; l++) diag_local[l] = 0.;
+    VF_UDiagonal3DBatch_Kernel(diag_local,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,nb,e3D,flops);
+    for (l = 0,k = 0; k < e3D->nphiz; k++) {
+      for (j = 0; j < e3D->nphiy; j++) {
+        for (i = 0; i < e3D->nphix; i++) {
+          for (c = 0; c < 3; c++,l++) {
+            for (b = 0; b < nb; b++) {
+              diag_array[ek+k][ej+j][ei+b+i][c] += diag_local[l*VFCARTFE_BATCH+b];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UMatFreeGetDiagonal"
+/*
+  VF_UMatFreeGetDiagonal: diagonal of the matrix free elasticity operator, used by the
+  Jacobi / Chebyshev smoother on the finest multigrid level.
+  Only the diagonal of the element matrices is computed, by VF_UDiagonalRowBatch_Kernel, with the same 4 colors as VF_UMatFreeMult.
+*/
+extern PetscErrorCode VF_UMatFreeGetDiagonal(Mat K,Vec D)
+{
+  VFCtx          *ctx;
+  PetscErrorCode ierr;
+  PetscLogDouble flops = 0.;
+  PetscInt       xs,xm,ys,ym,zs,zm;
+  PetscInt       ej,ek,color;
+  Vec            D_localVec,W;
+  PetscReal      ***v_array,****d_array;
+
+  PetscFunctionBegin;
+  ierr = MatShellGetContext(K,(void**)&ctx);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScal,ctx->VlocalMG[ctx->UMGnlevels-1],&v_array);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daVect,&D_localVec);CHKERRQ(ierr);
+  ierr = VecSet(D_localVec,0.);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(ctx->daVect,D_localVec,&d_array);CHKERRQ(ierr);
+
+  for (color = 0; color < 4; color++) {
+    VFPragmaOMP(parallel for collapse(2) reduction(+:flops))
+    for (ek = zs + color / 2; ek < zs + zm; ek += 2) {
+      for (ej = ys + color % 2; ej < ys+ym; ej += 2) {
+        VF_UDiagonalRowBatch_Kernel(d_array,v_array,ctx,ek,ej,xs,xs+xm,&flops);
+      }
+    }
+  }
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
+
+  ierr = DMDAVecRestoreArray(ctx->daScal,ctx->VlocalMG[ctx->UMGnlevels-1],&v_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,D_localVec,&d_array);CHKERRQ(ierr);
+  ierr = VecSet(D,0.);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalBegin(ctx->daVect,D_localVec,ADD_VALUES,D);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalEnd(ctx->daVect,D_localVec,ADD_VALUES,D);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daVect,&D_localVec);CHKERRQ(ierr);
+  /*
+    Dirichlet rows: D = mask . D + (1 - mask)
+  */
+  ierr = DMGetGlobalVector(ctx->daVect,&W);CHKERRQ(ierr);
+  ierr = VecSet(W,1.);CHKERRQ(ierr);
+  ierr = VecAXPY(W,-1.,ctx->UBCMask);CHKERRQ(ierr);
+  ierr = VecPointwiseMult(D,D,ctx->UBCMask);CHKERRQ(ierr);
+  ierr = VecAXPY(D,1.,W);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daVect,&W);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UMGLevelOperator"
+/*
+  VF_UMGLevelOperator: assemble the elasticity operator on a coarse level of the multigrid hierarchy
+  (rediscretization using the V field injected from the finer levels).
+  The layer of a coarse cell is found from the z coordinate of its lowest node, as in VFLayerInit.
+*/
+extern PetscErrorCode VF_UMGLevelOperator(Mat K,DM daVectL,DM daScalL,Vec VL_localVec,VFCtx *ctx)
+{
+  PetscErrorCode    ierr;
+  PetscInt          xs,xm,nx;
+  PetscInt          ys,ym,ny;
+  PetscInt          zs,zm,nz;
+  PetscInt          xe,ye,ze;
+  PetscInt          ei,ej,ek,i,j,k,c,l,layer;
+  PetscInt          nrow;
+  PetscReal         ***v_array;
+  PetscReal         *bilinearForm_local;
+  MatStencil        *row;
+  PetscReal         hx,hy,hz;
+  DM                cda;
+  Vec               coordinates;
+  PetscReal         ****coords_array;
+  VFCartFEElement3D e;
+  VFUStiffness      *Kref;
+
+  PetscFunctionBegin;
+  ierr = VFCartFEElement3DCreate(&e);CHKERRQ(ierr);
+  nrow = e.dim * e.nphix * e.nphiy * e.nphiz;
+  ierr = DMDAGetInfo(daScalL,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
+                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(daScalL,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  xe   = PetscMin(xs+xm,nx-1);
+  ye   = PetscMin(ys+ym,ny-1);
+  ze   = PetscMin(zs+zm,nz-1);
+
+  ierr = DMGetCoordinateDM(daScalL,&cda);CHKERRQ(ierr);
+  ierr = DMGetCoordinatesLocal(daScalL,&coordinates);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(cda,coordinates,&coords_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(daScalL,VL_localVec,&v_array);CHKERRQ(ierr);
+  ierr = PetscMalloc2(nrow * nrow,&bilinearForm_local,nrow,&row);CHKERRQ(ierr);
+  ierr = PetscMalloc(ctx->nlayer * sizeof(VFUStiffness),&Kref);CHKERRQ(ierr);
+  ierr = PetscMemzero(Kref,ctx->nlayer * sizeof(VFUStiffness));CHKERRQ(ierr);
+
+  ierr = MatZeroEntries(K);CHKERRQ(ierr);
+  for (ek = zs; ek < ze; ek++) {
+    for (ej = ys; ej < ye; ej++) {
+      for (ei = xs; ei < xe; ei++) {
+        hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
+        hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
+        hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
+        ierr = VFCartFEElement3DInitQuadrature(&e,hx,hy,hz,ctx->feCacheU->ng1D);CHKERRQ(ierr);
+        for (layer = 0,l = 0; l < ctx->nlayer; l++)
+          if (coords_array[ek][ej][ei][2] > ctx->layersep[l]) layer = l;
+        ierr = VF_UStiffnessSetUp(&Kref[layer],&ctx->matprop[layer],hx,hy,hz,&e);CHKERRQ(ierr);
+        ierr = VF_BilinearFormU3D_local(bilinearForm_local,v_array,&Kref[layer],&ctx->vfprop,ek,ej,ei,&e);CHKERRQ(ierr);
+        for (l = 0,k = 0; k < e.nphiz; k++) {
+          for (j = 0; j < e.nphiy; j++) {
+            for (i = 0; i < e.nphix; i++) {
+              for (c = 0; c < e.dim; c++,l++) {
+                row[l].i = ei + i; row[l].j = ej + j; row[l].k = ek + k; row[l].c = c;
+              }
+            }
+          }
+        }
+        ierr = MatSetValuesStencil(K,nrow,row,nrow,row,bilinearForm_local,ADD_VALUES);CHKERRQ(ierr);
+      }
+    }
+  }
+  ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  ierr = MatApplyDirichletBC(K,&ctx->bcU[0]);CHKERRQ(ierr);
+  ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+
+  for (l = 0; l < ctx->nlayer; l++) {
+    ierr = VF_UStiffnessDestroy(&Kref[l]);CHKERRQ(ierr);
+  }
+  ierr = PetscFree(Kref);CHKERRQ(ierr);
+  ierr = PetscFree2(bilinearForm_local,row);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(daScalL,VL_localVec,&v_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(cda,coordinates,&coords_array);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UMatFreeJacobian"
+/*
+  VF_UMatFreeJacobian: Jacobian callback for the matrix free U solver.
+  Gathers V on the finest level, injects it on each coarse level, and reassembles the coarse level operators.
+*/
+extern PetscErrorCode VF_UMatFreeJacobian(SNES snesU,Vec U,Mat K,Mat KPC,void *user)
+{
+  VFCtx          *ctx=(VFCtx*)user;
+  PetscErrorCode ierr;
+  PetscInt       l,n = ctx->UMGnlevels;
+
+  PetscFunctionBegin;
+  ierr = DMGlobalToLocalBegin(ctx->daScal,ctx->fields->V,INSERT_VALUES,ctx->VlocalMG[n-1]);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daScal,ctx->fields->V,INSERT_VALUES,ctx->VlocalMG[n-1]);CHKERRQ(ierr);
+  for (l = n-2; l >= 0; l--) {
+    if (l == n-2) {
+      ierr = MatRestrict(ctx->VinjectMG[l],ctx->fields->V,ctx->VMG[l]);CHKERRQ(ierr);
+    } else {
+      ierr = MatRestrict(ctx->VinjectMG[l],ctx->VMG[l+1],ctx->VMG[l]);CHKERRQ(ierr);
+    }
+    ierr = DMGlobalToLocalBegin(ctx->daScalMG[l],ctx->VMG[l],INSERT_VALUES,ctx->VlocalMG[l]);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalEnd(ctx->daScalMG[l],ctx->VMG[l],INSERT_VALUES,ctx->VlocalMG[l]);CHKERRQ(ierr);
+    ierr = VF_UMGLevelOperator(ctx->KUMG[l],ctx->daVectMG[l],ctx->daScalMG[l],ctx->VlocalMG[l],ctx);CHKERRQ(ierr);
+  }
+  /*
+    Bump the state of the shell matrices so that the preconditioner is rebuilt
+  */
+  ierr = MatAssemblyBegin(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  ierr = MatAssemblyEnd(K,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  if (KPC != K) {
+    ierr = MatAssemblyBegin(KPC,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+    ierr = MatAssemblyEnd(KPC,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UMatFreeInitialize"
+/*
+  VF_UMatFreeInitialize: Create the coarse DMDA hierarchy, coarse level operators
+  and the MatShell used by the matrix free U solver (-U_matfree)
+*/
+extern PetscErrorCode VF_UMatFreeInitialize(VFCtx *ctx,Mat *K)
+{
+  PetscErrorCode ierr;
+  PetscInt       l,n = ctx->UMGnlevels;
+  PetscInt       nloc,N;
+  PetscInt       nx,ny,nz,ratio;
+  Vec            coordinates;
+  PetscReal      BBmin[3],BBmax[3];
+
+  PetscFunctionBegin;
+  if (ctx->unilateral != UNILATERAL_NONE) SETERRQ1(PETSC_COMM_WORLD,PETSC_ERR_SUP,"ERROR: -U_matfree is only implemented for -unilateral NONE in %s\n",__FUNCT__);
+  if (n < 2) SETERRQ2(PETSC_COMM_WORLD,PETSC_ERR_USER,"ERROR: -U_matfree_mg_levels should be at least 2, got %i in %s\n",n,__FUNCT__);
+  /*
+    Each coarsening halves the number of cells, so the number of cells in each direction must be 
+    divisible by 2^(n-1)
+  */
+  ierr = DMDAGetInfo(ctx->daScal,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
+                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  ratio = 1 << (n-1);
+  if ((nx-1) % ratio || (ny-1) % ratio || (nz-1) % ratio || (nx-1) < ratio || (ny-1) < ratio || (nz-1) < ratio) {
+    SETERRQ6(PETSC_COMM_WORLD,PETSC_ERR_USER,"ERROR: the number of cells %ix%ix%i is not a nonzero multiple of 2^(%i-1) for -U_matfree_mg_levels %i in %s\n",
+             nx-1,ny-1,nz-1,n,n,__FUNCT__);
+  }
+
+  ierr = PetscMalloc3(n,&ctx->daVectMG,n,&ctx->daScalMG,n,&ctx->KUMG);CHKERRQ(ierr);
+  ierr = PetscMalloc3(n,&ctx->VinjectMG,n,&ctx->VMG,n,&ctx->VlocalMG);CHKERRQ(ierr);
+  ierr = DMDAGetBoundingBox(ctx->daScal,BBmin,BBmax);CHKERRQ(ierr);
+
+  ctx->daVectMG[n-1]  = ctx->daVect;
+  ctx->daScalMG[n-1]  = ctx->daScal;
+  ierr = PetscObjectReference((PetscObject)ctx->daVect);CHKERRQ(ierr);
+  ierr = PetscObjectReference((PetscObject)ctx->daScal);CHKERRQ(ierr);
+  ctx->KUMG[n-1]      = NULL;
+  ctx->VinjectMG[n-1] = NULL;
+  ctx->VMG[n-1]       = NULL;
+  for (l = n-2; l >= 0; l--) {
+    ierr = DMCoarsen(ctx->daVectMG[l+1],PETSC_COMM_WORLD,&ctx->daVectMG[l]);CHKERRQ(ierr);
+    ierr = DMCoarsen(ctx->daScalMG[l+1],PETSC_COMM_WORLD,&ctx->daScalMG[l]);CHKERRQ(ierr);
+    ierr = DMGetCoordinates(ctx->daScalMG[l],&coordinates);CHKERRQ(ierr);
+    if (!coordinates) {
+      ierr = DMDASetUniformCoordinates(ctx->daScalMG[l],BBmin[0],BBmax[0],BBmin[1],BBmax[1],BBmin[2],BBmax[2]);CHKERRQ(ierr);
+    }
+    ierr = DMCreateMatrix(ctx->daVectMG[l],&ctx->KUMG[l]);CHKERRQ(ierr);
+    ierr = MatSetOption(ctx->KUMG[l],MAT_KEEP_NONZERO_PATTERN,PETSC_TRUE);CHKERRQ(ierr);
+    ierr = DMCreateInjection(ctx->daScalMG[l],ctx->daScalMG[l+1],&ctx->VinjectMG[l]);CHKERRQ(ierr);
+    ierr = DMCreateGlobalVector(ctx->daScalMG[l],&ctx->VMG[l]);CHKERRQ(ierr);
+  }
+  for (l = 0; l < n; l++) {
+    ierr = DMCreateLocalVector(ctx->daScalMG[l],&ctx->VlocalMG[l]);CHKERRQ(ierr);
+  }
+
+  /*
+    UBCMask is 0 on the Dirichlet dofs of U and 1 elsewhere
+  */
+  ierr = DMCreateGlobalVector(ctx->daVect,&ctx->UBCMask);CHKERRQ(ierr);
+  ierr = VecSet(ctx->UBCMask,1.);CHKERRQ(ierr);
+  ierr = GradientApplyDirichletBC(ctx->UBCMask,&ctx->bcU[0]);CHKERRQ(ierr);
+
+  ierr = VecGetLocalSize(ctx->UBCMask,&nloc);CHKERRQ(ierr);
+  ierr = VecGetSize(ctx->UBCMask,&N);CHKERRQ(ierr);
+  ierr = MatCreateShell(PETSC_COMM_WORLD,nloc,nloc,N,N,ctx,K);CHKERRQ(ierr);
+  ierr = MatShellSetOperation(*K,MATOP_MULT,(void(*)(void))VF_UMatFreeMult);CHKERRQ(ierr);
+  ierr = MatShellSetOperation(*K,MATOP_GET_DIAGONAL,(void(*)(void))VF_UMatFreeGetDiagonal);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UMatFreePCSetUp"
+/*
+  VF_UMatFreePCSetUp: geometric multigrid on the daVect hierarchy for the matrix free U solver.
+  The coarse operators are rediscretized (see VF_UMGLevelOperator), the finest level is smoothed
+  by Chebyshev / Jacobi, which only requires the diagonal of the MatShell.
+  All of this can be overridden using -U_mg_levels_ options
+*/
+extern PetscErrorCode VF_UMatFreePCSetUp(PC pc,VFCtx *ctx)
+{
+  PetscErrorCode ierr;
+  PetscInt       l,n = ctx->UMGnlevels;
+  Mat            P;
+  KSP            kspL;
+  PC             pcL;
+
+  PetscFunctionBegin;
+  ierr = PCSetType(pc,PCMG);CHKERRQ(ierr);
+  ierr = PCMGSetLevels(pc,n,NULL);CHKERRQ(ierr);
+  ierr = PCMGSetType(pc,PC_MG_MULTIPLICATIVE);CHKERRQ(ierr);
+  ierr = PCMGSetGalerkin(pc,PC_MG_GALERKIN_EXTERNAL);CHKERRQ(ierr);
+  for (l = 1; l < n; l++) {
+    ierr = DMCreateInterpolation(ctx->daVectMG[l-1],ctx->daVectMG[l],&P,NULL);CHKERRQ(ierr);
+    ierr = PCMGSetInterpolation(pc,l,P);CHKERRQ(ierr);
+    ierr = MatDestroy(&P);CHKERRQ(ierr);
+  }
+  for (l = 0; l < n-1; l++) {
+    ierr = PCMGGetSmoother(pc,l,&kspL);CHKERRQ(ierr);
+    ierr = KSPSetOperators(kspL,ctx->KUMG[l],ctx->KUMG[l]);CHKERRQ(ierr);
+  }
+  ierr = PCMGGetSmoother(pc,n-1,&kspL);CHKERRQ(ierr);
+  ierr = KSPSetType(kspL,KSPCHEBYSHEV);CHKERRQ(ierr);
+  ierr = KSPGetPC(kspL,&pcL);CHKERRQ(ierr);
+  ierr = PCSetType(pcL,PCJACOBI);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_UMatFreeFinalize"
+/*
+  VF_UMatFreeFinalize
+*/
+extern PetscErrorCode VF_UMatFreeFinalize(VFCtx *ctx)
+{
+  PetscErrorCode ierr;
+  PetscInt       l;
+
+  PetscFunctionBegin;
+  for (l = 0; l < ctx->UMGnlevels; l++) {
+    ierr = DMDestroy(&ctx->daVectMG[l]);CHKERRQ(ierr);
+    ierr = DMDestroy(&ctx->daScalMG[l]);CHKERRQ(ierr);
+    ierr = MatDestroy(&ctx->KUMG[l]);CHKERRQ(ierr);
+    ierr = MatDestroy(&ctx->VinjectMG[l]);CHKERRQ(ierr);
+    ierr = VecDestroy(&ctx->VMG[l]);CHKERRQ(ierr);
+    ierr = VecDestroy(&ctx->VlocalMG[l]);CHKERRQ(ierr);
+  }
+  ierr = PetscFree3(ctx->daVectMG,ctx->daScalMG,ctx->KUMG);CHKERRQ(ierr);
+  ierr = PetscFree3(ctx->VinjectMG,ctx->VMG,ctx->VlocalMG);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->UBCMask);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+
 /* ====================== */
 #undef __FUNCT__
 #define __FUNCT__ "VF_BilinearFormVAT23D_local"
@@ -2094,10 +3363,9 @@ extern PetscErrorCode VF_BilinearFormVCoupling3D_local(PetscReal *Mat_local,Pets
 {
   PetscErrorCode ierr;
   PetscInt       g,i1,i2,j1,j2,k1,k2,l;
-  PetscReal      *ElasticEnergyDensity_local;
+  PetscReal      ElasticEnergyDensity_local[VFCARTFE_MAXNG3D];
   
   PetscFunctionBegin;
-  ierr = PetscMalloc(e->ng * sizeof(PetscReal),&ElasticEnergyDensity_local);CHKERRQ(ierr);
   for (g = 0; g < e->ng; g++) ElasticEnergyDensity_local[g] = 0;
   ierr = ElasticEnergyDensity3D_local(ElasticEnergyDensity_local,U_array,
                                       theta_array,thetaRef_array,matprop,ek,ej,ei,e);CHKERRQ(ierr);
@@ -2110,7 +3378,6 @@ extern PetscErrorCode VF_BilinearFormVCoupling3D_local(PetscReal *Mat_local,Pets
             for (i2 = 0; i2 < e->nphix; i2++,l++)
               for (g = 0; g < e->ng; g++)
                 Mat_local[l] += e->weight[g] * e->phi[k1][j1][i1][g] * e->phi[k2][j2][i2][g] * ElasticEnergyDensity_local[g] * 2.;
-  ierr = PetscFree(ElasticEnergyDensity_local);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -2126,11 +3393,9 @@ extern PetscErrorCode VF_BilinearFormVCouplingNoCompression3D_local(PetscReal *M
 {
   PetscErrorCode ierr;
   PetscInt       g,i1,i2,j1,j2,k1,k2,l;
-  PetscReal      *ElasticEnergyDensityS_local,*ElasticEnergyDensityD_local;
+  PetscReal      ElasticEnergyDensityS_local[VFCARTFE_MAXNG3D],ElasticEnergyDensityD_local[VFCARTFE_MAXNG3D];
   
   PetscFunctionBegin;
-  ierr = PetscMalloc2(e->ng,&ElasticEnergyDensityS_local,
-                      e->ng,&ElasticEnergyDensityD_local);CHKERRQ(ierr);
   ierr = ElasticEnergyDensitySphericalDeviatoricNoCompression3D_local(ElasticEnergyDensityS_local,ElasticEnergyDensityD_local,
                                                          U_array,theta_array,thetaRef_array,matprop,ek,ej,ei,e);CHKERRQ(ierr);
   for (l = 0,k1 = 0; k1 < e->nphiz; k1++) {
@@ -2148,7 +3413,91 @@ extern PetscErrorCode VF_BilinearFormVCouplingNoCompression3D_local(PetscReal *M
       }
     }
   }
-  ierr = PetscFree2(ElasticEnergyDensityS_local,ElasticEnergyDensityD_local);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_BilinearFormVApply3D_local"
+/*
+ VF_BilinearFormVApply3D_local: computes Kv_local = K_local . v_local, where K_local is the sum of the element matrices
+ of the AT1 or AT2 surface energy (VF_BilinearFormVAT13D_local, VF_BilinearFormVAT23D_local) and of the coupling term
+ with the elastic energy density ElasticEnergyDensity_elem at the integration points (VF_BilinearFormVCoupling3D_local),
+ without forming K_local. 
+ v and its gradient are evaluated at the integration points and tested against the basis functions by sum factorization.
+ */
+extern PetscErrorCode VF_BilinearFormVApply3D_local(PetscReal *Kv_local,PetscReal ***v_array,PetscReal *ElasticEnergyDensity_elem,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
+{
+  PetscErrorCode ierr;
+  PetscInt       i,j,k,g,l;
+  PetscReal      coef = matprop->Gc / vfprop->atCv * .5;
+  PetscReal      v_local[8];
+  PetscReal      f_elem[VFCARTFE_MAXNG3D],df_elem[3*VFCARTFE_MAXNG3D];
+  
+  PetscFunctionBegin;
+  for (l = 0,k = 0; k < e->nphiz; k++)
+    for (j = 0; j < e->nphiy; j++)
+      for (i = 0; i < e->nphix; i++,l++) {
+        v_local[l]  = v_array[ek+k][ej+j][ei+i];
+        Kv_local[l] = 0.;
+      }
+  ierr = VFCartFEElement3DInterpolate(e,v_local,f_elem,df_elem);CHKERRQ(ierr);
+  for (g = 0; g < e->ng; g++) {
+    switch (vfprop->atnum) {
+      case 1:
+        f_elem[g] = f_elem[g] * ElasticEnergyDensity_elem[g] * 2.;
+        break;
+      case 2:
+        f_elem[g] = f_elem[g] * (ElasticEnergyDensity_elem[g] * 2. + coef / vfprop->epsilon);
+        break;
+    }
+  }
+  for (g = 0; g < 3 * e->ng; g++) df_elem[g] *= coef * vfprop->epsilon;
+  ierr = PetscLogFlops(6 * e->ng);CHKERRQ(ierr);
+  ierr = VFCartFEElement3DIntegrate(e,f_elem,df_elem,Kv_local);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/*
+ VF_BilinearFormVApply3DBatch_Kernel: VF_BilinearFormVApply3DBatch_local without the PETSc calls, its flops are added to *flops
+ */
+static void VF_BilinearFormVApply3DBatch_Kernel(PetscReal *Kv_local,PetscReal ***v_array,PetscReal *ElasticEnergyDensity_elem,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt nb,VFCartFEElement3D *e,PetscLogDouble *flops)
+{
+  PetscInt       l,gb;
+  PetscInt       nphi = e->nphix * e->nphiy * e->nphiz;
+  PetscReal      coef = matprop->Gc / vfprop->atCv * .5;
+  PetscReal      v_local[8*VFCARTFE_BATCH];
+  PetscReal      f_elem[VFCARTFE_MAXNG3D*VFCARTFE_BATCH],df_elem[3*VFCARTFE_MAXNG3D*VFCARTFE_BATCH];
+  
+  VF_GatherBatch(v_local,v_array,NULL,0,ek,ej,ei,nb,e);
+  for (l = 0; l < nphi*VFCARTFE_BATCH; l++) Kv_local[l] = 0.;
+  VFCartFEElement3DInterpolateBatch_Kernel(e,v_local,f_elem,df_elem,flops);
+  switch (vfprop->atnum) {
+    case 1:
+      for (gb = 0; gb < e->ng*VFCARTFE_BATCH; gb++) f_elem[gb] = f_elem[gb] * ElasticEnergyDensity_elem[gb] * 2.;
+      break;
+    case 2:
+      for (gb = 0; gb < e->ng*VFCARTFE_BATCH; gb++) f_elem[gb] = f_elem[gb] * (ElasticEnergyDensity_elem[gb] * 2. + coef / vfprop->epsilon);
+      break;
+  }
+  for (gb = 0; gb < 3*e->ng*VFCARTFE_BATCH; gb++) df_elem[gb] *= coef * vfprop->epsilon;
+  *flops += VFCARTFE_BATCH * 6 * e->ng;
+  VFCartFEElement3DIntegrateBatch_Kernel(e,f_elem,df_elem,Kv_local,flops);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_BilinearFormVApply3DBatch_local"
+/*
+ VF_BilinearFormVApply3DBatch_local: VF_BilinearFormVApply3D_local for the nb cells (ei+b,ej,ek) of a batch sharing 
+ the element e, with Kv_local[l*VFCARTFE_BATCH+b] and ElasticEnergyDensity_elem[g*VFCARTFE_BATCH+b].
+ */
+extern PetscErrorCode VF_BilinearFormVApply3DBatch_local(PetscReal *Kv_local,PetscReal ***v_array,PetscReal *ElasticEnergyDensity_elem,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,PetscInt nb,VFCartFEElement3D *e)
+{
+  PetscErrorCode ierr;
+  PetscLogDouble flops = 0.;
+  
+  PetscFunctionBegin;
+  VF_BilinearFormVApply3DBatch_Kernel(Kv_local,v_array,ElasticEnergyDensity_elem,matprop,vfprop,ek,ej,ei,nb,e,&flops);
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -2164,16 +3513,13 @@ extern PetscErrorCode VF_ResidualVThermoPoro3D_local(PetscReal *residual_local,P
 {
   PetscErrorCode ierr;
   PetscInt       l,i,j,k,g,c;
-  PetscReal      *Dtheta_elem,*pressure_elem,*divu_elem;
+  PetscReal      Dtheta_elem[VFCARTFE_MAXNG3D],pressure_elem[VFCARTFE_MAXNG3D],divu_elem[VFCARTFE_MAXNG3D];
   PetscReal      coefalpha,beta;
   
   PetscFunctionBegin;
   coefalpha = (3.* matprop->lambda + 2. * matprop->mu) * matprop->alpha;
   beta      = matprop->beta;
   
-  ierr = PetscMalloc3(e->ng,&Dtheta_elem,
-                      e->ng,&pressure_elem,
-                      e->ng,&divu_elem);CHKERRQ(ierr);
   /*
    Initialize pressure_Elem, theta_Elem and v_elem
    */
@@ -2211,7 +3557,6 @@ extern PetscErrorCode VF_ResidualVThermoPoro3D_local(PetscReal *residual_local,P
     }
   }
   ierr = PetscLogFlops(7 * e->ng * e->nphix * e->nphiy * e->nphiz);CHKERRQ(ierr);
-  ierr = PetscFree3(Dtheta_elem,pressure_elem,divu_elem);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -2227,17 +3572,13 @@ extern PetscErrorCode VF_ResidualVThermoPoroNoCompression3D_local(PetscReal *res
 {
   PetscErrorCode ierr;
   PetscInt       l,i,j,k,g,c;
-  PetscReal      *Dtheta_elem,*pressure_elem,*divu_elem,*tr_epsilon;
+  PetscReal      Dtheta_elem[VFCARTFE_MAXNG3D],pressure_elem[VFCARTFE_MAXNG3D],divu_elem[VFCARTFE_MAXNG3D],tr_epsilon[VFCARTFE_MAXNG3D];
   PetscReal      coefalpha,beta;
   
   PetscFunctionBegin;
   coefalpha = (3.* matprop->lambda + 2. * matprop->mu) * matprop->alpha;
   beta      = matprop->beta;
   
-  ierr = PetscMalloc4(e->ng,&Dtheta_elem,
-                      e->ng,&pressure_elem,
-                      e->ng,&divu_elem,
-                      e->ng,&tr_epsilon);CHKERRQ(ierr);
   /*
    Initialize pressure_Elem, theta_Elem and v_elem
    */
@@ -2280,28 +3621,16 @@ extern PetscErrorCode VF_ResidualVThermoPoroNoCompression3D_local(PetscReal *res
     }
   }
   ierr = PetscLogFlops(7 * e->ng * e->nphix * e->nphiy * e->nphiz);CHKERRQ(ierr);
-  ierr = PetscFree4(Dtheta_elem,pressure_elem,divu_elem,tr_epsilon);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
-#undef __FUNCT__
-#define __FUNCT__ "VF_ResidualVCrackPressure3D_local"
 /*
- VF_ResidualVCrackPressure3D_local
- 
- (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+ VF_ResidualVCrackPressure3D_Kernel: VF_ResidualVCrackPressure3D_local without the PETSc calls, its flops are added to *flops
  */
-extern PetscErrorCode VF_ResidualVCrackPressure3D_local(PetscReal *residual_local,PetscReal ****u_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
+static void VF_ResidualVCrackPressure3D_Kernel(PetscReal *residual_local,PetscReal ****u_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e,PetscLogDouble *flops)
 {
-  PetscErrorCode ierr;
   PetscInt       l,i,j,k,g,c;
-  PetscReal      *pressure_elem,*u_elem[3];
-  
-  PetscFunctionBegin;
-  ierr = PetscMalloc4(e->ng,&pressure_elem,
-                      e->ng,&u_elem[0],
-                      e->ng,&u_elem[1],
-                      e->ng,&u_elem[2]);CHKERRQ(ierr);
+  PetscReal      pressure_elem[VFCARTFE_MAXNG3D],u_elem[3][VFCARTFE_MAXNG3D];
   
   /*
    Compute the projection of the fields in the local base functions basis
@@ -2318,7 +3647,7 @@ extern PetscErrorCode VF_ResidualVCrackPressure3D_local(PetscReal *residual_loca
           for (c= 0; c<3; c++) u_elem[c][g] += e->phi[k][j][i][g] * u_array[ek+k][ej+j][ei+i][c];
         }
     }
-  ierr = PetscLogFlops(9 * e->ng * e->nphix * e->nphiy * e->nphiz);CHKERRQ(ierr);
+  *flops += 9 * e->ng * e->nphix * e->nphiy * e->nphiz;
   
   /*
    Accumulate the contribution of the current element to the local
@@ -2332,75 +3661,96 @@ extern PetscErrorCode VF_ResidualVCrackPressure3D_local(PetscReal *residual_loca
             residual_local[l] += e->weight[g] * pressure_elem[g]
             * u_elem[c][g]
             * e->dphi[k][j][i][c][g];
-  ierr = PetscLogFlops(12 * e->ng * e->nphix * e->nphiy * e->nphiz);CHKERRQ(ierr);
-  /*
-   Clean up
-   */
-  ierr = PetscFree4(pressure_elem,u_elem[0],u_elem[1],u_elem[2]);CHKERRQ(ierr);
-  PetscFunctionReturn(0);
+  *flops += 12 * e->ng * e->nphix * e->nphiy * e->nphiz;
 }
 
 #undef __FUNCT__
-#define __FUNCT__ "VF_ResidualVAT23D_local"
+#define __FUNCT__ "VF_ResidualVCrackPressure3D_local"
 /*
- VF_ResidualVAT23D_local
+ VF_ResidualVCrackPressure3D_local
  
  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
  */
-extern PetscErrorCode VF_ResidualVAT23D_local(PetscReal *residual_local,VFMatProp *matprop,VFProp *vfprop,VFCartFEElement3D *e)
+extern PetscErrorCode VF_ResidualVCrackPressure3D_local(PetscReal *residual_local,PetscReal ****u_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
+{
+  PetscErrorCode ierr;
+  PetscLogDouble flops = 0.;
+  
+  PetscFunctionBegin;
+  VF_ResidualVCrackPressure3D_Kernel(residual_local,u_array,pressure_array,matprop,vfprop,ek,ej,ei,e,&flops);
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/*
+ VF_ResidualVAT23D_Kernel: VF_ResidualVAT23D_local without the PETSc calls
+ */
+static void VF_ResidualVAT23D_Kernel(PetscReal *residual_local,VFMatProp *matprop,VFProp *vfprop,VFCartFEElement3D *e)
 {
   PetscInt  g,i,j,k,l;
   PetscReal coef = matprop->Gc / vfprop->atCv / vfprop->epsilon *.5;
   
-  PetscFunctionBegin;
   for (l= 0,k= 0; k < e->nphiz; k++)
     for (j = 0; j < e->nphiy; j++)
       for (i = 0; i < e->nphix; i++,l++)
         for (g = 0; g < e->ng; g++)
           residual_local[l] += e->weight[g] * e->phi[k][j][i][g] * coef;
-  PetscFunctionReturn(0);
 }
 
-
 #undef __FUNCT__
-#define __FUNCT__ "VF_ResidualVAT13D_local"
+#define __FUNCT__ "VF_ResidualVAT23D_local"
 /*
- VF_ResidualVAT13D_local
+ VF_ResidualVAT23D_local
  
  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
  */
-extern PetscErrorCode VF_ResidualVAT13D_local(PetscReal *residual_local,VFMatProp *matprop,VFProp *vfprop,VFCartFEElement3D *e)
+extern PetscErrorCode VF_ResidualVAT23D_local(PetscReal *residual_local,VFMatProp *matprop,VFProp *vfprop,VFCartFEElement3D *e)
+{
+  PetscFunctionBegin;
+  VF_ResidualVAT23D_Kernel(residual_local,matprop,vfprop,e);
+  PetscFunctionReturn(0);
+}
+
+
+/*
+ VF_ResidualVAT13D_Kernel: VF_ResidualVAT13D_local without the PETSc calls
+ */
+static void VF_ResidualVAT13D_Kernel(PetscReal *residual_local,VFMatProp *matprop,VFProp *vfprop,VFCartFEElement3D *e)
 {
   PetscInt  g,i,j,k,l;
   PetscReal coef = matprop->Gc / vfprop->atCv / vfprop->epsilon *.25;
   
-  PetscFunctionBegin;
   for (l= 0,k= 0; k < e->nphiz; k++)
     for (j = 0; j < e->nphiy; j++)
       for (i = 0; i < e->nphix; i++,l++)
         for (g = 0; g < e->ng; g++)
           residual_local[l] += e->weight[g] * e->phi[k][j][i][g] * coef;
-  PetscFunctionReturn(0);
 }
 
-
 #undef __FUNCT__
-#define __FUNCT__ "VF_AT2SurfaceEnergy3D_local"
+#define __FUNCT__ "VF_ResidualVAT13D_local"
 /*
- VF_AT2SurfaceEnergy3D_local:
+ VF_ResidualVAT13D_local
  
  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
  */
-extern PetscErrorCode VF_AT2SurfaceEnergy3D_local(PetscReal *SurfaceEnergy_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
+extern PetscErrorCode VF_ResidualVAT13D_local(PetscReal *residual_local,VFMatProp *matprop,VFProp *vfprop,VFCartFEElement3D *e)
+{
+  PetscFunctionBegin;
+  VF_ResidualVAT13D_Kernel(residual_local,matprop,vfprop,e);
+  PetscFunctionReturn(0);
+}
+
+
+/*
+ VF_AT2SurfaceEnergy3D_Kernel: VF_AT2SurfaceEnergy3D_local without the PETSc calls
+ */
+extern void VF_AT2SurfaceEnergy3D_Kernel(PetscReal *SurfaceEnergy_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
 {
   PetscInt       g,i,j,k;
-  PetscReal      *v_elem,*gradv_elem[3];
-  PetscErrorCode ierr;
+  PetscReal      v_elem[VFCARTFE_MAXNG3D],gradv_elem[3][VFCARTFE_MAXNG3D];
   PetscReal      coef = matprop->Gc / vfprop->atCv * .25;
   
-  PetscFunctionBegin;
-  ierr = PetscMalloc4(e->ng,&v_elem,e->ng,&gradv_elem[0],e->ng,&gradv_elem[1],e->ng,&gradv_elem[2]);CHKERRQ(ierr);
-  
   for (g = 0; g < e->ng; g++) {
     v_elem[g]        = 0.;
     gradv_elem[0][g] = 0.;
@@ -2420,27 +3770,31 @@ extern PetscErrorCode VF_AT2SurfaceEnergy3D_local(PetscReal *SurfaceEnergy_local
   for (g = 0; g < e->ng; g++)
     *SurfaceEnergy_local += e->weight[g] * ((1. - v_elem[g]) * (1. - v_elem[g]) / vfprop->epsilon
                                             + (gradv_elem[0][g] * gradv_elem[0][g] + gradv_elem[1][g] * gradv_elem[1][g] + gradv_elem[2][g] * gradv_elem[2][g]) * vfprop->epsilon) * coef;
-  ierr = PetscFree4(v_elem,gradv_elem[0],gradv_elem[1],gradv_elem[2]);CHKERRQ(ierr);
-  PetscFunctionReturn(0);
 }
 
 #undef __FUNCT__
-#define __FUNCT__ "VF_AT1SurfaceEnergy3D_local"
+#define __FUNCT__ "VF_AT2SurfaceEnergy3D_local"
 /*
- VF_AT1SurfaceEnergy3D_local:
+ VF_AT2SurfaceEnergy3D_local:
  
  (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
  */
-extern PetscErrorCode VF_AT1SurfaceEnergy3D_local(PetscReal *SurfaceEnergy_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
+extern PetscErrorCode VF_AT2SurfaceEnergy3D_local(PetscReal *SurfaceEnergy_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
+{
+  PetscFunctionBegin;
+  VF_AT2SurfaceEnergy3D_Kernel(SurfaceEnergy_local,v_array,matprop,vfprop,ek,ej,ei,e);
+  PetscFunctionReturn(0);
+}
+
+/*
+ VF_AT1SurfaceEnergy3D_Kernel: VF_AT1SurfaceEnergy3D_local without the PETSc calls
+ */
+extern void VF_AT1SurfaceEnergy3D_Kernel(PetscReal *SurfaceEnergy_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
 {
   PetscInt       g,i,j,k;
-  PetscReal      *v_elem,*gradv_elem[3];
-  PetscErrorCode ierr;
+  PetscReal      v_elem[VFCARTFE_MAXNG3D],gradv_elem[3][VFCARTFE_MAXNG3D];
   PetscReal      coef = matprop->Gc / vfprop->atCv * .25;
   
-  PetscFunctionBegin;
-  ierr = PetscMalloc4(e->ng,&v_elem,e->ng,&gradv_elem[0],e->ng,&gradv_elem[1],e->ng,&gradv_elem[2]);CHKERRQ(ierr);
-  
   for (g = 0; g < e->ng; g++) {
     v_elem[g]        = 0.;
     gradv_elem[0][g] = 0.;
@@ -2460,7 +3814,19 @@ extern PetscErrorCode VF_AT1SurfaceEnergy3D_local(PetscReal *SurfaceEnergy_local
   for (g = 0; g < e->ng; g++)
     *SurfaceEnergy_local += e->weight[g] * ((1. - v_elem[g]) / vfprop->epsilon
                                             + (gradv_elem[0][g] * gradv_elem[0][g] + gradv_elem[1][g] * gradv_elem[1][g] + gradv_elem[2][g] * gradv_elem[2][g]) * vfprop->epsilon) * coef;
-  ierr = PetscFree4(v_elem,gradv_elem[0],gradv_elem[1],gradv_elem[2]);CHKERRQ(ierr);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_AT1SurfaceEnergy3D_local"
+/*
+ VF_AT1SurfaceEnergy3D_local:
+ 
+ (c) 2010-2012 Blaise Bourdin bourdin@lsu.edu
+ */
+extern PetscErrorCode VF_AT1SurfaceEnergy3D_local(PetscReal *SurfaceEnergy_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e)
+{
+  PetscFunctionBegin;
+  VF_AT1SurfaceEnergy3D_Kernel(SurfaceEnergy_local,v_array,matprop,vfprop,ek,ej,ei,e);
   PetscFunctionReturn(0);
 }
 
@@ -2474,6 +3840,7 @@ extern PetscErrorCode VF_AT1SurfaceEnergy3D_local(PetscReal *SurfaceEnergy_local
 extern PetscErrorCode VF_VEnergy3D(PetscReal *SurfaceEnergy,VFFields *fields,VFCtx *ctx)
 {
   PetscErrorCode ierr;
+  VFCartFEElement3D *e3D;
   PetscInt       xs,xm,nx;
   PetscInt       ys,ym,ny;
   PetscInt       zs,zm,nz;
@@ -2481,10 +3848,15 @@ extern PetscErrorCode VF_VEnergy3D(PetscReal *SurfaceEnergy,VFFields *fields,VFC
   Vec            v_localVec;
   PetscReal      ***v_array;
   PetscReal      mySurfaceEnergy= 0.;
-  PetscReal      hx,hy,hz;
   PetscReal      ****coords_array;
+  PetscBool      flg;
   
   PetscFunctionBegin;
+  ierr = VF_VResidualEnergyIsCurrent(fields->V,ctx,&flg);CHKERRQ(ierr);
+  if (flg) {
+    *SurfaceEnergy = ctx->REnergy.SurfaceEnergy;
+    PetscFunctionReturn(0);
+  }
   
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
@@ -2499,22 +3871,24 @@ extern PetscErrorCode VF_VEnergy3D(PetscReal *SurfaceEnergy,VFFields *fields,VFC
   ierr = DMGlobalToLocalEnd(ctx->daScal,fields->V,INSERT_VALUES,v_localVec);CHKERRQ(ierr);
   ierr = DMDAVecGetArray(ctx->daScal,v_localVec,&v_array);CHKERRQ(ierr);
   
+  /*
+    The rows of cells are shared among the OpenMP threads, if any
+  */
+  VFPragmaOMP(parallel for collapse(2) private(ei,e3D) reduction(+:mySurfaceEnergy))
   for (ek = zs; ek < zs + zm; ek++) {
-    for (ej = ys; ej < ys + ym; ej++)
+    for (ej = ys; ej < ys + ym; ej++) {
       for (ei = xs; ei < xs + xm; ei++) {
-        hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+        VFCartFEElementCacheGet3D_Kernel(ctx->feCacheV,ei,ej,ek,&e3D);
         switch (ctx->vfprop.atnum ) {
           case 1:
-            ierr = VF_AT1SurfaceEnergy3D_local(&mySurfaceEnergy,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,&ctx->e3D);CHKERRQ(ierr);
+            VF_AT1SurfaceEnergy3D_Kernel(&mySurfaceEnergy,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3D);
             break;
           case 2:
-            ierr = VF_AT2SurfaceEnergy3D_local(&mySurfaceEnergy,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,&ctx->e3D);CHKERRQ(ierr);
+            VF_AT2SurfaceEnergy3D_Kernel(&mySurfaceEnergy,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3D);
             break;
         }
       }
+    }
   }
   *SurfaceEnergy = 0.;
   
@@ -2525,6 +3899,58 @@ extern PetscErrorCode VF_VEnergy3D(PetscReal *SurfaceEnergy,VFFields *fields,VFC
   PetscFunctionReturn(0);
 }
 
+#undef __FUNCT__
+#define __FUNCT__ "VF_IrrevUpdate"
+/*
+ VF_IrrevUpdate: Adds to ctx->irrevIS the local nodes where VIrrev <= irrevtol.
+ The set of irreversibly broken nodes only grows, so the nodes already in the set are kept, 
+ and the indices remain sorted. Nothing is done if VIrrev has not changed since the last update.
+ */
+extern PetscErrorCode VF_IrrevUpdate(Vec VIrrev,VFProp *vfprop,VFCtx *ctx)
+{
+  PetscErrorCode   ierr;
+  PetscObjectState VIrrevstate;
+  PetscInt         rstart,rend,l,m = 0,nold = 0,n = 0;
+  const PetscInt   *oldidx = NULL;
+  PetscInt         *idx;
+  const PetscReal  *VIrrev_array;
+  IS               irrevIS;
+  
+  PetscFunctionBegin;
+  ierr = PetscObjectStateGet((PetscObject)VIrrev,&VIrrevstate);CHKERRQ(ierr);
+  if (ctx->irrevIS && VIrrev == ctx->irrevV && VIrrevstate == ctx->irrevVstate) PetscFunctionReturn(0);
+  if (VIrrev != ctx->irrevV) {
+    ierr = ISDestroy(&ctx->irrevIS);CHKERRQ(ierr);
+  }
+  
+  ierr = VecGetOwnershipRange(VIrrev,&rstart,&rend);CHKERRQ(ierr);
+  ierr = PetscMalloc1(rend-rstart,&idx);CHKERRQ(ierr);
+  if (ctx->irrevIS) {
+    ierr = ISGetLocalSize(ctx->irrevIS,&nold);CHKERRQ(ierr);
+    ierr = ISGetIndices(ctx->irrevIS,&oldidx);CHKERRQ(ierr);
+  }
+  ierr = VecGetArrayRead(VIrrev,&VIrrev_array);CHKERRQ(ierr);
+  for (l = 0; l < rend-rstart; l++) {
+    if (m < nold && oldidx[m] == rstart+l) {
+      idx[n++] = rstart+l;
+      m++;
+    } else if (VIrrev_array[l] <= vfprop->irrevtol) {
+      idx[n++] = rstart+l;
+    }
+  }
+  ierr = VecRestoreArrayRead(VIrrev,&VIrrev_array);CHKERRQ(ierr);
+  if (ctx->irrevIS) {
+    ierr = ISRestoreIndices(ctx->irrevIS,&oldidx);CHKERRQ(ierr);
+  }
+  ierr = ISCreateGeneral(PETSC_COMM_WORLD,n,idx,PETSC_COPY_VALUES,&irrevIS);CHKERRQ(ierr);
+  ierr = PetscFree(idx);CHKERRQ(ierr);
+  ierr = ISDestroy(&ctx->irrevIS);CHKERRQ(ierr);
+  ctx->irrevIS     = irrevIS;
+  ctx->irrevV      = VIrrev;
+  ctx->irrevVstate = VIrrevstate;
+  PetscFunctionReturn(0);
+}
+
 #undef __FUNCT__
 #define __FUNCT__ "VF_IrrevApplyEQ"
 /*
@@ -2535,54 +3961,12 @@ extern PetscErrorCode VF_VEnergy3D(PetscReal *SurfaceEnergy,VFFields *fields,VFC
 extern PetscErrorCode VF_IrrevApplyEQ(Mat K,Vec RHS,Vec V,Vec VIrrev,VFProp *vfprop,VFCtx *ctx)
 {
   PetscErrorCode ierr;
-  PetscInt       myirrevnum = 0;
-  PetscInt       xs,xm,nx;
-  PetscInt       ys,ym,ny;
-  PetscInt       zs,zm,nz;
-  PetscInt       i,j,k,l = 0;
-  PetscReal      ***V_array,***VIrrev_array,***residual_array;
-  PetscReal      one = 1.;
-  MatStencil     *row;
+
   PetscFunctionBegin;
-  
-  ierr = DMDAGetInfo(ctx->daScal,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
-                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
-  ierr = DMDAGetCorners(ctx->daScal,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  
-  ierr = DMDAVecGetArray(ctx->daScal,V,&V_array);CHKERRQ(ierr);
-  ierr = DMDAVecGetArray(ctx->daScal,VIrrev,&VIrrev_array);CHKERRQ(ierr);
-  ierr = DMDAVecGetArray(ctx->daScal,RHS,&residual_array);CHKERRQ(ierr);
-  
-  /*
-   first pass: RHS, V, and count
-   */
-  for (k = zs; k < zs + zm; k++)
-    for (j = ys; j < ys + ym; j++) {
-      for (i = xs; i < xs + xm; i++)
-        if (VIrrev_array[k][j][i] <= vfprop->irrevtol) {
-          myirrevnum++;
-          residual_array[k][j][i] = 0.;
-          V_array[k][j][i]   = 0.;
-        }
-    }
-  ierr = PetscMalloc(myirrevnum * sizeof(MatStencil),&row);CHKERRQ(ierr);
-  /*
-   second pass: Matrix
-   */
-  for (k = zs; k < zs + zm; k++)
-    for (j = ys; j < ys + ym; j++) {
-      for (i = xs; i < xs + xm; i++)
-        if (VIrrev_array[k][j][i] <= vfprop->irrevtol) {
-          row[l].i = i; row[l].j = j; row[l].k = k; row[l].c = 0;
-          l++;
-        }
-    }
-  ierr = MatZeroRowsStencil(K,myirrevnum,row,one,NULL,NULL);CHKERRQ(ierr);
-  ierr = PetscFree(row);CHKERRQ(ierr);
-  
-  ierr = DMDAVecRestoreArray(ctx->daScal,V,&V_array);CHKERRQ(ierr);
-  ierr = DMDAVecRestoreArray(ctx->daScal,VIrrev,&VIrrev_array);CHKERRQ(ierr);
-  ierr = DMDAVecRestoreArray(ctx->daScal,RHS,&residual_array);CHKERRQ(ierr);
+  ierr = VF_IrrevUpdate(VIrrev,vfprop,ctx);CHKERRQ(ierr);
+  ierr = VecISSet(RHS,ctx->irrevIS,0.);CHKERRQ(ierr);
+  ierr = VecISSet(V,ctx->irrevIS,0.);CHKERRQ(ierr);
+  ierr = MatZeroRowsIS(K,ctx->irrevIS,1.,NULL,NULL);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -2597,33 +3981,10 @@ extern PetscErrorCode VF_IrrevApplyEQ(Mat K,Vec RHS,Vec V,Vec VIrrev,VFProp *vfp
 extern PetscErrorCode VF_IrrevApplyEQVec(Vec RHS,Vec VIrrev,VFProp *vfprop,VFCtx *ctx)
 {
   PetscErrorCode ierr;
-  PetscInt       xs,xm,nx;
-  PetscInt       ys,ym,ny;
-  PetscInt       zs,zm,nz;
-  PetscInt       i,j,k;
-  PetscReal      ***VIrrev_array,***residual_array;
+
   PetscFunctionBegin;
-  
-  ierr = DMDAGetInfo(ctx->daScal,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
-                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
-  ierr = DMDAGetCorners(ctx->daScal,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  
-  ierr = DMDAVecGetArray(ctx->daScal,VIrrev,&VIrrev_array);CHKERRQ(ierr);
-  ierr = DMDAVecGetArray(ctx->daScal,RHS,&residual_array);CHKERRQ(ierr);
-  
-  /*
-   first pass: RHS, V, and count
-   */
-  for (k = zs; k < zs + zm; k++)
-    for (j = ys; j < ys + ym; j++) {
-      for (i = xs; i < xs + xm; i++)
-        if (VIrrev_array[k][j][i] <= vfprop->irrevtol) {
-          residual_array[k][j][i] = 0.;
-        }
-    }
-  
-  ierr = DMDAVecRestoreArray(ctx->daScal,VIrrev,&VIrrev_array);CHKERRQ(ierr);
-  ierr = DMDAVecRestoreArray(ctx->daScal,RHS,&residual_array);CHKERRQ(ierr);
+  ierr = VF_IrrevUpdate(VIrrev,vfprop,ctx);CHKERRQ(ierr);
+  ierr = VecISSet(RHS,ctx->irrevIS,0.);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -2637,61 +3998,103 @@ extern PetscErrorCode VF_IrrevApplyEQVec(Vec RHS,Vec VIrrev,VFProp *vfprop,VFCtx
 extern PetscErrorCode VF_IrrevApplyEQMat(Mat K,Vec VIrrev,VFProp *vfprop,VFCtx *ctx)
 {
   PetscErrorCode ierr;
-  PetscInt       myirrevnum = 0;
-  PetscInt       xs,xm,nx;
-  PetscInt       ys,ym,ny;
-  PetscInt       zs,zm,nz;
-  PetscInt       i,j,k,l = 0;
-  PetscReal      ***VIrrev_array;
-  MatStencil     *row;
+
   PetscFunctionBegin;
+  ierr = VF_IrrevUpdate(VIrrev,vfprop,ctx);CHKERRQ(ierr);
+  ierr = MatZeroRowsColumnsIS(K,ctx->irrevIS,1.,NULL,NULL);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+
+/*
+ VF_SurfaceEnergyRow_Kernel: accumulates in SurfaceEnergy the surface energy of the row of cells (xs ... xe-1,ej,ek)
+ */
+static void VF_SurfaceEnergyRow_Kernel(PetscReal *SurfaceEnergy,PetscReal ***v_array,VFCtx *ctx,PetscInt ek,PetscInt ej,PetscInt xs,PetscInt xe)
+{
+  VFCartFEElement3D *e3D;
+  PetscInt          ei;
   
-  ierr = DMDAGetInfo(ctx->daScal,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
-                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
-  ierr = DMDAGetCorners(ctx->daScal,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  
-  ierr = DMDAVecGetArray(ctx->daScal,VIrrev,&VIrrev_array);CHKERRQ(ierr);
+  for (ei = xs; ei < xe; ei++) {
+    VFCartFEElementCacheGet3D_Kernel(ctx->feCacheV,ei,ej,ek,&e3D);
+    switch (ctx->vfprop.atnum) {
+      case 1:
+        VF_AT1SurfaceEnergy3D_Kernel(SurfaceEnergy,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3D);
+        break;
+      case 2:
+        VF_AT2SurfaceEnergy3D_Kernel(SurfaceEnergy,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3D);
+        break;
+    }
+  }
+}
+
+/*
+ VF_VResidualRowBatch_Kernel: accumulates in residual_array the contribution to the V residual (no unilateral condition)
+ of the row of cells (xs ... xe-1,ej,ek), VFCARTFE_BATCH neighbouring cells at a time.
+ Only the nodes (*,ej..ej+1,ek..ek+1) are written. The flops are added to *flops.
+ The thermo-poro term (VF_ResidualVThermoPoro3D_local) is not computed, since its contribution is overwritten 
+ by VF_BilinearFormVApply3D_local in the per cell loop of VF_VResidual.
+ */
+static void VF_VResidualRowBatch_Kernel(PetscReal ***residual_array,PetscReal ****U_array,PetscReal ***V_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,PetscReal ***pressure_array,VFCtx *ctx,PetscInt ek,PetscInt ej,PetscInt xs,PetscInt xe,PetscLogDouble *flops)
+{
+  VFCartFEElement3D *e3D;
+  PetscInt          ei,nb,b,i,j,k,l,m;
+  PetscReal         residual_local[8],residualBatch_local[8*VFCARTFE_BATCH];
+  PetscReal         ElasticEnergyDensity_elem[VFCARTFE_MAXNG3D*VFCARTFE_BATCH];
   
-  /*
-   first pass: count number of BC
-   */
-  for (k = zs; k < zs + zm; k++)
-    for (j = ys; j < ys + ym; j++) {
-      for (i = xs; i < xs + xm; i++)
-        if (VIrrev_array[k][j][i] <= vfprop->irrevtol) {
-          myirrevnum++;
-        }
+  for (ei = xs; ei < xe; ei += nb) {
+    VFCartFEElementCacheGet3DBatch_Kernel(ctx->feCacheV,ei,ej,ek,xe,&e3D,&nb);
+    ElasticEnergyDensity3DBatch_Kernel(ElasticEnergyDensity_elem,U_array,theta_array,thetaRef_array,
+                                       &ctx->matprop[ctx->layer[ek]],ek,ej,ei,nb,e3D,flops);
+    VF_BilinearFormVApply3DBatch_Kernel(residualBatch_local,V_array,ElasticEnergyDensity_elem,
+                                        &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,nb,e3D,flops);
+    /*
+      The AT1 / AT2 terms do not depend on the fields, so they are computed once per batch
+    */
+    for (m = 0; m < 8; m++) residual_local[m] = 0.;
+    switch (ctx->vfprop.atnum) {
+      case 1:
+        VF_ResidualVAT13D_Kernel(residual_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,e3D);
+        break;
+      case 2:
+        VF_ResidualVAT23D_Kernel(residual_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,e3D);
+        break;
     }
-  ierr = PetscMalloc(myirrevnum * sizeof(MatStencil),&row);CHKERRQ(ierr);
-  /*
-   second pass: Apply BC
-   */
-  for (k = zs; k < zs + zm; k++)
-    for (j = ys; j < ys + ym; j++) {
-      for (i = xs; i < xs + xm; i++)
-        if (VIrrev_array[k][j][i] <= vfprop->irrevtol) {
-          row[l].i = i; row[l].j = j; row[l].k = k; row[l].c = 0;
-          l++;
+    for (m = 0; m < 8; m++) {
+      for (b = 0; b < VFCARTFE_BATCH; b++) {
+        residualBatch_local[m*VFCARTFE_BATCH+b] = residual_local[m] - residualBatch_local[m*VFCARTFE_BATCH+b];
+      }
+    }
+    for (b = 0; b < nb; b++) {
+      if (ctx->hasCrackPressure) {
+        for (m = 0; m < 8; m++) residual_local[m] = 0.;
+        VF_ResidualVCrackPressure3D_Kernel(residual_local,U_array,pressure_array,
+                                           &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei+b,
+                                           e3D,flops);
+        for (m = 0; m < 8; m++) residualBatch_local[m*VFCARTFE_BATCH+b] += residual_local[m];
+      }
+      for (l = 0,k = 0; k < e3D->nphiz; k++) {
+        for (j = 0; j < e3D->nphiy; j++) {
+          for (i = 0; i < e3D->nphix; i++,l++) {
+            residual_array[ek+k][ej+j][ei+b+i] -= residualBatch_local[l*VFCARTFE_BATCH+b];
+          }
         }
+      }
     }
-  ierr = MatZeroRowsColumnsStencil(K,myirrevnum,row,1.,NULL,NULL);CHKERRQ(ierr);
-  ierr = PetscFree(row);CHKERRQ(ierr);
-  
-  ierr = DMDAVecRestoreArray(ctx->daScal,VIrrev,&VIrrev_array);CHKERRQ(ierr);
-  PetscFunctionReturn(0);
+  }
 }
 
-
 #undef __FUNCT__
 #define __FUNCT__ "VF_VResidual"
 extern PetscErrorCode VF_VResidual(SNES snes,Vec V,Vec residual,void *user)
 {
   PetscErrorCode ierr;
+  VFCartFEElement3D *e3D;
   VFCtx          *ctx=(VFCtx*)user;
   PetscInt       xs,xm,nx;
   PetscInt       ys,ym,ny;
   PetscInt       zs,zm,nz;
-  PetscInt       ei,ej,ek,i,j,k,l,m;
+  PetscInt       ei,ej,ek,i,j,k,l,m,g,color;
+  PetscLogDouble flops = 0.;
   PetscInt       nrow = ctx->e3D.nphix * ctx->e3D.nphiy * ctx->e3D.nphiz;
   Vec            residual_localVec,U_localVec,V_localVec;
   Vec            theta_localVec,thetaRef_localVec;
@@ -2700,9 +4103,9 @@ extern PetscErrorCode VF_VResidual(SNES snes,Vec V,Vec residual,void *user)
   PetscReal      ***theta_array,***thetaRef_array;
   PetscReal      ***pressure_array;
   PetscReal      *residual_local;
-  PetscReal      *K_local;
-  PetscReal      hx,hy,hz;
+  PetscReal      ElasticEnergyDensity_elem[VFCARTFE_MAXNG3D],ElasticEnergyDensityD_elem[VFCARTFE_MAXNG3D];
   PetscReal      ****coords_array;
+  PetscReal      mySurfaceEnergy = 0.;
   
   PetscFunctionBegin;
   ierr = VecSet(residual,0.0);CHKERRQ(ierr);
@@ -2760,8 +4163,7 @@ extern PetscErrorCode VF_VResidual(SNES snes,Vec V,Vec residual,void *user)
   /*
    get local mat and residual
    */
-  ierr = PetscMalloc2(nrow,&residual_local,
-                      nrow * nrow,&K_local);CHKERRQ(ierr);
+  ierr = PetscMalloc(nrow * sizeof(PetscReal),&residual_local);CHKERRQ(ierr);
   ierr = DMGetLocalVector(ctx->daScal,&residual_localVec);CHKERRQ(ierr);
   ierr = VecSet(residual_localVec,0.);CHKERRQ(ierr);
   ierr = DMDAVecGetArray(ctx->daScal,residual_localVec,&residual_array);CHKERRQ(ierr);
@@ -2769,82 +4171,80 @@ extern PetscErrorCode VF_VResidual(SNES snes,Vec V,Vec residual,void *user)
   /*
    loop through all elements (ei,ej)
    */
-  for (ek = zs; ek < zs+zm; ek++) {
-    for (ej = ys; ej < ys+ym; ej++)
-      for (ei = xs; ei < xs+xm; ei++) {
-        hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
-        /*
-         Accumulate stiffness matrix
-         */
-        ierr = PetscMemzero(K_local,nrow * nrow * sizeof(PetscReal));
-        switch (ctx->vfprop.atnum ) {
-          case 1:
-            ierr = VF_BilinearFormVAT13D_local(K_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,&ctx->e3D);CHKERRQ(ierr);
-            break;
-          case 2:
-            ierr = VF_BilinearFormVAT23D_local(K_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,&ctx->e3D);CHKERRQ(ierr);
-            break;
+  if (ctx->unilateral == UNILATERAL_NONE) {
+    /*
+      Same as below, row by row, VFCARTFE_BATCH neighbouring cells at a time.
+      Rows with the same parity of ej and ek share no node, so each of the 4 colors is shared among the 
+      OpenMP threads, if any. With -residual_energy, the surface energy of the row is accumulated in the same pass.
+    */
+    for (color = 0; color < 4; color++) {
+      VFPragmaOMP(parallel for collapse(2) reduction(+:mySurfaceEnergy,flops))
+      for (ek = zs + color / 2; ek < zs + zm; ek += 2) {
+        for (ej = ys + color % 2; ej < ys+ym; ej += 2) {
+          VF_VResidualRowBatch_Kernel(residual_array,U_array,V_array,theta_array,thetaRef_array,pressure_array,
+                                      ctx,ek,ej,xs,xs+xm,&flops);
+          if (ctx->residualEnergy) {
+            VF_SurfaceEnergyRow_Kernel(&mySurfaceEnergy,V_array,ctx,ek,ej,xs,xs+xm);
+          }
         }
-        switch (ctx->unilateral) {
-          case UNILATERAL_NONE:
-            ierr = VF_BilinearFormVCoupling3D_local(K_local,U_array,theta_array,thetaRef_array,
+      }
+    }
+    ierr = PetscLogFlops(flops);CHKERRQ(ierr);
+  } else {
+    for (ek = zs; ek < zs+zm; ek++) {
+      for (ej = ys; ej < ys+ym; ej++) {
+        for (ei = xs; ei < xs+xm; ei++) {
+          ierr = VFCartFEElementCacheGet3D(ctx->feCacheV,ei,ej,ek,&e3D);CHKERRQ(ierr);
+          /*
+           Elastic energy density at the integration points (UNILATERAL_NOCOMPRESSION)
+           */
+          ierr = ElasticEnergyDensitySphericalDeviatoricNoCompression3D_local(ElasticEnergyDensity_elem,ElasticEnergyDensityD_elem,
+                                                                              U_array,theta_array,thetaRef_array,
+                                                                              &ctx->matprop[ctx->layer[ek]],ek,ej,ei,e3D);CHKERRQ(ierr);
+          for (g = 0; g < e3D->ng; g++) ElasticEnergyDensity_elem[g] += ElasticEnergyDensityD_elem[g];
+          ierr = VF_ResidualVThermoPoroNoCompression3D_local(residual_local,U_array,theta_array,thetaRef_array,pressure_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3D);
+        
+          /*
+           Accumulate local contributions to residual: -K_local . V, where K_local is the stiffness matrix
+           of the surface energy and coupling terms, applied without being formed
+           */
+          ierr = VF_BilinearFormVApply3D_local(residual_local,V_array,ElasticEnergyDensity_elem,
+                                               &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3D);CHKERRQ(ierr);
+          for (m = 0; m < nrow; m++) residual_local[m] = -residual_local[m];
+          /*
+            Now need to assemble -beta p div u v~ + 3 alpha beta kappa theta p v~
+          */
+        
+          switch (ctx->vfprop.atnum) {
+            case 1:
+              ierr = VF_ResidualVAT13D_local(residual_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,e3D);CHKERRQ(ierr);
+              break;
+            case 2:
+              ierr = VF_ResidualVAT23D_local(residual_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,e3D);CHKERRQ(ierr);
+              break;
+          }
+          if (ctx->hasCrackPressure) {
+            ierr = VF_ResidualVCrackPressure3D_local(residual_local,U_array,pressure_array,
                                            &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,
-                                           &ctx->e3D);CHKERRQ(ierr);
-            ierr = VF_ResidualVThermoPoro3D_local(residual_local,U_array,theta_array,thetaRef_array,pressure_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,&ctx->e3D);
-            break;
-          case UNILATERAL_NOCOMPRESSION:
-            ierr = VF_BilinearFormVCouplingNoCompression3D_local(K_local,U_array,theta_array,thetaRef_array,
-                                                    &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,
-                                                    &ctx->e3D);CHKERRQ(ierr);
-            ierr = VF_ResidualVThermoPoroNoCompression3D_local(residual_local,U_array,theta_array,thetaRef_array,pressure_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,&ctx->e3D);
-            break;
-        }
+                                           e3D);CHKERRQ(ierr);
+          }
         
-        /*
-         Accumulate local contributions to residual
-         */
-        for (m = 0; m < nrow; m++) {
-          residual_local[m] = 0.;
-          for (l= 0,k = 0; k < ctx->e3D.nphiz; k++) {
+          for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
             for (j = 0; j < ctx->e3D.nphiy; j++) {
               for (i = 0; i < ctx->e3D.nphix; i++,l++) {
-                residual_local[m] -= K_local[m*nrow+l] * V_array[ek+k][ej+j][ei+i];
+                residual_array[ek+k][ej+j][ei+i] -= residual_local[l];
               }
             }
           }
+          /*
+           Jump to next element
+           */
         }
-        /*
-          Now need to assemble -beta p div u v~ + 3 alpha beta kappa theta p v~
-        */
-        
-        switch (ctx->vfprop.atnum) {
-          case 1:
-            ierr = VF_ResidualVAT13D_local(residual_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,&ctx->e3D);CHKERRQ(ierr);
-            break;
-          case 2:
-            ierr = VF_ResidualVAT23D_local(residual_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,&ctx->e3D);CHKERRQ(ierr);
-            break;
-        }
-        if (ctx->hasCrackPressure) {
-          ierr = VF_ResidualVCrackPressure3D_local(residual_local,U_array,pressure_array,
-                                         &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,
-                                         &ctx->e3D);CHKERRQ(ierr);
-        }
-        
-        for (l = 0,k = 0; k < ctx->e3D.nphiz; k++) {
-          for (j = 0; j < ctx->e3D.nphiy; j++) {
-            for (i = 0; i < ctx->e3D.nphix; i++,l++) {
-              residual_array[ek+k][ej+j][ei+i] -= residual_local[l];
-            }
-          }
+        if (ctx->residualEnergy) {
+          VF_SurfaceEnergyRow_Kernel(&mySurfaceEnergy,V_array,ctx,ek,ej,xs,xs+xm);
         }
-        /*
-         Jump to next element
-         */
       }
+    }
   }
   ierr = DMDAVecRestoreArray(ctx->daScal,residual_localVec,&residual_array);CHKERRQ(ierr);
   ierr = DMLocalToGlobalBegin(ctx->daScal,residual_localVec,ADD_VALUES,residual);CHKERRQ(ierr);
@@ -2865,7 +4265,10 @@ extern PetscErrorCode VF_VResidual(SNES snes,Vec V,Vec residual,void *user)
   ierr = DMRestoreLocalVector(ctx->daScal,&thetaRef_localVec);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArray(ctx->daScal,pressure_localVec,&pressure_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daScal,&pressure_localVec);CHKERRQ(ierr);  
-  ierr = PetscFree2(residual_local,K_local);CHKERRQ(ierr);
+  ierr = PetscFree(residual_local);CHKERRQ(ierr);
+  if (ctx->residualEnergy) {
+    ierr = VF_VResidualEnergySet(V,mySurfaceEnergy,ctx);CHKERRQ(ierr);
+  }
   
   if (ctx->vfprop.atnum == 2)
     ierr = VF_IrrevApplyEQVec(residual,ctx->fields->VIrrev,&(ctx->vfprop),ctx);CHKERRQ(ierr);
@@ -2883,6 +4286,7 @@ extern PetscErrorCode VF_VResidual(SNES snes,Vec V,Vec residual,void *user)
 extern PetscErrorCode VF_VIJacobian(SNES snes,Vec V,Mat Jac,Mat Jacpre,void *user)
 {
   PetscErrorCode ierr;
+  VFCartFEElement3D *e3D;
   VFCtx          *ctx=(VFCtx*)user;
   PetscInt       xs,xm,nx;
   PetscInt       ys,ym,ny;
@@ -2895,8 +4299,6 @@ extern PetscErrorCode VF_VIJacobian(SNES snes,Vec V,Mat Jac,Mat Jacpre,void *use
   PetscReal      ***theta_array,***thetaRef_array;
   PetscReal      *Jac_local;
   MatStencil     *row;
-  PetscReal      hx,hy,hz;
-  PetscReal      ****coords_array;
   
   PetscFunctionBegin;
   /*
@@ -2911,12 +4313,7 @@ extern PetscErrorCode VF_VIJacobian(SNES snes,Vec V,Mat Jac,Mat Jacpre,void *use
    */
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
   
-  ierr = MatZeroEntries(Jacpre);CHKERRQ(ierr);
-  /*
-   Get coordinates
-   */
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
-  
+  ierr = VFCartFEMatCOOZeroEntries(&ctx->cooV,Jacpre);CHKERRQ(ierr);
   /*
    get U_array
    */
@@ -2948,32 +4345,29 @@ extern PetscErrorCode VF_VIJacobian(SNES snes,Vec V,Mat Jac,Mat Jacpre,void *use
   for (ek = zs; ek < zs+zm; ek++) {
     for (ej = ys; ej < ys+ym; ej++) {
       for (ei = xs; ei < xs+xm; ei++) {
-        hx   = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy   = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz   = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCacheV,ei,ej,ek,&e3D);CHKERRQ(ierr);
         /*
          Accumulate stiffness matrix
          */
         ierr = PetscMemzero(Jac_local,nrow * nrow * sizeof(PetscReal));
         switch (ctx->vfprop.atnum ) {
           case 1:
-            ierr = VF_BilinearFormVAT13D_local(Jac_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,&ctx->e3D);CHKERRQ(ierr);
+            ierr = VF_BilinearFormVAT13D_local(Jac_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,e3D);CHKERRQ(ierr);
             break;
           case 2:
-            ierr = VF_BilinearFormVAT23D_local(Jac_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,&ctx->e3D);CHKERRQ(ierr);
+            ierr = VF_BilinearFormVAT23D_local(Jac_local,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,e3D);CHKERRQ(ierr);
             break;
         }
         switch (ctx->unilateral) {
           case UNILATERAL_NONE:
             ierr = VF_BilinearFormVCoupling3D_local(Jac_local,U_array,theta_array,thetaRef_array,
                                            &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,
-                                           &ctx->e3D);CHKERRQ(ierr);
+                                           e3D);CHKERRQ(ierr);
             break;
           case UNILATERAL_NOCOMPRESSION:
             ierr = VF_BilinearFormVCouplingNoCompression3D_local(Jac_local,U_array,theta_array,thetaRef_array,
                                                     &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,
-                                                    &ctx->e3D);CHKERRQ(ierr);
+                                                    e3D);CHKERRQ(ierr);
             break;
         }
         /*
@@ -2994,7 +4388,7 @@ extern PetscErrorCode VF_VIJacobian(SNES snes,Vec V,Mat Jac,Mat Jacpre,void *use
         /*
          Add local stiffness matrix to global stiffness natrix
          */
-        ierr = MatSetValuesStencil(Jacpre,nrow,row,nrow,row,Jac_local,ADD_VALUES);CHKERRQ(ierr);
+        ierr = VFCartFEMatCOOSetValuesStencil(&ctx->cooV,Jacpre,ei,ej,ek,nrow,row,nrow,row,Jac_local);CHKERRQ(ierr);
         
         /*
          Jump to next element
@@ -3002,14 +4396,13 @@ extern PetscErrorCode VF_VIJacobian(SNES snes,Vec V,Mat Jac,Mat Jacpre,void *use
       }
     }
   }
+  ierr = VFCartFEMatCOOAssemble(&ctx->cooV,Jacpre);CHKERRQ(ierr);
   ierr = MatAssemblyBegin(Jacpre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
   ierr = MatAssemblyEnd(Jacpre,MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
   
   /*
    Cleanup
    */
-  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
-  
   ierr = DMDAVecRestoreArrayDOF(ctx->daVect,U_localVec,&U_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daVect,&U_localVec);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArray(ctx->daScal,theta_localVec,&theta_array);CHKERRQ(ierr);
@@ -3063,6 +4456,9 @@ extern PetscErrorCode VF_StepV(VFFields *fields,VFCtx *ctx)
   
   PetscFunctionBegin;
   ierr = SNESSolve(ctx->snesV,NULL,fields->V);CHKERRQ(ierr);
+  if (ctx->residualEnergy) {
+    ierr = VF_VResidualEnergyAttach(fields->V,ctx);CHKERRQ(ierr);
+  }
   if (ctx->verbose > 1) {
     ierr = VecView(fields->V,PETSC_VIEWER_STDOUT_WORLD);CHKERRQ(ierr);
   }
@@ -19,8 +19,30 @@ extern PetscErrorCode ElasticEnergyDensitySphericalDeviatoric3D_local(PetscReal
                                                                       VFCartFEElement3D *e);
 */
 extern PetscErrorCode VF_UEnergy3D(PetscReal *ElasticEnergy,PetscReal *OverbdnWork,PetscReal *PressureWork,Vec U,VFCtx *ctx);
+/*
+  Element kernels of the energies, also used by the diagnostics of VFPermfield
+*/
+extern PetscErrorCode VF_ElasticEnergyRowBatch_local(PetscReal *ElasticEnergy,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,PetscReal ***pressure_array,VFCtx *ctx,PetscInt ek,PetscInt ej,PetscInt xs,PetscInt xe);
+extern PetscErrorCode VF_ElasticEnergyNoCompression3D_local(PetscReal *ElasticEnergy_local,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e);
+extern PetscErrorCode VF_PressureWork3D_local(PetscReal *PressureWork_local,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e);
+extern PetscErrorCode VF_InSituStressWorkCell_local(PetscReal *InsituWork,PetscReal ****u_array,PetscReal ****f_array,PetscReal ****coords_array,PetscReal *BBmin,PetscReal *BBmax,VFCtx *ctx,PetscInt nx,PetscInt ny,PetscInt nz,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e3D);
+extern PetscErrorCode VF_AT1SurfaceEnergy3D_local(PetscReal *SurfaceEnergy_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e);
+extern PetscErrorCode VF_AT2SurfaceEnergy3D_local(PetscReal *SurfaceEnergy_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e);
+extern void VF_ElasticEnergyRowBatch_Kernel(PetscReal *ElasticEnergy,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***theta_array,PetscReal ***thetaRef_array,PetscReal ***pressure_array,VFCtx *ctx,PetscInt ek,PetscInt ej,PetscInt xs,PetscInt xe,PetscLogDouble *flops);
+extern void VF_PressureWork3D_Kernel(PetscReal *PressureWork_local,PetscReal ****u_array,PetscReal ***v_array,PetscReal ***pressure_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e,PetscLogDouble *flops);
+extern void VF_AT1SurfaceEnergy3D_Kernel(PetscReal *SurfaceEnergy_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e);
+extern void VF_AT2SurfaceEnergy3D_Kernel(PetscReal *SurfaceEnergy_local,PetscReal ***v_array,VFMatProp *matprop,VFProp *vfprop,PetscInt ek,PetscInt ej,PetscInt ei,VFCartFEElement3D *e);
 
 extern PetscErrorCode VF_StepU(VFFields *fields,VFCtx *ctx);
+extern PetscErrorCode VF_USuperpositionIsCurrent(Vec U,VFCtx *ctx,PetscBool *flg);
+extern PetscErrorCode VF_USuperpositionDestroy(VFCtx *ctx);
+extern PetscErrorCode VF_UResidualEnergySet(Vec U,PetscReal ElasticEnergy,PetscReal PressureWork,PetscReal InsituWork,VFCtx *ctx);
+extern PetscErrorCode VF_UResidualEnergyAttach(Vec U,VFCtx *ctx);
+extern PetscErrorCode VF_UResidualEnergyIsCurrent(Vec U,VFCtx *ctx,PetscBool *flg);
+extern PetscErrorCode VF_VResidualEnergySet(Vec V,PetscReal SurfaceEnergy,VFCtx *ctx);
+extern PetscErrorCode VF_VResidualEnergyAttach(Vec V,VFCtx *ctx);
+extern PetscErrorCode VF_VResidualEnergyIsCurrent(Vec V,VFCtx *ctx,PetscBool *flg);
+extern PetscErrorCode VF_IrrevUpdate(Vec VIrrev,VFProp *vfprop,VFCtx *ctx);
 extern PetscErrorCode VF_VEnergy3D(PetscReal *SurfaceEnergy,VFFields *fields,VFCtx *ctx);
 extern PetscErrorCode VF_StepV(VFFields *fields,VFCtx *ctx);
 /*
@@ -34,4 +56,12 @@ extern PetscErrorCode VF_VSNESMonitor(SNES snes,PetscInt its,PetscReal fnorm,voi
 extern PetscErrorCode VF_UIJacobian(SNES snes,Vec U,Mat Jac,Mat Jac1,void *user);
 extern PetscErrorCode VF_UResidual(SNES snes,Vec U,Vec Func,void *user);
 
+extern PetscErrorCode VF_UStiffnessSetUp(VFUStiffness *K,VFMatProp *matprop,PetscReal hx,PetscReal hy,PetscReal hz,VFCartFEElement3D *e);
+extern PetscErrorCode VF_UStiffnessDestroy(VFUStiffness *K);
+
+extern PetscErrorCode VF_UMatFreeInitialize(VFCtx *ctx,Mat *K);
+extern PetscErrorCode VF_UMatFreePCSetUp(PC pc,VFCtx *ctx);
+extern PetscErrorCode VF_UMatFreeJacobian(SNES snes,Vec U,Mat Jac,Mat Jac1,void *user);
+extern PetscErrorCode VF_UMatFreeFinalize(VFCtx *ctx);
+
 #endif
@@ -8,27 +8,186 @@
 #include "petsc.h"
 #include "VFCartFE.h"
 #include "VFCommon.h"
+#include "VFMech.h"
 #include "VFPermfield.h"
 
 #undef __FUNCT__
-#define __FUNCT__ "VolumetricCrackOpening3D_local"
-extern PetscErrorCode VolumetricCrackOpening3D_local(PetscReal *CrackVolume_local, PetscReal ***volcrackopening_array, PetscReal ****displ_array, PetscReal ***vfield_array, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e)
+#define __FUNCT__ "VFDamageBandUpdate"
+/*
+  VFDamageBandUpdate: updates the list of the local cells of daScalCell where V is not uniformly 0 or 1 
+  (up to ctx->bandTol), dilated by ctx->bandDilation layers of cells. The cells outside the band have 
+  grad V = 0 and 0 or 1 as average V, so that they do not contribute to the fracture sweeps. This only holds
+  exactly for the default bandTol = 0: with a positive tolerance, the nearly intact or broken cells also lose
+  their fracture flow coupling terms.
+  The update is incremental: only the cells with a node where V changed since the last call are 
+  re-evaluated, and only the cells which entered or left the band update the number of band cells 
+  around each local cell. The band cells are exchanged through ctx->daBand, whose stencil width is
+  the dilation, so that the dilation crosses the process boundaries.
+*/
+extern PetscErrorCode VFDamageBandUpdate(VFCtx *ctx,Vec V)
+{
+  PetscErrorCode   ierr;
+  PetscObjectState Vstate;
+  PetscInt         nx,ny,nz,x_nprocs,y_nprocs,z_nprocs;
+  const PetscInt   *lx,*ly,*lz;
+  PetscInt         xs,xm,ys,ym,zs,zm;
+  PetscInt         gxs,gxm,gys,gym,gzs,gzm;
+  PetscInt         ei,ej,ek,i,j,k,l,d,inc;
+  PetscBool        first,changed,rebuild = PETSC_FALSE;
+  Vec              v_local,active,active_local;
+  PetscReal        ***v_array,***vold_array;
+  PetscReal        ***active_array,***activeold_array;
+  PetscReal        vmin,vmax;
+  
+  PetscFunctionBegin;
+  ierr = PetscObjectStateGet((PetscObject)V,&Vstate);CHKERRQ(ierr);
+  if (ctx->bandMask && V == ctx->bandV && Vstate == ctx->bandVstate) PetscFunctionReturn(0);
+  
+  d     = ctx->bandDilation;
+  first = (PetscBool)(!ctx->bandMask);
+  ierr  = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  if (first) {
+    ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,&x_nprocs,&y_nprocs,&z_nprocs,
+                       NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+    ierr = DMDAGetOwnershipRanges(ctx->daScalCell,&lx,&ly,&lz);CHKERRQ(ierr);
+    ierr = DMDACreate3d(PETSC_COMM_WORLD,DM_BOUNDARY_NONE,DM_BOUNDARY_NONE,DM_BOUNDARY_NONE,
+                        DMDA_STENCIL_BOX,nx,ny,nz,x_nprocs,y_nprocs,z_nprocs,1,d,
+                        lx,ly,lz,&ctx->daBand);CHKERRQ(ierr);
+    ierr = DMSetUp(ctx->daBand);CHKERRQ(ierr);
+    ierr = DMCreateLocalVector(ctx->daBand,&ctx->bandActive);CHKERRQ(ierr);
+    ierr = VecSet(ctx->bandActive,0.);CHKERRQ(ierr);
+    ierr = DMCreateLocalVector(ctx->daScal,&ctx->bandVlocal);CHKERRQ(ierr);
+    ierr = PetscMalloc3(xm*ym*zm,&ctx->bandMask,3*xm*ym*zm,&ctx->bandCell,xm*ym*zm,&ctx->bandCount);CHKERRQ(ierr);
+    ierr = PetscMemzero(ctx->bandMask,xm*ym*zm*sizeof(PetscBool));CHKERRQ(ierr);
+    ierr = PetscMemzero(ctx->bandCount,xm*ym*zm*sizeof(PetscInt));CHKERRQ(ierr);
+    ctx->nBand = 0;
+  }
+  ierr = DMDAGetGhostCorners(ctx->daBand,&gxs,&gys,&gzs,&gxm,&gym,&gzm);CHKERRQ(ierr);
+  
+  ierr = DMGetLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daScal,V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daScal,V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScal,ctx->bandVlocal,&vold_array);CHKERRQ(ierr);
+  /*
+    Re-evaluate the local cells with a node where V changed
+  */
+  ierr = DMGetGlobalVector(ctx->daBand,&active);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daBand,active,&active_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daBand,ctx->bandActive,&activeold_array);CHKERRQ(ierr);
+  for (ek = zs; ek < zs+zm; ek++) {
+    for (ej = ys; ej < ys+ym; ej++) {
+      for (ei = xs; ei < xs+xm; ei++) {
+        changed = first;
+        vmin    = vmax = v_array[ek][ej][ei];
+        for (k = 0; k < 2; k++) {
+          for (j = 0; j < 2; j++) {
+            for (i = 0; i < 2; i++) {
+              vmin = PetscMin(vmin,v_array[ek+k][ej+j][ei+i]);
+              vmax = PetscMax(vmax,v_array[ek+k][ej+j][ei+i]);
+              if (v_array[ek+k][ej+j][ei+i] != vold_array[ek+k][ej+j][ei+i]) changed = PETSC_TRUE;
+            }
+          }
+        }
+        if (changed) {
+          active_array[ek][ej][ei] = (vmin < 1.-ctx->bandTol && vmax > ctx->bandTol) ? 1. : 0.;
+        } else {
+          active_array[ek][ej][ei] = activeold_array[ek][ej][ei];
+        }
+      }
+    }
+  }
+  ierr = DMDAVecRestoreArray(ctx->daBand,ctx->bandActive,&activeold_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daBand,active,&active_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daScal,ctx->bandVlocal,&vold_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
+  ierr = VecCopy(v_local,ctx->bandVlocal);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
+  /*
+    Only the ghosted cells which entered or left the band update the band count of the local cells
+    within d layers
+  */
+  ierr = DMGetLocalVector(ctx->daBand,&active_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daBand,active,INSERT_VALUES,active_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daBand,active,INSERT_VALUES,active_local);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daBand,&active);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daBand,active_local,&active_array);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daBand,ctx->bandActive,&activeold_array);CHKERRQ(ierr);
+  for (ek = gzs; ek < gzs+gzm; ek++) {
+    for (ej = gys; ej < gys+gym; ej++) {
+      for (ei = gxs; ei < gxs+gxm; ei++) {
+        if (active_array[ek][ej][ei] == activeold_array[ek][ej][ei]) continue;
+        inc = (active_array[ek][ej][ei] > 0.) ? 1 : -1;
+        for (k = PetscMax(ek-d,zs); k <= PetscMin(ek+d,zs+zm-1); k++) {
+          for (j = PetscMax(ej-d,ys); j <= PetscMin(ej+d,ys+ym-1); j++) {
+            for (i = PetscMax(ei-d,xs); i <= PetscMin(ei+d,xs+xm-1); i++) {
+              l = ((k-zs)*ym+j-ys)*xm+i-xs;
+              ctx->bandCount[l] += inc;
+              if ((PetscBool)(ctx->bandCount[l] > 0) != ctx->bandMask[l]) {
+                ctx->bandMask[l] = (PetscBool)(ctx->bandCount[l] > 0);
+                rebuild          = PETSC_TRUE;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  ierr = DMDAVecRestoreArray(ctx->daBand,ctx->bandActive,&activeold_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daBand,active_local,&active_array);CHKERRQ(ierr);
+  ierr = VecCopy(active_local,ctx->bandActive);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daBand,&active_local);CHKERRQ(ierr);
+  
+  if (rebuild) {
+    ctx->nBand = 0;
+    for (l = 0,ek = zs; ek < zs+zm; ek++) {
+      for (ej = ys; ej < ys+ym; ej++) {
+        for (ei = xs; ei < xs+xm; ei++,l++) {
+          if (ctx->bandMask[l]) {
+            ctx->bandCell[3*ctx->nBand]   = ei;
+            ctx->bandCell[3*ctx->nBand+1] = ej;
+            ctx->bandCell[3*ctx->nBand+2] = ek;
+            ctx->nBand++;
+          }
+        }
+      }
+    }
+  }
+  ctx->bandV      = V;
+  ctx->bandVstate = Vstate;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFDamageBandDestroy"
+extern PetscErrorCode VFDamageBandDestroy(VFCtx *ctx)
 {
   PetscErrorCode ierr;
+  
+  PetscFunctionBegin;
+  ierr = PetscFree3(ctx->bandMask,ctx->bandCell,ctx->bandCount);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->bandActive);CHKERRQ(ierr);
+  ierr = VecDestroy(&ctx->bandVlocal);CHKERRQ(ierr);
+  ierr = DMDestroy(&ctx->daBand);CHKERRQ(ierr);
+  ctx->nBand = 0;
+  PetscFunctionReturn(0);
+}
+
+/*
+  VolumetricCrackOpening3D_Kernel: VolumetricCrackOpening3D_local without the PETSc calls, the values at the integration points are on the stack
+*/
+static void VolumetricCrackOpening3D_Kernel(PetscReal *CrackVolume_local, PetscReal ***volcrackopening_array, PetscReal ****displ_array, PetscReal ***vfield_array, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e)
+{
   PetscInt    i, j, k;
   PetscInt    eg;
-  PetscReal   *dx_vfield_loc;
-  PetscReal   *dy_vfield_loc;
-  PetscReal   *dz_vfield_loc;
-  PetscReal   *udispl_loc;
-  PetscReal   *vdispl_loc;
-  PetscReal   *wdispl_loc;
+  PetscReal   dx_vfield_loc[VFCARTFE_MAXNG3D];
+  PetscReal   dy_vfield_loc[VFCARTFE_MAXNG3D];
+  PetscReal   dz_vfield_loc[VFCARTFE_MAXNG3D];
+  PetscReal   udispl_loc[VFCARTFE_MAXNG3D];
+  PetscReal   vdispl_loc[VFCARTFE_MAXNG3D];
+  PetscReal   wdispl_loc[VFCARTFE_MAXNG3D];
   PetscReal   element_vol = 0;
   
-  PetscFunctionBegin;
-  ierr = PetscMalloc3(e->ng,&dx_vfield_loc,e->ng,&dy_vfield_loc,e->ng,&dz_vfield_loc);CHKERRQ(ierr);
-  ierr = PetscMalloc3(e->ng,&udispl_loc,e->ng,&vdispl_loc,e->ng,&wdispl_loc);CHKERRQ(ierr);
-  
   for (eg = 0; eg < e->ng; eg++){
     udispl_loc[eg] = 0.;
     vdispl_loc[eg] = 0.;
@@ -64,9 +223,14 @@ extern PetscErrorCode VolumetricCrackOpening3D_local(PetscReal *CrackVolume_loca
     *CrackVolume_local += (udispl_loc[eg]*dx_vfield_loc[eg] + vdispl_loc[eg]*dy_vfield_loc[eg] + wdispl_loc[eg]*dz_vfield_loc[eg])*e->weight[eg];
   }
   volcrackopening_array[ek][ej][ei] = volcrackopening_array[ek][ej][ei]/element_vol;
-  
-  ierr = PetscFree3(dx_vfield_loc,dy_vfield_loc,dz_vfield_loc);CHKERRQ(ierr);
-  ierr = PetscFree3(udispl_loc,vdispl_loc,wdispl_loc);CHKERRQ(ierr);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VolumetricCrackOpening3D_local"
+extern PetscErrorCode VolumetricCrackOpening3D_local(PetscReal *CrackVolume_local, PetscReal ***volcrackopening_array, PetscReal ****displ_array, PetscReal ***vfield_array, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e)
+{
+  PetscFunctionBegin;
+  VolumetricCrackOpening3D_Kernel(CrackVolume_local,volcrackopening_array,displ_array,vfield_array,ek,ej,ei,e);
   PetscFunctionReturn(0);
 }
 
@@ -75,12 +239,12 @@ extern PetscErrorCode VolumetricCrackOpening3D_local(PetscReal *CrackVolume_loca
 extern PetscErrorCode VolumetricCrackOpening(PetscReal *CrackVolume, VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode  ierr;
+  VFCartFEElement3D *e3D;
   PetscInt        ek, ej, ei;
+  PetscInt        b;
   PetscInt        xs,xm,nx;
   PetscInt        ys,ym,ny;
   PetscInt        zs,zm,nz;
-  PetscReal       hx,hy,hz;
-  PetscReal       ****coords_array;
   PetscReal       ****u_array;
   Vec             u_local;
   PetscReal       ***v_array;
@@ -89,13 +253,21 @@ extern PetscErrorCode VolumetricCrackOpening(PetscReal *CrackVolume, VFCtx *ctx,
   Vec             CellVolCrackOpening;
   Vec             VolCrackOpening_local;
   PetscReal       ***volcrackopening_array;
+  PetscBool       flg;
   
   
   PetscFunctionBegin;
+  if (ctx->USuperposition) {
+    ierr = VF_USuperpositionIsCurrent(fields->U,ctx,&flg);CHKERRQ(ierr);
+    if (flg) {
+      *CrackVolume = ctx->USup.CrackVolume[0] + ctx->USup.p * ctx->USup.CrackVolume[1];
+      ierr = VecWAXPY(fields->VolCrackOpening,ctx->USup.p,ctx->USup.VolCrackOpening1,ctx->USup.VolCrackOpening0);CHKERRQ(ierr);
+      PetscFunctionReturn(0);
+    }
+  }
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   
   
   ierr = DMGetLocalVector(ctx->daVect,&u_local);CHKERRQ(ierr);
@@ -116,21 +288,15 @@ extern PetscErrorCode VolumetricCrackOpening(PetscReal *CrackVolume, VFCtx *ctx,
   ierr = DMDAVecGetArray(ctx->daScalCell,VolCrackOpening_local,&volcrackopening_array);CHKERRQ(ierr);
   
   *CrackVolume = 0.;
-  for (ek = zs; ek < zs+zm; ek++) {
-    for (ej = ys; ej < ys+ym; ej++) {
-      for (ei = xs; ei < xs+xm; ei++) {
-        hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
-        ierr = VolumetricCrackOpening3D_local(&myCrackVolumeLocal, volcrackopening_array, u_array, v_array, ek, ej, ei, &ctx->e3D);CHKERRQ(ierr);
-        myCrackVolume += myCrackVolumeLocal;
-      }
-    }
+  ierr = VFDamageBandUpdate(ctx,fields->V);CHKERRQ(ierr);
+  for (b = 0; b < ctx->nBand; b++) {
+    ei = ctx->bandCell[3*b]; ej = ctx->bandCell[3*b+1]; ek = ctx->bandCell[3*b+2];
+    ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
+    ierr = VolumetricCrackOpening3D_local(&myCrackVolumeLocal, volcrackopening_array, u_array, v_array, ek, ej, ei, e3D);CHKERRQ(ierr);
+    myCrackVolume += myCrackVolumeLocal;
   }
   ierr = MPI_Allreduce(&myCrackVolume,CrackVolume,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
   
-  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArrayDOF(ctx->daVect,u_local,&u_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daVect,&u_local);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArray(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
@@ -262,12 +428,650 @@ extern PetscErrorCode ComputeUcdotGradVlocal(PetscReal *cod, PetscReal *grad_ele
   PetscFunctionReturn(0);
 }
 
+#undef __FUNCT__
+#define __FUNCT__ "VF_WidthCacheCompute"
+/*
+  VF_WidthCacheCompute: computes the values of ComputeAveVGradVandNormal_local at the centre of every cell 
+  of the locator loc. The fields of the cell (ei,ej,ek) are stored in 
+  wc[((ek-loc->s[2])*loc->m[1]+ej-loc->s[1])*loc->m[0]+ei-loc->s[0])*VF_WIDTHCACHE_NC+...]
+*/
+static PetscErrorCode VF_WidthCacheCompute(PetscReal *wc,VFCartFELocator *loc,PetscReal ****u_array,PetscReal ***v_array)
+{
+  PetscInt        ek,ej,ei,k,j,i,c;
+  PetscReal       idx,idy,idz,vn,mag,*f;
+  
+  PetscFunctionBegin;
+  for (ek = loc->s[2]; ek < loc->s[2]+loc->m[2]; ek++) {
+    idz = 1./(4.*(loc->x[2][ek-loc->s[2]+1]-loc->x[2][ek-loc->s[2]]));
+    for (ej = loc->s[1]; ej < loc->s[1]+loc->m[1]; ej++) {
+      idy = 1./(4.*(loc->x[1][ej-loc->s[1]+1]-loc->x[1][ej-loc->s[1]]));
+      f = &wc[(((ek-loc->s[2])*loc->m[1]+ej-loc->s[1])*loc->m[0])*VF_WIDTHCACHE_NC];
+      for (ei = loc->s[0]; ei < loc->s[0]+loc->m[0]; ei++,f += VF_WIDTHCACHE_NC) {
+        idx = 1./(4.*(loc->x[0][ei-loc->s[0]+1]-loc->x[0][ei-loc->s[0]]));
+        for (c = 0; c < VF_WIDTHCACHE_NC; c++) f[c] = 0.;
+        for (k = 0; k < 2; k++) {
+          for (j = 0; j < 2; j++) {
+            for (i = 0; i < 2; i++) {
+              f[0] += v_array[ek+k][ej+j][ei+i];
+              vn   = v_array[ek+k][ej+j][ei+i];
+              f[1] += (i ? vn : -vn) * idx;
+              f[2] += (j ? vn : -vn) * idy;
+              f[3] += (k ? vn : -vn) * idz;
+              for (c = 0; c < 3; c++) f[7+c] += u_array[ek+k][ej+j][ei+i][c];
+            }
+          }
+        }
+        f[0] *= .125;
+        for (c = 0; c < 3; c++) f[7+c] *= .125;
+        mag = sqrt(f[1]*f[1]+f[2]*f[2]+f[3]*f[3]);
+        if (mag > 0. && !PetscIsInfOrNanScalar(mag)) {
+          for (c = 0; c < 3; c++) f[4+c] = f[1+c]/mag;
+        }
+      }
+    }
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_WidthCacheSample"
+/*
+  VF_WidthCacheSample: interpolates the cached cell centred fields at the point x of the cell (ei,ej,ek), 
+  trilinearly between the centres of the 8 cells surrounding x. The interpolation is clamped to the 
+  nearest centre on the boundary of the cells of the locator. The normal is the normalized interpolated grad V.
+*/
+static PetscErrorCode VF_WidthCacheSample(PetscReal *v_elem,PetscReal *grad_cc,PetscReal *n_cc,PetscReal *u_cc,const PetscReal *wc,VFCartFELocator *loc,const PetscReal *x,PetscInt ei,PetscInt ej,PetscInt ek)
+{
+  PetscInt        d,r,i,j,k,c,idx[3],i0[3],i1[3];
+  PetscReal       w1[3],xc0,xc1,w,mag;
+  const PetscReal *f;
+  
+  PetscFunctionBegin;
+  idx[0] = ei-loc->s[0]; idx[1] = ej-loc->s[1]; idx[2] = ek-loc->s[2];
+  for (d = 0; d < 3; d++) {
+    r   = idx[d];
+    xc0 = .5*(loc->x[d][r]+loc->x[d][r+1]);
+    if (x[d] < xc0 && r > 0) {
+      i0[d] = r-1; i1[d] = r;
+    } else if (x[d] >= xc0 && r < loc->m[d]-1) {
+      i0[d] = r; i1[d] = r+1;
+    } else {
+      i0[d] = i1[d] = r;
+    }
+    w1[d] = 0.;
+    if (i1[d] != i0[d]) {
+      xc0   = .5*(loc->x[d][i0[d]]+loc->x[d][i0[d]+1]);
+      xc1   = .5*(loc->x[d][i1[d]]+loc->x[d][i1[d]+1]);
+      w1[d] = PetscMin(PetscMax((x[d]-xc0)/(xc1-xc0),0.),1.);
+    }
+  }
+  *v_elem = 0.;
+  for (c = 0; c < 3; c++) {
+    grad_cc[c] = 0.;
+    n_cc[c]    = 0.;
+    u_cc[c]    = 0.;
+  }
+  for (k = 0; k < 2; k++) {
+    for (j = 0; j < 2; j++) {
+      for (i = 0; i < 2; i++) {
+        w = (i ? w1[0] : 1.-w1[0]) * (j ? w1[1] : 1.-w1[1]) * (k ? w1[2] : 1.-w1[2]);
+        f = &wc[(((k ? i1[2] : i0[2])*loc->m[1]+(j ? i1[1] : i0[1]))*loc->m[0]+(i ? i1[0] : i0[0]))*VF_WIDTHCACHE_NC];
+        *v_elem += w * f[0];
+        for (c = 0; c < 3; c++) {
+          grad_cc[c] += w * f[1+c];
+          u_cc[c]    += w * f[7+c];
+        }
+      }
+    }
+  }
+  mag = sqrt(grad_cc[0]*grad_cc[0]+grad_cc[1]*grad_cc[1]+grad_cc[2]*grad_cc[2]);
+  if (mag > 0. && !PetscIsInfOrNanScalar(mag)) {
+    for (c = 0; c < 3; c++) n_cc[c] = grad_cc[c]/mag;
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_WidthCacheGet"
+/*
+  VF_WidthCacheGet: copies the cached cell centred fields of the cell (ei,ej,ek)
+*/
+static PetscErrorCode VF_WidthCacheGet(PetscReal *v_elem,PetscReal *grad_cc,PetscReal *n_cc,PetscReal *u_cc,const PetscReal *wc,VFCartFELocator *loc,PetscInt ei,PetscInt ej,PetscInt ek)
+{
+  PetscInt        c;
+  const PetscReal *f;
+  
+  PetscFunctionBegin;
+  f = &wc[(((ek-loc->s[2])*loc->m[1]+ej-loc->s[1])*loc->m[0]+ei-loc->s[0])*VF_WIDTHCACHE_NC];
+  *v_elem = f[0];
+  for (c = 0; c < 3; c++) {
+    grad_cc[c] = f[1+c];
+    n_cc[c]    = f[4+c];
+    u_cc[c]    = f[7+c];
+  }
+  PetscFunctionReturn(0);
+}
+
+/*
+  State of a ray of the distributed width integration. Only made of PetscReal, so that it can be sent as 
+  VF_WIDTHRAY_NR MPIU_REAL
+*/
+typedef struct {
+  PetscReal       x[3];               /* next sample */
+  PetscReal       n[3];               /* current direction */
+  PetscReal       ref[3];             /* signed normal at the origin, the ray stops when n.ref < 0 */
+  PetscReal       coorda[3];          /* centre of the origin cell */
+  PetscReal       grad[3];            /* grad V at the previous sample */
+  PetscReal       cod;                /* u.grad V at the previous sample */
+  PetscReal       len,lc;             /* step and travelled length */
+  PetscReal       w,value[3];         /* integrals of u.grad V and grad V along the ray */
+  PetscReal       origin[3];          /* origin cell */
+  PetscReal       cell[3];            /* last cell sampled */
+  PetscReal       done;               /* the ray stopped and is sent back to its origin */
+} VFWidthRay;
+#define VF_WIDTHRAY_NR ((PetscInt)(sizeof(VFWidthRay)/sizeof(PetscReal)))
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_WidthRayPush"
+/*
+  VF_WidthRayPush: appends the ray r to the buffer buf of length n and size cap
+*/
+static PetscErrorCode VF_WidthRayPush(VFWidthRay **buf,PetscInt *n,PetscInt *cap,const VFWidthRay *r)
+{
+  PetscErrorCode  ierr;
+  VFWidthRay      *tmp;
+  
+  PetscFunctionBegin;
+  if (*n == *cap) {
+    *cap = PetscMax(2*(*cap),16);
+    ierr = PetscMalloc(*cap*sizeof(VFWidthRay),&tmp);CHKERRQ(ierr);
+    ierr = PetscMemcpy(tmp,*buf,*n*sizeof(VFWidthRay));CHKERRQ(ierr);
+    ierr = PetscFree(*buf);CHKERRQ(ierr);
+    *buf = tmp;
+  }
+  (*buf)[(*n)++] = *r;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VF_WidthRayExchange"
+/*
+  VF_WidthRayExchange: sends the rays of sbuf[n] to the neighbour nb[n] (in the order of DMDAGetNeighbors) 
+  and appends the rays received from the neighbours to rbuf
+*/
+static PetscErrorCode VF_WidthRayExchange(const PetscMPIInt *nb,VFWidthRay **sbuf,PetscInt *scount,VFWidthRay **rbuf,PetscInt *nr,PetscInt *rcap)
+{
+  PetscErrorCode  ierr;
+  MPI_Request     req[52];
+  PetscMPIInt     nreq;
+  PetscInt        rcount[27],n,ntot;
+  VFWidthRay      *tmp;
+  
+  PetscFunctionBegin;
+  nreq = 0;
+  for (n = 0; n < 27; n++) {
+    rcount[n] = 0;
+    if (n == 13 || nb[n] < 0) continue;
+    ierr = MPI_Irecv(&rcount[n],1,MPIU_INT,nb[n],26-n,PETSC_COMM_WORLD,&req[nreq++]);CHKERRQ(ierr);
+    ierr = MPI_Isend(&scount[n],1,MPIU_INT,nb[n],n,PETSC_COMM_WORLD,&req[nreq++]);CHKERRQ(ierr);
+  }
+  ierr = MPI_Waitall(nreq,req,MPI_STATUSES_IGNORE);CHKERRQ(ierr);
+  
+  for (ntot = *nr,n = 0; n < 27; n++) ntot += rcount[n];
+  if (ntot > *rcap) {
+    *rcap = ntot;
+    ierr = PetscMalloc(*rcap*sizeof(VFWidthRay),&tmp);CHKERRQ(ierr);
+    ierr = PetscMemcpy(tmp,*rbuf,*nr*sizeof(VFWidthRay));CHKERRQ(ierr);
+    ierr = PetscFree(*rbuf);CHKERRQ(ierr);
+    *rbuf = tmp;
+  }
+  nreq = 0;
+  for (n = 0; n < 27; n++) {
+    if (rcount[n] > 0) {
+      ierr = MPI_Irecv(&(*rbuf)[*nr],(PetscMPIInt)(rcount[n]*VF_WIDTHRAY_NR),MPIU_REAL,nb[n],26-n,PETSC_COMM_WORLD,&req[nreq++]);CHKERRQ(ierr);
+      *nr += rcount[n];
+    }
+    if (scount[n] > 0) {
+      ierr = MPI_Isend(sbuf[n],(PetscMPIInt)(scount[n]*VF_WIDTHRAY_NR),MPIU_REAL,nb[n],n,PETSC_COMM_WORLD,&req[nreq++]);CHKERRQ(ierr);
+    }
+  }
+  ierr = MPI_Waitall(nreq,req,MPI_STATUSES_IGNORE);CHKERRQ(ierr);
+  for (n = 0; n < 27; n++) scount[n] = 0;
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "UpdateFractureWidthDistributed"
+/*
+  UpdateFractureWidthDistributed: same as UpdateFractureWidth, with the daW DAs holding a single layer 
+  of ghost nodes. The rays leaving the local cells are forwarded to the neighbouring processor in their 
+  direction, all at once after every processor advanced its rays as far as it could. Once stopped, the 
+  rays are sent back the same way to the processor owning their origin, which sums their contributions. 
+  Each processor only talks to its neighbours, the rays crossing several subdomains are relayed.
+*/
+static PetscErrorCode UpdateFractureWidthDistributed(VFCtx *ctx, VFFields *fields)
+{
+  PetscErrorCode  ierr;
+  PetscInt        ek,ej,ei,b,c,d,n,r;
+  PetscInt        xs,xm,nx;
+  PetscInt        ys,ym,ny;
+  PetscInt        zs,zm,nz;
+  PetscInt        nxs,nxm,nys,nym,nzs,nzm;
+  PetscInt        xs1,xm1,ys1,ym1,zs1,zm1;
+  PetscInt        px,py,pz;
+  const PetscInt  *lx,*ly,*lz;
+  PetscInt        *proc[3],me[3],cell[3],to[3],idx[3];
+  const PetscMPIInt *nb;
+  PetscReal       *axes[3],*axesbuf;
+  PetscReal       ****coords_array;
+  Vec             coordinates;
+  PetscReal       ****u_array;
+  Vec             u_local;
+  PetscReal       ***v_array;
+  Vec             v_local;
+  PetscReal       ***w_array,***pmult_array;
+  Vec             wc_global,wc_local;
+  PetscReal       *wc;
+  VFCartFELocator gloc,oloc,cloc;
+  PetscBool       found;
+  VFWidthRay      ray,*rays = NULL,*sbuf[27];
+  PetscInt        nray = 0,cap = 0,scount[27],scap[27],nsent,nsentall;
+  PetscReal       *value;
+  PetscReal       ave_V,grad_cc[3],n_cc[3],u_cc[3],n_occ[3],cod,f[2],coords1[3],coords2[3],tlent1,tlent2;
+  PetscReal       hx,hy,hz,len,lastlen = -1.,val,vlim = 1.0;
+  
+  PetscFunctionBegin;
+  ierr = DMDAGetInfo(ctx->daWScalCell,NULL,&nx,&ny,&nz,&px,&py,&pz,
+                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(ctx->daWScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(ctx->daWScal,&nxs,&nys,&nzs,&nxm,&nym,&nzm);CHKERRQ(ierr);
+  ierr = DMDAGetGhostCorners(ctx->daWCacheCell,&xs1,&ys1,&zs1,&xm1,&ym1,&zm1);CHKERRQ(ierr);
+  ierr = DMDAGetNeighbors(ctx->daWScalCell,&nb);CHKERRQ(ierr);
+  /*
+    Processor coordinates of the owner of each cell
+  */
+  ierr = DMDAGetOwnershipRanges(ctx->daWScalCell,&lx,&ly,&lz);CHKERRQ(ierr);
+  ierr = PetscMalloc3(nx,&proc[0],ny,&proc[1],nz,&proc[2]);CHKERRQ(ierr);
+  for (ei = 0,n = 0; n < px; n++) for (c = 0; c < lx[n]; c++) proc[0][ei++] = n;
+  for (ej = 0,n = 0; n < py; n++) for (c = 0; c < ly[n]; c++) proc[1][ej++] = n;
+  for (ek = 0,n = 0; n < pz; n++) for (c = 0; c < lz[n]; c++) proc[2][ek++] = n;
+  me[0] = proc[0][xs]; me[1] = proc[1][ys]; me[2] = proc[2][zs];
+  /*
+    Node coordinates of the whole grid along each axis
+  */
+  ierr = PetscMalloc((nx+ny+nz+3)*sizeof(PetscReal),&axesbuf);CHKERRQ(ierr);
+  ierr = PetscMemzero(axesbuf,(nx+ny+nz+3)*sizeof(PetscReal));CHKERRQ(ierr);
+  axes[0] = axesbuf; axes[1] = axes[0]+nx+1; axes[2] = axes[1]+ny+1;
+  ierr = DMGetCoordinates(ctx->daScal,&coordinates);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(ctx->daWVect,coordinates,&coords_array);CHKERRQ(ierr);
+  if (nys == 0 && nzs == 0) for (ei = nxs; ei < nxs+nxm; ei++) axes[0][ei] = coords_array[0][0][ei][0];
+  if (nxs == 0 && nzs == 0) for (ej = nys; ej < nys+nym; ej++) axes[1][ej] = coords_array[0][ej][0][1];
+  if (nxs == 0 && nys == 0) for (ek = nzs; ek < nzs+nzm; ek++) axes[2][ek] = coords_array[ek][0][0][2];
+  ierr = DMDAVecRestoreArrayDOF(ctx->daWVect,coordinates,&coords_array);CHKERRQ(ierr);
+  ierr = MPI_Allreduce(MPI_IN_PLACE,axesbuf,(PetscMPIInt)(nx+ny+nz+3),MPIU_REAL,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  ierr = VFCartFELocatorCreateFromAxes(&gloc,axes,0,0,0,nx,ny,nz);CHKERRQ(ierr);
+  ierr = VFCartFELocatorCreateFromAxes(&oloc,axes,xs,ys,zs,xm,ym,zm);CHKERRQ(ierr);
+  ierr = VFCartFELocatorCreateFromAxes(&cloc,axes,xs1,ys1,zs1,xm1,ym1,zm1);CHKERRQ(ierr);
+  
+  ierr = DMGetLocalVector(ctx->daWScal,&v_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daWScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daWScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daWScal,v_local,&v_array);CHKERRQ(ierr);
+  
+  ierr = DMGetLocalVector(ctx->daWVect,&u_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daWVect,fields->U,INSERT_VALUES,u_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daWVect,fields->U,INSERT_VALUES,u_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(ctx->daWVect,u_local,&u_array);CHKERRQ(ierr);
+  /*
+    Cell centred V, grad V, normal and u of the local cells and of their neighbours
+  */
+  ierr = DMGetGlobalVector(ctx->daWCacheCell,&wc_global);CHKERRQ(ierr);
+  ierr = VecGetArray(wc_global,&wc);CHKERRQ(ierr);
+  ierr = VF_WidthCacheCompute(wc,&oloc,u_array,v_array);CHKERRQ(ierr);
+  ierr = VecRestoreArray(wc_global,&wc);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daWCacheCell,&wc_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daWCacheCell,wc_global,INSERT_VALUES,wc_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daWCacheCell,wc_global,INSERT_VALUES,wc_local);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daWCacheCell,&wc_global);CHKERRQ(ierr);
+  ierr = VecGetArray(wc_local,&wc);CHKERRQ(ierr);
+  
+  ierr = VecSet(fields->widthc,0.);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScalCell,fields->widthc,&w_array);CHKERRQ(ierr);
+  ierr = VecSet(fields->pmult,1.);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScalCell,fields->pmult,&pmult_array);CHKERRQ(ierr);
+  ierr = PetscMalloc(xm*ym*zm*3*sizeof(PetscReal),&value);CHKERRQ(ierr);
+  ierr = PetscMemzero(value,xm*ym*zm*3*sizeof(PetscReal));CHKERRQ(ierr);
+  for (n = 0; n < 27; n++) {
+    sbuf[n]   = NULL;
+    scount[n] = scap[n] = 0;
+  }
+  /*
+    Two rays, along the normal and opposite to it, from the centre of each cell of the damage band
+  */
+  ierr = VFDamageBandUpdate(ctx,fields->V);CHKERRQ(ierr);
+  for (b = 0; b < ctx->nBand; b++) {
+    ei = ctx->bandCell[3*b]; ej = ctx->bandCell[3*b+1]; ek = ctx->bandCell[3*b+2];
+    ierr = VF_WidthCacheGet(&ave_V, grad_cc, n_cc, u_cc, wc, &cloc, ei, ej, ek);CHKERRQ(ierr);
+    hx = axes[0][ei+1]-axes[0][ei];
+    hy = axes[1][ej+1]-axes[1][ej];
+    hz = axes[2][ek+1]-axes[2][ek];
+    len = sqrt(pow(n_cc[0]*hx,2)+pow(n_cc[1]*hy,2)+pow(n_cc[2]*hz,2))/20;
+    if (ave_V < 1.0 && ave_V > 0.0 && len > 0.) {
+      ierr = PetscMemzero(&ray,sizeof(VFWidthRay));CHKERRQ(ierr);
+      ray.coorda[0] = (axes[0][ei+1]+axes[0][ei])/2.;
+      ray.coorda[1] = (axes[1][ej+1]+axes[1][ej])/2.;
+      ray.coorda[2] = (axes[2][ek+1]+axes[2][ek])/2.;
+      ray.origin[0] = ray.cell[0] = ei;
+      ray.origin[1] = ray.cell[1] = ej;
+      ray.origin[2] = ray.cell[2] = ek;
+      ray.cod       = grad_cc[0]*u_cc[0]+grad_cc[1]*u_cc[1]+grad_cc[2]*u_cc[2];
+      ray.len       = len;
+      ray.lc        = len;
+      for (c = 0; c < 3; c++) {
+        ray.grad[c] = grad_cc[c];
+        ray.n[c]    = n_cc[c];
+        ray.ref[c]  = n_cc[c];
+        ray.x[c]    = ray.coorda[c]+n_cc[c]*len;
+      }
+      ierr = VF_WidthRayPush(&rays,&nray,&cap,&ray);CHKERRQ(ierr);
+      for (c = 0; c < 3; c++) {
+        ray.ref[c]  = -n_cc[c];
+        ray.x[c]    = ray.coorda[c]-n_cc[c]*len;
+      }
+      ierr = VF_WidthRayPush(&rays,&nray,&cap,&ray);CHKERRQ(ierr);
+    }
+  }
+  
+  do {
+    for (r = 0; r < nray; r++) {
+      ray = rays[r];
+      while (1) {
+        if (ray.done == 1.) {
+          for (d = 0; d < 3; d++) to[d] = proc[d][(PetscInt)ray.origin[d]];
+        } else {
+          ierr = VFCartFELocatorFind(&gloc,ray.x,&cell[0],&cell[1],&cell[2],&found);CHKERRQ(ierr);
+          if (!found) {
+            for (d = 0; d < 3; d++) cell[d] = (PetscInt)ray.cell[d];
+          }
+          for (d = 0; d < 3; d++) to[d] = proc[d][cell[d]];
+        }
+        if (to[0] != me[0] || to[1] != me[1] || to[2] != me[2]) {
+          n = 0;
+          for (d = 2; d >= 0; d--) n = 3*n + (to[d] > me[d]) - (to[d] < me[d]) + 1;
+          ierr = VF_WidthRayPush(&sbuf[n],&scount[n],&scap[n],&ray);CHKERRQ(ierr);
+          break;
+        }
+        if (ray.done == 1.) {
+          for (d = 0; d < 3; d++) idx[d] = (PetscInt)ray.origin[d];
+          w_array[idx[2]][idx[1]][idx[0]] += ray.w;
+          for (c = 0; c < 3; c++) value[(((idx[2]-zs)*ym+idx[1]-ys)*xm+idx[0]-xs)*3+c] += ray.value[c];
+          break;
+        }
+        /*
+          One step of the ray marching of UpdateFractureWidth
+        */
+        for (d = 0; d < 3; d++) ray.cell[d] = cell[d];
+        for (c = 0; c < 3; c++) n_occ[c] = ray.n[c];
+        if (ray.len != lastlen) {
+          ierr    = VFCartFEElement1DInit(&ctx->e1D,ray.len);CHKERRQ(ierr);
+          lastlen = ray.len;
+        }
+        if (ctx->widthInterpolation) {
+          ierr = VF_WidthCacheSample(&ave_V, grad_cc, n_cc, u_cc, wc, &cloc, ray.x, cell[0], cell[1], cell[2]);CHKERRQ(ierr);
+        } else {
+          hx = axes[0][cell[0]+1]-axes[0][cell[0]];
+          hy = axes[1][cell[1]+1]-axes[1][cell[1]];
+          hz = axes[2][cell[2]+1]-axes[2][cell[2]];
+          ierr = CartFEElement3DInit(&ctx->s3D,ray.x[0]-axes[0][cell[0]],ray.x[1]-axes[1][cell[1]],ray.x[2]-axes[2][cell[2]],hx,hy,hz);CHKERRQ(ierr);
+          ierr = ComputeAveVGradVandNormal_local(&ave_V, grad_cc, n_cc, u_cc, u_array, v_array, cell[2], cell[1], cell[0], &ctx->s3D);CHKERRQ(ierr);
+        }
+        cod = grad_cc[0]*u_cc[0]+grad_cc[1]*u_cc[1]+grad_cc[2]*u_cc[2];
+        f[0] = ray.cod; f[1] = cod;
+        ierr = IntegrateUcdotGradVlocal(&ray.w,f,&ctx->e1D);CHKERRQ(ierr);
+        for (c = 0; c < 3; c++) {
+          f[0] = ray.grad[c]; f[1] = grad_cc[c];
+          ierr = IntegrateUcdotGradVlocal(&ray.value[c],f,&ctx->e1D);CHKERRQ(ierr);
+        }
+        if ((n_cc[0] == 0) && (n_cc[1] == 0) && (n_cc[2] == 0)) {
+          for (c = 0; c < 3; c++) n_cc[c] = n_occ[c];
+        }
+        for (c = 0; c < 3; c++) {
+          coords1[c] = ray.x[c]+n_cc[c]*ray.len;
+          coords2[c] = ray.x[c]-n_cc[c]*ray.len;
+        }
+        tlent1 = sqrt((pow(coords1[0]-ray.coorda[0],2))+(pow(coords1[1]-ray.coorda[1],2))+(pow(coords1[2]-ray.coorda[2],2)));
+        tlent2 = sqrt((pow(coords2[0]-ray.coorda[0],2))+(pow(coords2[1]-ray.coorda[1],2))+(pow(coords2[2]-ray.coorda[2],2)));
+        for (c = 0; c < 3; c++) {
+          if (tlent1 > tlent2) {
+            ray.x[c] = coords1[c];
+            ray.n[c] = n_cc[c];
+          } else {
+            ray.x[c] = coords2[c];
+            ray.n[c] = -n_cc[c];
+          }
+          ray.grad[c] = grad_cc[c];
+        }
+        ray.lc += ray.len;
+        ray.cod = cod;
+        if (!(ray.lc < ctx->WidthIntLenght-ray.len && ave_V < vlim && (ray.ref[0]*ray.n[0]+ray.ref[1]*ray.n[1]+ray.ref[2]*ray.n[2] >= 0.))) {
+          ray.done = 1.;
+        }
+      }
+    }
+    nray  = 0;
+    nsent = 0;
+    for (n = 0; n < 27; n++) nsent += scount[n];
+    ierr = MPI_Allreduce(&nsent,&nsentall,1,MPIU_INT,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
+    if (nsentall) {
+      ierr = VF_WidthRayExchange(nb,sbuf,scount,&rays,&nray,&cap);CHKERRQ(ierr);
+    }
+  } while (nsentall);
+  
+  for (b = 0; b < ctx->nBand; b++) {
+    ei = ctx->bandCell[3*b]; ej = ctx->bandCell[3*b+1]; ek = ctx->bandCell[3*b+2];
+    n   = ((ek-zs)*ym+ej-ys)*xm+ei-xs;
+    val = sqrt(pow(value[3*n],2)+pow(value[3*n+1],2)+pow(value[3*n+2],2));
+    if (val > ctx->width_tol) {
+      pmult_array[ek][ej][ei] = 0.;
+    }
+    if (w_array[ek][ej][ei] < 0.0) {
+      w_array[ek][ej][ei] = 0;
+    }
+    if (ctx->removeTipEffect && val > ctx->width_tol) {
+      w_array[ek][ej][ei] = 0;
+    }
+  }
+  for (n = 0; n < 27; n++) {
+    ierr = PetscFree(sbuf[n]);CHKERRQ(ierr);
+  }
+  ierr = PetscFree(rays);CHKERRQ(ierr);
+  ierr = PetscFree(value);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daScalCell,fields->pmult,&pmult_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daScalCell,fields->widthc,&w_array);CHKERRQ(ierr);
+  
+  ierr = VecRestoreArray(wc_local,&wc);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daWCacheCell,&wc_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(ctx->daWVect,u_local,&u_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daWVect,&u_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daWScal,v_local,&v_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daWScal,&v_local);CHKERRQ(ierr);
+  ierr = VFCartFELocatorDestroy(&cloc);CHKERRQ(ierr);
+  ierr = VFCartFELocatorDestroy(&oloc);CHKERRQ(ierr);
+  ierr = VFCartFELocatorDestroy(&gloc);CHKERRQ(ierr);
+  ierr = PetscFree(axesbuf);CHKERRQ(ierr);
+  ierr = PetscFree3(proc[0],proc[1],proc[2]);CHKERRQ(ierr);
+  
+  ierr = VecSet(fields->width,0.);CHKERRQ(ierr);
+  ierr = CellToNodeInterpolation(fields->width,fields->widthc,ctx);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "UpdateFractureWidthEulerian"
+/*
+  UpdateFractureWidthEulerian: Eulerian alternative to the ray marching of UpdateFractureWidth. 
+  The cell centred u.grad V and grad V are integrated along each axis d over the cells whose centres are 
+  within WidthIntLenght, using running sums over the ghosted lines of daWScalCell. 
+  If the crack is locally planar with normal n, the integral along the axis d is w/|n_d|, so that 
+  w = sum_d |n_d|^3 I_d, which favours the axes most aligned with n. 
+  The cost is a fixed number of sweeps of the local cells, independent of WidthIntLenght.
+*/
+static PetscErrorCode UpdateFractureWidthEulerian(VFCtx *ctx, VFFields *fields)
+{
+  PetscErrorCode  ierr;
+  PetscInt        ek,ej,ei,b,c,d,f,i,lo,hi,cell;
+  PetscInt        xs,xm,ys,ym,zs,zm;
+  PetscInt        xs1,xm1,ys1,ym1,zs1,zm1;
+  PetscInt        s[3],m[3],s1[3],m1[3],t[3],idx[3],a0,a1;
+  PetscReal       ****coords_array;
+  Vec             coords_local;
+  Vec             coordinates;
+  PetscReal       ****u_array;
+  Vec             u_local;
+  PetscReal       ***v_array;
+  Vec             v_local;
+  PetscReal       ***f_array,***w_array,***pmult_array;
+  Vec             f_global,f_local;
+  VFCartFELocator oloc,cloc;
+  PetscReal       *cc,*integ,*sum,*xc;
+  PetscReal       wd,w,g[3],value;
+  
+  PetscFunctionBegin;
+  ierr = DMDAGetCorners(ctx->daWScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  ierr = DMDAGetGhostCorners(ctx->daWScalCell,&xs1,&ys1,&zs1,&xm1,&ym1,&zm1);CHKERRQ(ierr);
+  s[0]  = xs;  s[1]  = ys;  s[2]  = zs;  m[0]  = xm;  m[1]  = ym;  m[2]  = zm;
+  s1[0] = xs1; s1[1] = ys1; s1[2] = zs1; m1[0] = xm1; m1[1] = ym1; m1[2] = zm1;
+  
+  ierr = DMGetLocalVector(ctx->daWScal,&v_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daWScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daWScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daWScal,v_local,&v_array);CHKERRQ(ierr);
+  
+  ierr = DMGetLocalVector(ctx->daWVect,&u_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daWVect,fields->U,INSERT_VALUES,u_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daWVect,fields->U,INSERT_VALUES,u_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(ctx->daWVect,u_local,&u_array);CHKERRQ(ierr);
+  
+  ierr = DMGetCoordinates(ctx->daScal,&coordinates);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daWVect,&coords_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daWVect,coordinates,INSERT_VALUES,coords_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalEnd(ctx->daWVect,coordinates,INSERT_VALUES,coords_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(ctx->daWVect,coords_local,&coords_array);CHKERRQ(ierr);
+  ierr = VFCartFELocatorCreate(&oloc,coords_array,xs,ys,zs,xm,ym,zm);CHKERRQ(ierr);
+  ierr = VFCartFELocatorCreate(&cloc,coords_array,xs1,ys1,zs1,xm1,ym1,zm1);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(ctx->daWVect,coords_local,&coords_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daWVect,&coords_local);CHKERRQ(ierr);
+  /*
+    Cell centred V, grad V, normal and u of the local cells
+  */
+  ierr = PetscMalloc(xm*ym*zm*VF_WIDTHCACHE_NC*sizeof(PetscReal),&cc);CHKERRQ(ierr);
+  ierr = VF_WidthCacheCompute(cc,&oloc,u_array,v_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(ctx->daWVect,u_local,&u_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daWVect,&u_local);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daWScal,v_local,&v_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daWScal,&v_local);CHKERRQ(ierr);
+  /*
+    integ[(cell*4+f)*3+d]: integral along the axis d of u.grad V (f = 0) and grad V (f = 1,2,3)
+  */
+  ierr = PetscMalloc(xm*ym*zm*12*sizeof(PetscReal),&integ);CHKERRQ(ierr);
+  ierr = PetscMalloc2(PetscMax(PetscMax(xm1,ym1),zm1)+1,&sum,PetscMax(PetscMax(xm1,ym1),zm1),&xc);CHKERRQ(ierr);
+  ierr = DMGetGlobalVector(ctx->daWScalCell,&f_global);CHKERRQ(ierr);
+  ierr = DMGetLocalVector(ctx->daWScalCell,&f_local);CHKERRQ(ierr);
+  for (f = 0; f < 4; f++) {
+    ierr = DMDAVecGetArray(ctx->daWScalCell,f_global,&f_array);CHKERRQ(ierr);
+    for (ek = zs; ek < zs+zm; ek++) {
+      for (ej = ys; ej < ys+ym; ej++) {
+        for (ei = xs; ei < xs+xm; ei++) {
+          cell = ((ek-zs)*ym+ej-ys)*xm+ei-xs;
+          if (f == 0) {
+            f_array[ek][ej][ei] = 0.;
+            for (c = 0; c < 3; c++) f_array[ek][ej][ei] += cc[cell*VF_WIDTHCACHE_NC+1+c]*cc[cell*VF_WIDTHCACHE_NC+7+c];
+          } else {
+            f_array[ek][ej][ei] = cc[cell*VF_WIDTHCACHE_NC+f];
+          }
+        }
+      }
+    }
+    ierr = DMDAVecRestoreArray(ctx->daWScalCell,f_global,&f_array);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daWScalCell,f_global,INSERT_VALUES,f_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalEnd(ctx->daWScalCell,f_global,INSERT_VALUES,f_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArray(ctx->daWScalCell,f_local,&f_array);CHKERRQ(ierr);
+    for (d = 0; d < 3; d++) {
+      /*
+        Lines along the axis d through the local cells, t[a0] and t[a1] are the transverse indices
+      */
+      a0 = (d+1)%3; a1 = (d+2)%3;
+      for (i = 0; i < m1[d]; i++) xc[i] = .5*(cloc.x[d][i]+cloc.x[d][i+1]);
+      for (t[a1] = s[a1]; t[a1] < s[a1]+m[a1]; t[a1]++) {
+        for (t[a0] = s[a0]; t[a0] < s[a0]+m[a0]; t[a0]++) {
+          idx[a0] = t[a0]; idx[a1] = t[a1];
+          sum[0] = 0.;
+          for (i = 0; i < m1[d]; i++) {
+            idx[d]   = s1[d]+i;
+            sum[i+1] = sum[i] + f_array[idx[2]][idx[1]][idx[0]] * (cloc.x[d][i+1]-cloc.x[d][i]);
+          }
+          lo = hi = 0;
+          for (i = s[d]-s1[d]; i < s[d]-s1[d]+m[d]; i++) {
+            while (xc[lo] < xc[i]-ctx->WidthIntLenght) lo++;
+            while (hi < m1[d] && xc[hi] <= xc[i]+ctx->WidthIntLenght) hi++;
+            idx[d] = s1[d]+i;
+            cell   = ((idx[2]-zs)*ym+idx[1]-ys)*xm+idx[0]-xs;
+            integ[(cell*4+f)*3+d] = sum[hi]-sum[lo];
+          }
+        }
+      }
+    }
+    ierr = DMDAVecRestoreArray(ctx->daWScalCell,f_local,&f_array);CHKERRQ(ierr);
+  }
+  ierr = DMRestoreLocalVector(ctx->daWScalCell,&f_local);CHKERRQ(ierr);
+  ierr = DMRestoreGlobalVector(ctx->daWScalCell,&f_global);CHKERRQ(ierr);
+  ierr = PetscFree2(sum,xc);CHKERRQ(ierr);
+  
+  ierr = VecSet(fields->widthc,0.);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScalCell,fields->widthc,&w_array);CHKERRQ(ierr);
+  ierr = VecSet(fields->pmult,1.);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScalCell,fields->pmult,&pmult_array);CHKERRQ(ierr);
+  ierr = VFDamageBandUpdate(ctx,fields->V);CHKERRQ(ierr);
+  for (b = 0; b < ctx->nBand; b++) {
+    ei = ctx->bandCell[3*b]; ej = ctx->bandCell[3*b+1]; ek = ctx->bandCell[3*b+2];
+    cell = ((ek-zs)*ym+ej-ys)*xm+ei-xs;
+    if (cc[cell*VF_WIDTHCACHE_NC] < 1.0 && cc[cell*VF_WIDTHCACHE_NC] > 0.0) {
+      w = g[0] = g[1] = g[2] = 0.;
+      for (d = 0; d < 3; d++) {
+        wd = PetscAbs(cc[cell*VF_WIDTHCACHE_NC+4+d]);
+        wd = wd*wd*wd;
+        w += wd*integ[(cell*4)*3+d];
+        for (c = 0; c < 3; c++) g[c] += wd*integ[(cell*4+1+c)*3+d];
+      }
+      value = sqrt(g[0]*g[0]+g[1]*g[1]+g[2]*g[2]);
+      if (value > ctx->width_tol) {
+        pmult_array[ek][ej][ei] = 0.;
+      }
+      if (w < 0.0 || (ctx->removeTipEffect && value > ctx->width_tol)) {
+        w = 0.;
+      }
+      w_array[ek][ej][ei] = w;
+    }
+  }
+  ierr = DMDAVecRestoreArray(ctx->daScalCell,fields->pmult,&pmult_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daScalCell,fields->widthc,&w_array);CHKERRQ(ierr);
+  ierr = PetscFree(integ);CHKERRQ(ierr);
+  ierr = PetscFree(cc);CHKERRQ(ierr);
+  ierr = VFCartFELocatorDestroy(&cloc);CHKERRQ(ierr);
+  ierr = VFCartFELocatorDestroy(&oloc);CHKERRQ(ierr);
+  
+  ierr = VecSet(fields->width,0.);CHKERRQ(ierr);
+  ierr = CellToNodeInterpolation(fields->width,fields->widthc,ctx);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
 #undef __FUNCT__
 #define __FUNCT__ "UpdateFractureWidth"
 extern PetscErrorCode UpdateFractureWidth(VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode  ierr;
   PetscInt        ek, ej, ei;
+  PetscInt        b;
   PetscInt        xs,xm,nx;
   PetscInt        ys,ym,ny;
   PetscInt        zs,zm,nz;
@@ -310,9 +1114,43 @@ extern PetscErrorCode UpdateFractureWidth(VFCtx *ctx, VFFields *fields)
   PetscReal       grady[2] = {0,0};
   PetscReal       gradz[2] = {0,0};
   PetscReal       valuex = 0,valuey = 0,valuez = 0;
+  VFCartFELocator locator;
+  PetscBool       found;
+  PetscReal       *wc;
+  Vec             wray;
+  PetscReal       wraymax,weulmax,wdiffmax,wraynorm,wdiffnorm;
 
   
   PetscFunctionBegin;
+  if (ctx->widthEulerian) {
+    if (ctx->widthCompare) {
+      /*
+        Reference ray marching width, compared with the Eulerian one below
+      */
+      ctx->widthEulerian = PETSC_FALSE;
+      ierr = UpdateFractureWidth(ctx,fields);CHKERRQ(ierr);
+      ctx->widthEulerian = PETSC_TRUE;
+      ierr = VecDuplicate(fields->widthc,&wray);CHKERRQ(ierr);
+      ierr = VecCopy(fields->widthc,wray);CHKERRQ(ierr);
+    }
+    ierr = UpdateFractureWidthEulerian(ctx,fields);CHKERRQ(ierr);
+    if (ctx->widthCompare) {
+      ierr = VecNorm(wray,NORM_INFINITY,&wraymax);CHKERRQ(ierr);
+      ierr = VecNorm(wray,NORM_2,&wraynorm);CHKERRQ(ierr);
+      ierr = VecNorm(fields->widthc,NORM_INFINITY,&weulmax);CHKERRQ(ierr);
+      ierr = VecAXPY(wray,-1.,fields->widthc);CHKERRQ(ierr);
+      ierr = VecNorm(wray,NORM_INFINITY,&wdiffmax);CHKERRQ(ierr);
+      ierr = VecNorm(wray,NORM_2,&wdiffnorm);CHKERRQ(ierr);
+      ierr = PetscPrintf(PETSC_COMM_WORLD,"      Fracture width: max ray %e, max Eulerian %e, max difference %e, relative l2 difference %e\n",
+                         wraymax,weulmax,wdiffmax,(wraynorm > 0.) ? wdiffnorm/wraynorm : wdiffnorm);CHKERRQ(ierr);
+      ierr = VecDestroy(&wray);CHKERRQ(ierr);
+    }
+    PetscFunctionReturn(0);
+  }
+  if (ctx->widthDistributed) {
+    ierr = UpdateFractureWidthDistributed(ctx,fields);CHKERRQ(ierr);
+    PetscFunctionReturn(0);
+  }
   ierr = DMDAGetInfo(ctx->daWScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daWScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
@@ -333,6 +1171,15 @@ extern PetscErrorCode UpdateFractureWidth(VFCtx *ctx, VFFields *fields)
   ierr = DMGlobalToLocalBegin(ctx->daWVect,coordinates,INSERT_VALUES,coords_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalEnd(ctx->daWVect,coordinates,INSERT_VALUES,coords_local);CHKERRQ(ierr);
   ierr = DMDAVecGetArrayDOF(ctx->daWVect,coords_local,&coords_array);CHKERRQ(ierr);
+  /*
+   Locates the points of the rays in the ghosted cells
+   */
+  ierr = VFCartFELocatorCreate(&locator,coords_array,xs1,ys1,zs1,xm1,ym1,zm1);CHKERRQ(ierr);
+  /*
+   Cell centred V, grad V, normal and u of the ghosted cells, sampled by the rays
+   */
+  ierr = PetscMalloc(xm1*ym1*zm1*VF_WIDTHCACHE_NC*sizeof(PetscReal),&wc);CHKERRQ(ierr);
+  ierr = VF_WidthCacheCompute(wc,&locator,u_array,v_array);CHKERRQ(ierr);
   
   ierr = VecSet(fields->widthc,0.);CHKERRQ(ierr);
   ierr = DMGetLocalVector(ctx->daScalCell,&w_local);CHKERRQ(ierr);
@@ -347,200 +1194,181 @@ extern PetscErrorCode UpdateFractureWidth(VFCtx *ctx, VFFields *fields)
   ierr = DMDAVecGetArray(ctx->daScalCell,pmult_local,&pmult_array);CHKERRQ(ierr);
     
   
-  for (ek = zs; ek < zs+zm; ek++) {
-    for (ej = ys; ej < ys+ym; ej++) {
-      for (ei = xs; ei < xs+xm; ei++) {
-        valuex = valuey = valuez = 0.;
-        length_atzero = 0;
-        w_array[ek][ej][ei] = 0;
-        hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        hwx = hx/2.;hwy = hy/2.;hwz = hz/2.;
-        ierr = CartFEElement3DInit(&ctx->s3D,hwx,hwy,hwz,hx,hy,hz);CHKERRQ(ierr);
-        ierr = ComputeAveVGradVandNormal_local(&ave_V, grad_cc, n_cc, u_cc, u_array, v_array, ek, ej, ei, &ctx->s3D);CHKERRQ(ierr);
+  ierr = VFDamageBandUpdate(ctx,fields->V);CHKERRQ(ierr);
+  for (b = 0; b < ctx->nBand; b++) {
+    ei = ctx->bandCell[3*b]; ej = ctx->bandCell[3*b+1]; ek = ctx->bandCell[3*b+2];
+    valuex = valuey = valuez = 0.;
+    length_atzero = 0;
+    w_array[ek][ej][ei] = 0;
+    hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
+    hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
+    hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
+    ierr = VF_WidthCacheGet(&ave_V, grad_cc, n_cc, u_cc, wc, &locator, ei, ej, ek);CHKERRQ(ierr);
+    for(c = 0; c < 3; c++){
+      ref_cc[c] = n_cc[c];
+    }
+    len = sqrt(pow(n_cc[0]*hx,2)+pow(n_cc[1]*hy,2)+pow(n_cc[2]*hz,2))/20;
+    if(ave_V < 1.0 && ave_V > 0.0){ 
+      gradx[0] = grad_cc[0];
+      grady[0] = grad_cc[1];
+      gradz[0] = grad_cc[2];
+      cod[0] = grad_cc[0]*u_cc[0]+grad_cc[1]*u_cc[1]+grad_cc[2]*u_cc[2];
+      coorda_array[0] = (coords_array[ek][ej][ei+1][0]+coords_array[ek][ej][ei][0])/2.;
+      coorda_array[1] = (coords_array[ek][ej+1][ei][1]+coords_array[ek][ej][ei][1])/2.;
+      coorda_array[2] = (coords_array[ek+1][ej][ei][2]+coords_array[ek][ej][ei][2])/2.;
+      for(c = 0; c < 3; c++){
+        coordc_array[c] = coorda_array[c]+n_cc[c]*len;
+      }
+      lc = len;
+      do
+      {
+        ierr = VFCartFELocatorFind(&locator,coordc_array,&ei1,&ej1,&ek1,&found);CHKERRQ(ierr);
+        if (found) {
+          ekk = ek1;ejj = ej1;eii = ei1;
+        }
+        n_occ[2] = n_cc[2]; n_occ[1] = n_cc[1]; n_occ[0] = n_cc[0];
+        ierr = VFCartFEElement1DInit(&ctx->e1D,len);CHKERRQ(ierr);
+        if (ctx->widthInterpolation) {
+          ierr = VF_WidthCacheSample(&ave_V, grad_cc, n_cc, u_cc, wc, &locator, coordc_array, eii, ejj, ekk);CHKERRQ(ierr);
+        } else {
+          hx = coords_array[ekk][ejj][eii+1][0]-coords_array[ekk][ejj][eii][0];
+          hy = coords_array[ekk][ejj+1][eii][1]-coords_array[ekk][ejj][eii][1];
+          hz = coords_array[ekk+1][ejj][eii][2]-coords_array[ekk][ejj][eii][2];
+          hwx = coordc_array[0]-coords_array[ekk][ejj][eii][0];
+          hwy = coordc_array[1]-coords_array[ekk][ejj][eii][1];
+          hwz = coordc_array[2]-coords_array[ekk][ejj][eii][2];
+          ierr = CartFEElement3DInit(&ctx->s3D,hwx,hwy,hwz,hx,hy,hz);CHKERRQ(ierr);
+          ierr = ComputeAveVGradVandNormal_local(&ave_V, grad_cc, n_cc, u_cc, u_array, v_array, ekk, ejj, eii, &ctx->s3D);CHKERRQ(ierr);
+        }
+        cod[1] = grad_cc[0]*u_cc[0]+grad_cc[1]*u_cc[1]+grad_cc[2]*u_cc[2];
+        ierr = IntegrateUcdotGradVlocal(&w_array[ek][ej][ei],cod, &ctx->e1D);CHKERRQ(ierr);
+        gradx[1] = grad_cc[0];
+        grady[1] = grad_cc[1];
+        gradz[1] = grad_cc[2];
+        ierr = IntegrateUcdotGradVlocal(&valuex,gradx, &ctx->e1D);CHKERRQ(ierr);
+        ierr = IntegrateUcdotGradVlocal(&valuey,grady, &ctx->e1D);CHKERRQ(ierr);
+        ierr = IntegrateUcdotGradVlocal(&valuez,gradz, &ctx->e1D);CHKERRQ(ierr);
+        if((n_cc[0] == 0) && (n_cc[1] == 0) && (n_cc[2] == 0)){
+          n_cc[0] = n_occ[0];
+          n_cc[1] = n_occ[1];
+          n_cc[2] = n_occ[2];
+        }
+        if(ave_V == 0){
+          length_atzero += len;
+        }
         for(c = 0; c < 3; c++){
-          ref_cc[c] = n_cc[c];
-        }
-        len = sqrt(pow(n_cc[0]*hx,2)+pow(n_cc[1]*hy,2)+pow(n_cc[2]*hz,2))/20;
-        if(ave_V < 1.0 && ave_V > 0.0){ 
-          gradx[0] = grad_cc[0];
-          grady[0] = grad_cc[1];
-          gradz[0] = grad_cc[2];
-          cod[0] = grad_cc[0]*u_cc[0]+grad_cc[1]*u_cc[1]+grad_cc[2]*u_cc[2];
-          coorda_array[0] = (coords_array[ek][ej][ei+1][0]+coords_array[ek][ej][ei][0])/2.;
-          coorda_array[1] = (coords_array[ek][ej+1][ei][1]+coords_array[ek][ej][ei][1])/2.;
-          coorda_array[2] = (coords_array[ek+1][ej][ei][2]+coords_array[ek][ej][ei][2])/2.;
+          coords1[c] = coordc_array[c]+n_cc[c]*len;
+          coords2[c] = coordc_array[c]-n_cc[c]*len;
+        }
+        tlent1 = sqrt((pow(coords1[0]-coorda_array[0],2))+(pow(coords1[1]-coorda_array[1],2))+(pow(coords1[2]-coorda_array[2],2)));
+        tlent2 = sqrt((pow(coords2[0]-coorda_array[0],2))+(pow(coords2[1]-coorda_array[1],2))+(pow(coords2[2]-coorda_array[2],2)));
+        if(tlent1 > tlent2){
           for(c = 0; c < 3; c++){
-            coordc_array[c] = coorda_array[c]+n_cc[c]*len;
+            coordc_array[c] = coords1[c];
           }
-          lc = len;
-          do
-          {
-            for (ek1 = zs1; ek1 < zs1+zm1; ek1++) {
-              for (ej1 = ys1; ej1 < ys1+ym1; ej1++) {
-                for (ei1 = xs1; ei1 < xs1+xm1; ei1++) {
-                  if(
-                     ((coords_array[ek1][ej1][ei1+1][0] >= coordc_array[0]) && (coords_array[ek1][ej1][ei1][0] <= coordc_array[0] ))    &&
-                     ((coords_array[ek1][ej1+1][ei1][1] >= coordc_array[1]) && (coords_array[ek1][ej1][ei1][1] <= coordc_array[1] ))    &&
-                     ((coords_array[ek1+1][ej1][ei1][2] >= coordc_array[2]) && (coords_array[ek1][ej1][ei1][2] <= coordc_array[2] ))
-                     )
-                  {
-                    ekk = ek1;ejj = ej1;eii = ei1;
-                  }
-                }
-              }
-            }
-            hx = coords_array[ekk][ejj][eii+1][0]-coords_array[ekk][ejj][eii][0];
-            hy = coords_array[ekk][ejj+1][eii][1]-coords_array[ekk][ejj][eii][1];
-            hz = coords_array[ekk+1][ejj][eii][2]-coords_array[ekk][ejj][eii][2];
-            hwx = coordc_array[0]-coords_array[ekk][ejj][eii][0];
-            hwy = coordc_array[1]-coords_array[ekk][ejj][eii][1];
-            hwz = coordc_array[2]-coords_array[ekk][ejj][eii][2];
-            n_occ[2] = n_cc[2]; n_occ[1] = n_cc[1]; n_occ[0] = n_cc[0];
-            ierr = CartFEElement3DInit(&ctx->s3D,hwx,hwy,hwz,hx,hy,hz);CHKERRQ(ierr);
-            ierr = VFCartFEElement1DInit(&ctx->e1D,len);CHKERRQ(ierr);
-            ierr = ComputeAveVGradVandNormal_local(&ave_V, grad_cc, n_cc, u_cc, u_array, v_array, ekk, ejj, eii, &ctx->s3D);CHKERRQ(ierr);
-            cod[1] = grad_cc[0]*u_cc[0]+grad_cc[1]*u_cc[1]+grad_cc[2]*u_cc[2];
-            ierr = IntegrateUcdotGradVlocal(&w_array[ek][ej][ei],cod, &ctx->e1D);CHKERRQ(ierr);
-            gradx[1] = grad_cc[0];
-            grady[1] = grad_cc[1];
-            gradz[1] = grad_cc[2];
-            ierr = IntegrateUcdotGradVlocal(&valuex,gradx, &ctx->e1D);CHKERRQ(ierr);
-            ierr = IntegrateUcdotGradVlocal(&valuey,grady, &ctx->e1D);CHKERRQ(ierr);
-            ierr = IntegrateUcdotGradVlocal(&valuez,gradz, &ctx->e1D);CHKERRQ(ierr);
-            if((n_cc[0] == 0) && (n_cc[1] == 0) && (n_cc[2] == 0)){
-              n_cc[0] = n_occ[0];
-              n_cc[1] = n_occ[1];
-              n_cc[2] = n_occ[2];
-            }
-            if(ave_V == 0){
-              length_atzero += len;
-            }
-            for(c = 0; c < 3; c++){
-              coords1[c] = coordc_array[c]+n_cc[c]*len;
-              coords2[c] = coordc_array[c]-n_cc[c]*len;
-            }
-            tlent1 = sqrt((pow(coords1[0]-coorda_array[0],2))+(pow(coords1[1]-coorda_array[1],2))+(pow(coords1[2]-coorda_array[2],2)));
-            tlent2 = sqrt((pow(coords2[0]-coorda_array[0],2))+(pow(coords2[1]-coorda_array[1],2))+(pow(coords2[2]-coorda_array[2],2)));
-            if(tlent1 > tlent2){
-              for(c = 0; c < 3; c++){
-                coordc_array[c] = coords1[c];
-              }
-            }
-            else{
-              for(c = 0; c < 3; c++){
-                coordc_array[c] = coords2[c];
-                n_cc[c] = -1*n_cc[c];
-              }
-            }
-            lc += len;
-            cod[0] = cod[1];
-            gradx[0] = grad_cc[0];
-            grady[0] = grad_cc[1];
-            gradz[0] = grad_cc[2];
+        }
+        else{
+          for(c = 0; c < 3; c++){
+            coordc_array[c] = coords2[c];
+            n_cc[c] = -1*n_cc[c];
           }
-          while(lc < (ctx->WidthIntLenght-len) && ave_V < vlim && (ref_cc[0]*n_cc[0]+ref_cc[1]*n_cc[1]+ref_cc[2]*n_cc[2] >= 0.));
-          hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-          hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-          hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-          hwx = hx/2.;hwy = hy/2.;hwz = hz/2.;
+        }
+        lc += len;
+        cod[0] = cod[1];
+        gradx[0] = grad_cc[0];
+        grady[0] = grad_cc[1];
+        gradz[0] = grad_cc[2];
+      }
+      while(lc < (ctx->WidthIntLenght-len) && ave_V < vlim && (ref_cc[0]*n_cc[0]+ref_cc[1]*n_cc[1]+ref_cc[2]*n_cc[2] >= 0.));
+      ierr = VF_WidthCacheGet(&ave_V, grad_cc, n_cc, u_cc, wc, &locator, ei, ej, ek);CHKERRQ(ierr);
+      for(c = 0; c < 3; c++){
+        ref_cc[c] = n_cc[c];
+      }
+      gradx[0] = grad_cc[0];
+      grady[0] = grad_cc[1];
+      gradz[0] = grad_cc[2];
+      cod[0] = grad_cc[0]*u_cc[0]+grad_cc[1]*u_cc[1]+grad_cc[2]*u_cc[2];
+      coorda_array[0] = (coords_array[ek][ej][ei+1][0]+coords_array[ek][ej][ei][0])/2.;
+      coorda_array[1] = (coords_array[ek][ej+1][ei][1]+coords_array[ek][ej][ei][1])/2.;
+      coorda_array[2] = (coords_array[ek+1][ej][ei][2]+coords_array[ek][ej][ei][2])/2.;
+      for(c = 0; c < 3; c++){
+        coordc_array[c] = coorda_array[c]-n_cc[c]*len;
+      }
+      lc = len;
+      do
+      {
+        ierr = VFCartFELocatorFind(&locator,coordc_array,&ei1,&ej1,&ek1,&found);CHKERRQ(ierr);
+        if (found) {
+          ekk = ek1;ejj = ej1;eii = ei1;
+        }
+        n_occ[2] = n_cc[2]; n_occ[1] = n_cc[1]; n_occ[0] = n_cc[0];
+        ierr = VFCartFEElement1DInit(&ctx->e1D,len);CHKERRQ(ierr);
+        if (ctx->widthInterpolation) {
+          ierr = VF_WidthCacheSample(&ave_V, grad_cc, n_cc, u_cc, wc, &locator, coordc_array, eii, ejj, ekk);CHKERRQ(ierr);
+        } else {
+          hx = coords_array[ekk][ejj][eii+1][0]-coords_array[ekk][ejj][eii][0];
+          hy = coords_array[ekk][ejj+1][eii][1]-coords_array[ekk][ejj][eii][1];
+          hz = coords_array[ekk+1][ejj][eii][2]-coords_array[ekk][ejj][eii][2];
+          hwx = coordc_array[0]-coords_array[ekk][ejj][eii][0];
+          hwy = coordc_array[1]-coords_array[ekk][ejj][eii][1];
+          hwz = coordc_array[2]-coords_array[ekk][ejj][eii][2];
           ierr = CartFEElement3DInit(&ctx->s3D,hwx,hwy,hwz,hx,hy,hz);CHKERRQ(ierr);
-          ierr = ComputeAveVGradVandNormal_local(&ave_V, grad_cc, n_cc, u_cc, u_array, v_array, ek, ej, ei, &ctx->s3D);CHKERRQ(ierr);
+          ierr = ComputeAveVGradVandNormal_local(&ave_V, grad_cc, n_cc, u_cc, u_array, v_array, ekk, ejj, eii, &ctx->s3D);CHKERRQ(ierr);
+        }
+        cod[1] = grad_cc[0]*u_cc[0]+grad_cc[1]*u_cc[1]+grad_cc[2]*u_cc[2];
+        ierr = IntegrateUcdotGradVlocal(&w_array[ek][ej][ei],cod, &ctx->e1D);CHKERRQ(ierr);
+        gradx[1] = grad_cc[0];
+        grady[1] = grad_cc[1];
+        gradz[1] = grad_cc[2];
+        ierr = IntegrateUcdotGradVlocal(&valuex,gradx, &ctx->e1D);CHKERRQ(ierr);
+        ierr = IntegrateUcdotGradVlocal(&valuey,grady, &ctx->e1D);CHKERRQ(ierr);
+        ierr = IntegrateUcdotGradVlocal(&valuez,gradz, &ctx->e1D);CHKERRQ(ierr);            
+        if((n_cc[0] == 0) && (n_cc[1] == 0) && (n_cc[2] == 0)){
+          n_cc[0] = n_occ[0];
+          n_cc[1] = n_occ[1];
+          n_cc[2] = n_occ[2];
+        }
+        if(ave_V == 0){
+          length_atzero += len;
+        }
+        for(c = 0; c < 3; c++){
+          coords1[c] = coordc_array[c]+n_cc[c]*len;
+          coords2[c] = coordc_array[c]-n_cc[c]*len;
+        }
+        tlent1 = sqrt((pow(coords1[0]-coorda_array[0],2))+(pow(coords1[1]-coorda_array[1],2))+(pow(coords1[2]-coorda_array[2],2)));
+        tlent2 = sqrt((pow(coords2[0]-coorda_array[0],2))+(pow(coords2[1]-coorda_array[1],2))+(pow(coords2[2]-coorda_array[2],2)));
+        if(tlent1 > tlent2){
           for(c = 0; c < 3; c++){
-            ref_cc[c] = n_cc[c];
+            coordc_array[c] = coords1[c];
           }
-          gradx[0] = grad_cc[0];
-          grady[0] = grad_cc[1];
-          gradz[0] = grad_cc[2];
-          cod[0] = grad_cc[0]*u_cc[0]+grad_cc[1]*u_cc[1]+grad_cc[2]*u_cc[2];
-          coorda_array[0] = (coords_array[ek][ej][ei+1][0]+coords_array[ek][ej][ei][0])/2.;
-          coorda_array[1] = (coords_array[ek][ej+1][ei][1]+coords_array[ek][ej][ei][1])/2.;
-          coorda_array[2] = (coords_array[ek+1][ej][ei][2]+coords_array[ek][ej][ei][2])/2.;
+        }
+        else{
           for(c = 0; c < 3; c++){
-            coordc_array[c] = coorda_array[c]-n_cc[c]*len;
-          }
-          lc = len;
-          do
-          {
-            for (ek1 = zs1; ek1 < zs1+zm1; ek1++) {
-              for (ej1 = ys1; ej1 < ys1+ym1; ej1++) {
-                for (ei1 = xs1; ei1 < xs1+xm1; ei1++) {
-                  if(
-                     ((coords_array[ek1][ej1][ei1+1][0] >= coordc_array[0]) && (coords_array[ek1][ej1][ei1][0] <= coordc_array[0] ))    &&
-                     ((coords_array[ek1][ej1+1][ei1][1] >= coordc_array[1]) && (coords_array[ek1][ej1][ei1][1] <= coordc_array[1] ))    &&
-                     ((coords_array[ek1+1][ej1][ei1][2] >= coordc_array[2]) && (coords_array[ek1][ej1][ei1][2] <= coordc_array[2] ))
-                     )
-                  {
-                    ekk = ek1;ejj = ej1;eii = ei1;
-                  }
-                }
-              }
-            }
-            hx = coords_array[ekk][ejj][eii+1][0]-coords_array[ekk][ejj][eii][0];
-            hy = coords_array[ekk][ejj+1][eii][1]-coords_array[ekk][ejj][eii][1];
-            hz = coords_array[ekk+1][ejj][eii][2]-coords_array[ekk][ejj][eii][2];
-            hwx = coordc_array[0]-coords_array[ekk][ejj][eii][0];
-            hwy = coordc_array[1]-coords_array[ekk][ejj][eii][1];
-            hwz = coordc_array[2]-coords_array[ekk][ejj][eii][2];
-            n_occ[2] = n_cc[2]; n_occ[1] = n_cc[1]; n_occ[0] = n_cc[0];
-            ierr = CartFEElement3DInit(&ctx->s3D,hwx,hwy,hwz,hx,hy,hz);CHKERRQ(ierr);
-            ierr = VFCartFEElement1DInit(&ctx->e1D,len);CHKERRQ(ierr);
-            ierr = ComputeAveVGradVandNormal_local(&ave_V, grad_cc, n_cc, u_cc, u_array, v_array, ekk, ejj, eii, &ctx->s3D);CHKERRQ(ierr);
-            cod[1] = grad_cc[0]*u_cc[0]+grad_cc[1]*u_cc[1]+grad_cc[2]*u_cc[2];
-            ierr = IntegrateUcdotGradVlocal(&w_array[ek][ej][ei],cod, &ctx->e1D);CHKERRQ(ierr);
-            gradx[1] = grad_cc[0];
-            grady[1] = grad_cc[1];
-            gradz[1] = grad_cc[2];
-            ierr = IntegrateUcdotGradVlocal(&valuex,gradx, &ctx->e1D);CHKERRQ(ierr);
-            ierr = IntegrateUcdotGradVlocal(&valuey,grady, &ctx->e1D);CHKERRQ(ierr);
-            ierr = IntegrateUcdotGradVlocal(&valuez,gradz, &ctx->e1D);CHKERRQ(ierr);            
-            if((n_cc[0] == 0) && (n_cc[1] == 0) && (n_cc[2] == 0)){
-              n_cc[0] = n_occ[0];
-              n_cc[1] = n_occ[1];
-              n_cc[2] = n_occ[2];
-            }
-            if(ave_V == 0){
-              length_atzero += len;
-            }
-            for(c = 0; c < 3; c++){
-              coords1[c] = coordc_array[c]+n_cc[c]*len;
-              coords2[c] = coordc_array[c]-n_cc[c]*len;
-            }
-            tlent1 = sqrt((pow(coords1[0]-coorda_array[0],2))+(pow(coords1[1]-coorda_array[1],2))+(pow(coords1[2]-coorda_array[2],2)));
-            tlent2 = sqrt((pow(coords2[0]-coorda_array[0],2))+(pow(coords2[1]-coorda_array[1],2))+(pow(coords2[2]-coorda_array[2],2)));
-            if(tlent1 > tlent2){
-              for(c = 0; c < 3; c++){
-                coordc_array[c] = coords1[c];
-              }
-            }
-            else{
-              for(c = 0; c < 3; c++){
-                coordc_array[c] = coords2[c];
-                n_cc[c] = -1*n_cc[c];
-              }
-            }
-            lc += len;
-            cod[0] = cod[1];
-            gradx[0] = grad_cc[0];
-            grady[0] = grad_cc[1];
-            gradz[0] = grad_cc[2];
-          }
-          while(lc < ctx->WidthIntLenght-len && ave_V < vlim && (-ref_cc[0]*n_cc[0]-ref_cc[1]*n_cc[1]-ref_cc[2]*n_cc[2] >= 0.));
-            value = sqrt( pow(valuex,2)+pow(valuey,2)+pow(valuez,2));
-          if(value > ctx->width_tol){
-            pmult_array[ek][ej][ei] = 0.;
+            coordc_array[c] = coords2[c];
+            n_cc[c] = -1*n_cc[c];
           }
         }
-        if(w_array[ek][ej][ei] < 0.0){
-          w_array[ek][ej][ei] = 0;
-        }
-        if(ctx->removeTipEffect && value > ctx->width_tol){
-          w_array[ek][ej][ei] = 0;
-        }
+        lc += len;
+        cod[0] = cod[1];
+        gradx[0] = grad_cc[0];
+        grady[0] = grad_cc[1];
+        gradz[0] = grad_cc[2];
+      }
+      while(lc < ctx->WidthIntLenght-len && ave_V < vlim && (-ref_cc[0]*n_cc[0]-ref_cc[1]*n_cc[1]-ref_cc[2]*n_cc[2] >= 0.));
+        value = sqrt( pow(valuex,2)+pow(valuey,2)+pow(valuez,2));
+      if(value > ctx->width_tol){
+        pmult_array[ek][ej][ei] = 0.;
       }
     }
+    if(w_array[ek][ej][ei] < 0.0){
+      w_array[ek][ej][ei] = 0;
+    }
+    if(ctx->removeTipEffect && value > ctx->width_tol){
+      w_array[ek][ej][ei] = 0;
+    }
   }
+  ierr = PetscFree(wc);CHKERRQ(ierr);
+  ierr = VFCartFELocatorDestroy(&locator);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArrayDOF(ctx->daWVect,coords_local,&coords_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daWVect,&coords_local);CHKERRQ(ierr);
   
@@ -643,25 +1471,17 @@ extern PetscErrorCode ComputeCellCenterGradV_local(PetscReal *grad_cc, PetscReal
   PetscFunctionReturn(0);
 }
 
-#undef __FUNCT__
-#define __FUNCT__ "VolumetricCrackOpening3D_localCC"
-extern PetscErrorCode VolumetricCrackOpening3D_localCC(PetscReal *CrackVolume_local, PetscReal ***volcrackopening_array, PetscReal ***udotn_array, PetscReal ****u_array, PetscReal ***v_array, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e)
+/*
+  VolumetricCrackOpening3DCC_Kernel: VolumetricCrackOpening3D_localCC without the PETSc calls, the values at the integration points are on the stack
+*/
+static void VolumetricCrackOpening3DCC_Kernel(PetscReal *CrackVolume_local, PetscReal ***volcrackopening_array, PetscReal ***udotn_array, PetscReal ****u_array, PetscReal ***v_array, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e)
 {
-  PetscErrorCode ierr;
   PetscInt    i, j, k, c;
   PetscInt    eg;
-  PetscReal   *n_elem[3],*dv_mag_elem;
-  PetscReal   *u_elem[3],*dv_elem[3];
+  PetscReal   n_elem[3][VFCARTFE_MAXNG3D],dv_mag_elem[VFCARTFE_MAXNG3D];
+  PetscReal   u_elem[3][VFCARTFE_MAXNG3D],dv_elem[3][VFCARTFE_MAXNG3D];
   PetscReal   element_vol = 0;
   
-  PetscFunctionBegin;
-  ierr = PetscMalloc6(e->ng,&dv_elem[0],
-                      e->ng,&dv_elem[1],
-                      e->ng,&dv_elem[2],
-                      e->ng,&u_elem[0],
-                      e->ng,&u_elem[1],
-                      e->ng,&u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscMalloc4(e->ng,&n_elem[0],e->ng,&n_elem[1],e->ng,&n_elem[2],e->ng,&dv_mag_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     for(c = 0; c < 3; c++){
       dv_elem[c][eg] = 0;
@@ -713,26 +1533,27 @@ extern PetscErrorCode VolumetricCrackOpening3D_localCC(PetscReal *CrackVolume_lo
     }
     udotn_array[ek][ej][ei] = udotn_array[ek][ej][ei]/element_vol;
   }
-  ierr = PetscFree6(dv_elem[0],dv_elem[1],dv_elem[2],u_elem[0],u_elem[1],u_elem[2]);CHKERRQ(ierr);
-  ierr = PetscFree4(n_elem[0],n_elem[1],n_elem[2],dv_mag_elem);CHKERRQ(ierr);
-  PetscFunctionReturn(0);
 }
 
 #undef __FUNCT__
-#define __FUNCT__ "VolumetricStrainVolume_local"
-extern PetscErrorCode VolumetricStrainVolume_local(PetscReal *VolStrainVolume_local,PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e, VFMatProp *matprop, PetscReal ****u_diff_array, PetscReal ***v_array)
+#define __FUNCT__ "VolumetricCrackOpening3D_localCC"
+extern PetscErrorCode VolumetricCrackOpening3D_localCC(PetscReal *CrackVolume_local, PetscReal ***volcrackopening_array, PetscReal ***udotn_array, PetscReal ****u_array, PetscReal ***v_array, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e)
+{
+  PetscFunctionBegin;
+  VolumetricCrackOpening3DCC_Kernel(CrackVolume_local,volcrackopening_array,udotn_array,u_array,v_array,ek,ej,ei,e);
+  PetscFunctionReturn(0);
+}
+
+/*
+  VolumetricStrainVolume_Kernel: VolumetricStrainVolume_local without the PETSc calls, the values at the integration points are on the stack
+*/
+static void VolumetricStrainVolume_Kernel(PetscReal *VolStrainVolume_local,PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e, VFMatProp *matprop, PetscReal ****u_diff_array, PetscReal ***v_array)
 {
   
-  PetscErrorCode ierr;
   PetscInt    i, j, k, c;
   PetscInt    eg;
-  PetscReal    *v_elem,*du_elem[3],beta;
+  PetscReal    v_elem[VFCARTFE_MAXNG3D],du_elem[3][VFCARTFE_MAXNG3D],beta;
   
-  PetscFunctionBegin;
-  ierr = PetscMalloc4(e->ng,&v_elem,
-                      e->ng,&du_elem[0],
-                      e->ng,&du_elem[1],
-                      e->ng,&du_elem[2]);CHKERRQ(ierr);
   beta  = matprop->beta;
   for (eg = 0; eg < e->ng; eg++){
     v_elem[eg] = 0.;
@@ -758,7 +1579,14 @@ extern PetscErrorCode VolumetricStrainVolume_local(PetscReal *VolStrainVolume_lo
       *VolStrainVolume_local += 1*beta*(pow(v_elem[eg],2))*du_elem[c][eg]*e->weight[eg];
     }
   }
-  ierr = PetscFree4(v_elem,du_elem[0],du_elem[1],du_elem[2]);CHKERRQ(ierr);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VolumetricStrainVolume_local"
+extern PetscErrorCode VolumetricStrainVolume_local(PetscReal *VolStrainVolume_local,PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e, VFMatProp *matprop, PetscReal ****u_diff_array, PetscReal ***v_array)
+{
+  PetscFunctionBegin;
+  VolumetricStrainVolume_Kernel(VolStrainVolume_local,ek,ej,ei,e,matprop,u_diff_array,v_array);
   PetscFunctionReturn(0);
 }
 
@@ -767,12 +1595,12 @@ extern PetscErrorCode VolumetricStrainVolume_local(PetscReal *VolStrainVolume_lo
 extern PetscErrorCode VFCheckVolumeBalance(PetscReal *ModulusVolume, PetscReal *DivVolume, PetscReal *SurfVolume, PetscReal *SumWellRate,PetscReal *SumSourceRate,PetscReal *VolStrainVolume,VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode  ierr;
+  VFCartFEElement3D *e3D;
+  VFCartFEElement2D *e2D;
   PetscInt        ek, ej, ei,i;
   PetscInt        xs,xm,nx;
   PetscInt        ys,ym,ny;
   PetscInt        zs,zm,nz;
-  PetscReal       hx,hy,hz;
-  PetscReal       ****coords_array;
   PetscReal       ****vel_array;
   PetscReal       ***v_array;
   Vec             v_local;
@@ -792,6 +1620,7 @@ extern PetscErrorCode VFCheckVolumeBalance(PetscReal *ModulusVolume, PetscReal *
   PetscReal       mysurfVolumeLocal = 0.,mysurfVolume = 0.;
   PetscReal       mysourceVolumeLocal = 0.,mysourceVolume = 0.;
   PetscReal       mystrainVolumeLocal = 0.,mystrainVolume = 0.;
+  PetscReal       myVolume[5],Volume[5];
   FACE           face;
   PetscReal       timestepsize = 0;
   PetscReal      ***m_inv_array;
@@ -802,7 +1631,6 @@ extern PetscErrorCode VFCheckVolumeBalance(PetscReal *ModulusVolume, PetscReal *
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMGetLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalBegin(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalEnd(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
@@ -856,17 +1684,14 @@ extern PetscErrorCode VFCheckVolumeBalance(PetscReal *ModulusVolume, PetscReal *
   for (ek = zs; ek < zs+zm; ek++) {
     for (ej = ys; ej < ys+ym; ej++) {
       for (ei = xs; ei < xs+xm; ei++) {
-        hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
-        ierr = ModulusVolume_local(&mymodVolumeLocal, ek, ej, ei,&ctx->e3D,m_inv_array[ek][ej][ei],press_diff_array,v_array);CHKERRQ(ierr);
-        ierr = DivergenceVolume_local(&mydivVolumeLocal, ek, ej, ei, &ctx->e3D,vel_array, v_array);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
+        ierr = ModulusVolume_local(&mymodVolumeLocal, ek, ej, ei,e3D,m_inv_array[ek][ej][ei],press_diff_array,v_array);CHKERRQ(ierr);
+        ierr = DivergenceVolume_local(&mydivVolumeLocal, ek, ej, ei, e3D,vel_array, v_array);CHKERRQ(ierr);
         if(ctx->hasFluidSources){
-          ierr = SourceVolume_local(&mysourceVolumeLocal, ek, ej, ei, &ctx->e3D, src_array, v_array);CHKERRQ(ierr);
+          ierr = SourceVolume_local(&mysourceVolumeLocal, ek, ej, ei, e3D, src_array, v_array);CHKERRQ(ierr);
         }
         if(ctx->FlowDisplCoupling){
-          ierr = VolumetricStrainVolume_local(&mystrainVolumeLocal, ek, ej, ei, &ctx->e3D,&ctx->matprop[ctx->layer[ek]],u_diff_array,v_array);CHKERRQ(ierr);
+          ierr = VolumetricStrainVolume_local(&mystrainVolumeLocal, ek, ej, ei, e3D,&ctx->matprop[ctx->layer[ek]],u_diff_array,v_array);CHKERRQ(ierr);
         }
         mymodVolume += mymodVolumeLocal;
         mysourceVolume += timestepsize*mysourceVolumeLocal;
@@ -874,38 +1699,38 @@ extern PetscErrorCode VFCheckVolumeBalance(PetscReal *ModulusVolume, PetscReal *
         mystrainVolume += mystrainVolumeLocal;
         if(ei == 0){
           face = X0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
-          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,&ctx->e2D,vel_array,v_array);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,e2D,vel_array,v_array);CHKERRQ(ierr);
           mysurfVolume += timestepsize*mysurfVolumeLocal;
         }
         if(ei == nx-1){
           face = X1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
-          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,&ctx->e2D,vel_array,v_array);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,e2D,vel_array,v_array);CHKERRQ(ierr);
           mysurfVolume += timestepsize*mysurfVolumeLocal;
         }
         if(ej == 0){
           face = Y0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
-          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,&ctx->e2D,vel_array,v_array);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,e2D,vel_array,v_array);CHKERRQ(ierr);
           mysurfVolume += timestepsize*mysurfVolumeLocal;
         }
         if(ej == ny-1){
           face = Y1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
-          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,&ctx->e2D,vel_array,v_array);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,e2D,vel_array,v_array);CHKERRQ(ierr);
           mysurfVolume += timestepsize*mysurfVolumeLocal;
         }
         if(ek == 0){
           face = Z0;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
-          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,&ctx->e2D,vel_array,v_array);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,e2D,vel_array,v_array);CHKERRQ(ierr);
           mysurfVolume += timestepsize*mysurfVolumeLocal;
         }
         if(ek == nz-1){
           face = Z1;
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
-          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,&ctx->e2D,vel_array,v_array);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = SurfaceFluxVolume_local(&mysurfVolumeLocal,ek,ej,ei,face,e2D,vel_array,v_array);CHKERRQ(ierr);
           mysurfVolume += timestepsize*mysurfVolumeLocal;
         }
       }
@@ -920,12 +1745,17 @@ extern PetscErrorCode VFCheckVolumeBalance(PetscReal *ModulusVolume, PetscReal *
       *SumWellRate = *SumWellRate - timestepsize*ctx->well[i].Qw;
     }
   }
-  ierr = MPI_Allreduce(&mymodVolume,ModulusVolume,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
-  ierr = MPI_Allreduce(&mydivVolume,DivVolume,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
-  ierr = MPI_Allreduce(&mysurfVolume,SurfVolume,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
-  ierr = MPI_Allreduce(&mysourceVolume,SumSourceRate,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
-  ierr = MPI_Allreduce(&mystrainVolume,VolStrainVolume,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
-  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
+  myVolume[0] = mymodVolume;
+  myVolume[1] = mydivVolume;
+  myVolume[2] = mysurfVolume;
+  myVolume[3] = mysourceVolume;
+  myVolume[4] = mystrainVolume;
+  ierr = MPI_Allreduce(myVolume,Volume,5,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  *ModulusVolume   = Volume[0];
+  *DivVolume       = Volume[1];
+  *SurfVolume      = Volume[2];
+  *SumSourceRate   = Volume[3];
+  *VolStrainVolume = Volume[4];
   ierr = DMDAVecRestoreArray(ctx->daScal,press_diff_local,&press_diff_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daScal,&press_diff_local);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArray(ctx->daScal,src_local,&src_array);CHKERRQ(ierr);
@@ -946,19 +1776,16 @@ extern PetscErrorCode VFCheckVolumeBalance(PetscReal *ModulusVolume, PetscReal *
   PetscFunctionReturn(0);
 }
 
-#undef __FUNCT__
-#define __FUNCT__ "ModulusVolume_local"
-extern PetscErrorCode ModulusVolume_local(PetscReal *ModVolume_local,PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e, PetscReal m_inv, PetscReal ***press_diff_array,PetscReal ***v_array)
+/*
+  ModulusVolume_Kernel: ModulusVolume_local without the PETSc calls, the values at the integration points are on the stack
+*/
+static void ModulusVolume_Kernel(PetscReal *ModVolume_local,PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e, PetscReal m_inv, PetscReal ***press_diff_array,PetscReal ***v_array)
 {
   
-  PetscErrorCode ierr;
   PetscInt    i, j, k;
   PetscInt    eg;
-  PetscReal   *v_elem,*press_diff_elem;
-  
-  PetscFunctionBegin;
+  PetscReal   v_elem[VFCARTFE_MAXNG3D],press_diff_elem[VFCARTFE_MAXNG3D];
   
-  ierr = PetscMalloc2(e->ng,&v_elem,e->ng,&press_diff_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     v_elem[eg] = 0;
     press_diff_elem[eg] = 0;
@@ -977,7 +1804,14 @@ extern PetscErrorCode ModulusVolume_local(PetscReal *ModVolume_local,PetscInt ek
   for(eg = 0; eg < e->ng; eg++){
     *ModVolume_local += (pow(v_elem[eg],2))*m_inv*press_diff_elem[eg]*e->weight[eg];
   }
-  ierr = PetscFree2(v_elem,press_diff_elem);CHKERRQ(ierr);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "ModulusVolume_local"
+extern PetscErrorCode ModulusVolume_local(PetscReal *ModVolume_local,PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e, PetscReal m_inv, PetscReal ***press_diff_array,PetscReal ***v_array)
+{
+  PetscFunctionBegin;
+  ModulusVolume_Kernel(ModVolume_local,ek,ej,ei,e,m_inv,press_diff_array,v_array);
   PetscFunctionReturn(0);
 }
 
@@ -1078,17 +1912,15 @@ extern PetscErrorCode SurfaceFluxVolume_local(PetscReal *mysurfVolumeLocal,Petsc
   PetscFunctionReturn(0);
 }
 
-#undef __FUNCT__
-#define __FUNCT__ "DivergenceVolume_local"
-extern PetscErrorCode DivergenceVolume_local(PetscReal *DivVolume_local, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e, PetscReal ****vel_array,PetscReal ***v_array)
+/*
+  DivergenceVolume_Kernel: DivergenceVolume_local without the PETSc calls, the values at the integration points are on the stack
+*/
+static void DivergenceVolume_Kernel(PetscReal *DivVolume_local, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e, PetscReal ****vel_array,PetscReal ***v_array)
 {
   
-  PetscErrorCode ierr;
   PetscInt    i, j, k, c;
   PetscInt    eg;
-  PetscReal   *dvel_elem[3],*v_elem;
-  PetscFunctionBegin;
-  ierr = PetscMalloc4(e->ng,&dvel_elem[0],e->ng,&dvel_elem[1],e->ng,&dvel_elem[2],e->ng,&v_elem);CHKERRQ(ierr);
+  PetscReal   dvel_elem[3][VFCARTFE_MAXNG3D],v_elem[VFCARTFE_MAXNG3D];
   for (eg = 0; eg < e->ng; eg++){
     v_elem[eg] = 0;
     for (c = 0; c < 3; c++){
@@ -1113,22 +1945,27 @@ extern PetscErrorCode DivergenceVolume_local(PetscReal *DivVolume_local, PetscIn
       *DivVolume_local += (pow(v_elem[eg],2))*dvel_elem[c][eg]*e->weight[eg];
     }
   }
-  ierr = PetscFree4(dvel_elem[0],dvel_elem[1],dvel_elem[2],v_elem);CHKERRQ(ierr);
-  PetscFunctionReturn(0);
 }
 
 #undef __FUNCT__
-#define __FUNCT__ "SourceVolume_local"
-extern PetscErrorCode SourceVolume_local(PetscReal *SrcVolume_local, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e,PetscReal ***src_array, PetscReal ***v_array)
+#define __FUNCT__ "DivergenceVolume_local"
+extern PetscErrorCode DivergenceVolume_local(PetscReal *DivVolume_local, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e, PetscReal ****vel_array,PetscReal ***v_array)
+{
+  PetscFunctionBegin;
+  DivergenceVolume_Kernel(DivVolume_local,ek,ej,ei,e,vel_array,v_array);
+  PetscFunctionReturn(0);
+}
+
+/*
+  SourceVolume_Kernel: SourceVolume_local without the PETSc calls, the values at the integration points are on the stack
+*/
+static void SourceVolume_Kernel(PetscReal *SrcVolume_local, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e,PetscReal ***src_array, PetscReal ***v_array)
 {
   
-  PetscErrorCode ierr;
   PetscInt    i, j, k;
   PetscInt    eg;
-  PetscReal   *src_elem,*v_elem;
+  PetscReal   src_elem[VFCARTFE_MAXNG3D],v_elem[VFCARTFE_MAXNG3D];
   
-  PetscFunctionBegin;
-  ierr = PetscMalloc2(e->ng,&v_elem,e->ng,&src_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     v_elem[eg] = 0;
     src_elem[eg] = 0;
@@ -1147,93 +1984,77 @@ extern PetscErrorCode SourceVolume_local(PetscReal *SrcVolume_local, PetscInt ek
   for(eg = 0; eg < e->ng; eg++){
     *SrcVolume_local += (pow(v_elem[eg],2))*src_elem[eg]*e->weight[eg];
   }
-  ierr = PetscFree2(v_elem,src_elem);CHKERRQ(ierr);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "SourceVolume_local"
+extern PetscErrorCode SourceVolume_local(PetscReal *SrcVolume_local, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e,PetscReal ***src_array, PetscReal ***v_array)
+{
+  PetscFunctionBegin;
+  SourceVolume_Kernel(SrcVolume_local,ek,ej,ei,e,src_array,v_array);
   PetscFunctionReturn(0);
 }
 
 #undef __FUNCT__
 #define __FUNCT__ "CellToNodeInterpolation"
+/*
+  CellToNodeInterpolation: sets node_vec to the volume weighted average of cell_vec over the cells sharing 
+  each node. The lumped nodal volumes only depend on the geometry and are computed once in VFGeometryInitialize.
+*/
 extern PetscErrorCode CellToNodeInterpolation(Vec node_vec,Vec cell_vec,VFCtx *ctx)
 {
   PetscErrorCode  ierr;
   PetscInt        dof;
-  PetscInt        xs,xm,nx;
-  PetscInt        ys,ym,ny;
-  PetscInt        zs,zm,nz;
+  PetscInt        xs,xm;
+  PetscInt        ys,ym;
+  PetscInt        zs,zm;
   PetscInt        ek, ej, ei;
   PetscInt        k, j, i;
   PetscInt        c;
-  PetscReal       hx,hy,hz;
+  PetscReal       hx,hy,hz,cellvol;
   PetscReal       ****coords_array;
-  PetscReal       ***vol_array;
-  Vec             volume;
-  Vec             volume_local;
-  PetscReal       nodal_sum_local = 0.;
-  PetscReal       cell_sum_local = 0.;
+  PetscReal       ***volinv_array;
   Vec             node_local;
-  PetscReal       ***node_array;
   PetscReal       ****node_arraydof;
-  PetscReal       ***cell_array;
   PetscReal       ****cell_arraydof;
-  DM              dm;
+  DM              dm,dmCell;
   
   PetscFunctionBegin;
   ierr = VecGetDM(node_vec,&dm);CHKERRQ(ierr);
   ierr = DMDAGetInfo(dm,NULL,NULL,NULL,NULL,NULL,NULL,NULL,
                      &dof,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
-  ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
-                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  switch (dof) {
+    case 1:
+      dmCell = ctx->daScalCell;
+      break;
+    case 3:
+      dmCell = ctx->daVectCell;
+      break;
+    default:
+      dmCell = ctx->daVFperm;
+      break;
+  }
+  /*
+    Scatter-add the volume weighted cell values to the nodes
+  */
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
   ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
-  ierr = DMCreateGlobalVector(ctx->daScal, &volume);CHKERRQ(ierr);
-  ierr = PetscObjectSetName((PetscObject) volume,"Volume");CHKERRQ(ierr);
-  ierr = VecSet(volume,0.0);CHKERRQ(ierr);
-  ierr = DMGetLocalVector(ctx->daScal,&volume_local);CHKERRQ(ierr);
-  ierr = DMGlobalToLocalBegin(ctx->daScal,volume,INSERT_VALUES,volume_local);CHKERRQ(ierr);
-  ierr = DMGlobalToLocalEnd(ctx->daScal,volume,INSERT_VALUES,volume_local);CHKERRQ(ierr);
-  ierr = DMDAVecGetArray(ctx->daScal,volume_local,&vol_array);CHKERRQ(ierr);
-  if (dof == 1){
-    ierr = DMGetLocalVector(dm,&node_local);CHKERRQ(ierr);
-    ierr = DMGlobalToLocalBegin(dm,node_vec,INSERT_VALUES,node_local);CHKERRQ(ierr);
-    ierr = DMGlobalToLocalEnd(dm,node_vec,INSERT_VALUES,node_local);CHKERRQ(ierr);
-    ierr = DMDAVecGetArray(dm,node_local,&node_array);CHKERRQ(ierr);
-    ierr = DMDAVecGetArray(ctx->daScalCell,cell_vec,&cell_array);CHKERRQ(ierr);
-  }
-  else if (dof == 3)
-  {
-    ierr = DMGetLocalVector(dm,&node_local);CHKERRQ(ierr);
-    ierr = DMGlobalToLocalBegin(dm,node_vec,INSERT_VALUES,node_local);CHKERRQ(ierr);
-    ierr = DMGlobalToLocalEnd(dm,node_vec,INSERT_VALUES,node_local);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOF(dm, node_local,&node_arraydof);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOF(ctx->daVectCell,cell_vec,&cell_arraydof);CHKERRQ(ierr);
-  }
-  else
-  {
-    ierr = DMGetLocalVector(dm,&node_local);CHKERRQ(ierr);
-    ierr = DMGlobalToLocalBegin(dm,node_vec,INSERT_VALUES,node_local);CHKERRQ(ierr);
-    ierr = DMGlobalToLocalEnd(dm,node_vec,INSERT_VALUES,node_local);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOF(dm, node_local,&node_arraydof);CHKERRQ(ierr);
-    ierr = DMDAVecGetArrayDOF(ctx->daVFperm,cell_vec,&cell_arraydof);CHKERRQ(ierr);
-  }
+  ierr = DMGetLocalVector(dm,&node_local);CHKERRQ(ierr);
+  ierr = VecSet(node_local,0.);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(dm,node_local,&node_arraydof);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(dmCell,cell_vec,&cell_arraydof);CHKERRQ(ierr);
   for (ek = zs; ek < zs + zm; ek++) {
     for (ej = ys; ej < ys + ym; ej++) {
       for (ei = xs; ei < xs + xm; ei++) {
         hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
         hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
         hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        for(k = 0; k < 2; k++){
-          for(j = 0; j < 2; j++){
-            for(i = 0; i < 2; i++){
-              vol_array[ek+k][ej+j][ei+i] += hz*hy*hx;
-              if(dof == 1)
-              {
-                node_array[ek+k][ej+j][ei+i] += cell_array[ek][ej][ei]*hx*hy*hz;
-              }
-              else
-              {
-                for(c = 0; c < dof; c++){
-                  node_arraydof[ek+k][ej+j][ei+i][c] += cell_arraydof[ek][ej][ei][c]*hx*hy*hz;
-                }
+        cellvol = hx*hy*hz;
+        for (k = 0; k < 2; k++) {
+          for (j = 0; j < 2; j++) {
+            for (i = 0; i < 2; i++) {
+              for (c = 0; c < dof; c++) {
+                node_arraydof[ek+k][ej+j][ei+i][c] += cell_arraydof[ek][ej][ei][c]*cellvol;
               }
             }
           }
@@ -1241,89 +2062,30 @@ extern PetscErrorCode CellToNodeInterpolation(Vec node_vec,Vec cell_vec,VFCtx *c
       }
     }
   }
+  ierr = DMDAVecRestoreArrayDOF(dmCell,cell_vec,&cell_arraydof);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(dm,node_local,&node_arraydof);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
-  ierr = DMDAVecRestoreArray(ctx->daScal,volume_local,&vol_array);CHKERRQ(ierr);
-  ierr = DMLocalToGlobalBegin(ctx->daScal,volume_local,ADD_VALUES,volume);CHKERRQ(ierr);
-  ierr = DMLocalToGlobalEnd(ctx->daScal,volume_local,ADD_VALUES,volume);CHKERRQ(ierr);
-  ierr = DMRestoreLocalVector(ctx->daScal,&volume_local);CHKERRQ(ierr);
-  if(dof == 1){
-    ierr = DMDAVecRestoreArray(dm, node_local,&node_array);CHKERRQ(ierr);
-    ierr = DMLocalToGlobalBegin(dm,node_local,ADD_VALUES,node_vec);CHKERRQ(ierr);
-    ierr = DMLocalToGlobalEnd(dm,node_local,ADD_VALUES,node_vec);CHKERRQ(ierr);
-    ierr = DMRestoreLocalVector(dm,&node_local);CHKERRQ(ierr);
-  }
-  else
-  {
-    ierr = DMDAVecRestoreArrayDOF(dm, node_local,&node_arraydof);CHKERRQ(ierr);
-    ierr = DMLocalToGlobalBegin(dm,node_local,ADD_VALUES,node_vec);CHKERRQ(ierr);
-    ierr = DMLocalToGlobalEnd(dm,node_local,ADD_VALUES,node_vec);CHKERRQ(ierr);
-    ierr = DMRestoreLocalVector(dm,&node_local);CHKERRQ(ierr);
-  }
-  if (dof == 1){
-    ierr = DMDAVecGetArray(dm, node_vec,&node_array);CHKERRQ(ierr);
-  }
-  else
-  {
-    ierr = DMDAVecGetArrayDOF(dm, node_vec,&node_arraydof);CHKERRQ(ierr);
-  }
-  ierr = DMDAVecGetArray(ctx->daScal,volume,&vol_array);CHKERRQ(ierr);
-  ierr = DMDAGetInfo(ctx->daScal,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
-                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  ierr = VecSet(node_vec,0.);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalBegin(dm,node_local,ADD_VALUES,node_vec);CHKERRQ(ierr);
+  ierr = DMLocalToGlobalEnd(dm,node_local,ADD_VALUES,node_vec);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(dm,&node_local);CHKERRQ(ierr);
+  /*
+    Scale by the inverse of the lumped nodal volumes
+  */
   ierr = DMDAGetCorners(ctx->daScal,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  ierr = DMDAVecGetArrayDOF(dm,node_vec,&node_arraydof);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScal,ctx->NodalVolumeInv,&volinv_array);CHKERRQ(ierr);
   for (ek = zs; ek < zs + zm; ek++) {
     for (ej = ys; ej < ys + ym; ej++) {
       for (ei = xs; ei < xs + xm; ei++) {
-        if(dof == 1)
-        {
-          node_array[ek][ej][ei] = node_array[ek][ej][ei]/vol_array[ek][ej][ei];
-          nodal_sum_local += PetscAbs(node_array[ek][ej][ei]);
-        }
-        else
-        {
-          for(c = 0; c < dof; c++){
-            node_arraydof[ek][ej][ei][c] = node_arraydof[ek][ej][ei][c]/vol_array[ek][ej][ei];
-            nodal_sum_local += PetscAbs(node_arraydof[ek][ej][ei][c]);
-          }
-          
-        }
-      }
-    }
-  }
-  ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
-                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
-  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  for (ek = zs; ek < zs + zm; ek++) {
-    for (ej = ys; ej < ys + ym; ej++) {
-      for (ei = xs; ei < xs + xm; ei++) {
-        if(dof == 1)
-        {
-          cell_sum_local += PetscAbs(cell_array[ek][ej][ei]);
-        }
-        else
-        {
-          for(c = 0; c < dof; c++){
-            cell_sum_local += PetscAbs(cell_arraydof[ek][ej][ei][c]);
-          }
+        for (c = 0; c < dof; c++) {
+          node_arraydof[ek][ej][ei][c] *= volinv_array[ek][ej][ei];
         }
       }
     }
   }
-  ierr = DMDAVecRestoreArray(ctx->daScal,volume,&vol_array);CHKERRQ(ierr);
-  if(dof == 1){
-    ierr = DMDAVecRestoreArray(dm,node_vec,&node_array);CHKERRQ(ierr);
-    ierr = DMDAVecRestoreArray(ctx->daScalCell,cell_vec,&cell_array);CHKERRQ(ierr);
-  }
-  else if (dof == 3)
-  {
-    ierr = DMDAVecRestoreArrayDOF(dm,node_vec,&node_arraydof);CHKERRQ(ierr);
-    ierr = DMDAVecRestoreArrayDOF(ctx->daVectCell,cell_vec,&cell_arraydof);CHKERRQ(ierr);
-  }
-  else
-  {
-    ierr = DMDAVecRestoreArrayDOF(dm,node_vec,&node_arraydof);CHKERRQ(ierr);
-    ierr = DMDAVecRestoreArrayDOF(ctx->daVFperm,cell_vec,&cell_arraydof);CHKERRQ(ierr);
-  }
-  ierr = VecDestroy(&volume);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daScal,ctx->NodalVolumeInv,&volinv_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArrayDOF(dm,node_vec,&node_arraydof);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -1332,12 +2094,12 @@ extern PetscErrorCode CellToNodeInterpolation(Vec node_vec,Vec cell_vec,VFCtx *c
 extern PetscErrorCode VolumetricLeakOffRate(PetscReal *LeakOffRate, VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode  ierr;
+  VFCartFEElement3D *e3D;
   PetscInt        ek, ej, ei;
+  PetscInt        b;
   PetscInt        xs,xm,nx;
   PetscInt        ys,ym,ny;
   PetscInt        zs,zm,nz;
-  PetscReal       hx,hy,hz;
-  PetscReal       ****coords_array;
   PetscReal       ****q_array;
   Vec             q_local;
   PetscReal       ***v_array;
@@ -1353,7 +2115,6 @@ extern PetscErrorCode VolumetricLeakOffRate(PetscReal *LeakOffRate, VFCtx *ctx,
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMGetLocalVector(ctx->daVect,&q_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalBegin(ctx->daVect,fields->velocity,INSERT_VALUES,q_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalEnd(ctx->daVect,fields->velocity,INSERT_VALUES,q_local);CHKERRQ(ierr);
@@ -1371,20 +2132,14 @@ extern PetscErrorCode VolumetricLeakOffRate(PetscReal *LeakOffRate, VFCtx *ctx,
   ierr = DMDAVecGetArray(ctx->daScalCell,VolLeakoffRate_local,&volleakoffrate_array);CHKERRQ(ierr);
   
   *LeakOffRate = 0.;
-  for (ek = zs; ek < zs+zm; ek++) {
-    for (ej = ys; ej < ys+ym; ej++) {
-      for (ei = xs; ei < xs+xm; ei++) {
-        hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
-        ierr = VolumetricCrackOpening3D_localCC(&myLeakOffRateLocal, volleakoffrate_array,NULL, q_array, v_array, ek, ej, ei, &ctx->e3D);CHKERRQ(ierr);
-        myLeakOffRate += timestepsize*myLeakOffRateLocal;
-      }
-    }
+  ierr = VFDamageBandUpdate(ctx,fields->V);CHKERRQ(ierr);
+  for (b = 0; b < ctx->nBand; b++) {
+    ei = ctx->bandCell[3*b]; ej = ctx->bandCell[3*b+1]; ek = ctx->bandCell[3*b+2];
+    ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
+    ierr = VolumetricCrackOpening3D_localCC(&myLeakOffRateLocal, volleakoffrate_array,NULL, q_array, v_array, ek, ej, ei, e3D);CHKERRQ(ierr);
+    myLeakOffRate += timestepsize*myLeakOffRateLocal;
   }
   ierr = MPI_Allreduce(&myLeakOffRate,LeakOffRate,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
-  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArrayDOF(ctx->daVect,q_local,&q_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daVect,&q_local);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArray(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
@@ -1552,12 +2307,11 @@ extern PetscErrorCode VolumetricFractureWellRate_local(PetscReal *InjVolume_loca
 extern PetscErrorCode VolumetricFractureWellRate(PetscReal *InjectedVolume, VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode  ierr;
+  VFCartFEElement3D *e3D;
   PetscInt        ek, ej, ei;
   PetscInt        xs,xm,nx;
   PetscInt        ys,ym,ny;
   PetscInt        zs,zm,nz;
-  PetscReal       hx,hy,hz;
-  PetscReal       ****coords_array;
   PetscReal       ***regrate_array;
   Vec             regrate_local;
   PetscReal       ***v_array;
@@ -1568,7 +2322,6 @@ extern PetscErrorCode VolumetricFractureWellRate(PetscReal *InjectedVolume, VFCt
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   
   ierr = DMGetLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalBegin(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
@@ -1584,18 +2337,14 @@ extern PetscErrorCode VolumetricFractureWellRate(PetscReal *InjectedVolume, VFCt
   for (ek = zs; ek < zs+zm; ek++) {
     for (ej = ys; ej < ys+ym; ej++) {
       for (ei = xs; ei < xs+xm; ei++) {
-        hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
-        ierr = VolumetricFractureWellRate_local(&myInjVolumeRateLocal, regrate_array, v_array, ek, ej, ei, &ctx->e3D);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
+        ierr = VolumetricFractureWellRate_local(&myInjVolumeRateLocal, regrate_array, v_array, ek, ej, ei, e3D);CHKERRQ(ierr);
         myInjVolumeRate += myInjVolumeRateLocal;
       }
     }
   }
   ierr = MPI_Allreduce(&myInjVolumeRate,InjectedVolume,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
   
-  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArray(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
   
@@ -1698,12 +2447,11 @@ extern PetscErrorCode VF_IntegrateOnBoundary_local(PetscReal *SumnIntegral_local
 extern PetscErrorCode VF_IntegrateOnBoundary(PetscReal *SumnIntegral,Vec vec, FACE face, VFCtx *ctx)
 {
   PetscErrorCode  ierr;
+  VFCartFEElement2D *e2D;
   PetscInt        ek, ej, ei;
   PetscInt        xs,xm,nx;
   PetscInt        ys,ym,ny;
   PetscInt        zs,zm,nz;
-  PetscReal       hx,hy,hz;
-  PetscReal       ****coords_array;
   Vec             node_local;
   PetscReal       ***node_array;
   PetscInt        dof;
@@ -1717,7 +2465,6 @@ extern PetscErrorCode VF_IntegrateOnBoundary(PetscReal *SumnIntegral,Vec vec, FA
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMGetLocalVector(dm,&node_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalBegin(dm,vec,INSERT_VALUES,node_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalEnd(dm,vec,INSERT_VALUES,node_local);CHKERRQ(ierr);
@@ -1730,10 +2477,8 @@ extern PetscErrorCode VF_IntegrateOnBoundary(PetscReal *SumnIntegral,Vec vec, FA
       ei = 0;
       for (ek = zs; ek < zs+zm; ek++) {
         for (ej = ys; ej < ys+ym; ej++) {
-          hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-          hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
-          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,&ctx->e2D);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,e2D);CHKERRQ(ierr);
           mySumnIntegral += SumnIntegralLocal;
         }
       }
@@ -1742,10 +2487,8 @@ extern PetscErrorCode VF_IntegrateOnBoundary(PetscReal *SumnIntegral,Vec vec, FA
       ei = nx-1;
       for (ek = zs; ek < zs+zm; ek++) {
         for (ej = ys; ej < ys+ym; ej++) {
-          hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-          hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hz,hy);CHKERRQ(ierr);
-          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,&ctx->e2D);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,e2D);CHKERRQ(ierr);
           mySumnIntegral += SumnIntegralLocal;
         }
       }
@@ -1754,10 +2497,8 @@ extern PetscErrorCode VF_IntegrateOnBoundary(PetscReal *SumnIntegral,Vec vec, FA
       ej = 0;
       for (ek = zs; ek < zs+zm; ek++) {
         for (ei = xs; ei < xs+xm; ei++) {
-          hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-          hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
-          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,&ctx->e2D);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,e2D);CHKERRQ(ierr);
           mySumnIntegral += SumnIntegralLocal;
         }
       }
@@ -1766,10 +2507,8 @@ extern PetscErrorCode VF_IntegrateOnBoundary(PetscReal *SumnIntegral,Vec vec, FA
       ej = ny-1;
       for (ek = zs; ek < zs+zm; ek++) {
         for (ei = xs; ei < xs+xm; ei++) {
-          hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-          hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hz);CHKERRQ(ierr);
-          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,&ctx->e2D);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,e2D);CHKERRQ(ierr);
           mySumnIntegral += SumnIntegralLocal;
         }
       }
@@ -1778,10 +2517,8 @@ extern PetscErrorCode VF_IntegrateOnBoundary(PetscReal *SumnIntegral,Vec vec, FA
       ek = 0;
       for (ej = ys; ej < ys+ym; ej++) {
         for (ei = xs; ei < xs+xm; ei++) {
-          hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-          hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
-          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,&ctx->e2D);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,e2D);CHKERRQ(ierr);
           mySumnIntegral += SumnIntegralLocal;
         }
       }
@@ -1790,10 +2527,8 @@ extern PetscErrorCode VF_IntegrateOnBoundary(PetscReal *SumnIntegral,Vec vec, FA
       ek = nz-1;
       for (ej = ys; ej < ys+ym; ej++) {
         for (ei = xs; ei < xs+xm; ei++) {
-          hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-          hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-          ierr = VFCartFEElement2DInit(&ctx->e2D,hx,hy);CHKERRQ(ierr);
-          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,&ctx->e2D);CHKERRQ(ierr);
+          ierr = VFCartFEElementCacheGet2D(ctx->feCache,face,ei,ej,ek,&e2D);CHKERRQ(ierr);
+          ierr = VF_IntegrateOnBoundary_local(&SumnIntegralLocal,node_array,ek,ej,ei,face,e2D);CHKERRQ(ierr);
           mySumnIntegral += SumnIntegralLocal;
         }
       }
@@ -1857,12 +2592,11 @@ extern PetscErrorCode VF_ComputeRegularizedFracturePressure_local(PetscReal ***p
 extern PetscErrorCode VF_ComputeRegularizedFracturePressure(VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode  ierr;
+  VFCartFEElement3D *e3D;
   PetscInt        ek, ej, ei;
   PetscInt        xs,xm,nx;
   PetscInt        ys,ym,ny;
   PetscInt        zs,zm,nz;
-  PetscReal       hx,hy,hz;
-  PetscReal       ****coords_array;
   PetscReal       ****u_array;
   Vec             u_local;
   PetscReal       ***v_array;
@@ -1877,7 +2611,6 @@ extern PetscErrorCode VF_ComputeRegularizedFracturePressure(VFCtx *ctx, VFFields
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMGetLocalVector(ctx->daVect,&u_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalBegin(ctx->daVect,fields->U,INSERT_VALUES,u_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalEnd(ctx->daVect,fields->U,INSERT_VALUES,u_local);CHKERRQ(ierr);
@@ -1900,17 +2633,13 @@ extern PetscErrorCode VF_ComputeRegularizedFracturePressure(VFCtx *ctx, VFFields
   for (ek = zs; ek < zs+zm; ek++) {
     for (ej = ys; ej < ys+ym; ej++) {
       for (ei = xs; ei < xs+xm; ei++) {
-        hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
-        ierr = VF_ComputeRegularizedFracturePressure_local(press_c_array, press_array, u_array, v_array, ek, ej, ei, &ctx->e3D);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
+        ierr = VF_ComputeRegularizedFracturePressure_local(press_c_array, press_array, u_array, v_array, ek, ej, ei, e3D);CHKERRQ(ierr);
       }
     }
   }
   ierr = DMDAVecRestoreArray(ctx->daScal,press_local,&press_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daScal,&press_local);CHKERRQ(ierr);
-  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArrayDOF(ctx->daVect,u_local,&u_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daVect,&u_local);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArray(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
@@ -1930,12 +2659,12 @@ extern PetscErrorCode VF_ComputeRegularizedFracturePressure(VFCtx *ctx, VFFields
 extern PetscErrorCode VolumeFromWidth(PetscReal *CrackVolume, VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode  ierr;
+  VFCartFEElement3D *e3D;
   PetscInt        ek, ej, ei;
+  PetscInt        b;
   PetscInt        xs,xm,nx;
   PetscInt        ys,ym,ny;
   PetscInt        zs,zm,nz;
-  PetscReal       hx,hy,hz;
-  PetscReal       ****coords_array;
   PetscReal       ***v_array;
   Vec             v_local;
   PetscReal       myCrackVolumeLocal = 0.,myCrackVolume = 0.;
@@ -1947,7 +2676,6 @@ extern PetscErrorCode VolumeFromWidth(PetscReal *CrackVolume, VFCtx *ctx, VFFiel
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
   ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   
   ierr = DMGetLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
   ierr = DMGlobalToLocalBegin(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
@@ -1960,21 +2688,15 @@ extern PetscErrorCode VolumeFromWidth(PetscReal *CrackVolume, VFCtx *ctx, VFFiel
   ierr = DMDAVecGetArray(ctx->daScalCell,w_local,&w_array);CHKERRQ(ierr);
   
   *CrackVolume = 0.;
-  for (ek = zs; ek < zs+zm; ek++) {
-    for (ej = ys; ej < ys+ym; ej++) {
-      for (ei = xs; ei < xs+xm; ei++) {
-        hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-        hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-        hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
-        ierr = VolumeFromWidth_local(&myCrackVolumeLocal, w_array[ek][ej][ei], v_array, ek, ej, ei, &ctx->e3D);CHKERRQ(ierr);
-        myCrackVolume += myCrackVolumeLocal;
-      }
-    }
+  ierr = VFDamageBandUpdate(ctx,fields->V);CHKERRQ(ierr);
+  for (b = 0; b < ctx->nBand; b++) {
+    ei = ctx->bandCell[3*b]; ej = ctx->bandCell[3*b+1]; ek = ctx->bandCell[3*b+2];
+    ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
+    ierr = VolumeFromWidth_local(&myCrackVolumeLocal, w_array[ek][ej][ei], v_array, ek, ej, ei, e3D);CHKERRQ(ierr);
+    myCrackVolume += myCrackVolumeLocal;
   }
   ierr = MPI_Allreduce(&myCrackVolume,CrackVolume,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
   
-  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
   ierr = DMDAVecRestoreArray(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
   ierr = DMRestoreLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
   
@@ -1984,21 +2706,15 @@ extern PetscErrorCode VolumeFromWidth(PetscReal *CrackVolume, VFCtx *ctx, VFFiel
 }
 
 
-#undef __FUNCT__
-#define __FUNCT__ "VolumeFromWidth_local"
-extern PetscErrorCode VolumeFromWidth_local(PetscReal *CrackVolume_local, PetscReal w, PetscReal ***v_array, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e)
+/*
+  VolumeFromWidth_Kernel: VolumeFromWidth_local without the PETSc calls, the values at the integration points are on the stack
+*/
+static void VolumeFromWidth_Kernel(PetscReal *CrackVolume_local, PetscReal w, PetscReal ***v_array, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e)
 {
-  PetscErrorCode ierr;
   PetscInt    i, j, k, c;
   PetscInt    eg;
-  PetscReal   *dv_elem[3],*dv_mag_elem;
-  
+  PetscReal   dv_elem[3][VFCARTFE_MAXNG3D],dv_mag_elem[VFCARTFE_MAXNG3D];
   
-  PetscFunctionBegin;
-  ierr = PetscMalloc4(e->ng,&dv_elem[0],
-                      e->ng,&dv_elem[1],
-                      e->ng,&dv_elem[2],
-                      e->ng,&dv_mag_elem);CHKERRQ(ierr);
   for (eg = 0; eg < e->ng; eg++){
     for (c = 0; c < 3; c++){
       dv_elem[c][eg] = 0.;
@@ -2022,7 +2738,14 @@ extern PetscErrorCode VolumeFromWidth_local(PetscReal *CrackVolume_local, PetscR
   for(eg = 0; eg < e->ng; eg++){
     *CrackVolume_local += w*dv_mag_elem[eg]*e->weight[eg];
   }
-  ierr = PetscFree4(dv_elem[0],dv_elem[1],dv_elem[2],dv_mag_elem);CHKERRQ(ierr);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VolumeFromWidth_local"
+extern PetscErrorCode VolumeFromWidth_local(PetscReal *CrackVolume_local, PetscReal w, PetscReal ***v_array, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e)
+{
+  PetscFunctionBegin;
+  VolumeFromWidth_Kernel(CrackVolume_local,w,v_array,ek,ej,ei,e);
   PetscFunctionReturn(0);
 }
 
@@ -2030,11 +2753,443 @@ extern PetscErrorCode VolumeFromWidth_local(PetscReal *CrackVolume_local, PetscR
 
 
 
+#undef __FUNCT__
+#define __FUNCT__ "VFDiagnosticsBegin"
+/*
+  VFDiagnosticsBegin: computes the end of step diagnostics requested in diag->requested in a single sweep
+  over the local cells: crack volume (VolumetricCrackOpening), leak-off (VolumetricLeakOffRate), volume from
+  the width (VolumeFromWidth), volume balance terms (VFCheckVolumeBalance), VF_UEnergy3D and VF_VEnergy3D.
+  Each field is exchanged once and the local contributions are summed by a single reduction, which is
+  non-blocking when MPI allows it. The values are available in diag->value after VFDiagnosticsEnd.
+  fields->VolCrackOpening and fields->VolLeakOffRate are updated when the corresponding scalar is requested.
+  Energies already known from -U_superposition or -residual_energy are not recomputed.
+*/
+extern PetscErrorCode VFDiagnosticsBegin(VFDiagnostics *diag,VFCtx *ctx,VFFields *fields)
+{
+  PetscErrorCode    ierr;
+  PetscLogDouble    flops = 0.;
+  VFCartFEElement3D *e3D,*e3DU;
+  VFCartFEElement2D *e2D;
+  PetscInt          ek,ej,ei,i,d;
+  PetscInt          xs,xm,nx;
+  PetscInt          ys,ym,ny;
+  PetscInt          zs,zm,nz;
+  FACE              bface[6] = {X0,X1,Y0,Y1,Z0,Z1};
+  PetscBool         onface[6];
+  PetscBool         *req = diag->requested;
+  PetscBool         usup = PETSC_FALSE,ures,vres;
+  PetscBool         needU,needVel,needTheta,needPressure,needCellU,needSurface,batchElastic;
+  PetscReal         timestepsize,p,myLocal;
+  PetscReal         myElasticEnergy = 0.,mySurfaceEnergy = 0.;
+  PetscReal         myCrackVolume = 0.,myLeakOff = 0.,myWidthVolume = 0.,myModulusVolume = 0.;
+  PetscReal         myDivVolume = 0.,mySourceVolume = 0.,myStrainVolume = 0.,myPressureWork = 0.;
+  PetscReal         BBmin[3],BBmax[3];
+  PetscReal         ****coords_array;
+  PetscReal         ****u_array = NULL,****vel_array = NULL,****u_diff_array = NULL,****f_array = NULL;
+  PetscReal         ***v_array,***theta_array = NULL,***thetaRef_array = NULL,***pressure_array = NULL;
+  PetscReal         ***press_diff_array = NULL,***src_array = NULL,***m_inv_array = NULL,***w_array = NULL;
+  PetscReal         ***volcrackopening_array = NULL,***volleakoffrate_array = NULL;
+  Vec               v_local,u_local = NULL,vel_local = NULL,theta_local = NULL,thetaRef_local = NULL;
+  Vec               pressure_local = NULL,Pressure_diff = NULL,press_diff_local = NULL;
+  Vec               U_diff = NULL,u_diff_local = NULL,src_local = NULL,m_inv_local = NULL,w_local = NULL;
+  Vec               f_local = NULL;
+  Vec               CellVolCrackOpening = NULL,CellVolLeakoffRate = NULL;
+  
+  PetscFunctionBegin;
+  timestepsize = ctx->timevalue;
+  ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
+                     NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
+  ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
+  for (d = 0; d < VFDIAG_NUM; d++) {
+    diag->myValue[d] = 0.;
+    diag->sum[d]     = 0.;
+    diag->value[d]   = 0.;
+  }
+  /*
+    When U is the current superposition of the two elementary solutions, the crack volume and the 
+    energies of U are known in closed form, as in VolumetricCrackOpening and VF_UEnergy3D
+  */
+  if (ctx->USuperposition) {
+    ierr = VF_USuperpositionIsCurrent(fields->U,ctx,&usup);CHKERRQ(ierr);
+  }
+  if (usup) {
+    p = ctx->USup.p;
+    if (req[VFDIAG_CRACKVOLUME]) {
+      diag->value[VFDIAG_CRACKVOLUME] = ctx->USup.CrackVolume[0] + p * ctx->USup.CrackVolume[1];
+      ierr = VecWAXPY(fields->VolCrackOpening,p,ctx->USup.VolCrackOpening1,ctx->USup.VolCrackOpening0);CHKERRQ(ierr);
+    }
+    if (req[VFDIAG_ELASTICENERGY]) {
+      diag->value[VFDIAG_ELASTICENERGY] = ctx->USup.ElasticEnergy[0] + p * (ctx->USup.ElasticEnergy[1] + p * ctx->USup.ElasticEnergy[2]);
+    }
+    if (req[VFDIAG_INSITUWORK]) {
+      diag->value[VFDIAG_INSITUWORK] = ctx->USup.InsituWork[0] + p * (ctx->USup.InsituWork[1] + p * ctx->USup.InsituWork[2]);
+    }
+    if (req[VFDIAG_PRESSUREWORK]) {
+      diag->value[VFDIAG_PRESSUREWORK] = ctx->USup.PressureWork[0] + p * (ctx->USup.PressureWork[1] + p * ctx->USup.PressureWork[2]);
+    }
+  }
+  /*
+    Energies accumulated by the last U and V residuals (-residual_energy), if still current
+  */
+  ierr = VF_UResidualEnergyIsCurrent(fields->U,ctx,&ures);CHKERRQ(ierr);
+  if (ures && !usup) {
+    if (req[VFDIAG_ELASTICENERGY]) diag->value[VFDIAG_ELASTICENERGY] = ctx->REnergy.UWork[0];
+    if (req[VFDIAG_PRESSUREWORK])  diag->value[VFDIAG_PRESSUREWORK]  = ctx->REnergy.UWork[1];
+    if (req[VFDIAG_INSITUWORK])    diag->value[VFDIAG_INSITUWORK]    = ctx->REnergy.UWork[2];
+  }
+  ierr = VF_VResidualEnergyIsCurrent(fields->V,ctx,&vres);CHKERRQ(ierr);
+  if (vres && req[VFDIAG_SURFACEENERGY]) {
+    diag->value[VFDIAG_SURFACEENERGY] = ctx->REnergy.SurfaceEnergy;
+  }
+  ures         = (PetscBool)(usup || ures);
+  needCellU    = (PetscBool)(!ures && (req[VFDIAG_ELASTICENERGY] || req[VFDIAG_INSITUWORK] || req[VFDIAG_PRESSUREWORK]));
+  needU        = (PetscBool)(needCellU || (!usup && req[VFDIAG_CRACKVOLUME]));
+  needVel      = (PetscBool)(req[VFDIAG_LEAKOFF] || req[VFDIAG_DIVVOLUME] || req[VFDIAG_SURFVOLUME]);
+  needTheta    = (PetscBool)(!ures && req[VFDIAG_ELASTICENERGY]);
+  needPressure = (PetscBool)(needTheta || (!ures && req[VFDIAG_PRESSUREWORK] && ctx->hasCrackPressure));
+  needSurface  = (PetscBool)(!vres && req[VFDIAG_SURFACEENERGY]);
+  batchElastic = (PetscBool)(needTheta && ctx->unilateral == UNILATERAL_NONE);
+  
+  ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
+  ierr = DMDAGetBoundingBox(ctx->daVect,BBmin,BBmax);CHKERRQ(ierr);
+  /*
+    Start all the ghost updates, then complete them, so that the messages overlap
+  */
+  if (req[VFDIAG_MODULUSVOLUME]) {
+    ierr = DMGetGlobalVector(ctx->daScal,&Pressure_diff);CHKERRQ(ierr);
+    ierr = VecWAXPY(Pressure_diff,-1.0,ctx->pressure_old,fields->pressure);CHKERRQ(ierr);
+  }
+  if (req[VFDIAG_STRAINVOLUME] && ctx->FlowDisplCoupling) {
+    ierr = DMGetGlobalVector(ctx->daVect,&U_diff);CHKERRQ(ierr);
+    ierr = VecWAXPY(U_diff,-1.0,ctx->U_old,fields->U);CHKERRQ(ierr);
+  }
+  ierr = DMGetLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
+  ierr = DMGlobalToLocalBegin(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  if (needU) {
+    ierr = DMGetLocalVector(ctx->daVect,&u_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daVect,fields->U,INSERT_VALUES,u_local);CHKERRQ(ierr);
+  }
+  if (needVel) {
+    ierr = DMGetLocalVector(ctx->daVect,&vel_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daVect,fields->velocity,INSERT_VALUES,vel_local);CHKERRQ(ierr);
+  }
+  if (needTheta) {
+    ierr = DMGetLocalVector(ctx->daScal,&theta_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daScal,fields->theta,INSERT_VALUES,theta_local);CHKERRQ(ierr);
+    ierr = DMGetLocalVector(ctx->daScal,&thetaRef_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daScal,fields->thetaRef,INSERT_VALUES,thetaRef_local);CHKERRQ(ierr);
+  }
+  if (needPressure) {
+    ierr = DMGetLocalVector(ctx->daScal,&pressure_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daScal,fields->pressure,INSERT_VALUES,pressure_local);CHKERRQ(ierr);
+  }
+  if (Pressure_diff) {
+    ierr = DMGetLocalVector(ctx->daScal,&press_diff_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daScal,Pressure_diff,INSERT_VALUES,press_diff_local);CHKERRQ(ierr);
+    ierr = DMGetLocalVector(ctx->daScalCell,&m_inv_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daScalCell,ctx->M_inv,INSERT_VALUES,m_inv_local);CHKERRQ(ierr);
+  }
+  if (U_diff) {
+    ierr = DMGetLocalVector(ctx->daVect,&u_diff_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daVect,U_diff,INSERT_VALUES,u_diff_local);CHKERRQ(ierr);
+  }
+  if (req[VFDIAG_SOURCEVOLUME] && ctx->hasFluidSources) {
+    ierr = DMGetLocalVector(ctx->daScal,&src_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daScal,ctx->Source,INSERT_VALUES,src_local);CHKERRQ(ierr);
+  }
+  if (req[VFDIAG_WIDTHVOLUME]) {
+    ierr = DMGetLocalVector(ctx->daScalCell,&w_local);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalBegin(ctx->daScalCell,fields->widthc,INSERT_VALUES,w_local);CHKERRQ(ierr);
+  }
+  
+  ierr = DMGlobalToLocalEnd(ctx->daScal,fields->V,INSERT_VALUES,v_local);CHKERRQ(ierr);
+  ierr = DMDAVecGetArray(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
+  if (u_local) {
+    ierr = DMGlobalToLocalEnd(ctx->daVect,fields->U,INSERT_VALUES,u_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArrayDOF(ctx->daVect,u_local,&u_array);CHKERRQ(ierr);
+  }
+  if (vel_local) {
+    ierr = DMGlobalToLocalEnd(ctx->daVect,fields->velocity,INSERT_VALUES,vel_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArrayDOF(ctx->daVect,vel_local,&vel_array);CHKERRQ(ierr);
+  }
+  if (theta_local) {
+    ierr = DMGlobalToLocalEnd(ctx->daScal,fields->theta,INSERT_VALUES,theta_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArray(ctx->daScal,theta_local,&theta_array);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalEnd(ctx->daScal,fields->thetaRef,INSERT_VALUES,thetaRef_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArray(ctx->daScal,thetaRef_local,&thetaRef_array);CHKERRQ(ierr);
+  }
+  if (pressure_local) {
+    ierr = DMGlobalToLocalEnd(ctx->daScal,fields->pressure,INSERT_VALUES,pressure_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArray(ctx->daScal,pressure_local,&pressure_array);CHKERRQ(ierr);
+  }
+  if (press_diff_local) {
+    ierr = DMGlobalToLocalEnd(ctx->daScal,Pressure_diff,INSERT_VALUES,press_diff_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArray(ctx->daScal,press_diff_local,&press_diff_array);CHKERRQ(ierr);
+    ierr = DMGlobalToLocalEnd(ctx->daScalCell,ctx->M_inv,INSERT_VALUES,m_inv_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArray(ctx->daScalCell,m_inv_local,&m_inv_array);CHKERRQ(ierr);
+  }
+  if (u_diff_local) {
+    ierr = DMGlobalToLocalEnd(ctx->daVect,U_diff,INSERT_VALUES,u_diff_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArrayDOF(ctx->daVect,u_diff_local,&u_diff_array);CHKERRQ(ierr);
+  }
+  if (src_local) {
+    ierr = DMGlobalToLocalEnd(ctx->daScal,ctx->Source,INSERT_VALUES,src_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArray(ctx->daScal,src_local,&src_array);CHKERRQ(ierr);
+  }
+  if (w_local) {
+    ierr = DMGlobalToLocalEnd(ctx->daScalCell,fields->widthc,INSERT_VALUES,w_local);CHKERRQ(ierr);
+    ierr = DMDAVecGetArray(ctx->daScalCell,w_local,&w_array);CHKERRQ(ierr);
+  }
+  if (needCellU && req[VFDIAG_INSITUWORK] && ctx->hasInsitu) {
+    ierr = DMGetLocalVector(ctx->daVect,&f_local);CHKERRQ(ierr);
+    ierr = VecSet(f_local,0.);CHKERRQ(ierr);
+    ierr = DMDAVecGetArrayDOF(ctx->daVect,f_local,&f_array);CHKERRQ(ierr);
+  }
+  /*
+    Cell fields of the crack opening and leak-off. The owned cells are written directly in the global Vecs.
+  */
+  if (req[VFDIAG_CRACKVOLUME] && !usup) {
+    ierr = DMGetGlobalVector(ctx->daScalCell,&CellVolCrackOpening);CHKERRQ(ierr);
+    ierr = VecSet(CellVolCrackOpening,0.);CHKERRQ(ierr);
+    ierr = DMDAVecGetArray(ctx->daScalCell,CellVolCrackOpening,&volcrackopening_array);CHKERRQ(ierr);
+  }
+  if (req[VFDIAG_LEAKOFF]) {
+    ierr = DMGetGlobalVector(ctx->daScalCell,&CellVolLeakoffRate);CHKERRQ(ierr);
+    ierr = VecSet(CellVolLeakoffRate,0.);CHKERRQ(ierr);
+    ierr = DMDAVecGetArray(ctx->daScalCell,CellVolLeakoffRate,&volleakoffrate_array);CHKERRQ(ierr);
+  }
+  ierr = VFDamageBandUpdate(ctx,fields->V);CHKERRQ(ierr);
+  
+  /*
+    Row batched elastic energy and surface energy, shared among the OpenMP threads, if any
+  */
+  if (batchElastic || needSurface) {
+    VFPragmaOMP(parallel for collapse(2) private(ei,e3D) reduction(+:myElasticEnergy,mySurfaceEnergy,flops))
+    for (ek = zs; ek < zs+zm; ek++) {
+      for (ej = ys; ej < ys+ym; ej++) {
+        if (batchElastic) {
+          VF_ElasticEnergyRowBatch_Kernel(&myElasticEnergy,u_array,v_array,theta_array,thetaRef_array,pressure_array,
+                                          ctx,ek,ej,xs,xs+xm,&flops);
+        }
+        if (needSurface) {
+          for (ei = xs; ei < xs+xm; ei++) {
+            VFCartFEElementCacheGet3D_Kernel(ctx->feCacheV,ei,ej,ek,&e3D);
+            switch (ctx->vfprop.atnum) {
+              case 1:
+                VF_AT1SurfaceEnergy3D_Kernel(&mySurfaceEnergy,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3D);
+                break;
+              case 2:
+                VF_AT2SurfaceEnergy3D_Kernel(&mySurfaceEnergy,v_array,&ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3D);
+                break;
+            }
+          }
+        }
+      }
+    }
+  }
+  
+  /*
+    All the other element integrals of the volume, in one sweep over the local cells shared among the 
+    OpenMP threads, if any. i is the index of the cell in ctx->bandMask.
+  */
+  VFPragmaOMP(parallel for collapse(2) private(ei,i,e3D,e3DU,myLocal) reduction(+:myCrackVolume,myLeakOff,myWidthVolume,myModulusVolume,myDivVolume,mySourceVolume,myStrainVolume,myPressureWork,flops))
+  for (ek = zs; ek < zs+zm; ek++) {
+    for (ej = ys; ej < ys+ym; ej++) {
+      for (ei = xs; ei < xs+xm; ei++) {
+        i = ((ek-zs)*ym+ej-ys)*xm+ei-xs;
+        VFCartFEElementCacheGet3D_Kernel(ctx->feCache,ei,ej,ek,&e3D);
+        if (ctx->bandMask[i]) {
+          if (volcrackopening_array) {
+            VolumetricCrackOpening3D_Kernel(&myLocal,volcrackopening_array,u_array,v_array,ek,ej,ei,e3D);
+            myCrackVolume += myLocal;
+          }
+          if (volleakoffrate_array) {
+            VolumetricCrackOpening3DCC_Kernel(&myLocal,volleakoffrate_array,NULL,vel_array,v_array,ek,ej,ei,e3D);
+            myLeakOff += myLocal;
+          }
+          if (w_array) {
+            VolumeFromWidth_Kernel(&myLocal,w_array[ek][ej][ei],v_array,ek,ej,ei,e3D);
+            myWidthVolume += myLocal;
+          }
+        }
+        if (press_diff_array) {
+          ModulusVolume_Kernel(&myLocal,ek,ej,ei,e3D,m_inv_array[ek][ej][ei],press_diff_array,v_array);
+          myModulusVolume += myLocal;
+        }
+        if (req[VFDIAG_DIVVOLUME]) {
+          DivergenceVolume_Kernel(&myLocal,ek,ej,ei,e3D,vel_array,v_array);
+          myDivVolume += myLocal;
+        }
+        if (src_array) {
+          SourceVolume_Kernel(&myLocal,ek,ej,ei,e3D,src_array,v_array);
+          mySourceVolume += myLocal;
+        }
+        if (u_diff_array) {
+          VolumetricStrainVolume_Kernel(&myLocal,ek,ej,ei,e3D,&ctx->matprop[ctx->layer[ek]],u_diff_array,v_array);
+          myStrainVolume += myLocal;
+        }
+        if (needCellU && req[VFDIAG_PRESSUREWORK] && ctx->hasCrackPressure) {
+          VFCartFEElementCacheGet3D_Kernel(ctx->feCacheU,ei,ej,ek,&e3DU);
+          VF_PressureWork3D_Kernel(&myPressureWork,u_array,v_array,pressure_array,
+                                   &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3DU,&flops);
+        }
+      }
+    }
+  }
+  ierr = PetscLogFlops(flops);CHKERRQ(ierr);
+  diag->myValue[VFDIAG_ELASTICENERGY] = myElasticEnergy;
+  diag->myValue[VFDIAG_SURFACEENERGY] = mySurfaceEnergy;
+  diag->myValue[VFDIAG_CRACKVOLUME]   = myCrackVolume;
+  diag->myValue[VFDIAG_LEAKOFF]       = timestepsize*myLeakOff;
+  diag->myValue[VFDIAG_WIDTHVOLUME]   = myWidthVolume;
+  diag->myValue[VFDIAG_MODULUSVOLUME] = myModulusVolume;
+  diag->myValue[VFDIAG_DIVVOLUME]     = timestepsize*myDivVolume;
+  diag->myValue[VFDIAG_SOURCEVOLUME]  = timestepsize*mySourceVolume;
+  diag->myValue[VFDIAG_STRAINVOLUME]  = myStrainVolume;
+  diag->myValue[VFDIAG_PRESSUREWORK]  = myPressureWork;
+  
+  /*
+    Boundary faces, unilateral elastic energy and in-situ work, cell by cell
+  */
+  if (req[VFDIAG_SURFVOLUME] || needCellU) {
+    for (ek = zs; ek < zs+zm; ek++) {
+      for (ej = ys; ej < ys+ym; ej++) {
+        for (ei = xs; ei < xs+xm; ei++) {
+          if (req[VFDIAG_SURFVOLUME]) {
+            onface[0] = (PetscBool)(ei == 0); onface[1] = (PetscBool)(ei == nx-1);
+            onface[2] = (PetscBool)(ej == 0); onface[3] = (PetscBool)(ej == ny-1);
+            onface[4] = (PetscBool)(ek == 0); onface[5] = (PetscBool)(ek == nz-1);
+            for (d = 0; d < 6; d++) {
+              if (onface[d]) {
+                ierr = VFCartFEElementCacheGet2D(ctx->feCache,bface[d],ei,ej,ek,&e2D);CHKERRQ(ierr);
+                ierr = SurfaceFluxVolume_local(&myLocal,ek,ej,ei,bface[d],e2D,vel_array,v_array);CHKERRQ(ierr);
+                diag->myValue[VFDIAG_SURFVOLUME] += timestepsize*myLocal;
+              }
+            }
+          }
+          if (needCellU) {
+            ierr = VFCartFEElementCacheGet3D(ctx->feCacheU,ei,ej,ek,&e3DU);CHKERRQ(ierr);
+            if (req[VFDIAG_ELASTICENERGY] && ctx->unilateral == UNILATERAL_NOCOMPRESSION) {
+              ierr = VF_ElasticEnergyNoCompression3D_local(&myLocal,u_array,v_array,theta_array,thetaRef_array,pressure_array,
+                                                           &ctx->matprop[ctx->layer[ek]],&ctx->vfprop,ek,ej,ei,e3DU);CHKERRQ(ierr);
+              diag->myValue[VFDIAG_ELASTICENERGY] += myLocal;
+            }
+            if (f_array) {
+              ierr = VF_InSituStressWorkCell_local(&diag->myValue[VFDIAG_INSITUWORK],u_array,f_array,coords_array,BBmin,BBmax,
+                                                   ctx,nx,ny,nz,ek,ej,ei,e3DU);CHKERRQ(ierr);
+            }
+          }
+        }
+      }
+    }
+  }
+  diag->SumWellRate = 0.;
+  for (i = 0; i < ctx->numWells; i++) {
+    if (ctx->well[i].type == INJECTOR) {
+      diag->SumWellRate += timestepsize*ctx->well[i].Qw;
+    } else {
+      diag->SumWellRate -= timestepsize*ctx->well[i].Qw;
+    }
+  }
+  /*
+    Single reduction of all the diagnostics. It completes in VFDiagnosticsEnd while the nodal
+    interpolations below proceed.
+  */
+#if defined(PETSC_HAVE_MPI_NONBLOCKING_COLLECTIVES)
+  ierr = MPI_Iallreduce(diag->myValue,diag->sum,VFDIAG_NUM,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD,&diag->request);CHKERRQ(ierr);
+  diag->pending = PETSC_TRUE;
+#else
+  ierr = MPI_Allreduce(diag->myValue,diag->sum,VFDIAG_NUM,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  diag->pending = PETSC_FALSE;
+#endif
+  
+  ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
+  ierr = DMDAVecRestoreArray(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
+  ierr = DMRestoreLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
+  if (u_local) {
+    ierr = DMDAVecRestoreArrayDOF(ctx->daVect,u_local,&u_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daVect,&u_local);CHKERRQ(ierr);
+  }
+  if (vel_local) {
+    ierr = DMDAVecRestoreArrayDOF(ctx->daVect,vel_local,&vel_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daVect,&vel_local);CHKERRQ(ierr);
+  }
+  if (theta_local) {
+    ierr = DMDAVecRestoreArray(ctx->daScal,theta_local,&theta_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daScal,&theta_local);CHKERRQ(ierr);
+    ierr = DMDAVecRestoreArray(ctx->daScal,thetaRef_local,&thetaRef_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daScal,&thetaRef_local);CHKERRQ(ierr);
+  }
+  if (pressure_local) {
+    ierr = DMDAVecRestoreArray(ctx->daScal,pressure_local,&pressure_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daScal,&pressure_local);CHKERRQ(ierr);
+  }
+  if (press_diff_local) {
+    ierr = DMDAVecRestoreArray(ctx->daScal,press_diff_local,&press_diff_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daScal,&press_diff_local);CHKERRQ(ierr);
+    ierr = DMRestoreGlobalVector(ctx->daScal,&Pressure_diff);CHKERRQ(ierr);
+    ierr = DMDAVecRestoreArray(ctx->daScalCell,m_inv_local,&m_inv_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daScalCell,&m_inv_local);CHKERRQ(ierr);
+  }
+  if (u_diff_local) {
+    ierr = DMDAVecRestoreArrayDOF(ctx->daVect,u_diff_local,&u_diff_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daVect,&u_diff_local);CHKERRQ(ierr);
+    ierr = DMRestoreGlobalVector(ctx->daVect,&U_diff);CHKERRQ(ierr);
+  }
+  if (src_local) {
+    ierr = DMDAVecRestoreArray(ctx->daScal,src_local,&src_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daScal,&src_local);CHKERRQ(ierr);
+  }
+  if (w_local) {
+    ierr = DMDAVecRestoreArray(ctx->daScalCell,w_local,&w_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daScalCell,&w_local);CHKERRQ(ierr);
+  }
+  if (f_local) {
+    ierr = DMDAVecRestoreArrayDOF(ctx->daVect,f_local,&f_array);CHKERRQ(ierr);
+    ierr = DMRestoreLocalVector(ctx->daVect,&f_local);CHKERRQ(ierr);
+  }
+  if (CellVolCrackOpening) {
+    ierr = DMDAVecRestoreArray(ctx->daScalCell,CellVolCrackOpening,&volcrackopening_array);CHKERRQ(ierr);
+    ierr = VecSet(fields->VolCrackOpening,0.);CHKERRQ(ierr);
+    ierr = CellToNodeInterpolation(fields->VolCrackOpening,CellVolCrackOpening,ctx);CHKERRQ(ierr);
+    ierr = DMRestoreGlobalVector(ctx->daScalCell,&CellVolCrackOpening);CHKERRQ(ierr);
+  }
+  if (CellVolLeakoffRate) {
+    ierr = DMDAVecRestoreArray(ctx->daScalCell,CellVolLeakoffRate,&volleakoffrate_array);CHKERRQ(ierr);
+    ierr = VecSet(fields->VolLeakOffRate,0.);CHKERRQ(ierr);
+    ierr = CellToNodeInterpolation(fields->VolLeakOffRate,CellVolLeakoffRate,ctx);CHKERRQ(ierr);
+    ierr = DMRestoreGlobalVector(ctx->daScalCell,&CellVolLeakoffRate);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "VFDiagnosticsEnd"
+/*
+  VFDiagnosticsEnd: completes the reduction started by VFDiagnosticsBegin
+*/
+extern PetscErrorCode VFDiagnosticsEnd(VFDiagnostics *diag)
+{
+  PetscErrorCode ierr;
+  PetscInt       d;
+  
+  PetscFunctionBegin;
+  if (diag->pending) {
+    ierr = MPI_Wait(&diag->request,MPI_STATUS_IGNORE);CHKERRQ(ierr);
+    diag->pending = PETSC_FALSE;
+  }
+  for (d = 0; d < VFDIAG_NUM; d++) {
+    diag->value[d] += diag->sum[d];
+  }
+  PetscFunctionReturn(0);
+}
+
 #undef __FUNCT__
 #define __FUNCT__ "UpdatePermeablitysingMultipliers"
 extern PetscErrorCode UpdatePermeablitysingMultipliers(VFCtx *ctx, VFFields *fields)
 {
   PetscErrorCode  ierr;
+  VFCartFEElement3D *e3D;
   PetscInt        ek, ej, ei;
   PetscInt        xs,xm,nx;
   PetscInt        ys,ym,ny;
@@ -2084,7 +3239,7 @@ extern PetscErrorCode UpdatePermeablitysingMultipliers(VFCtx *ctx, VFFields *fie
         hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
         hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
         hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-        ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
+        ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
         ierr = CartFEElement3DInit(&ctx->s3D,hx/2.,hy/2.,hz/2.,hx,hy,hz);CHKERRQ(ierr);
         ierr = ComputeAverageVlocal(&ave_V, v_array, ek, ej, ei, &ctx->s3D);CHKERRQ(ierr);
         if(ave_V < ctx->pmult_vtol){
@@ -11,6 +11,44 @@
   Rename and check if all these need to be public
 */
 
+/*
+  Number of cell centred fields sampled by the width integration: ave V, grad V[3], normal[3], u[3]
+*/
+#define VF_WIDTHCACHE_NC 10
+
+/*
+  Scalars computed by the end of step diagnostics (VFDiagnosticsBegin / VFDiagnosticsEnd)
+*/
+typedef enum {
+  VFDIAG_CRACKVOLUME,
+  VFDIAG_LEAKOFF,
+  VFDIAG_WIDTHVOLUME,
+  VFDIAG_MODULUSVOLUME,
+  VFDIAG_DIVVOLUME,
+  VFDIAG_SURFVOLUME,
+  VFDIAG_SOURCEVOLUME,
+  VFDIAG_STRAINVOLUME,
+  VFDIAG_ELASTICENERGY,
+  VFDIAG_INSITUWORK,
+  VFDIAG_PRESSUREWORK,
+  VFDIAG_SURFACEENERGY,
+  VFDIAG_NUM
+} VFDiagnostic;
+
+typedef struct {
+  PetscBool   requested[VFDIAG_NUM];
+  PetscReal   myValue[VFDIAG_NUM];      /* contribution of this processor             */
+  PetscReal   sum[VFDIAG_NUM];          /* reduced contributions                      */
+  PetscReal   value[VFDIAG_NUM];        /* diagnostics, valid after VFDiagnosticsEnd  */
+  PetscReal   SumWellRate;
+  MPI_Request request;
+  PetscBool   pending;
+} VFDiagnostics;
+
+extern PetscErrorCode VFDamageBandUpdate(VFCtx *ctx,Vec V);
+extern PetscErrorCode VFDamageBandDestroy(VFCtx *ctx);
+extern PetscErrorCode VFDiagnosticsBegin(VFDiagnostics *diag,VFCtx *ctx,VFFields *fields);
+extern PetscErrorCode VFDiagnosticsEnd(VFDiagnostics *diag);
 extern PetscErrorCode VFCheckVolumeBalance(PetscReal *ModulusVolume, PetscReal *DivVolume, PetscReal *SurfVolume, PetscReal *SumWellRate,PetscReal *SumSourceRate,PetscReal *VolStrainVolume,VFCtx *ctx, VFFields *fields);
 extern PetscErrorCode VolumetricFunction_local(PetscReal *Function_local, PetscReal ***pmult_array, PetscReal ****u_array, PetscReal ***v_array, PetscInt ek, PetscInt ej, PetscInt ei, VFCartFEElement3D *e);
 extern PetscErrorCode CellToNodeInterpolation(Vec node_vec,Vec cell_vec,VFCtx *ctx);
@@ -411,12 +411,11 @@ extern PetscErrorCode VFRegDiracDeltaFunction(Vec RegV,VFWell *well, Vec V,Petsc
 extern PetscErrorCode VFRegRateScalingFactor(PetscReal *InjectedVolume, Vec Rate, Vec V, VFCtx *ctx)
 {
 	PetscErrorCode  ierr;
+	VFCartFEElement3D *e3D;
 	PetscInt		    ek, ej, ei;
 	PetscInt		    xs,xm,nx;
 	PetscInt		    ys,ym,ny;
 	PetscInt		    zs,zm,nz;
-	PetscReal		    hx,hy,hz;
-	PetscReal       ****coords_array;
 	PetscReal       ***regrate_array;
 	Vec             regrate_local;
 	PetscReal       ***v_array;
@@ -427,7 +426,6 @@ extern PetscErrorCode VFRegRateScalingFactor(PetscReal *InjectedVolume, Vec Rate
   ierr = DMDAGetInfo(ctx->daScalCell,NULL,&nx,&ny,&nz,NULL,NULL,NULL,
                      NULL,NULL,NULL,NULL,NULL,NULL);CHKERRQ(ierr);
 	ierr = DMDAGetCorners(ctx->daScalCell,&xs,&ys,&zs,&xm,&ym,&zm);CHKERRQ(ierr);
-	ierr = DMDAVecGetArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
 	
 	ierr = DMGetLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
 	ierr = DMGlobalToLocalBegin(ctx->daScal,V,INSERT_VALUES,v_local);CHKERRQ(ierr);
@@ -443,18 +441,14 @@ extern PetscErrorCode VFRegRateScalingFactor(PetscReal *InjectedVolume, Vec Rate
 	for (ek = zs; ek < zs+zm; ek++) {
 		for (ej = ys; ej < ys+ym; ej++) {
 			for (ei = xs; ei < xs+xm; ei++) {
-				hx = coords_array[ek][ej][ei+1][0]-coords_array[ek][ej][ei][0];
-				hy = coords_array[ek][ej+1][ei][1]-coords_array[ek][ej][ei][1];
-				hz = coords_array[ek+1][ej][ei][2]-coords_array[ek][ej][ei][2];
-				ierr = VFCartFEElement3DInit(&ctx->e3D,hx,hy,hz);CHKERRQ(ierr);
-				ierr = VolumetricFractureWellRate_local(&myInjVolumeRateLocal, regrate_array, v_array, ek, ej, ei, &ctx->e3D);CHKERRQ(ierr);
+				ierr = VFCartFEElementCacheGet3D(ctx->feCache,ei,ej,ek,&e3D);CHKERRQ(ierr);
+				ierr = VolumetricFractureWellRate_local(&myInjVolumeRateLocal, regrate_array, v_array, ek, ej, ei, e3D);CHKERRQ(ierr);
         myInjVolumeRate += myInjVolumeRateLocal;
 			}
 		}
 	}
 	ierr = MPI_Allreduce(&myInjVolumeRate,InjectedVolume,1,MPIU_SCALAR,MPI_SUM,PETSC_COMM_WORLD);CHKERRQ(ierr);
   
-	ierr = DMDAVecRestoreArrayDOF(ctx->daVect,ctx->coordinates,&coords_array);CHKERRQ(ierr);
 	ierr = DMDAVecRestoreArray(ctx->daScal,v_local,&v_array);CHKERRQ(ierr);
 	ierr = DMRestoreLocalVector(ctx->daScal,&v_local);CHKERRQ(ierr);
   
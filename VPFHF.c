@@ -30,7 +30,7 @@ int main(int argc,char **argv)
   PetscReal       pmax;
   PetscReal       InjVolrate, Q_inj;
   PetscReal       crackvolume_old = 0;
-  PetscReal       vol,vol1,vol2,vol3,vol4,vol5;
+  PetscReal       vol,vol2,vol5;
   PetscReal       p = 1e-6;
   PetscInt        altminit = 0;
   PetscReal       pw = 0,pw_old = 0;
@@ -38,6 +38,8 @@ int main(int argc,char **argv)
   PetscReal       volume;
   PetscReal       errV=1e+10;
   PetscReal       time_shutin=1e+10;
+  VFDiagnostics   diag;
+  PetscInt        i;
 
 
 	ierr = PetscInitialize(&argc,&argv,(char*)0,banner);CHKERRQ(ierr);
@@ -106,9 +108,15 @@ int main(int argc,char **argv)
      }
      while(errV >= ctx.altmintol  && altminit <= ctx.altminmaxit);
 
-    ierr = VolumetricLeakOffRate(&ctx.LeakOffRate,&ctx,&fields);CHKERRQ(ierr);
-    ierr = VolumeFromWidth(&volume, &ctx, &fields);CHKERRQ(ierr);
-    ierr = VFCheckVolumeBalance(&vol,&vol1,&vol2,&vol3,&vol4,&vol5,&ctx,&fields);CHKERRQ(ierr);
+    /*
+      End of step diagnostics, in one sweep. The crack volume reported is the one of the U-P loop and 
+      the divergence and source volumes are not reported.
+    */
+    for (i = 0; i < VFDIAG_NUM; i++) diag.requested[i] = PETSC_TRUE;
+    diag.requested[VFDIAG_CRACKVOLUME]  = PETSC_FALSE;
+    diag.requested[VFDIAG_DIVVOLUME]    = PETSC_FALSE;
+    diag.requested[VFDIAG_SOURCEVOLUME] = PETSC_FALSE;
+    ierr = VFDiagnosticsBegin(&diag,&ctx,&fields);CHKERRQ(ierr);
     ierr = VecCopy(fields.VelnPress,ctx.PreFlowFields);CHKERRQ(ierr);
     ierr = VecCopy(ctx.RHSVelP,ctx.RHSVelPpre);CHKERRQ(ierr);
     ierr = VecCopy(fields.pressure,ctx.pressure_old);CHKERRQ(ierr);
@@ -118,12 +126,16 @@ int main(int argc,char **argv)
     ierr = VecCopy(fields.widthc,ctx.widthc_old);CHKERRQ(ierr);
     ierr = VecCopy(fields.V,fields.VIrrev);CHKERRQ(ierr);
     ierr = VecMax(fields.pressure,NULL,&pmax);CHKERRQ(ierr);
-    ctx.ElasticEnergy = 0;
-    ctx.InsituWork    = 0;
-    ctx.PressureWork  = 0.;
-    ctx.SurfaceEnergy = 0.;
-    ierr = VF_UEnergy3D(&ctx.ElasticEnergy,&ctx.InsituWork,&ctx.PressureWork,fields.U,&ctx);CHKERRQ(ierr);
-    ierr = VF_VEnergy3D(&ctx.SurfaceEnergy,&fields,&ctx);CHKERRQ(ierr);
+    ierr = VFDiagnosticsEnd(&diag);CHKERRQ(ierr);
+    ctx.LeakOffRate   = diag.value[VFDIAG_LEAKOFF];
+    volume            = diag.value[VFDIAG_WIDTHVOLUME];
+    vol               = diag.value[VFDIAG_MODULUSVOLUME];
+    vol2              = diag.value[VFDIAG_SURFVOLUME];
+    vol5              = diag.value[VFDIAG_STRAINVOLUME];
+    ctx.ElasticEnergy = diag.value[VFDIAG_ELASTICENERGY];
+    ctx.InsituWork    = diag.value[VFDIAG_INSITUWORK];
+    ctx.PressureWork  = diag.value[VFDIAG_PRESSUREWORK];
+    ctx.SurfaceEnergy = diag.value[VFDIAG_SURFACEENERGY];
     ctx.TotalEnergy   = ctx.ElasticEnergy - ctx.InsituWork - ctx.PressureWork + ctx.SurfaceEnergy;
     ierr = PetscViewerASCIIPrintf(viewer,"%d \t %e \t %e \t %e \t %e \t %e \t %e \t %e \t %e \t %e \t %e\n",ctx.timestep,ctx.timevalue,ctx.timestep*ctx.timevalue,pw,pmax,ctx.timevalue*Q_inj,ctx.CrackVolume,ctx.SurfaceEnergy,ctx.ElasticEnergy,ctx.PressureWork,ctx.TotalEnergy);CHKERRQ(ierr);
     ierr = VF_ComputeRegularizedFracturePressure(&ctx,&fields);